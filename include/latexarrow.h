@@ -0,0 +1,187 @@
+#pragma once
+
+/**
+ * @file latexarrow.h
+ * @brief Reader for Apache Arrow IPC data used as table rows.
+ * @note The reader is self-contained: it decodes the FlatBuffers metadata of the IPC
+ *       format itself and maps the file in memory, so no Arrow library is needed.
+ * @see https://arrow.apache.org/docs/format/Columnar.html#serialization-and-interprocess-communication-ipc
+ */
+
+#include "latexgen.h"
+
+namespace LatexGen
+{
+    /**
+     * @brief Typed read-only view of a column of an ArrowTable
+     *
+     * Values are read in place from the Arrow buffers, one chunk per record batch.
+     */
+    class ArrowColumn
+    {
+    public:
+        enum class Type
+        {
+            NULL_VALUE, // Column of the Arrow Null type (every value is missing)
+            INTEGER,    // Signed integer of 8 to 64 bits
+            UNSIGNED,   // Unsigned integer of 8 to 64 bits
+            FLOATING,   // Single or double precision
+            BOOLEAN,
+            STRING,     // Utf8 or LargeUtf8
+            DATE,       // Date32 (days) or Date64 (milliseconds), formatted as YYYY-MM-DD
+            TIMESTAMP   // Formatted as YYYY-MM-DD HH:MM:SS[.fraction] (time zone ignored)
+        };
+
+        const std::string &getName() const
+        {
+            return m_name;
+        }
+
+        Type getType() const
+        {
+            return m_type;
+        }
+
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        bool isNull(size_t row) const;
+
+        /**
+         * @brief Get an integer value (also the raw value of dates and timestamps)
+         */
+        int64_t getInt(size_t row) const;
+
+        uint64_t getUnsigned(size_t row) const;
+
+        double getDouble(size_t row) const;
+
+        bool getBool(size_t row) const;
+
+        /**
+         * @brief Get a string value, pointing into the Arrow data
+         */
+        std::string_view getString(size_t row) const;
+
+        /**
+         * @brief Append the text of a value (nothing for a missing value)
+         * @param row Row index
+         * @param out String the text is appended to
+         */
+        void format(size_t row, std::string &out) const;
+
+    private:
+        friend class ArrowTable;
+
+        /**
+         * @brief Buffers of the column in one record batch
+         */
+        struct Chunk
+        {
+            size_t firstRow;
+            size_t length;
+            const uint8_t *validity; // Null when every value is valid
+            const uint8_t *values;   // Values, or offsets for strings
+            const uint8_t *data;     // String bytes
+            size_t dataSize;
+        };
+
+        std::string m_name;
+        Type m_type = Type::NULL_VALUE;
+        unsigned m_width = 0; // Value size in bytes (offset size for strings)
+        unsigned m_unit = 0;  // Arrow DateUnit or TimeUnit
+        size_t m_size = 0;
+        std::vector<Chunk> m_chunks;
+
+        const Chunk &findChunk(size_t row, size_t &index) const;
+        int64_t readInt(const Chunk &chunk, size_t index) const;
+        std::string_view readString(const Chunk &chunk, size_t index) const;
+    };
+
+    /**
+     * @brief Table read from an Arrow IPC file or stream, usable as Table rows
+     *
+     * Files are memory-mapped and values are formatted only when the LaTeX table is
+     * generated, so large tables are never converted to strings as a whole:
+     *
+     * @code
+     * auto data = ArrowTable::open("results.arrow");
+     * auto table = document.addTable(data->getColumnNames(), "Results");
+     * table->setDataSource(data);
+     * @endcode
+     *
+     * Columns of nested, dictionary-encoded, decimal and other types without a
+     * text form here are left out. Compressed record batches are not supported.
+     */
+    class ArrowTable : public TableDataSource
+    {
+    public:
+        /**
+         * @brief Read an Arrow IPC file (.arrow) or stream (.arrows)
+         * @param path Path of the file
+         * @param error Receives the reason of a failure (may be null)
+         * @return Table, or nullptr if the file cannot be read
+         */
+        static std::shared_ptr<ArrowTable> open(const std::string &path, std::string *error = nullptr);
+
+        /**
+         * @brief Read Arrow IPC data held in memory (for example received from a pipe)
+         * @param data IPC file or stream content
+         * @param error Receives the reason of a failure (may be null)
+         * @return Table, or nullptr if the data cannot be read
+         */
+        static std::shared_ptr<ArrowTable> fromBuffer(std::string data, std::string *error = nullptr);
+
+        ArrowTable(const ArrowTable &) = delete;
+        ArrowTable &operator=(const ArrowTable &) = delete;
+        ~ArrowTable() override;
+
+        size_t getRowCount() const override
+        {
+            return m_rowCount;
+        }
+
+        size_t getColumnCount() const override
+        {
+            return m_columns.size();
+        }
+
+        const ArrowColumn &getColumn(size_t index) const
+        {
+            return m_columns[index];
+        }
+
+        /**
+         * @brief Find a column by name
+         * @return Column, or nullptr if there is none with this name
+         */
+        const ArrowColumn *findColumn(const std::string &name) const;
+
+        /**
+         * @brief Get the column names, to use as table headers
+         */
+        std::vector<std::string> getColumnNames() const;
+
+        void formatCell(size_t row, size_t column, std::string &out) const override
+        {
+            m_columns[column].format(row, out);
+        }
+
+        bool fingerprint(ContentHasher &hasher) const override;
+
+    private:
+        ArrowTable() = default;
+
+        const uint8_t *m_data = nullptr;
+        size_t m_size = 0;
+        void *m_mapping = nullptr; // Memory-mapped file, if any
+        std::string m_buffer;      // Data read in memory otherwise
+        std::vector<ArrowColumn> m_columns;
+        size_t m_rowCount = 0;
+
+        bool load(std::string &error);
+    };
+
+} // namespace LatexGen
@@ -0,0 +1,340 @@
+#pragma once
+
+/**
+ * @file latexbatch.h
+ * @brief Sharded rendering of large document batches by worker processes.
+ * @note Workers talk to the coordinator over TCP (POSIX systems); on other systems
+ *       only BatchWorker::renderShard() is available.
+ */
+
+#include "latexcompile.h"
+
+#include <chrono>
+#include <deque>
+
+namespace LatexGen
+{
+    /**
+     * @brief Description of one document of a batch
+     */
+    struct DocumentSpec
+    {
+        std::string name;                          // Output base name, unique in the batch (may contain '/')
+        std::string templateName;                  // Template file, relative to the worker template directory
+        std::string bibliography;                  // Shared .bib file, without extension (empty for none)
+        std::map<std::string, std::string> fields; // Template record (title, author, date and citations are also used by the document)
+    };
+
+    /**
+     * @brief Read a manifest of document specs
+     *
+     * A manifest is a tab-separated text file whose first line names the columns:
+     * the name, template and bibliography columns fill the spec fields of the same
+     * name, other columns are template fields. Tabs, newlines and backslashes in values
+     * are written \\t, \\n and \\\\. Empty lines and lines starting with # are skipped.
+     * Names, templates and bibliographies must be relative paths without .. components,
+     * so documents stay in the worker directories.
+     *
+     * @param path Manifest file
+     * @param specs Receives the specs, in file order
+     * @param error Receives the reason of a failure (may be null)
+     * @return true if the manifest was read
+     */
+    bool readManifest(const std::string &path, std::vector<DocumentSpec> &specs, std::string *error = nullptr);
+
+    /**
+     * @brief Outcome of one document of a batch
+     */
+    struct DocumentOutcome
+    {
+        std::string name;
+        bool success = false;
+        std::string output;    // Path of the written .tex or PDF file
+        size_t bytes = 0;      // Size of the output
+        std::string message;   // Reason of a failure
+        unsigned attempts = 0; // Dispatches of the document (set by the coordinator)
+    };
+
+    /**
+     * @brief Renders shards of a batch, keeping templates and bibliographies warm
+     *
+     * Templates are read and compiled once per worker, and each shared bibliography
+     * is linked (or copied) once into each output directory holding .tex files that
+     * use it, so later shards using them only pay for their own records. Documents
+     * are written as .tex files, or compiled to PDF when a compiler is set (compiled
+     * documents refer to the .bib file by its full path). A worker runs in its own process, most
+     * often on another node, and receives its shards from a BatchCoordinator:
+     *
+     * @code
+     * BatchWorker::Options options;
+     * options.templateDirectory = "templates";
+     * options.outputDirectory = "/shared/quarter-end";
+     * BatchWorker worker(options);
+     * return worker.serve("coordinator.example.com", 7070);
+     * @endcode
+     *
+     * A worker is used by one thread at a time.
+     */
+    class BatchWorker
+    {
+    public:
+        /**
+         * @brief Directories used by the worker
+         */
+        struct Options
+        {
+            std::string templateDirectory = ".";     // Directory of the template files
+            std::string bibliographyDirectory = "."; // Directory of the shared .bib files
+            std::string outputDirectory = "output";  // Directory the documents are written to
+        };
+
+        /**
+         * @brief Work done and avoided
+         */
+        struct Stats
+        {
+            size_t shards = 0;
+            size_t documents = 0;
+            size_t failures = 0;
+            size_t templatesLoaded = 0;      // Templates read and compiled
+            size_t templateHits = 0;         // Documents served by an already compiled template
+            size_t bibliographiesLoaded = 0; // Shared bibliographies found and loaded
+            size_t bibliographyHits = 0;     // Documents served by an already loaded bibliography
+            size_t bytesWritten = 0;
+            double seconds = 0;              // Time spent rendering shards
+        };
+
+        /**
+         * @brief Builds the document of a spec (nullptr and a reason on failure)
+         */
+        using Factory = std::function<std::shared_ptr<Document>(const DocumentSpec &spec, BatchWorker &worker,
+                                                                std::string &error)>;
+
+        BatchWorker();
+        explicit BatchWorker(Options options);
+
+        BatchWorker(const BatchWorker &) = delete;
+        BatchWorker &operator=(const BatchWorker &) = delete;
+
+        const Options &getOptions() const
+        {
+            return m_options;
+        }
+
+        /**
+         * @brief Build documents with a custom factory (nullptr for createDocument())
+         */
+        void setFactory(Factory factory)
+        {
+            m_factory = std::move(factory);
+        }
+
+        /**
+         * @brief Compile the documents to PDF (nullptr to write .tex files)
+         */
+        void setCompiler(std::shared_ptr<Compiler> compiler)
+        {
+            m_compiler = std::move(compiler);
+        }
+
+        /**
+         * @brief Get a compiled template, reading it on first use
+         * @param name Template file, relative to the template directory
+         * @return Template, or nullptr if the file cannot be read
+         */
+        std::shared_ptr<const ContentTemplate> getTemplate(const std::string &name);
+
+        /**
+         * @brief Get a shared bibliography, loading it on first use
+         *
+         * With a compiler, the bibliography names the .bib file by its full path.
+         * Otherwise it names the file relative to the document, and renderShard()
+         * stages the .bib file of the spec next to each .tex file it writes.
+         *
+         * @param name .bib file without extension, relative to the bibliography directory
+         * @return Bibliography (valid as long as the worker), or nullptr if the file is missing
+         */
+        const Bibliography *getBibliography(const std::string &name);
+
+        /**
+         * @brief Build the document of a spec with the default layout
+         *
+         * An article titled with the title, author and date fields, whose content is
+         * the template filled with the fields. With a bibliography, the keys of the
+         * citations field (comma-separated) are cited so the bibliography is printed.
+         *
+         * @param spec Document spec
+         * @param error Receives the reason of a failure
+         * @return Document, or nullptr on failure
+         */
+        std::shared_ptr<Document> createDocument(const DocumentSpec &spec, std::string &error);
+
+        /**
+         * @brief Render the documents of a shard
+         *
+         * A spec whose name, template or bibliography is absolute or has a ..
+         * component fails without being rendered (see readManifest()).
+         *
+         * @param specs Documents of the shard
+         * @return Outcomes, in spec order
+         */
+        std::vector<DocumentOutcome> renderShard(const std::vector<DocumentSpec> &specs);
+
+        /**
+         * @brief Connect to a coordinator and render the shards it sends
+         * @param host Host name or address of the coordinator
+         * @param port Port of the coordinator
+         * @return 0 when the coordinator ends the batch, 1 if the connection failed or was lost
+         */
+        int serve(const std::string &host, int port);
+
+        Stats getStats() const
+        {
+            return m_stats;
+        }
+
+    private:
+        Options m_options;
+        Factory m_factory;
+        std::shared_ptr<Compiler> m_compiler;
+        std::unordered_map<std::string, std::shared_ptr<const ContentTemplate>> m_templates;
+        std::unordered_map<std::string, std::unique_ptr<Bibliography>> m_bibliographies; // By .bib file argument
+        std::set<std::string> m_stagedBibliographies;                                    // .bib files staged
+        Stats m_stats;
+
+        bool stageBibliography(const std::string &name, const std::string &directory);
+    };
+
+    /**
+     * @brief Splits a batch into shards and dispatches them to workers
+     *
+     * The coordinator listens on a TCP port; workers connect to it (see
+     * BatchWorker::serve()) and are handed one shard at a time. Documents that fail,
+     * and shards held by a worker that disconnects or exceeds the shard timeout, are
+     * dispatched again in a new shard until the attempt limit. Outcomes and worker
+     * statistics are gathered by the coordinator:
+     *
+     * @code
+     * std::vector<DocumentSpec> specs;
+     * readManifest("quarter-end.tsv", specs);
+     * BatchCoordinator coordinator(std::move(specs));
+     * coordinator.listen("0.0.0.0", 7070);
+     * coordinator.run();
+     * BatchCoordinator::Stats stats = coordinator.getStats();
+     * @endcode
+     *
+     * Local worker processes can stand in for other nodes (see forkLocalWorkers()).
+     * The protocol has no authentication: listen on a trusted network only.
+     */
+    class BatchCoordinator
+    {
+    public:
+        /**
+         * @brief Sharding and retry settings
+         */
+        struct Options
+        {
+            size_t shardSize = 100;    // Documents per shard
+            unsigned maxAttempts = 3;  // Dispatches of a document before it is reported as failed
+            double shardTimeout = 600; // Seconds a worker may hold a shard (0 for no limit)
+            double workerWait = 30;    // Seconds to wait for a worker while shards are pending
+        };
+
+        /**
+         * @brief Batch counters
+         */
+        struct Stats
+        {
+            size_t shards = 0;      // Shards of the manifest
+            size_t dispatches = 0;  // Shards sent to workers, retries included
+            size_t retries = 0;     // Shards sent again (failed documents or lost workers)
+            size_t documents = 0;
+            size_t succeeded = 0;
+            size_t failed = 0;
+            size_t workers = 0;     // Worker connections
+            size_t workersLost = 0; // Connections closed while holding a shard
+            double seconds = 0;     // Wall-clock time of run()
+            BatchWorker::Stats work; // Sum of the statistics of the shards rendered
+        };
+
+        explicit BatchCoordinator(std::vector<DocumentSpec> specs);
+        BatchCoordinator(std::vector<DocumentSpec> specs, Options options);
+
+        /**
+         * @brief Destructor, closes the connections and waits for the local workers
+         */
+        ~BatchCoordinator();
+
+        BatchCoordinator(const BatchCoordinator &) = delete;
+        BatchCoordinator &operator=(const BatchCoordinator &) = delete;
+
+        /**
+         * @brief Start listening for workers
+         * @param host Address to listen on
+         * @param port Port (0 to pick a free one)
+         * @return Port listened on, or -1 on failure
+         */
+        int listen(const std::string &host = "127.0.0.1", int port = 0);
+
+        /**
+         * @brief Fork worker processes on this host
+         *
+         * Each child runs @p workerMain with the port listened on and exits with its
+         * return value (normally that of BatchWorker::serve()). Call after listen().
+         *
+         * @param count Number of workers
+         * @param workerMain Body of the worker processes
+         * @return true if every worker was started
+         */
+        bool forkLocalWorkers(size_t count, const std::function<int(int port)> &workerMain);
+
+        /**
+         * @brief Dispatch the shards until every document succeeded or failed
+         *
+         * Workers are told to stop at the end. Documents left when no worker connects
+         * within the worker wait are reported as failed.
+         *
+         * @return true if every document succeeded
+         */
+        bool run();
+
+        /**
+         * @brief Get the outcome of every document, in manifest order
+         */
+        const std::vector<DocumentOutcome> &getResults() const
+        {
+            return m_results;
+        }
+
+        Stats getStats() const
+        {
+            return m_stats;
+        }
+
+    private:
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        struct Connection
+        {
+            int fd;
+            std::string inbox;
+            std::string name;
+            size_t shard; // Shard held, npos when idle
+            std::chrono::steady_clock::time_point dispatched;
+        };
+
+        std::vector<DocumentSpec> m_specs;
+        Options m_options;
+        std::vector<DocumentOutcome> m_results;
+        std::vector<std::vector<size_t>> m_shards; // Document indices, a new shard per retry
+        int m_listenFd = -1;
+        int m_port = -1;
+        std::vector<int> m_children;
+        Stats m_stats;
+
+        void closeConnection(Connection &connection, std::deque<size_t> &pending);
+        void requeue(const std::vector<size_t> &documents, const std::string &reason, std::deque<size_t> &pending);
+        bool finishShard(Connection &connection, const std::string &payload, std::deque<size_t> &pending);
+    };
+
+} // namespace LatexGen
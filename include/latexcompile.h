@@ -0,0 +1,423 @@
+#pragma once
+
+/**
+ * @file latexcompile.h
+ * @brief Compilation of generated documents with a TeX engine.
+ * @note The engine runs as a child process (POSIX systems); on other systems
+ *       compiling reports a failure.
+ */
+
+#include "latexgen.h"
+
+namespace LatexGen
+{
+    /**
+     * @brief Settings of the TeX engine runs
+     */
+    struct CompileOptions
+    {
+        std::string engine = "pdflatex";  // Engine executable, path or name looked up in PATH
+        std::vector<std::string> arguments = {"-interaction=nonstopmode", "-halt-on-error"};
+        unsigned passes = 1;              // Engine runs per compile (2 or more to resolve references)
+        std::string bibtex = "bibtex";    // Run after the first pass when a bibliography is used (empty to skip)
+        std::string inputDirectory = "."; // Directory the figures and .bib files are found from
+    };
+
+    /**
+     * @brief Outcome of a compile
+     */
+    struct CompileResult
+    {
+        bool success = false;
+        bool cached = false;          // PDF taken from the compile cache
+        int exitCode = -1;            // Exit code of the last engine run (-1 if it could not run)
+        std::string pdf;              // PDF bytes
+        std::string log;              // Engine output of the last run, or the reason of a failure
+        uint64_t key = 0;             // Content key of the compile (see Compiler::computeKey())
+        double seconds = 0;           // Wall-clock time of the compile, generation included
+        double generationSeconds = 0; // Time spent generating the source (overlapping the engine when streamed)
+    };
+
+    /**
+     * @brief Content-addressed store of compiled PDF files
+     *
+     * PDFs are kept in a directory, one file per key (16 hexadecimal digits and
+     * .pdf), so a cache directory can be reused by later runs and shared by several
+     * processes. When the stored files exceed the size limit, the least recently used
+     * ones are deleted; uses are recorded in the file modification times so the order
+     * survives restarts. All methods are thread-safe.
+     */
+    class CompileCache
+    {
+    public:
+        /**
+         * @brief Cache usage counters
+         */
+        struct Stats
+        {
+            size_t hits = 0;
+            size_t misses = 0;
+            size_t stores = 0;
+            size_t evictions = 0;
+            size_t bytesServed = 0; // PDF bytes returned by hits
+        };
+
+        /**
+         * @brief Open (or create) a cache directory
+         * @param directory Directory holding the PDF files
+         * @param maxBytes Maximum size of the stored PDF files
+         */
+        explicit CompileCache(const std::string &directory, size_t maxBytes = 1024 * 1024 * 1024);
+
+        CompileCache(const CompileCache &) = delete;
+        CompileCache &operator=(const CompileCache &) = delete;
+
+        /**
+         * @brief Look a PDF up and mark it as used
+         * @param key Content key of the compile
+         * @param pdf Receives the PDF bytes
+         * @return true if the PDF was found
+         */
+        bool lookup(uint64_t key, std::string &pdf);
+
+        /**
+         * @brief Store a PDF, evicting the least recently used ones over the size limit
+         * @param key Content key of the compile
+         * @param pdf PDF bytes
+         * @return true if the file was written
+         */
+        bool store(uint64_t key, const std::string &pdf);
+
+        /**
+         * @brief Get the number of stored PDF files
+         */
+        size_t size() const;
+
+        /**
+         * @brief Get the total size of the stored PDF files
+         */
+        size_t getStoredBytes() const;
+
+        /**
+         * @brief Delete every stored PDF file
+         */
+        void clear();
+
+        Stats getStats() const;
+
+    private:
+        struct Entry
+        {
+            size_t bytes;
+            uint64_t lastUse;
+        };
+
+        std::string m_directory;
+        size_t m_maxBytes;
+        uint64_t m_clock = 0;
+        size_t m_storedBytes = 0;
+        std::unordered_map<uint64_t, Entry> m_entries;
+        Stats m_stats;
+        mutable std::mutex m_mutex;
+
+        std::string getPath(uint64_t key) const;
+        void evict();
+    };
+
+    /**
+     * @brief Working directories for compiles, kept in memory and reused
+     *
+     * Directories are created under a memory-backed file system (/dev/shm when
+     * available), so the auxiliary files written by the engine (.aux, .log, .toc...)
+     * never reach the disk. The inputs a document reads (figures, .bib files) are
+     * hard-linked into the directory, or copied when linking is not possible. A released
+     * directory keeps its inputs and is handed to a later job: inputs that did not
+     * change are not staged again, inputs the job does not use are deleted (see
+     * prune()), and only the files written by the job are deleted on release.
+     * All methods are thread-safe.
+     */
+    class WorkspacePool
+    {
+    public:
+        /**
+         * @brief File system operations done and avoided
+         */
+        struct Stats
+        {
+            size_t acquired = 0;     // Workspaces handed out
+            size_t created = 0;      // Directories created
+            size_t recycled = 0;     // Directories reused (a creation and a removal avoided)
+            size_t linkedInputs = 0; // Inputs hard-linked (no data copied)
+            size_t copiedInputs = 0; // Inputs copied
+            size_t reusedInputs = 0; // Inputs already staged by a previous job
+            size_t bytesCopied = 0;
+            size_t bytesReused = 0;  // Input bytes neither copied nor linked again
+            size_t scratchFiles = 0; // Files written by jobs and deleted on release
+            size_t scratchBytes = 0; // Their size (disk writes avoided when memory-backed)
+        };
+
+        /**
+         * @param root Directory the workspaces are created in (empty for /dev/shm, or
+         *        the temporary directory if /dev/shm is not available)
+         * @param maxIdle Released workspaces kept for reuse
+         */
+        explicit WorkspacePool(const std::string &root = "", size_t maxIdle = 16);
+
+        /**
+         * @brief Destructor, deletes the workspaces
+         */
+        ~WorkspacePool();
+
+        WorkspacePool(const WorkspacePool &) = delete;
+        WorkspacePool &operator=(const WorkspacePool &) = delete;
+
+        /**
+         * @brief Get a workspace, reusing a released one when possible
+         * @return Directory path, or an empty string if it cannot be created
+         */
+        std::string acquire();
+
+        /**
+         * @brief Make an input file available in a workspace
+         * @param workspace Directory returned by acquire()
+         * @param source File to stage
+         * @param name Path of the file in the workspace (relative, without "..")
+         * @return true if the file is in the workspace
+         */
+        bool stage(const std::string &workspace, const std::string &source, const std::string &name);
+
+        /**
+         * @brief Delete the inputs left by previous jobs that the current job did not stage
+         *
+         * Call once the inputs of the job are staged, so the engine cannot find a file
+         * the job does not declare.
+         *
+         * @param workspace Directory returned by acquire()
+         */
+        void prune(const std::string &workspace);
+
+        /**
+         * @brief Give a workspace back, deleting the files written by the job
+         * @param workspace Directory returned by acquire()
+         */
+        void release(const std::string &workspace);
+
+        /**
+         * @brief Get the directory holding the workspaces
+         */
+        const std::string &getRoot() const
+        {
+            return m_root;
+        }
+
+        /**
+         * @brief Check whether the workspaces are on a memory-backed file system
+         */
+        bool isMemoryBacked() const
+        {
+            return m_memoryBacked;
+        }
+
+        Stats getStats() const;
+
+    private:
+        struct StagedInput
+        {
+            std::string source; // Full path of the file staged
+            std::filesystem::file_time_type time;
+            uintmax_t size;
+            bool current; // Staged by the job holding the workspace
+        };
+
+        std::string m_root;
+        bool m_memoryBacked = false;
+        size_t m_maxIdle;
+        size_t m_nextId = 0;
+        std::vector<std::string> m_idle;
+        std::unordered_map<std::string, std::map<std::string, StagedInput>> m_staged; // Workspace -> inputs
+        Stats m_stats;
+        mutable std::mutex m_mutex;
+    };
+
+    /**
+     * @brief Compiles documents with a TeX engine
+     *
+     * Each compile runs in a fresh temporary directory (or a workspace of a
+     * WorkspacePool); the input directory is added to the TeX and BibTeX search paths
+     * so figures and .bib files are found. With a compile cache, a document whose
+     * source, figures, .bib files and engine are unchanged is not compiled again:
+     *
+     * @code
+     * Compiler compiler;
+     * compiler.setCache(std::make_shared<CompileCache>("pdf-cache"));
+     * CompileResult result = compiler.compile(article);
+     * @endcode
+     *
+     * A compiler may be used from several threads.
+     */
+    class Compiler
+    {
+    public:
+        explicit Compiler(CompileOptions options = CompileOptions());
+
+        Compiler(const Compiler &) = delete;
+        Compiler &operator=(const Compiler &) = delete;
+
+        const CompileOptions &getOptions() const
+        {
+            return m_options;
+        }
+
+        /**
+         * @brief Reuse PDFs of identical compiles (nullptr to disable)
+         */
+        void setCache(std::shared_ptr<CompileCache> cache)
+        {
+            m_cache = std::move(cache);
+        }
+
+        std::shared_ptr<CompileCache> getCache() const
+        {
+            return m_cache;
+        }
+
+        /**
+         * @brief Compile in reusable memory-backed workspaces (nullptr for a new
+         *        temporary directory per compile)
+         *
+         * The figures and .bib files of the document are staged in the workspace.
+         */
+        void setWorkspacePool(std::shared_ptr<WorkspacePool> pool)
+        {
+            m_workspaces = std::move(pool);
+        }
+
+        std::shared_ptr<WorkspacePool> getWorkspacePool() const
+        {
+            return m_workspaces;
+        }
+
+        /**
+         * @brief Get the identity of the engine (first line of its --version output)
+         *
+         * Part of the cache key, so upgrading the engine does not reuse older PDFs.
+         * Computed once per compiler.
+         */
+        std::string getEngineIdentity() const;
+
+        /**
+         * @brief Compute the content key of a compile
+         *
+         * Hashes the source, the content of every dependency (a missing file counts
+         * as such), the engine identity and the options.
+         *
+         * @param source LaTeX source
+         * @param dependencies External files read by the source
+         * @return Key
+         */
+        uint64_t computeKey(const std::string &source, const DocumentDependencies &dependencies) const;
+
+        /**
+         * @brief Compile a document (or take its PDF from the cache)
+         * @param document Document to compile
+         * @param jobName Base name of the files in the working directory
+         * @return Result with the PDF on success
+         */
+        CompileResult compile(const Document &document, const std::string &jobName = "document") const;
+
+        /**
+         * @brief Compile LaTeX source (or take its PDF from the cache)
+         *
+         * Files referenced by the source (see DocumentDependencies::addReferences())
+         * are added to @p dependencies, so they are part of the key and staged.
+         *
+         * @param source LaTeX source
+         * @param dependencies External files read by the source
+         * @param jobName Base name of the files in the working directory
+         * @return Result with the PDF on success
+         */
+        CompileResult compileSource(const std::string &source, const DocumentDependencies &dependencies,
+                                    const std::string &jobName = "document") const;
+
+        /**
+         * @brief Compile a document while it is being generated
+         *
+         * The engine is started first and reads the source through a named pipe: the
+         * preamble is sent as soon as it is generated, so the engine starts and loads
+         * the packages while the body is still being rendered. Further passes read the
+         * complete source from a file. The cache is not looked up (the key is only
+         * known once the source is complete) but the PDF is stored in it.
+         *
+         * The first pass gets -no-parse-first-line unless the arguments already have
+         * it: a TeX engine looking for a %& format line would read from the pipe
+         * before the job starts. The engine must accept this option (TeX Live and
+         * MiKTeX engines do).
+         *
+         * @param document Document to compile
+         * @param jobName Base name of the files in the working directory
+         * @return Result with the PDF on success
+         */
+        CompileResult compileStreaming(const Document &document, const std::string &jobName = "document") const;
+
+    private:
+        struct FileHash
+        {
+            std::filesystem::file_time_type time;
+            uintmax_t size;
+            uint64_t hash;
+        };
+
+        CompileOptions m_options;
+        std::shared_ptr<CompileCache> m_cache;
+        std::shared_ptr<WorkspacePool> m_workspaces;
+        mutable std::string m_engineIdentity;
+        mutable std::once_flag m_engineIdentityOnce;
+        mutable std::unordered_map<std::string, FileHash> m_fileHashes; // By path, valid while unchanged
+        mutable std::mutex m_mutex;
+
+        void addFile(ContentHasher &hasher, const std::string &path) const;
+        std::string openWorkspace(const DocumentDependencies &dependencies) const;
+        void closeWorkspace(const std::string &directory) const;
+        void runPasses(const std::string &directory, const std::string &jobName, bool hasBibliography,
+                       unsigned firstPass, CompileResult &result) const;
+    };
+
+    /**
+     * @brief Document of a batch built with ninja (see writeNinjaFile())
+     */
+    struct BuildEntry
+    {
+        std::shared_ptr<const Document> document;
+        std::string directory;                 // Directory of the .tex file
+        std::string fileName = "document.tex"; // The PDF gets the same name with a .pdf extension
+    };
+
+    /**
+     * @brief Save a batch of documents and a ninja file compiling them
+     *
+     * Every document is saved with a dependency file next to its PDF (the PDF path
+     * followed by .d, see Document::saveToFile()), and the ninja file gets one build
+     * edge per document, reading that dependency file. Running the program again
+     * only rewrites the .tex files whose content changed, so ninja recompiles only the
+     * documents whose source, figures, .bib files, fragments or data changed:
+     *
+     * @code
+     * writeNinjaFile("build.ninja", {{report, "out/report", "report.tex"},
+     *                                {slides, "out/slides", "slides.tex"}});
+     * // then: ninja -f build.ninja
+     * @endcode
+     *
+     * The engine runs in the directory of each .tex file with the engine, arguments,
+     * passes and BibTeX settings of the options (the input directory is not used).
+     * Directories are relative to the directory ninja runs in, normally the current
+     * directory.
+     *
+     * @param path Path of the ninja file
+     * @param entries Documents of the batch
+     * @param options Engine settings
+     * @return true if every file is written
+     */
+    bool writeNinjaFile(const std::string &path, const std::vector<BuildEntry> &entries,
+                        const CompileOptions &options = CompileOptions());
+
+} // namespace LatexGen
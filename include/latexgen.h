@@ -28,6 +28,17 @@
 #include <memory>
 #include <filesystem>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <cctype>
+#include <atomic>
+#include <iterator>
+#include <functional>
+#include <mutex>
+#include <typeinfo>
 
 namespace LatexGen
 {
@@ -84,612 +95,2610 @@ namespace LatexGen
     std::string getBabelLanguageName(Language lang);
 
     /**
-     * @brief Class to represent a LaTeX document section
+     * @brief Function to escape LaTeX special characters in plain text
+     * @param text Plain text
+     * @return Text safe to insert in LaTeX content
      */
-    class Section
-    {
-    public:
-        enum class Level
-        {
-            CHAPTER = -1,     // For chapters (only for reports and books)
-            SECTION = 0,      // For sections
-            SUBSECTION = 1,   // For subsections
-            SUBSUBSECTION = 2 // For subsubsections
-        };
+    std::string escapeLatex(const std::string &text);
 
-        Section(const std::string &title, Level level = Level::SECTION)
-            : m_title(title), m_level(level) {}
+    /**
+     * @brief Function to append plain text with LaTeX special characters escaped
+     * @param out String the escaped text is appended to
+     * @param text Plain text
+     */
+    void appendEscapedLatex(std::string &out, std::string_view text);
 
-        void addContent(const std::string &content)
-        {
-            m_content.push_back(content);
-        }
+    /**
+     * @brief Create an empty file with a unique name next to a path
+     *
+     * A file is written under this name and then renamed over the path, so readers
+     * never see it half-written and concurrent writers never share a temporary file.
+     *
+     * @param path File the temporary file will replace
+     * @return Path of the created file, or an empty string on failure
+     */
+    std::string createTemporaryFile(const std::string &path);
 
-        std::string generate() const;
+    /**
+     * @brief Write a file through a temporary file renamed over it
+     *
+     * Readers see the previous content or the new one, never a partial file, and of
+     * two writers of the same path the last rename wins with complete content.
+     *
+     * @param path File to write
+     * @param content New content
+     * @return true if the file was replaced
+     */
+    bool replaceFile(const std::string &path, const std::string &content);
 
-    private:
-        std::string m_title;
-        Level m_level;
-        std::vector<std::string> m_content;
+    /**
+     * @brief Settings of the macro extraction pass
+     */
+    struct MacroExtractionOptions
+    {
+        size_t minLength = 64; // Minimum size of a repeated block, in bytes
+        size_t minRepeats = 3; // Minimum number of occurrences of a block
+        size_t maxLines = 32;  // Maximum number of lines of a block
     };
 
     /**
-     * @brief Base class for LaTeX environment
+     * @brief Result counters of the macro extraction pass
      */
-    class Environment
+    struct MacroExtractionStats
     {
-    public:
-        Environment(const std::string &name) : m_name(name) {}
-        virtual ~Environment() = default;
-
-        virtual std::string begin() const
-        {
-            return "\\begin{" + m_name + "}\n";
-        }
-
-        virtual std::string end() const
-        {
-            return "\\end{" + m_name + "}\n";
-        }
-
-        virtual std::string generate() const = 0;
-
-    protected:
-        std::string m_name;
+        size_t macros = 0;       // Macros defined
+        size_t replacements = 0; // Blocks replaced by a macro call
+        size_t inputBytes = 0;
+        size_t outputBytes = 0;
     };
 
     /**
-     * @brief Class for LaTeX tables
+     * @brief Replace repeated blocks of lines by macros defined in the preamble
+     *
+     * Blocks of whole lines of the document body that repeat at least minRepeats times
+     * are found with a rolling hash and replaced by \LGm... macros defined with
+     * \newcommand before \begin{document}, which makes the file smaller and saves
+     * TeX from tokenising the same text again. Only self-contained blocks are
+     * extracted: balanced braces and environments, no verbatim material, no #, % or
+     * @ characters.
+     *
+     * @param latex Complete LaTeX document
+     * @param options Extraction settings
+     * @param stats Optional counters filled by the pass
+     * @return Document with the repeated blocks replaced
      */
-    class Table : public Environment
+    std::string extractMacros(const std::string &latex, const MacroExtractionOptions &options = MacroExtractionOptions(),
+                              MacroExtractionStats *stats = nullptr);
+
+    /**
+     * @brief Stable 64-bit hash of node inputs, used as fragment cache key
+     *
+     * The result only depends on the values added (not on the process), so it can be
+     * stored on disk. Fragment keys also add the class name given by typeid, which
+     * depends on the compiler: a cache file is only reused by builds of the same compiler. Strings are length-prefixed, so ("ab", "c") and
+     * ("a", "bc") hash differently.
+     */
+    class ContentHasher
     {
     public:
-        Table(const std::vector<std::string> &headers, const std::string &position = "h")
-            : Environment("table"), m_headers(headers)
+        ContentHasher &add(std::string_view text)
         {
-            m_options["position"] = position;
+            add(static_cast<uint64_t>(text.size()));
+            addBytes(text.data(), text.size());
+            return *this;
         }
 
-        void setCaption(const std::string &caption)
+        ContentHasher &add(const std::string &text)
         {
-            m_caption = caption;
+            return add(std::string_view(text));
         }
 
-        void setLabel(const std::string &label)
+        ContentHasher &add(const char *text)
         {
-            m_label = label;
+            return add(std::string_view(text));
         }
 
-        void addRow(const std::vector<std::string> &row)
+        ContentHasher &add(uint64_t value)
         {
-            m_rows.push_back(row);
+            mix(value);
+            return *this;
         }
 
-        std::string generate() const override;
+        uint64_t digest() const
+        {
+            uint64_t z = m_state;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
 
     private:
-        std::vector<std::string> m_headers;
-        std::vector<std::vector<std::string>> m_rows;
-        std::string m_caption;
-        std::string m_label;
-        std::map<std::string, std::string> m_options;
+        uint64_t m_state = 0x243F6A8885A308D3ULL;
+
+        void mix(uint64_t word)
+        {
+            m_state ^= word * 0x9E3779B97F4A7C15ULL;
+            m_state = ((m_state << 31) | (m_state >> 33)) * 0xBF58476D1CE4E5B9ULL;
+        }
+
+        void addBytes(const char *data, size_t size);
     };
 
     /**
-     * @brief Class for LaTeX figures
+     * @brief Vector with structural sharing
+     *
+     * Copies of a SharedVector share their elements: copying is O(1) and the first
+     * modification after a copy only duplicates the part that changes (a block of at
+     * most 32 element pointers, the directory of blocks and the edited element).
+     * Elements are read through const references, and modified through edit().
+     *
+     * Documents use it for their content so that variants built with clone() share
+     * everything they did not change.
      */
-    class Figure : public Environment
+    template <typename T>
+    class SharedVector
     {
+        static constexpr size_t BLOCK_BITS = 5;
+        static constexpr size_t BLOCK_SIZE = size_t(1) << BLOCK_BITS;
+
+        using Node = std::shared_ptr<T>;
+        using Block = std::vector<Node>;
+        using Directory = std::vector<std::shared_ptr<Block>>;
+
     public:
-        Figure(const std::string &imagePath, const std::string &position = "h")
-            : Environment("figure"), m_imagePath(imagePath)
+        /**
+         * @brief Forward iterator over the elements (read-only)
+         */
+        class const_iterator
         {
-            m_options["position"] = position;
-        }
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const T *;
+            using reference = const T &;
 
-        void setCaption(const std::string &caption)
+            const_iterator(const Directory *directory, size_t index)
+                : m_directory(directory), m_index(index) {}
+
+            reference operator*() const
+            {
+                return *(*(*m_directory)[m_index >> BLOCK_BITS])[m_index & (BLOCK_SIZE - 1)];
+            }
+
+            pointer operator->() const
+            {
+                return &**this;
+            }
+
+            const_iterator &operator++()
+            {
+                ++m_index;
+                return *this;
+            }
+
+            const_iterator operator++(int)
+            {
+                const_iterator previous = *this;
+                ++m_index;
+                return previous;
+            }
+
+            bool operator==(const const_iterator &other) const
+            {
+                return m_index == other.m_index;
+            }
+
+            bool operator!=(const const_iterator &other) const
+            {
+                return m_index != other.m_index;
+            }
+
+        private:
+            const Directory *m_directory;
+            size_t m_index;
+        };
+
+        size_t size() const
         {
-            m_caption = caption;
+            return m_size;
         }
 
-        void setLabel(const std::string &label)
+        bool empty() const
         {
-            m_label = label;
+            return m_size == 0;
         }
 
-        void setWidth(const std::string &width)
+        const T &operator[](size_t index) const
         {
-            m_width = width;
+            return *(*(*m_directory)[index >> BLOCK_BITS])[index & (BLOCK_SIZE - 1)];
         }
 
-        std::string generate() const override;
+        const T &front() const
+        {
+            return (*this)[0];
+        }
 
-    private:
-        std::string m_imagePath;
-        std::string m_caption;
-        std::string m_label;
-        std::string m_width = "0.8\\textwidth";
-        std::map<std::string, std::string> m_options;
-    };
+        const T &back() const
+        {
+            return (*this)[m_size - 1];
+        }
 
-    /**
-     * @brief Class for LaTeX mathematical equations
-     */
-    class Equation : public Environment
-    {
-    public:
-        Equation(bool numbered = true)
-            : Environment(numbered ? "equation" : "equation*") {}
+        const_iterator begin() const
+        {
+            return const_iterator(m_directory.get(), 0);
+        }
 
-        void setContent(const std::string &content)
+        const_iterator end() const
         {
-            m_content = content;
+            return const_iterator(m_directory.get(), m_size);
         }
 
-        void setLabel(const std::string &label)
+        void push_back(T value)
         {
-            m_label = label;
+            Directory &directory = mutableDirectory();
+            if ((m_size & (BLOCK_SIZE - 1)) == 0)
+            {
+                directory.push_back(std::make_shared<Block>());
+                directory.back()->reserve(BLOCK_SIZE);
+            }
+            mutableBlock(m_size >> BLOCK_BITS).push_back(std::make_shared<T>(std::move(value)));
+            ++m_size;
         }
 
-        std::string generate() const override;
+        /**
+         * @brief Get an element for modification
+         *
+         * The element (and the blocks leading to it) is copied first if it is shared
+         * with another SharedVector.
+         *
+         * @param index Position of the element
+         * @return Reference to the element, valid until the next modification
+         */
+        T &edit(size_t index)
+        {
+            mutableDirectory();
+            Node &node = mutableBlock(index >> BLOCK_BITS)[index & (BLOCK_SIZE - 1)];
+            if (isShared(node))
+            {
+                node = std::make_shared<T>(*node);
+            }
+            return *node;
+        }
 
-    private:
-        std::string m_content;
-        std::string m_label;
-    };
+        /**
+         * @brief Replace an element
+         * @param index Position of the element
+         * @param value New value
+         */
+        void set(size_t index, T value)
+        {
+            mutableDirectory();
+            mutableBlock(index >> BLOCK_BITS)[index & (BLOCK_SIZE - 1)] = std::make_shared<T>(std::move(value));
+        }
 
-    /**
-     * @brief Class for LaTeX itemize and enumerate environments
-     */
-    class List : public Environment
-    {
-    public:
-        enum class ListType
+        void clear()
         {
-            ITEMIZE,
-            ENUMERATE,
-            DESCRIPTION
-        };
+            m_directory.reset();
+            m_size = 0;
+        }
 
-        List(ListType type = ListType::ITEMIZE)
-            : Environment(type == ListType::ITEMIZE ? "itemize" : type == ListType::ENUMERATE ? "enumerate"
-                                                                                              : "description"),
-              m_type(type) {}
+    private:
+        std::shared_ptr<Directory> m_directory;
+        size_t m_size = 0;
 
-        void addItem(const std::string &item, const std::string &label = "")
+        // A use count of 1 means no other vector can reach the object; the fence orders
+        // our writes after the release performed by the last owner that dropped it.
+        template <typename U>
+        static bool isShared(const std::shared_ptr<U> &ptr)
         {
-            m_items.push_back(item);
-            if (!label.empty())
+            if (ptr.use_count() > 1)
             {
-                m_itemLabels[m_items.size() - 1] = label;
+                return true;
             }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return false;
         }
 
-        std::string generate() const override;
+        Directory &mutableDirectory()
+        {
+            if (!m_directory)
+            {
+                m_directory = std::make_shared<Directory>();
+            }
+            else if (isShared(m_directory))
+            {
+                m_directory = std::make_shared<Directory>(*m_directory);
+            }
+            return *m_directory;
+        }
 
-    private:
-        ListType m_type;
-        std::vector<std::string> m_items;
-        std::map<size_t, std::string> m_itemLabels; // For description lists
+        Block &mutableBlock(size_t blockIndex)
+        {
+            std::shared_ptr<Block> &block = (*m_directory)[blockIndex];
+            if (isShared(block))
+            {
+                auto copy = std::make_shared<Block>();
+                copy->reserve(BLOCK_SIZE);
+                copy->assign(block->begin(), block->end());
+                block = copy;
+            }
+            return *block;
+        }
     };
 
     /**
-     * @brief Reference entry for bibliography
+     * @brief Value shared between copies until one of them modifies it
+     *
+     * Used for document members that are replaced as a whole (package map, glossary...).
      */
-    class BibEntry
+    template <typename T>
+    class CopyOnWrite
     {
     public:
-        enum class EntryType
-        {
-            ARTICLE,
-            BOOK,
-            INPROCEEDINGS,
-            TECHREPORT,
-            PHDTHESIS,
-            MASTERSTHESIS,
-            MISC
-        };
+        CopyOnWrite() : m_value(std::make_shared<T>()) {}
 
-        BibEntry(const std::string &key, EntryType type)
-            : m_key(key), m_type(type) {}
-
-        void addField(const std::string &field, const std::string &value)
-        {
-            m_fields[field] = value;
-        }
+        CopyOnWrite(T value) : m_value(std::make_shared<T>(std::move(value))) {}
 
-        std::string getKey() const
+        const T &operator*() const
         {
-            return m_key;
+            return *m_value;
         }
 
-        EntryType getType() const
+        const T *operator->() const
         {
-            return m_type;
+            return m_value.get();
         }
 
-        const std::map<std::string, std::string> &getFields() const
+        /**
+         * @brief Get the value for modification, copying it first if it is shared
+         * @return Reference to the value, valid until this object is copied or modified
+         */
+        T &edit()
         {
-            return m_fields;
+            if (m_value.use_count() > 1)
+            {
+                m_value = std::make_shared<T>(*m_value);
+            }
+            else
+            {
+                std::atomic_thread_fence(std::memory_order_acquire);
+            }
+            return *m_value;
         }
 
-        std::string generate() const;
-
-        static std::string getTypeString(EntryType type);
-
     private:
-        std::string m_key;
-        EntryType m_type;
-        std::map<std::string, std::string> m_fields;
+        std::shared_ptr<T> m_value;
     };
 
     /**
-     * @brief Class to manage bibliographies in LaTeX documents
+     * @brief Text held compressed in memory with a byte-oriented LZ77 code (LZ4 block format)
+     *
+     * The text is split into independent chunks of CHUNK_SIZE bytes, so it is decoded
+     * chunk by chunk while it is written instead of being rebuilt as a whole first.
      */
-    class Bibliography
+    class CompressedText
     {
     public:
+        static constexpr size_t CHUNK_SIZE = 65536;
+
+        explicit CompressedText(std::string_view text);
+
         /**
-         * @brief Constructor for an external .bib file
-         * @param bibFile Path to the .bib file (without extension)
-         * @param style Bibliography style
+         * @brief Get the size of the original text
          */
-        Bibliography(const std::string &bibFile, BibStyle style = BibStyle::PLAIN)
-            : m_bibFile(bibFile), m_style(style), m_customStyle(""), m_useExternalFile(true) {}
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        size_t getCompressedSize() const
+        {
+            return m_data.size();
+        }
 
         /**
-         * @brief Default constructor (empty bibliography)
+         * @brief Get the ContentHasher digest of the original text
          */
-        Bibliography() 
-            : m_bibFile("references"), m_style(BibStyle::PLAIN), m_customStyle(""), m_useExternalFile(false) {}
+        uint64_t getDigest() const
+        {
+            return m_digest;
+        }
 
         /**
-         * @brief Constructor for bibliography with custom style
-         * @param bibFile Path to the .bib file (without extension)
-         * @param customStyle Name of the custom .bst style file (without extension)
+         * @brief Decode the text at the end of a string
+         * @param out String receiving the text
          */
-        Bibliography(const std::string &bibFile, const std::string &customStyle)
-            : m_bibFile(bibFile), m_style(BibStyle::CUSTOM), m_customStyle(customStyle), m_useExternalFile(true) {}
+        void appendTo(std::string &out) const;
 
         /**
-         * @brief Set the .bib file
-         * @param bibFile Path to the .bib file (without extension)
-         * @param useExternalFile If true, use an existing file. If false, generate the file.
+         * @brief Decode the text to a stream, one chunk at a time
+         * @param out Output stream
          */
-        void setBibFile(const std::string &bibFile, bool useExternalFile = true)
+        void write(std::ostream &out) const;
+
+        std::string str() const
         {
-            m_bibFile = bibFile;
-            m_useExternalFile = useExternalFile;
+            std::string text;
+            appendTo(text);
+            return text;
         }
 
         /**
-         * @brief Add a bibliography entry manually
-         * @param entry Bibliography entry
+         * @brief Get the number of bytes decoded so far, by all decodes of this text
          */
-        void addEntry(const BibEntry &entry)
+        uint64_t getDecodedBytes() const
         {
-            m_entries.push_back(entry);
-            m_useExternalFile = false; // Use manual entries
+            return m_decodedBytes.load(std::memory_order_relaxed);
         }
 
         /**
-         * @brief Set the bibliography style
-         * @param style Bibliography style
+         * @brief Get the time spent decoding so far, in seconds
          */
-        void setStyle(BibStyle style)
+        double getDecodeSeconds() const
         {
-            m_style = style;
-            if (style != BibStyle::CUSTOM)
+            return static_cast<double>(m_decodeNanoseconds.load(std::memory_order_relaxed)) / 1e9;
+        }
+
+    private:
+        std::string m_data;
+        std::vector<size_t> m_chunkEnds; // End of each compressed chunk in m_data
+        size_t m_size;
+        uint64_t m_digest;
+        mutable std::atomic<uint64_t> m_decodedBytes{0};
+        mutable std::atomic<uint64_t> m_decodeNanoseconds{0};
+
+        size_t decodeChunk(size_t chunk, char *out) const;
+        void addDecode(uint64_t bytes, uint64_t nanoseconds) const;
+    };
+
+    /**
+     * @brief Counters of the text stored by a document (see Document::getTextStorageStats)
+     */
+    struct TextStorageStats
+    {
+        size_t blocks = 0;           // Text blocks
+        size_t compressedBlocks = 0; // Blocks stored compressed
+        size_t textBytes = 0;        // Size of the text
+        size_t storedBytes = 0;      // Memory used by the text (compressed size for compressed blocks)
+        uint64_t decodedBytes = 0;   // Bytes decoded from compressed blocks so far
+        double decodeSeconds = 0;    // Time spent decoding them
+
+        double getCompressionRatio() const
+        {
+            return storedBytes == 0 ? 1.0 : static_cast<double>(textBytes) / static_cast<double>(storedBytes);
+        }
+
+        /**
+         * @brief Get the decode throughput in bytes per second (0 before the first decode)
+         */
+        double getDecodeThroughput() const
+        {
+            return decodeSeconds <= 0 ? 0.0 : static_cast<double>(decodedBytes) / decodeSeconds;
+        }
+    };
+
+    /**
+     * @brief Text block kept either as is or as a CompressedText shared by copies
+     */
+    class StoredText
+    {
+    public:
+        StoredText(std::string text = std::string()) : m_text(std::move(text)) {}
+
+        /**
+         * @brief Compress the text if it is at least @p threshold bytes long
+         * @param threshold Minimum size in bytes (0 keeps the text as is)
+         */
+        void compress(size_t threshold)
+        {
+            if (threshold > 0 && !m_compressed && m_text.size() >= threshold)
             {
-                m_customStyle = "";
+                m_compressed = std::make_shared<const CompressedText>(m_text);
+                std::string().swap(m_text);
+            }
+        }
+
+        bool isCompressed() const
+        {
+            return m_compressed != nullptr;
+        }
+
+        size_t size() const
+        {
+            return m_compressed ? m_compressed->size() : m_text.size();
+        }
+
+        void appendTo(std::string &out) const
+        {
+            if (m_compressed)
+            {
+                m_compressed->appendTo(out);
+            }
+            else
+            {
+                out += m_text;
+            }
+        }
+
+        void write(std::ostream &out) const
+        {
+            if (m_compressed)
+            {
+                m_compressed->write(out);
+            }
+            else
+            {
+                out << m_text;
             }
         }
 
+        std::string str() const
+        {
+            return m_compressed ? m_compressed->str() : m_text;
+        }
+
         /**
-         * @brief Set a custom bibliography style
-         * @param customStyle Name of the custom .bst style file (without extension)
+         * @brief Get the text for modification (a compressed text is decoded first)
          */
-        void setCustomStyle(const std::string &customStyle)
+        std::string &edit()
         {
-            m_style = BibStyle::CUSTOM;
-            m_customStyle = customStyle;
+            if (m_compressed)
+            {
+                m_text = m_compressed->str();
+                m_compressed.reset();
+            }
+            return m_text;
+        }
+
+        void fingerprint(ContentHasher &hasher) const
+        {
+            if (m_compressed)
+            {
+                hasher.add("compressed").add(m_compressed->getDigest());
+            }
+            else
+            {
+                hasher.add(m_text);
+            }
+        }
+
+        void addStats(TextStorageStats &stats) const
+        {
+            ++stats.blocks;
+            stats.textBytes += size();
+            if (m_compressed)
+            {
+                ++stats.compressedBlocks;
+                stats.storedBytes += m_compressed->getCompressedSize();
+                stats.decodedBytes += m_compressed->getDecodedBytes();
+                stats.decodeSeconds += m_compressed->getDecodeSeconds();
+            }
+            else
+            {
+                stats.storedBytes += m_text.size();
+            }
         }
 
+    private:
+        std::string m_text;
+        std::shared_ptr<const CompressedText> m_compressed;
+    };
+
+    inline std::ostream &operator<<(std::ostream &out, const StoredText &text)
+    {
+        text.write(out);
+        return out;
+    }
+
+    /**
+     * @brief Content computed by a callback when the document is generated
+     *
+     * The callback is only invoked when the content is emitted, so content that is
+     * never generated (e.g. excluded from a preview) is never computed. With
+     * memoisation the first result is kept and reused by later generations, including
+     * those of clones and snapshots, which share the LazyContent object.
+     */
+    class LazyContent
+    {
+    public:
+        using Provider = std::function<std::string()>;
+
         /**
-         * @brief Get the .bib file name
-         * @return Path to the .bib file (without extension)
+         * @brief Constructor
+         * @param provider Callback returning LaTeX content
+         * @param memoize If true, the callback is invoked at most once
          */
-        std::string getBibFile() const;
+        explicit LazyContent(Provider provider, bool memoize = true)
+            : m_provider(std::move(provider)), m_memoize(memoize) {}
 
         /**
-         * @brief Get configuration commands for the preamble
-         * @return String containing LaTeX commands to configure the bibliography
+         * @brief Get the content, invoking the callback if needed (thread-safe)
+         * @return LaTeX content
          */
-        std::string getPreambleConfig() const;
+        std::string evaluate() const;
 
         /**
-         * @brief Get commands to include the bibliography in the document
-         * @param title Optional title for the bibliography section (if empty, the default language title is used)
-         * @return String containing LaTeX commands to include the bibliography
+         * @brief Check whether a memoised value is available
          */
-        std::string getIncludeCommands(const std::string &title = "") const;
-        
+        bool isEvaluated() const;
+
         /**
-         * @brief Generate the .bib file from manual entries
-         * @param outputDir Output directory (optional)
-         * @return true if the file was created successfully, false otherwise
+         * @brief Drop the memoised value so the next generation invokes the callback again
          */
-        bool generateBibFile(const std::string &outputDir = "") const;
+        void reset();
 
     private:
-        std::string m_bibFile;
-        BibStyle m_style;
-        std::string m_customStyle;
-        bool m_useExternalFile;
-        std::vector<BibEntry> m_entries;
+        Provider m_provider;
+        bool m_memoize;
+        mutable std::mutex m_mutex;
+        mutable bool m_evaluated = false;
+        mutable std::string m_value;
+    };
 
-        std::string getStyleName() const;
+    /**
+     * @brief Stream buffer that normalises LaTeX whitespace while it is written
+     *
+     * Lines are filtered one at a time as they are written to the target buffer:
+     * indentation, trailing blanks and runs of spaces are reduced, and in the body
+     * runs of blank lines are collapsed to one paragraph break and dropped around
+     * sectioning commands (which end the paragraph anyway). Blank lines of the preamble
+     * are kept, since one may be a paragraph break inside a macro definition. Verbatim
+     * and listing environments, and the spaces of lines using \\verb or \\lstinline,
+     * are written byte for byte.
+     */
+    class CompactStreamBuf : public std::streambuf
+    {
+    public:
+        /**
+         * @brief Constructor
+         * @param target Buffer receiving the filtered output
+         */
+        explicit CompactStreamBuf(std::streambuf *target) : m_target(target) {}
+
+        ~CompactStreamBuf() override
+        {
+            finish();
+        }
+
+        /**
+         * @brief Write the last line if it has no newline (done by the destructor)
+         */
+        void finish();
+
+        size_t getBytesIn() const
+        {
+            return m_bytesIn;
+        }
+
+        size_t getBytesOut() const
+        {
+            return m_bytesOut;
+        }
+
+    protected:
+        int_type overflow(int_type ch) override;
+        std::streamsize xsputn(const char *data, std::streamsize count) override;
+        int sync() override;
+
+    private:
+        std::streambuf *m_target;
+        std::string m_line;        // Current line, not complete yet
+        std::string m_verbatimEnd; // End command of the verbatim environment being copied
+        bool m_inBody = false;
+        bool m_pendingBlank = false;
+        bool m_afterHeading = false;
+        size_t m_bytesIn = 0;
+        size_t m_bytesOut = 0;
+
+        void processLine(bool complete);
+        void put(const char *data, size_t size);
     };
 
     /**
-     * @brief Class for mathematical theorem environments
+     * @brief Class to represent a LaTeX document section
      */
-    class TheoremEnvironment : public Environment
+    class Section
     {
     public:
+        enum class Level
+        {
+            CHAPTER = -1,     // For chapters (only for reports and books)
+            SECTION = 0,      // For sections
+            SUBSECTION = 1,   // For subsections
+            SUBSUBSECTION = 2 // For subsubsections
+        };
+
+        Section(const std::string &title, Level level = Level::SECTION)
+            : m_title(title), m_level(level) {}
+
+        void addContent(const std::string &content)
+        {
+            m_content.push_back({content, nullptr});
+        }
+
         /**
-         * @brief Enum for theorem-like environment types
+         * @brief Add content computed only when the section is generated
+         * @param provider Callback returning LaTeX content
+         * @param memoize If true, the callback is invoked at most once
          */
-        enum class Type
+        void addLazyContent(LazyContent::Provider provider, bool memoize = true)
         {
-            THEOREM,
-            LEMMA,
-            PROPOSITION,
-            COROLLARY,
-            DEFINITION,
-            EXAMPLE,
-            REMARK,
-            PROOF,
-            CUSTOM
+            m_content.push_back({StoredText(), std::make_shared<LazyContent>(std::move(provider), memoize)});
+        }
+
+        void setTitle(const std::string &title)
+        {
+            m_title = title;
+        }
+
+        /**
+         * @brief Set an identifier used to select the section (see RenderFilter)
+         * @param id Section identifier (not printed)
+         */
+        void setId(const std::string &id)
+        {
+            m_id = id;
+        }
+
+        const std::string &getId() const
+        {
+            return m_id;
+        }
+
+        const std::string &getTitle() const
+        {
+            return m_title;
+        }
+
+        Level getLevel() const
+        {
+            return m_level;
+        }
+
+        /**
+         * @brief Remove all the content of the section (title and level are kept)
+         */
+        void clearContent()
+        {
+            m_content.clear();
+        }
+
+        std::string generate() const;
+
+        /**
+         * @brief Add the section inputs to a hasher (see Environment::fingerprint)
+         * @param hasher Hasher receiving the inputs
+         * @return false if the section has lazy content and cannot be cached
+         */
+        bool fingerprint(ContentHasher &hasher) const;
+
+        /**
+         * @brief Store text pieces of at least @p threshold bytes compressed
+         * @param threshold Minimum size in bytes
+         */
+        void compress(size_t threshold);
+
+        /**
+         * @brief Add the text pieces to storage counters (lazy content excluded)
+         * @param stats Counters to update
+         */
+        void addStorageStats(TextStorageStats &stats) const;
+
+    private:
+        /**
+         * @brief Content piece, either text or lazy content
+         */
+        struct Content
+        {
+            StoredText text;
+            std::shared_ptr<const LazyContent> lazy; // Evaluated at generation when set
         };
 
+        std::string m_title;
+        std::string m_id;
+        Level m_level;
+        std::vector<Content> m_content;
+    };
+
+    /**
+     * @brief Selection of the sections to render, for partial previews
+     *
+     * A section is rendered with its subsections when it matches any criterion.
+     * Skipped sections still step their LaTeX counter and add their table of contents
+     * entry, so numbering and the table of contents are the same as in the full
+     * document; their content (including lazy content) is not generated.
+     */
+    struct RenderFilter
+    {
+        std::set<size_t> parts;                        // Part indices (Book)
+        std::set<size_t> chapters;                     // Chapter indices, in document order
+        std::set<std::string> sectionIds;              // Section identifiers (see Section::setId)
+        std::function<bool(const Section &)> predicate; // Custom selection (may be empty)
+        bool includeOtherContent = false;              // Keep environments and raw content outside sections
+    };
+
+    /**
+     * @brief Settings for a fast compile of interactive previews
+     *
+     * Used by Document::generate(const PreviewProfile &) and Document::write(), which
+     * render a clone of the document: the document itself is not changed, so the full
+     * and the preview output can be generated from the same model.
+     */
+    struct PreviewProfile
+    {
+        bool draft = true;                 // draft class option (no images, links or fonts loaded)
+        bool draftFigures = true;          // Figures shown as boxes with their file name
+        bool omitContentLists = true;      // Leave out the table of contents, lists of figures and tables, index
+        std::set<std::string> droppedPackages = {"tocloft", "bookmark", "listings"};
+        std::string bibliographyOutput;    // .bbl file of a previous full compile, input instead of \bibliography
+    };
+
+    /**
+     * @brief External files read by LaTeX when compiling a document
+     *
+     * Paths are as written in the generated source, relative to the directory the
+     * document is compiled in (see Document::collectDependencies()).
+     */
+    struct DocumentDependencies
+    {
+        std::vector<std::string> images;         // Figure images (the extension may be left to graphicx)
+        std::vector<std::string> bibliographies; // .bib files
+        std::vector<std::string> inputs;         // Files read by \input, \include, \lstinputlisting...
+        std::vector<std::string> dataFiles;      // Plot data read by pgfplots (\addplot table, \pgfplotstableread)
+
         /**
-         * @brief Constructor for theorem environment
-         * @param type Type of theorem environment
-         * @param content Content of the theorem
-         * @param title Optional title for the theorem
+         * @brief Add the files referenced by LaTeX source
+         *
+         * Finds the file arguments of \input, \include, \includegraphics,
+         * \lstinputlisting, \VerbatimInput, \addplot table and file,
+         * \pgfplotstableread, \bibliography and \addbibresource outside comments.
+         * Arguments built from macros are skipped. The .tex and .bib extensions are
+         * added where LaTeX adds them.
+         *
+         * With a base directory, the files of \input and \include found there are read
+         * and scanned as well, recursively (each file once). Their references stay
+         * relative to the base directory, as TeX resolves them from the directory the
+         * document is compiled in.
+         *
+         * @param source LaTeX source (raw content, section text or a whole document)
+         * @param baseDirectory Directory the document is compiled from (empty to scan
+         *        @p source only)
          */
-        TheoremEnvironment(Type type, const std::string &content, const std::string &title = "")
-            : Environment(getEnvironmentName(type)), m_type(type), m_content(content), m_title(title), m_customType("") {}
+        void addReferences(const std::string &source, const std::string &baseDirectory = "");
+
+        /**
+         * @brief Keep the first occurrence of each file in every list
+         */
+        void removeDuplicates();
+    };
+
+    /**
+     * @brief Base class for LaTeX environment
+     */
+    class Environment
+    {
+    public:
+        Environment(const std::string &name) : m_name(name) {}
+        virtual ~Environment() = default;
+
+        virtual std::string begin() const
+        {
+            return "\\begin{" + m_name + "}\n";
+        }
+
+        virtual std::string end() const
+        {
+            return "\\end{" + m_name + "}\n";
+        }
+
+        virtual std::string generate() const = 0;
+
+        /**
+         * @brief Create an independent copy of the environment
+         *
+         * Used by documents to copy a shared environment before modifying it.
+         * Environments that cannot be copied return nullptr.
+         *
+         * @return Pointer to the copy
+         */
+        virtual std::shared_ptr<Environment> clone() const
+        {
+            return nullptr;
+        }
+
+        /**
+         * @brief Add everything the generated code depends on to a hasher
+         *
+         * Used as the key of the fragment cache. Environments whose output cannot be
+         * described this way (e.g. computed by a callback) return false and are
+         * always generated.
+         *
+         * @param hasher Hasher receiving the inputs
+         * @return true if the environment can be cached
+         */
+        virtual bool fingerprint(ContentHasher &hasher) const
+        {
+            (void)hasher;
+            return false;
+        }
+
+        /**
+         * @brief Whether fingerprint() describes every input of this object
+         *
+         * The library classes return true only when the object is exactly of their
+         * class: a subclass adding members would otherwise inherit a fingerprint that
+         * ignores them and share cache entries with other instances. A subclass opts in
+         * by overriding both fingerprint() and cacheable().
+         *
+         * @return true if the environment may be cached and interned
+         */
+        virtual bool cacheable() const
+        {
+            return false;
+        }
+
+        /**
+         * @brief Add the external files read by the generated code
+         * @param dependencies Receives the files
+         */
+        virtual void collectDependencies(DocumentDependencies &dependencies) const
+        {
+            (void)dependencies;
+        }
+
+    protected:
+        std::string m_name;
+    };
+
+    /**
+     * @brief Rows of a Table read from an external source (see Table::setDataSource)
+     *
+     * Values stay in the representation of the source and are formatted only when the
+     * table is generated.
+     */
+    class TableDataSource
+    {
+    public:
+        virtual ~TableDataSource() = default;
+
+        virtual size_t getRowCount() const = 0;
+
+        virtual size_t getColumnCount() const = 0;
+
+        /**
+         * @brief Append the text of a cell
+         * @param row Row index
+         * @param column Column index
+         * @param out String the text is appended to (nothing for a missing value)
+         */
+        virtual void formatCell(size_t row, size_t column, std::string &out) const = 0;
+
+        /**
+         * @brief Add the content of the source to a hasher (see Environment::fingerprint)
+         * @param hasher Hasher receiving the content
+         * @return false if the content cannot be identified (the table is not cached)
+         */
+        virtual bool fingerprint(ContentHasher &hasher) const
+        {
+            (void)hasher;
+            return false;
+        }
+    };
+
+    /**
+     * @brief Class for LaTeX tables
+     */
+    class Table : public Environment
+    {
+    public:
+        Table(const std::vector<std::string> &headers, const std::string &position = "h")
+            : Environment("table"), m_headers(headers), m_columns(headers.size())
+        {
+            m_options["position"] = position;
+        }
+
+        void setCaption(const std::string &caption)
+        {
+            m_caption = caption;
+        }
+
+        void setLabel(const std::string &label)
+        {
+            m_label = label;
+        }
+
+        /**
+         * @brief Add a row (cells beyond the number of headers are ignored)
+         * @param row Cells of the row
+         */
+        void addRow(const std::vector<std::string> &row);
+
+        /**
+         * @brief Escape LaTeX special characters in the cells (headers excluded)
+         *
+         * Each distinct value of a column is escaped once, not once per cell.
+         *
+         * @param escape If true, cells are escaped when the table is generated
+         */
+        void setEscapeCells(bool escape);
+
+        /**
+         * @brief Add the rows of a data source after the rows added with addRow()
+         *
+         * The source is shared, not copied; its cells are formatted (and escaped if
+         * setEscapeCells() is enabled) when the table is generated.
+         *
+         * @param source Data source (nullptr to remove it)
+         */
+        void setDataSource(std::shared_ptr<const TableDataSource> source)
+        {
+            m_dataSource = std::move(source);
+        }
+
+        std::shared_ptr<const TableDataSource> getDataSource() const
+        {
+            return m_dataSource;
+        }
+
+        /**
+         * @brief Get the number of rows added with addRow() (data source excluded)
+         */
+        size_t getRowCount() const
+        {
+            return m_rowCount;
+        }
+
+        /**
+         * @brief Get a cell value (empty if the row is shorter)
+         * @param row Row index
+         * @param column Column index
+         * @return Cell value, as added
+         */
+        const std::string &getCell(size_t row, size_t column) const;
+
+        /**
+         * @brief Get the number of distinct values stored for a column
+         * @param column Column index
+         * @return Size of the column dictionary
+         */
+        size_t getDistinctValueCount(size_t column) const;
+
+        std::string generate() const override;
+
+        std::shared_ptr<Environment> clone() const override
+        {
+            return std::make_shared<Table>(*this);
+        }
+
+        bool fingerprint(ContentHasher &hasher) const override;
+
+        bool cacheable() const override
+        {
+            return typeid(*this) == typeid(Table);
+        }
+
+    private:
+        /**
+         * @brief Dictionary-encoded cells of one column
+         *
+         * Distinct values are stored once together with their rendering, and cells are
+         * value IDs kept in blocks shared with copies of the table (see Document::snapshot).
+         * Deduplication stops when a column turns out to hold mostly distinct values.
+         */
+        class Column
+        {
+        public:
+            static constexpr uint32_t ABSENT = std::numeric_limits<uint32_t>::max(); // Cell of a short row
+            static constexpr size_t IDS_PER_BLOCK = 4096;
+
+            void add(const std::string &value, bool escape);
+            void addAbsent();
+            void setEscape(bool escape);
+
+            const std::vector<uint32_t> &getBlock(size_t index) const
+            {
+                return m_ids[index];
+            }
+
+            uint32_t getId(size_t row) const
+            {
+                return m_ids[row / IDS_PER_BLOCK][row % IDS_PER_BLOCK];
+            }
+
+            const std::vector<std::string> &getValues() const
+            {
+                return m_dictionary->values;
+            }
+
+            /**
+             * @brief Get the LaTeX code of each value, indexed by value ID
+             */
+            const std::vector<std::string> &getRendered(bool escape) const
+            {
+                return escape ? m_dictionary->escaped : m_dictionary->values;
+            }
+
+        private:
+            static constexpr size_t DEDUPLICATION_CHECK = 1024; // Cells added before judging the cardinality
+
+            struct Dictionary
+            {
+                std::vector<std::string> values;
+                std::vector<std::string> escaped; // Only filled while cells are escaped
+                std::unordered_map<std::string, uint32_t> index;
+                bool deduplicate = true;
+            };
+
+            SharedVector<std::vector<uint32_t>> m_ids;
+            CopyOnWrite<Dictionary> m_dictionary;
+            size_t m_size = 0;
+
+            void append(uint32_t id);
+        };
+
+        std::vector<std::string> m_headers;
+        std::vector<Column> m_columns; // One per header
+        size_t m_rowCount = 0;
+        bool m_escapeCells = false;
+        std::shared_ptr<const TableDataSource> m_dataSource;
+        std::string m_caption;
+        std::string m_label;
+        std::map<std::string, std::string> m_options;
+    };
+
+    /**
+     * @brief Class for LaTeX figures
+     */
+    class Figure : public Environment
+    {
+    public:
+        Figure(const std::string &imagePath, const std::string &position = "h")
+            : Environment("figure"), m_imagePath(imagePath)
+        {
+            m_options["position"] = position;
+        }
+
+        void setCaption(const std::string &caption)
+        {
+            m_caption = caption;
+        }
+
+        void setLabel(const std::string &label)
+        {
+            m_label = label;
+        }
+
+        void setWidth(const std::string &width)
+        {
+            m_width = width;
+        }
+
+        std::string generate() const override;
+
+        std::shared_ptr<Environment> clone() const override
+        {
+            return std::make_shared<Figure>(*this);
+        }
+
+        bool fingerprint(ContentHasher &hasher) const override;
+
+        bool cacheable() const override
+        {
+            return typeid(*this) == typeid(Figure);
+        }
+
+        void collectDependencies(DocumentDependencies &dependencies) const override
+        {
+            dependencies.images.push_back(m_imagePath);
+        }
+
+        const std::string &getImagePath() const
+        {
+            return m_imagePath;
+        }
+
+    private:
+        std::string m_imagePath;
+        std::string m_caption;
+        std::string m_label;
+        std::string m_width = "0.8\\textwidth";
+        std::map<std::string, std::string> m_options;
+    };
+
+    /**
+     * @brief Class for LaTeX mathematical equations
+     */
+    class Equation : public Environment
+    {
+    public:
+        Equation(bool numbered = true)
+            : Environment(numbered ? "equation" : "equation*") {}
+
+        void setContent(const std::string &content)
+        {
+            m_content = content;
+        }
+
+        void setLabel(const std::string &label)
+        {
+            m_label = label;
+        }
+
+        std::string generate() const override;
+
+        std::shared_ptr<Environment> clone() const override
+        {
+            return std::make_shared<Equation>(*this);
+        }
+
+        bool fingerprint(ContentHasher &hasher) const override;
+
+        bool cacheable() const override
+        {
+            return typeid(*this) == typeid(Equation);
+        }
+
+    private:
+        std::string m_content;
+        std::string m_label;
+    };
+
+    /**
+     * @brief Class for LaTeX itemize and enumerate environments
+     */
+    class List : public Environment
+    {
+    public:
+        enum class ListType
+        {
+            ITEMIZE,
+            ENUMERATE,
+            DESCRIPTION
+        };
+
+        List(ListType type = ListType::ITEMIZE)
+            : Environment(type == ListType::ITEMIZE ? "itemize" : type == ListType::ENUMERATE ? "enumerate"
+                                                                                              : "description"),
+              m_type(type) {}
+
+        void addItem(const std::string &item, const std::string &label = "")
+        {
+            m_items.edit().push_back({item, label, nullptr});
+        }
+
+        /**
+         * @brief Add a nested list under the last item
+         *
+         * If the list has no item yet, an empty item is created to hold the nested list.
+         * Note that LaTeX itself limits the nesting depth (4 levels per list type by default).
+         *
+         * @param type Type of the nested list
+         * @return Pointer to the nested List object
+         */
+        std::shared_ptr<List> addSubList(ListType type = ListType::ITEMIZE);
+
+        /**
+         * @brief Get the number of items (nested items excluded)
+         * @return Number of items
+         */
+        size_t size() const
+        {
+            return m_items->size();
+        }
+
+        std::string generate() const override;
+
+        std::shared_ptr<Environment> clone() const override;
+
+        bool fingerprint(ContentHasher &hasher) const override;
+
+        bool cacheable() const override
+        {
+            return typeid(*this) == typeid(List);
+        }
+
+    private:
+        /**
+         * @brief List item with its optional label and nested list
+         */
+        struct Item
+        {
+            std::string text;
+            std::string label;            // For description lists
+            std::shared_ptr<List> child;  // Nested list (may be null)
+        };
+
+        ListType m_type;
+        CopyOnWrite<std::vector<Item>> m_items; // Shared by copies until one of them is modified
+    };
+
+    /**
+     * @brief Reference entry for bibliography
+     */
+    class BibEntry
+    {
+    public:
+        enum class EntryType
+        {
+            ARTICLE,
+            BOOK,
+            INPROCEEDINGS,
+            TECHREPORT,
+            PHDTHESIS,
+            MASTERSTHESIS,
+            MISC
+        };
+
+        BibEntry(const std::string &key, EntryType type)
+            : m_key(key), m_type(type) {}
+
+        void addField(const std::string &field, const std::string &value)
+        {
+            m_fields[field] = value;
+        }
+
+        std::string getKey() const
+        {
+            return m_key;
+        }
+
+        EntryType getType() const
+        {
+            return m_type;
+        }
+
+        const std::map<std::string, std::string> &getFields() const
+        {
+            return m_fields;
+        }
+
+        std::string generate() const;
+
+        static std::string getTypeString(EntryType type);
+
+    private:
+        std::string m_key;
+        EntryType m_type;
+        std::map<std::string, std::string> m_fields;
+    };
+
+    /**
+     * @brief Class to manage bibliographies in LaTeX documents
+     */
+    class Bibliography
+    {
+    public:
+        /**
+         * @brief Constructor for an external .bib file
+         * @param bibFile Path to the .bib file (without extension)
+         * @param style Bibliography style
+         */
+        Bibliography(const std::string &bibFile, BibStyle style = BibStyle::PLAIN)
+            : m_bibFile(bibFile), m_style(style), m_customStyle(""), m_useExternalFile(true) {}
+
+        /**
+         * @brief Default constructor (empty bibliography)
+         */
+        Bibliography() 
+            : m_bibFile("references"), m_style(BibStyle::PLAIN), m_customStyle(""), m_useExternalFile(false) {}
+
+        /**
+         * @brief Constructor for bibliography with custom style
+         * @param bibFile Path to the .bib file (without extension)
+         * @param customStyle Name of the custom .bst style file (without extension)
+         */
+        Bibliography(const std::string &bibFile, const std::string &customStyle)
+            : m_bibFile(bibFile), m_style(BibStyle::CUSTOM), m_customStyle(customStyle), m_useExternalFile(true) {}
+
+        /**
+         * @brief Set the .bib file
+         * @param bibFile Path to the .bib file (without extension)
+         * @param useExternalFile If true, use an existing file. If false, generate the file.
+         */
+        void setBibFile(const std::string &bibFile, bool useExternalFile = true)
+        {
+            m_bibFile = bibFile;
+            m_useExternalFile = useExternalFile;
+        }
+
+        /**
+         * @brief Add a bibliography entry manually
+         * @param entry Bibliography entry
+         */
+        void addEntry(const BibEntry &entry)
+        {
+            m_entries.push_back(entry);
+            m_useExternalFile = false; // Use manual entries
+        }
+
+        /**
+         * @brief Set the bibliography style
+         * @param style Bibliography style
+         */
+        void setStyle(BibStyle style)
+        {
+            m_style = style;
+            if (style != BibStyle::CUSTOM)
+            {
+                m_customStyle = "";
+            }
+        }
+
+        /**
+         * @brief Set a custom bibliography style
+         * @param customStyle Name of the custom .bst style file (without extension)
+         */
+        void setCustomStyle(const std::string &customStyle)
+        {
+            m_style = BibStyle::CUSTOM;
+            m_customStyle = customStyle;
+        }
+
+        /**
+         * @brief Get the .bib file name
+         * @return Path to the .bib file (without extension)
+         */
+        std::string getBibFile() const;
+
+        /**
+         * @brief Get configuration commands for the preamble
+         * @return String containing LaTeX commands to configure the bibliography
+         */
+        std::string getPreambleConfig() const;
+
+        /**
+         * @brief Get commands to include the bibliography in the document
+         * @param title Optional title for the bibliography section (if empty, the default language title is used)
+         * @return String containing LaTeX commands to include the bibliography
+         */
+        std::string getIncludeCommands(const std::string &title = "") const;
+        
+        /**
+         * @brief Generate the .bib file from manual entries
+         * @param outputDir Output directory (optional)
+         * @return true if the file was created successfully, false otherwise
+         */
+        bool generateBibFile(const std::string &outputDir = "") const;
+
+    private:
+        std::string m_bibFile;
+        BibStyle m_style;
+        std::string m_customStyle;
+        bool m_useExternalFile;
+        SharedVector<BibEntry> m_entries;
+
+        std::string getStyleName() const;
+    };
+
+    /**
+     * @brief Class to manage glossary terms and acronyms
+     *
+     * References are written as \gls{key}, \Gls{key}, \acrshort{key}, \acrlong{key}
+     * or \acrfull{key} and are resolved by the library while the document is generated:
+     * the first \gls use of an acronym is expanded ("Long Form (LF)"), later uses are
+     * abbreviated. No glossaries package or makeglossaries run is needed.
+     */
+    class Glossary
+    {
+    public:
+        /**
+         * @brief Glossary entry (plain term or acronym)
+         */
+        struct Entry
+        {
+            std::string key;
+            std::string name;        // Term name, or short form for acronyms
+            std::string longForm;    // Long form (acronyms only)
+            std::string description; // Description shown in the glossary section
+            bool acronym = false;
+        };
+
+        /**
+         * @brief Add a glossary term
+         * @param key Key used in \gls{key}
+         * @param name Text printed for the term
+         * @param description Description shown in the glossary section
+         */
+        void addEntry(const std::string &key, const std::string &name, const std::string &description);
+
+        /**
+         * @brief Add an acronym
+         * @param key Key used in \gls{key}
+         * @param shortForm Abbreviation (e.g., "API")
+         * @param longForm Expanded form (e.g., "Application Programming Interface")
+         * @param description Optional description shown in the glossary section
+         */
+        void addAcronym(const std::string &key, const std::string &shortForm,
+                        const std::string &longForm, const std::string &description = "");
+
+        /**
+         * @brief Find an entry by key
+         * @param key Entry key
+         * @return Pointer to the entry, or nullptr if the key is unknown
+         */
+        const Entry *find(const std::string &key) const;
+
+        bool empty() const
+        {
+            return m_entries.empty();
+        }
+
+        size_t size() const
+        {
+            return m_entries.size();
+        }
+
+        /**
+         * @brief Replace glossary references in a text, in reading order
+         *
+         * Verbatim environments and \verb are left unchanged. References to keys that
+         * are not in the glossary are replaced by a bold "??", as LaTeX does for an
+         * undefined \ref.
+         *
+         * @param text Text containing \gls{...} references
+         * @param used Usage flags per entry, updated as references are resolved
+         * @param unknownKeys Receives the keys of unknown references, in reading order (may be null)
+         * @return Text with all references resolved
+         */
+        std::string resolve(const std::string &text, std::vector<bool> &used,
+                            std::vector<std::string> *unknownKeys = nullptr) const;
+
+        /**
+         * @brief Generate the glossary section for the entries that were used
+         * @param used Usage flags per entry, as filled by resolve()
+         * @param heading Heading command (e.g., "\\section*{Glossary}")
+         * @return String containing LaTeX code (empty if no entry was used)
+         */
+        std::string generate(const std::vector<bool> &used, const std::string &heading) const;
+
+    private:
+        std::vector<Entry> m_entries;
+        std::unordered_map<std::string, size_t> m_index; // Key -> position in m_entries
+
+        void insertEntry(Entry entry);
+    };
+
+    /**
+     * @brief Class for mathematical theorem environments
+     */
+    class TheoremEnvironment : public Environment
+    {
+    public:
+        /**
+         * @brief Enum for theorem-like environment types
+         */
+        enum class Type
+        {
+            THEOREM,
+            LEMMA,
+            PROPOSITION,
+            COROLLARY,
+            DEFINITION,
+            EXAMPLE,
+            REMARK,
+            PROOF,
+            CUSTOM
+        };
+
+        /**
+         * @brief Constructor for theorem environment
+         * @param type Type of theorem environment
+         * @param content Content of the theorem
+         * @param title Optional title for the theorem
+         */
+        TheoremEnvironment(Type type, const std::string &content, const std::string &title = "")
+            : Environment(getEnvironmentName(type)), m_type(type), m_content(content), m_title(title), m_customType("") {}
+
+        /**
+         * @brief Constructor for custom theorem environment
+         * @param customType Name of the custom theorem environment
+         * @param content Content of the theorem
+         * @param title Optional title for the theorem
+         */
+        TheoremEnvironment(const std::string &customType, const std::string &content, const std::string &title = "")
+            : Environment(customType), m_type(Type::CUSTOM), m_content(content), m_title(title), m_customType(customType) {}
+
+        /**
+         * @brief Set the content of the theorem
+         * @param content Content of the theorem
+         */
+        void setContent(const std::string &content)
+        {
+            m_content = content;
+        }
+
+        /**
+         * @brief Set the title of the theorem
+         * @param title Title of the theorem
+         */
+        void setTitle(const std::string &title)
+        {
+            m_title = title;
+        }
+
+        /**
+         * @brief Generate LaTeX code for the theorem environment
+         * @return String containing LaTeX code
+         */
+        std::string generate() const override;
+
+        std::shared_ptr<Environment> clone() const override
+        {
+            return std::make_shared<TheoremEnvironment>(*this);
+        }
+
+        bool fingerprint(ContentHasher &hasher) const override;
+
+        bool cacheable() const override
+        {
+            return typeid(*this) == typeid(TheoremEnvironment);
+        }
+
+        /**
+         * @brief Get the theorem environment setup for document preamble
+         * @param language The document language for localization
+         * @return String containing LaTeX commands for theorem environment setup
+         */
+        static std::string getTheoremSetup(Language language = Language::ENGLISH);
+
+    private:
+        Type m_type;
+        std::string m_content;
+        std::string m_title;
+        std::string m_customType;
+
+        static std::string getEnvironmentName(Type type);
+    };
+
+    /**
+     * @brief Class for algorithm environments
+     *
+     * The arguments of all lines are stored in one arena of at most 4 GiB; the add
+     * methods return false, leaving the algorithm unchanged, for a line that does
+     * not fit.
+     */
+    class Algorithm : public Environment
+    {
+    public:
+        /**
+         * @brief Constructor for algorithm environment
+         * @param caption Caption for the algorithm
+         */
+        Algorithm(const std::string &caption = "")
+            : Environment("algorithm"), m_caption(caption) {}
+
+        /**
+         * @brief Set the caption of the algorithm
+         * @param caption Caption of the algorithm
+         */
+        void setCaption(const std::string &caption)
+        {
+            m_caption = caption;
+        }
+
+        /**
+         * @brief Set the label of the algorithm
+         * @param label Label of the algorithm
+         */
+        void setLabel(const std::string &label)
+        {
+            m_label = label;
+        }
+
+        /**
+         * @brief Add a line of pseudocode to the algorithm
+         *
+         * A line that is a closing command (\EndFor, \EndWhile, \EndIf or
+         * \EndFunction) closes the matching open block, which is then not closed
+         * again when the algorithm is generated.
+         *
+         * @param line Line of pseudocode
+         * @param indent Indentation level (0 = no indent)
+         */
+        bool addLine(const std::string &line, int indent = 0);
+
+        /**
+         * @brief Add a comment line to the algorithm
+         * @param comment Comment text
+         * @param indent Indentation level (0 = no indent)
+         */
+        bool addComment(const std::string &comment, int indent = 0)
+        {
+            return pushOp(OpCode::COMMENT, indent, comment);
+        }
+
+        /**
+         * @brief Add a for loop to the algorithm
+         * @param condition Loop condition
+         * @param indent Indentation level (0 = no indent)
+         */
+        bool addForLoop(const std::string &condition, int indent = 0)
+        {
+            return openBlock(OpCode::FOR, indent, condition);
+        }
+
+        /**
+         * @brief Add a while loop to the algorithm
+         * @param condition Loop condition
+         * @param indent Indentation level (0 = no indent)
+         */
+        bool addWhileLoop(const std::string &condition, int indent = 0)
+        {
+            return openBlock(OpCode::WHILE, indent, condition);
+        }
+
+        /**
+         * @brief Add an if statement to the algorithm
+         * @param condition If condition
+         * @param indent Indentation level (0 = no indent)
+         */
+        bool addIf(const std::string &condition, int indent = 0)
+        {
+            return openBlock(OpCode::IF, indent, condition);
+        }
+
+        /**
+         * @brief Add an else statement to the algorithm
+         * @param indent Indentation level (0 = no indent)
+         */
+        bool addElse(int indent = 0)
+        {
+            return pushOp(OpCode::ELSE, indent);
+        }
+
+        /**
+         * @brief Add an else if statement to the algorithm
+         * @param condition Else if condition
+         * @param indent Indentation level (0 = no indent)
+         */
+        bool addElseIf(const std::string &condition, int indent = 0)
+        {
+            return pushOp(OpCode::ELSE_IF, indent, condition);
+        }
+
+        /**
+         * @brief Add an end statement to the algorithm (for closing loops, if statements, etc.)
+         * @param statement Type of statement to end (e.g., "For", "If", "While")
+         * @param indent Indentation level (0 = no indent)
+         */
+        bool addEnd(const std::string &statement, int indent = 0);
+
+        /**
+         * @brief Close the innermost open block (For, While, If or Function)
+         *
+         * The matching \EndFor, \EndWhile, \EndIf or \EndFunction is added with the
+         * indentation of the statement that opened the block. Blocks still open when
+         * the algorithm is generated are closed automatically.
+         *
+         * @return false if no block is open
+         */
+        bool closeBlock();
+
+        /**
+         * @brief Add a return statement to the algorithm
+         * @param value Return value
+         * @param indent Indentation level (0 = no indent)
+         */
+        bool addReturn(const std::string &value, int indent = 0)
+        {
+            return pushOp(OpCode::RETURN, indent, value);
+        }
+
+        /**
+         * @brief Add a break statement to the algorithm
+         * @param indent Indentation level (0 = no indent)
+         */
+        bool addBreak(int indent = 0)
+        {
+            return pushOp(OpCode::BREAK, indent);
+        }
+        /**
+         * @brief Add a continue statement to the algorithm
+         * @param indent Indentation level (0 = no indent)
+         */
+        bool addContinue(int indent = 0)
+        {
+            return pushOp(OpCode::CONTINUE, indent);
+        }
+
+        
+        /**
+         * @brief Add a function definition to the algorithm
+         * @param name Function name
+         * @param args Function arguments
+         * @param indent Indentation level (0 = no indent)
+         */
+        bool addFunction(const std::string &name, const std::string &args, int indent = 0)
+        {
+            return openBlock(OpCode::FUNCTION, indent, name, args);
+        }
+        /**
+         * @brief Add a function end statement to the algorithm
+         * @param indent Indentation level (0 = no indent)
+         */
+        bool addFunctionEnd(int indent = 0)
+        {
+            return addEnd("Function", indent);
+        }
+       
+        /**
+         * @brief Generate LaTeX code for the algorithm environment
+         * @return String containing LaTeX code
+         */
+        std::string generate() const override;
+
+        std::shared_ptr<Environment> clone() const override
+        {
+            return std::make_shared<Algorithm>(*this);
+        }
+
+        bool fingerprint(ContentHasher &hasher) const override;
+
+        bool cacheable() const override
+        {
+            return typeid(*this) == typeid(Algorithm);
+        }
+
+        /**
+         * @brief Get the algorithm package inclusion commands for document preamble
+         * @return String containing LaTeX commands for algorithm package setup
+         */
+        static std::string getAlgorithmPackages();
+
+
+    private:
+        /**
+         * @brief Statement kinds, each emitted as prefix + argument [+ infix + argument] + suffix
+         */
+        enum class OpCode : uint8_t
+        {
+            LINE,
+            COMMENT,
+            FOR,
+            WHILE,
+            IF,
+            ELSE,
+            ELSE_IF,
+            END,
+            RETURN,
+            BREAK,
+            CONTINUE,
+            FUNCTION
+        };
+
+        /**
+         * @brief One pseudocode line; its arguments are stored back to back in the arena
+         */
+        struct Op
+        {
+            uint32_t offset;      // Offset of the first argument in the arena
+            uint32_t length;      // Length of the first argument
+            uint32_t extraLength; // Length of the second argument (function arguments)
+            int32_t indent;       // Indentation level
+            OpCode code;
+        };
+
+        /**
+         * @brief Lines of the algorithm, shared by copies until one of them is modified
+         */
+        struct Program
+        {
+            std::string arena;              // Arguments of all lines
+            std::vector<Op> ops;            // Lines in order
+            std::vector<size_t> openBlocks; // Indices of the lines opening blocks not closed yet
+        };
+
+        std::string m_caption;
+        std::string m_label;
+        CopyOnWrite<Program> m_program;
+
+        bool pushOp(OpCode code, int indent, const std::string &arg = "", const std::string &extra = "");
+        bool openBlock(OpCode code, int indent, const std::string &arg, const std::string &extra = "");
+        void closeOpenBlock(const std::string &statement);
+        static const char *getEndStatement(OpCode code);
+    };
+
+    /**
+     * @brief Class for source code listings highlighted at generation time
+     *
+     * The source is tokenized by the library and emitted as a fancyvrb Verbatim
+     * environment with pre-coloured markup, so TeX does no lexing (unlike listings).
+     */
+    class CodeListing : public Environment
+    {
+    public:
+        /**
+         * @brief Languages understood by the highlighter
+         */
+        enum class SourceLanguage
+        {
+            PLAIN,  // No highlighting
+            CPP,    // C and C++
+            JAVA,
+            PYTHON,
+            SHELL
+        };
+
+        /**
+         * @brief Constructor for code listing
+         * @param code Source code
+         * @param language Language of the source code
+         */
+        CodeListing(const std::string &code, SourceLanguage language = SourceLanguage::CPP)
+            : Environment("Verbatim"), m_code(std::make_shared<const std::string>(code)), m_language(language) {}
+
+        /**
+         * @brief Set the source code
+         * @param code Source code
+         */
+        void setCode(const std::string &code)
+        {
+            m_code = std::make_shared<const std::string>(code);
+        }
+
+        /**
+         * @brief Set the language of the source code
+         * @param language Language of the source code
+         */
+        void setLanguage(SourceLanguage language)
+        {
+            m_language = language;
+        }
+
+        /**
+         * @brief Set the title printed on the listing frame
+         * @param title Title of the listing
+         */
+        void setTitle(const std::string &title)
+        {
+            m_title = title;
+        }
+
+        /**
+         * @brief Enable or disable line numbers
+         * @param show If true, number the lines on the left
+         */
+        void setLineNumbers(bool show)
+        {
+            m_lineNumbers = show;
+        }
+
+        /**
+         * @brief Generate LaTeX code for the code listing
+         * @return String containing LaTeX code
+         */
+        std::string generate() const override;
+
+        std::shared_ptr<Environment> clone() const override
+        {
+            return std::make_shared<CodeListing>(*this);
+        }
+
+        bool fingerprint(ContentHasher &hasher) const override;
+
+        bool cacheable() const override
+        {
+            return typeid(*this) == typeid(CodeListing);
+        }
+
+        /**
+         * @brief Highlight source code into Verbatim markup
+         * @param code Source code
+         * @param language Language of the source code
+         * @param out String the markup is appended to
+         */
+        static void highlight(const std::string &code, SourceLanguage language, std::string &out);
+
+        /**
+         * @brief Get the package inclusion and style commands for document preamble
+         * @return String containing LaTeX commands for code listing setup
+         */
+        static std::string getListingSetup();
+
+    private:
+        std::shared_ptr<const std::string> m_code; // Shared by copies, replaced by setCode()
+        SourceLanguage m_language;
+        std::string m_title;
+        bool m_lineNumbers = false;
+    };
+
+    /**
+     * @brief Class for content with {{placeholder}} slots, compiled once and filled per record
+     *
+     * The text is split once into literal segments and slots. {{name}} inserts the value
+     * with LaTeX special characters escaped, {{&name}} inserts it unchanged. Placeholder
+     * names may contain letters, digits, '_', '-' and '.'; any other {{...}} is kept as is.
+     */
+    class ContentTemplate
+    {
+    public:
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        /**
+         * @brief Constructor compiling the template text
+         * @param text Template text
+         */
+        explicit ContentTemplate(const std::string &text);
+
+        /**
+         * @brief Get the number of distinct placeholders
+         * @return Number of slots
+         */
+        size_t getSlotCount() const
+        {
+            return m_slotNames.size();
+        }
+
+        /**
+         * @brief Get the placeholder names, in slot order
+         * @return Placeholder names
+         */
+        const std::vector<std::string> &getSlotNames() const
+        {
+            return m_slotNames;
+        }
+
+        /**
+         * @brief Find the slot of a placeholder
+         * @param name Placeholder name
+         * @return Slot index, or npos if the template has no such placeholder
+         */
+        size_t findSlot(const std::string &name) const;
+
+        /**
+         * @brief Render the template with values given by slot index
+         * @param out String the rendered text is appended to
+         * @param values Values indexed by slot (missing values render as empty)
+         */
+        void render(std::string &out, const std::vector<std::string> &values) const;
+
+        /**
+         * @brief Fill the template with a record
+         * @param record Values by placeholder name (missing values render as empty)
+         * @return Rendered text
+         */
+        std::string fill(const std::map<std::string, std::string> &record) const;
+
+        /**
+         * @brief Fill the template with values given by slot index
+         * @param values Values indexed by slot
+         * @return Rendered text
+         */
+        std::string fillSlots(const std::vector<std::string> &values) const;
+
+        /**
+         * @brief Add the compiled template to a hasher
+         * @param hasher Hasher receiving the template structure
+         */
+        void fingerprint(ContentHasher &hasher) const;
+
+    private:
+        /**
+         * @brief Literal text (slot == npos) or placeholder reference
+         */
+        struct Segment
+        {
+            size_t offset; // Offset of the literal in m_literals
+            size_t length; // Length of the literal
+            size_t slot;   // Slot index, npos for literals
+            bool raw;      // Insert the value without escaping
+        };
+
+        std::string m_literals;
+        std::vector<Segment> m_segments;
+        std::vector<std::string> m_slotNames;
+        std::unordered_map<std::string, size_t> m_slotIndex; // Name -> slot
+    };
+
+    /**
+     * @brief Document content rendered from a shared ContentTemplate and the current record
+     */
+    class TemplateBlock : public Environment
+    {
+    public:
+        /**
+         * @brief Constructor for template block
+         * @param contentTemplate Compiled template (may be shared by many blocks)
+         */
+        TemplateBlock(std::shared_ptr<const ContentTemplate> contentTemplate)
+            : Environment("template"), m_template(std::move(contentTemplate)),
+              m_values(m_template ? m_template->getSlotCount() : 0) {}
+
+        /**
+         * @brief Set the value of one placeholder
+         * @param name Placeholder name
+         * @param value Value (escaped or not according to the placeholder)
+         */
+        void setValue(const std::string &name, const std::string &value);
+
+        /**
+         * @brief Replace all values with those of a record
+         * @param record Values by placeholder name (placeholders not in the record become empty)
+         */
+        void setRecord(const std::map<std::string, std::string> &record);
+
+        /**
+         * @brief Get the compiled template
+         * @return Pointer to the template
+         */
+        std::shared_ptr<const ContentTemplate> getTemplate() const
+        {
+            return m_template;
+        }
+
+        /**
+         * @brief Generate the content for the current record
+         * @return String containing LaTeX code
+         */
+        std::string generate() const override;
+
+        std::shared_ptr<Environment> clone() const override
+        {
+            return std::make_shared<TemplateBlock>(*this);
+        }
+
+        bool fingerprint(ContentHasher &hasher) const override;
+
+        bool cacheable() const override
+        {
+            return typeid(*this) == typeid(TemplateBlock);
+        }
+
+    private:
+        std::shared_ptr<const ContentTemplate> m_template;
+        std::vector<std::string> m_values; // Values by slot
+    };
+
+    /**
+     * @brief Environment built by a callback when the document is generated
+     *
+     * The callback is invoked the first time the environment is emitted (or every time
+     * without memoisation). Copies, including those made by clone() and snapshot(),
+     * share the memoised result.
+     */
+    class LazyEnvironment : public Environment
+    {
+    public:
+        using Factory = std::function<std::shared_ptr<Environment>()>;
+
+        /**
+         * @brief Constructor for lazy environment
+         * @param factory Callback building the environment (may return nullptr for no content)
+         * @param memoize If true, the callback is invoked at most once
+         */
+        LazyEnvironment(Factory factory, bool memoize = true);
+
+        /**
+         * @brief Check whether the environment was already built and memoised
+         */
+        bool isEvaluated() const
+        {
+            return m_content->isEvaluated();
+        }
+
+        std::string generate() const override;
+
+        std::shared_ptr<Environment> clone() const override
+        {
+            return std::make_shared<LazyEnvironment>(*this);
+        }
+
+    private:
+        std::shared_ptr<LazyContent> m_content;
+    };
+
+    /**
+     * @brief Persistent cache of generated fragments, shared across process runs
+     *
+     * Fragments (the LaTeX code of a section or an environment) are stored under the
+     * stable hash of their inputs, so a later run generating the same node splices the
+     * stored bytes instead of generating it again.
+     *
+     * File layout (little-endian): a 32-byte header ("LGFCACHE", format version, run
+     * counter, entry count), a table of fixed-size 32-byte index records (key, data
+     * offset, length, last run that used the entry), then the fragment bytes. The
+     * index is read when the cache is opened and fragments are read on demand. When
+     * saving, the least recently used fragments are dropped to respect the size limit
+     * and the file is replaced atomically. All methods are thread-safe.
+     */
+    class FragmentCache
+    {
+    public:
+        /**
+         * @brief Cache usage counters
+         */
+        struct Stats
+        {
+            size_t hits = 0;        // Fragments spliced from the cache
+            size_t misses = 0;      // Fragments generated (and stored)
+            size_t bytesReused = 0; // Bytes spliced from the cache
+            size_t evictions = 0;   // Fragments dropped by the last save()
+        };
+
+        /**
+         * @brief Open (or create on save) a cache file
+         * @param filePath Path to the cache file
+         * @param maxBytes Maximum size of the stored fragments
+         */
+        explicit FragmentCache(const std::string &filePath, size_t maxBytes = 256 * 1024 * 1024);
+
+        /**
+         * @brief Destructor, saves the cache if it was modified
+         */
+        ~FragmentCache();
+
+        FragmentCache(const FragmentCache &) = delete;
+        FragmentCache &operator=(const FragmentCache &) = delete;
+
+        /**
+         * @brief Look a fragment up and mark it as used
+         * @param key Hash of the fragment inputs
+         * @param out Receives the fragment bytes
+         * @return true if the fragment was found
+         */
+        bool lookup(uint64_t key, std::string &out);
+
+        /**
+         * @brief Store a fragment
+         * @param key Hash of the fragment inputs
+         * @param fragment Fragment bytes
+         */
+        void store(uint64_t key, const std::string &fragment);
+
+        /**
+         * @brief Write the cache file, evicting the least recently used fragments
+         * @return true if the file was written successfully
+         */
+        bool save();
 
         /**
-         * @brief Constructor for custom theorem environment
-         * @param customType Name of the custom theorem environment
-         * @param content Content of the theorem
-         * @param title Optional title for the theorem
+         * @brief Get the number of stored fragments
          */
-        TheoremEnvironment(const std::string &customType, const std::string &content, const std::string &title = "")
-            : Environment(customType), m_type(Type::CUSTOM), m_content(content), m_title(title), m_customType(customType) {}
+        size_t size() const;
 
+        Stats getStats() const;
+
+    private:
         /**
-         * @brief Set the content of the theorem
-         * @param content Content of the theorem
+         * @brief Stored fragment, either in the cache file or added during this run
          */
-        void setContent(const std::string &content)
+        struct Entry
         {
-            m_content = content;
-        }
+            uint64_t offset = 0;  // Offset in the data area of the file (if not in memory)
+            uint64_t length = 0;
+            uint64_t lastUsed = 0; // Run counter of the last use
+            std::shared_ptr<const std::string> data; // Fragment added during this run
+        };
+
+        std::string m_filePath;
+        size_t m_maxBytes;
+        uint64_t m_run = 1;
+        uint64_t m_dataStart = 0;
+        std::unordered_map<uint64_t, Entry> m_entries;
+        std::ifstream m_file;
+        bool m_dirty = false;
+        Stats m_stats;
+        mutable std::mutex m_mutex;
+
+        void load();
+        bool readData(const Entry &entry, std::string &out);
+    };
 
+    /**
+     * @brief Store of identical environments, kept and rendered once
+     *
+     * Environments are compared by the hash of their inputs (see
+     * Environment::fingerprint): interning an environment equal to one already in the
+     * pool returns the stored one, so repeated disclaimer tables, logos or theorem
+     * boxes share a single object. Interned environments are treated as immutable and
+     * their generated code is kept, so each is rendered once for all the documents
+     * using the pool. All methods are thread-safe.
+     */
+    class EnvironmentPool
+    {
+    public:
         /**
-         * @brief Set the title of the theorem
-         * @param title Title of the theorem
+         * @brief Deduplication counters
          */
-        void setTitle(const std::string &title)
+        struct Stats
         {
-            m_title = title;
-        }
+            size_t interned = 0;      // Environments passed to intern()
+            size_t unique = 0;        // Distinct environments stored
+            size_t renders = 0;       // Interned environments emitted
+            size_t reusedRenders = 0; // Emissions served from the kept generated code
+            size_t bytesReused = 0;   // Bytes served from the kept generated code
+
+            /**
+             * @brief Ratio of interned to stored environments (1 means no duplicate)
+             */
+            double getDedupeRatio() const
+            {
+                return unique ? static_cast<double>(interned) / unique : 1.0;
+            }
+        };
 
         /**
-         * @brief Generate LaTeX code for the theorem environment
-         * @return String containing LaTeX code
+         * @brief Get the stored environment equal to the given one, storing it if new
+         * @param env Complete environment, not modified afterwards
+         * @return Stored environment (env itself if it cannot be fingerprinted)
          */
-        std::string generate() const override;
+        std::shared_ptr<Environment> intern(std::shared_ptr<Environment> env);
 
         /**
-         * @brief Get the theorem environment setup for document preamble
-         * @param language The document language for localization
-         * @return String containing LaTeX commands for theorem environment setup
+         * @brief Check whether an environment is stored in the pool
          */
-        static std::string getTheoremSetup(Language language = Language::ENGLISH);
+        bool contains(const Environment *env) const;
 
-    private:
-        Type m_type;
-        std::string m_content;
-        std::string m_title;
-        std::string m_customType;
+        /**
+         * @brief Get the generated code of an interned environment, if already rendered
+         * @param env Environment being emitted
+         * @param out Receives the generated code
+         * @return true if the code was found
+         */
+        bool lookupRendered(const Environment &env, std::string &out);
 
-        static std::string getEnvironmentName(Type type);
+        /**
+         * @brief Keep the generated code of an interned environment
+         * @param env Environment that was rendered (ignored if not interned)
+         * @param fragment Generated code
+         */
+        void storeRendered(const Environment &env, const std::string &fragment);
+
+        Stats getStats() const;
+
+    private:
+        std::unordered_map<uint64_t, std::shared_ptr<Environment>> m_byKey;
+        std::unordered_map<const Environment *, std::shared_ptr<const std::string>> m_rendered; // Interned -> code
+        Stats m_stats;
+        mutable std::mutex m_mutex;
     };
 
     /**
-     * @brief Class for algorithm environments
+     * @brief In-memory cache of rendered Beamer frames with change reports
+     *
+     * Frames generated from sections and environments are kept by the hash of their
+     * inputs, so regenerating a presentation after editing one frame renders only that
+     * frame again. Each generation records the content hash of every frame, and the
+     * change report lists the frames that differ from the previous generation (by frame
+     * unit index, see Presentation::generateFrameUnits()), to recompile only those.
+     * Frames not used by the last generations are dropped once the cache holds more
+     * than its maximum number of frames. All methods are thread-safe.
      */
-    class Algorithm : public Environment
+    class FrameCache
     {
     public:
         /**
-         * @brief Constructor for algorithm environment
-         * @param caption Caption for the algorithm
+         * @brief Cache usage counters
          */
-        Algorithm(const std::string &caption = "")
-            : Environment("algorithm"), m_caption(caption) {}
+        struct Stats
+        {
+            size_t hits = 0;        // Frames taken from the cache
+            size_t misses = 0;      // Frames rendered (and stored)
+            size_t bytesReused = 0; // Bytes taken from the cache
+            size_t evictions = 0;   // Frames dropped
+        };
 
         /**
-         * @brief Set the caption of the algorithm
-         * @param caption Caption of the algorithm
+         * @brief Frames changed by the last generation
          */
-        void setCaption(const std::string &caption)
+        struct ChangeReport
         {
-            m_caption = caption;
-        }
+            std::vector<size_t> changed; // Indices of new or modified frames, in order
+            size_t removed = 0;          // Frames of the previous generation beyond the last one
+            size_t frames = 0;           // Frames in the generation
+            size_t rendered = 0;         // Frames rendered instead of taken from the cache
+        };
 
         /**
-         * @brief Set the label of the algorithm
-         * @param label Label of the algorithm
+         * @brief Frame stored in the cache
          */
-        void setLabel(const std::string &label)
+        struct Frame
         {
-            m_label = label;
-        }
+            std::string title;
+            std::string latex;
+        };
 
         /**
-         * @brief Add a line of pseudocode to the algorithm
-         * @param line Line of pseudocode
-         * @param indent Indentation level (0 = no indent)
+         * @param maxFrames Number of frames above which unused frames are dropped
          */
-        void addLine(const std::string &line, int indent = 0)
+        explicit FrameCache(size_t maxFrames = 10000)
+            : m_maxFrames(maxFrames)
         {
-            m_lines.push_back({line, indent});
         }
 
         /**
-         * @brief Add a comment line to the algorithm
-         * @param comment Comment text
-         * @param indent Indentation level (0 = no indent)
+         * @brief Look a frame up and mark it as used
+         * @param key Hash of the frame inputs
+         * @param out Receives the frame
+         * @return true if the frame was found
          */
-        void addComment(const std::string &comment, int indent = 0)
-        {
-            m_lines.push_back({"\\" + std::string(indent > 0 ? ">\\" : "") + "Comment{" + comment + "}", indent});
-        }
+        bool lookup(uint64_t key, Frame &out);
 
         /**
-         * @brief Add a for loop to the algorithm
-         * @param condition Loop condition
-         * @param indent Indentation level (0 = no indent)
+         * @brief Store a rendered frame
+         * @param key Hash of the frame inputs
+         * @param frame Frame title and code
          */
-        void addForLoop(const std::string &condition, int indent = 0)
-        {
-            m_lines.push_back({"\\For{" + condition + "}", indent});
-            // m_lines.push_back({"\\Do", indent});
-        }
+        void store(uint64_t key, const Frame &frame);
 
         /**
-         * @brief Add a while loop to the algorithm
-         * @param condition Loop condition
-         * @param indent Indentation level (0 = no indent)
+         * @brief Record a generation and compare it with the previous one
+         * @param frameHashes Content hash of every frame unit, in order
+         * @param rendered Frames rendered during the generation
+         * @return Change report (also kept for getLastChanges())
          */
-        void addWhileLoop(const std::string &condition, int indent = 0)
-        {
-            m_lines.push_back({"\\While{" + condition + "}", indent});
-            // m_lines.push_back({"\\Do", indent});
-        }
+        ChangeReport record(const std::vector<uint64_t> &frameHashes, size_t rendered);
 
         /**
-         * @brief Add an if statement to the algorithm
-         * @param condition If condition
-         * @param indent Indentation level (0 = no indent)
+         * @brief Get the change report of the last recorded generation
          */
-        void addIf(const std::string &condition, int indent = 0)
-        {
-            m_lines.push_back({"\\If{" + condition + "}", indent});
-            // m_lines.push_back({"\\Then", indent});
-        }
+        ChangeReport getLastChanges() const;
 
         /**
-         * @brief Add an else statement to the algorithm
-         * @param indent Indentation level (0 = no indent)
+         * @brief Get the number of stored frames
          */
-        void addElse(int indent = 0)
-        {
-            m_lines.push_back({"\\Else", indent});
-        }
+        size_t size() const;
 
         /**
-         * @brief Add an else if statement to the algorithm
-         * @param condition Else if condition
-         * @param indent Indentation level (0 = no indent)
+         * @brief Drop every frame and forget the previous generation
          */
-        void addElseIf(const std::string &condition, int indent = 0)
+        void clear();
+
+        Stats getStats() const;
+
+    private:
+        struct Entry
         {
-            m_lines.push_back({"\\ElsIf{" + condition + "}", indent});
-            // m_lines.push_back({"\\Then", indent});
-        }
+            std::shared_ptr<const Frame> frame;
+            uint64_t generation;
+        };
+
+        size_t m_maxFrames;
+        uint64_t m_generation = 1;
+        std::unordered_map<uint64_t, Entry> m_entries;
+        std::vector<uint64_t> m_lastHashes;
+        ChangeReport m_lastChanges;
+        Stats m_stats;
+        mutable std::mutex m_mutex;
+    };
 
+    /**
+     * @brief Ordered content slots reserved up front and filled concurrently
+     *
+     * reserve() hands out consecutive slot indices with an atomic counter and each fill
+     * publishes the slot content with a single atomic store, so producers running on
+     * several threads never wait for each other. Slots live in segments of growing size
+     * that never move; a reader sees each slot either empty or completely filled, in
+     * reservation order.
+     */
+    class ContentSlots
+    {
+    public:
         /**
-         * @brief Add an end statement to the algorithm (for closing loops, if statements, etc.)
-         * @param statement Type of statement to end (e.g., "For", "If", "While")
-         * @param indent Indentation level (0 = no indent)
+         * @brief Content of a filled slot (exactly one member is set)
          */
-        void addEnd(const std::string &statement, int indent = 0)
+        struct Item
         {
-            m_lines.push_back({"\\End" + statement, indent});
-        }
+            std::shared_ptr<const Section> section;
+            std::shared_ptr<Environment> environment;
+            std::shared_ptr<const std::string> rawContent;
+        };
 
         /**
-         * @brief Add a return statement to the algorithm
-         * @param value Return value
-         * @param indent Indentation level (0 = no indent)
+         * @brief Position of a reservation in the content of its document
+         *
+         * Counts of each kind of content added before the slots were reserved; a filled
+         * slot is written after that many items of its own kind.
          */
-        void addReturn(const std::string &value, int indent = 0)
+        struct Anchor
         {
-            m_lines.push_back({"\n\\Return{" + value + "}", indent});
-        }
+            size_t sections = 0;
+            size_t environments = 0;
+            size_t rawContent = 0;
+            size_t part = static_cast<size_t>(-1); // Book part whose chapters are counted by sections (none by default)
+        };
 
         /**
-         * @brief Add a break statement to the algorithm
-         * @param indent Indentation level (0 = no indent)
+         * @brief Slots reserved by one call to reserve()
          */
-        void addBreak(int indent = 0)
+        struct Reservation
         {
-            m_lines.push_back({"\\Break", indent});
-        }
+            size_t first;
+            size_t count;
+            Anchor anchor;
+        };
+
+        ContentSlots() = default;
+        ContentSlots(const ContentSlots &other);
+        ContentSlots &operator=(const ContentSlots &other);
+        ~ContentSlots();
+
         /**
-         * @brief Add a continue statement to the algorithm
-         * @param indent Indentation level (0 = no indent)
+         * @brief Reserve consecutive slots (thread-safe)
+         * @param count Number of slots
+         * @return Index of the first reserved slot
          */
-        void addContinue(int indent = 0)
+        size_t reserve(size_t count)
         {
-            m_lines.push_back({"\\Continue", indent});
+            return reserve(count, Anchor());
         }
 
-        
         /**
-         * @brief Add a function definition to the algorithm
-         * @param name Function name
-         * @param args Function arguments
-         * @param indent Indentation level (0 = no indent)
+         * @brief Reserve consecutive slots at a position of the document (thread-safe)
+         * @param count Number of slots
+         * @param anchor Position of the slots in the document content
+         * @return Index of the first reserved slot
          */
-        void addFunction(const std::string &name, const std::string &args, int indent = 0)
-        {
-            m_lines.push_back({"\\Function{" + name + "}(" + args + ")", indent});
-            // m_lines.push_back({"\\Do", indent});
-        }
+        size_t reserve(size_t count, const Anchor &anchor);
+
         /**
-         * @brief Add a function end statement to the algorithm
-         * @param indent Indentation level (0 = no indent)
+         * @brief Get the reservations made so far (thread-safe)
+         * @return Reservations, in no particular order
+         */
+        std::vector<Reservation> getReservations() const;
+
+        /**
+         * @brief Publish the content of a reserved slot (thread-safe)
+         * @param index Slot index returned by reserve()
+         * @param item Slot content
+         * @return false if the slot was not reserved or is already filled
+         */
+        bool fill(size_t index, Item item);
+
+        /**
+         * @brief Get the content of a slot (thread-safe)
+         * @param index Slot index
+         * @return Pointer to the content, or nullptr if the slot is not filled yet
          */
-        void addFunctionEnd(int indent = 0)
+        const Item *get(size_t index) const;
+
+        /**
+         * @brief Get the number of reserved slots
+         */
+        size_t size() const
         {
-            m_lines.push_back({"\\EndFunction", indent});
+            return m_reserved.load(std::memory_order_acquire);
         }
-       
+
         /**
-         * @brief Generate LaTeX code for the algorithm environment
+         * @brief Generate the content of the filled slots, in slot order
          * @return String containing LaTeX code
          */
-        std::string generate() const override;
+        std::string generate() const;
 
         /**
-         * @brief Get the algorithm package inclusion commands for document preamble
-         * @return String containing LaTeX commands for algorithm package setup
+         * @brief Replace slot environments by copies (see Document::clone)
+         *
+         * Not thread-safe: only call it on slots no other thread can access.
          */
-        static std::string getAlgorithmPackages();
-
+        void detachEnvironments();
 
     private:
-        std::string m_caption;
-        std::string m_label;
-        std::vector<std::pair<std::string, int>> m_lines; // Line content, indentation level
+        static constexpr size_t FIRST_SEGMENT_SIZE = 32;
+        static constexpr size_t MAX_SEGMENTS = 48;
+
+        using Slot = std::atomic<Item *>;
+
+        /**
+         * @brief Node of the lock-free list of reservations, pushed at the head
+         */
+        struct ReservationNode
+        {
+            Reservation reservation;
+            ReservationNode *next;
+        };
+
+        std::atomic<size_t> m_reserved{0};
+        std::atomic<Slot *> m_segments[MAX_SEGMENTS] = {};
+        std::atomic<ReservationNode *> m_reservations{nullptr};
+
+        static size_t locate(size_t index, size_t &offset);
+        Slot *slot(size_t index) const;
+        size_t allocate(size_t count);
+        void publish(const Reservation &reservation);
+        void copyFrom(const ContentSlots &other);
+        void clear();
     };
 
     /**
@@ -844,78 +2853,401 @@ namespace LatexGen
         std::string m_footerRight;
     };
 
-    /**
-     * @brief Base class for all LaTeX documents
-     */
-    class Document
-    {
-    public:
-        Document(DocumentType type, const std::string &title = "",
-                 const std::string &author = "", const std::string &date = "\\today",
-                 Language language = Language::ENGLISH);
-        virtual ~Document() = default;
+    /**
+     * @brief Base class for all LaTeX documents
+     */
+    class Document
+    {
+    public:
+        Document(DocumentType type, const std::string &title = "",
+                 const std::string &author = "", const std::string &date = "\\today",
+                 Language language = Language::ENGLISH);
+        virtual ~Document() = default;
+
+        void setTitle(const std::string &title)
+        {
+            m_title = title;
+        }
+
+        void setAuthor(const std::string &author)
+        {
+            m_author = author;
+        }
+
+        void setDate(const std::string &date)
+        {
+            m_date = date;
+        }
+
+        void setLanguage(Language language)
+        {
+            m_language = language;
+        }
+
+        Language getLanguage() const
+        {
+            return m_language;
+        }
+
+        std::string getTitle() const
+        {
+            return m_title;
+        }
+
+        std::string getAuthor() const
+        {
+            return m_author;
+        }
+
+        void addPackage(const std::string &package, const std::string &options = "")
+        {
+            m_packages.edit()[package] = options;
+        }
+
+        void addSection(const Section &section)
+        {
+            m_sections.push_back(section);
+            if (m_compressionThreshold > 0)
+            {
+                m_sections.edit(m_sections.size() - 1).compress(m_compressionThreshold);
+            }
+        }
+
+        void addEnvironment(std::shared_ptr<Environment> env)
+        {
+            m_environments.push_back(env);
+            exposeEnvironment(m_environments.size() - 1);
+        }
+
+        void addRawContent(const std::string &content)
+        {
+            StoredText text(content);
+            text.compress(m_compressionThreshold);
+            m_rawContent.push_back(std::move(text));
+        }
+
+        /**
+         * @brief Add a complete environment that may repeat (logo, disclaimer...)
+         *
+         * The environment is interned in the document environment pool: identical
+         * environments are stored once and generated once. It must not be modified
+         * after this call.
+         *
+         * @param env Environment to add
+         * @return Environment actually added (an identical one already in the pool, or env)
+         */
+        std::shared_ptr<Environment> addSharedEnvironment(std::shared_ptr<Environment> env);
+
+        /**
+         * @brief Share an environment pool with other documents
+         * @param pool Environment pool (see addSharedEnvironment())
+         */
+        void setEnvironmentPool(std::shared_ptr<EnvironmentPool> pool)
+        {
+            m_environmentPool = std::move(pool);
+        }
+
+        /**
+         * @brief Get the environment pool, with its deduplication statistics
+         * @return Pointer to the pool (nullptr if no environment was shared yet)
+         */
+        std::shared_ptr<EnvironmentPool> getEnvironmentPool() const
+        {
+            return m_environmentPool;
+        }
+
+        /**
+         * @brief Reserve ordered slots for content produced later, possibly on other threads
+         *
+         * Slots are rendered where they were reserved: a filled slot is written after
+         * the content of the same kind (sections, environments or raw content) added
+         * before the reservation, as if it had been added then, and slots reserved at the
+         * same point are written in slot order. In a book with a current part, section
+         * slots are chapters of that part. Filling slots is thread-safe and lock-free,
+         * and may happen while the document is being generated: slots that are not
+         * filled yet are skipped. Reserving is thread-safe too, but reads the content
+         * added so far, so it must not run concurrently with other methods of the
+         * document, which are not thread-safe.
+         *
+         * @param count Number of consecutive slots to reserve
+         * @return Index of the first reserved slot
+         */
+        size_t reserveSlots(size_t count = 1)
+        {
+            return m_slots.reserve(count, getSlotAnchor());
+        }
+
+        /**
+         * @brief Fill a reserved slot with a section (thread-safe)
+         * @param slot Slot index returned by reserveSlots()
+         * @param section Section to render in the slot
+         * @return false if the slot was not reserved or is already filled
+         */
+        bool fillSection(size_t slot, const Section &section)
+        {
+            return m_slots.fill(slot, {std::make_shared<const Section>(section), nullptr, nullptr});
+        }
+
+        /**
+         * @brief Fill a reserved slot with an environment (thread-safe)
+         * @param slot Slot index returned by reserveSlots()
+         * @param env Environment to render in the slot
+         * @return false if the slot was not reserved or is already filled
+         */
+        bool fillEnvironment(size_t slot, std::shared_ptr<Environment> env)
+        {
+            return env && m_slots.fill(slot, {nullptr, std::move(env), nullptr});
+        }
 
-        void setTitle(const std::string &title)
+        /**
+         * @brief Fill a reserved slot with raw LaTeX content (thread-safe)
+         * @param slot Slot index returned by reserveSlots()
+         * @param content LaTeX content
+         * @return false if the slot was not reserved or is already filled
+         */
+        bool fillRawContent(size_t slot, const std::string &content)
         {
-            m_title = title;
+            return m_slots.fill(slot, {nullptr, nullptr, std::make_shared<const std::string>(content)});
         }
 
-        void setAuthor(const std::string &author)
+        /**
+         * @brief Create a copy of the document that shares its content
+         *
+         * The copy takes constant time: sections, environments, raw content, packages,
+         * bibliography and glossary are shared with this document until one of the two
+         * modifies them, and only the modified parts are copied then. Shared environments
+         * must be modified through editEnvironment() to keep the change in one document.
+         * Environments the caller may still hold a pointer to (returned by addTable(),
+         * editEnvironment()...) and those of filled slots (see reserveSlots()) are
+         * copied for the clone, so changes made through these pointers only show in
+         * this document; this is linear in their number.
+         *
+         * @return Pointer to the copy (same document class as this one)
+         */
+        virtual std::shared_ptr<Document> clone() const
         {
-            m_author = author;
+            auto copy = std::make_shared<Document>(*this);
+            detachEnvironments(*copy);
+            return copy;
         }
 
-        void setDate(const std::string &date)
+        size_t getSectionCount() const
         {
-            m_date = date;
+            return m_sections.size();
         }
 
-        void setLanguage(Language language)
+        const Section &getSection(size_t index) const
         {
-            m_language = language;
+            return m_sections[index];
         }
 
-        Language getLanguage() const
+        /**
+         * @brief Get a section for modification
+         * @param index Position of the section (in insertion order)
+         * @return Reference to a section owned by this document only
+         */
+        Section &editSection(size_t index)
         {
-            return m_language;
+            return m_sections.edit(index);
         }
 
-        std::string getTitle() const
+        size_t getEnvironmentCount() const
         {
-            return m_title;
+            return m_environments.size();
         }
 
-        std::string getAuthor() const
+        std::shared_ptr<const Environment> getEnvironment(size_t index) const
         {
-            return m_author;
+            return m_environments[index];
         }
 
-        void addPackage(const std::string &package, const std::string &options = "")
+        /**
+         * @brief Get an environment for modification
+         *
+         * The environment is copied first unless this document is its only owner, so the
+         * change does not show in clones (pointers obtained earlier keep the old version).
+         *
+         * @param index Position of the environment (in insertion order)
+         * @return Pointer to the environment, or nullptr if it cannot be copied
+         */
+        std::shared_ptr<Environment> editEnvironment(size_t index);
+
+        size_t getRawContentCount() const
         {
-            m_packages[package] = options;
+            return m_rawContent.size();
         }
 
-        void addSection(const Section &section)
+        /**
+         * @brief Get a raw content block for modification
+         * @param index Position of the block (in insertion order)
+         * @return Reference to a block owned by this document only
+         */
+        std::string &editRawContent(size_t index)
         {
-            m_sections.push_back(section);
+            return m_rawContent.edit(index).edit();
         }
 
-        void addEnvironment(std::shared_ptr<Environment> env)
+        /**
+         * @brief Render only a selection of the sections (ignored by presentations)
+         *
+         * The preamble, title and table of contents are kept. Combine with clone() to
+         * preview a part of a document without changing it.
+         *
+         * @param filter Sections to render
+         */
+        void setRenderFilter(const RenderFilter &filter)
         {
-            m_environments.push_back(env);
+            m_renderFilter = std::make_shared<const RenderFilter>(filter);
         }
 
-        void addRawContent(const std::string &content)
+        /**
+         * @brief Reuse fragments generated by previous runs
+         *
+         * Sections and environments are looked up by the hash of their inputs and
+         * spliced from the cache when found; generated ones are added to it. Nodes with
+         * lazy content are always generated. The cache may be shared by documents.
+         *
+         * @param cache Fragment cache (nullptr to disable)
+         */
+        void setFragmentCache(std::shared_ptr<FragmentCache> cache)
+        {
+            m_fragmentCache = std::move(cache);
+        }
+
+        /**
+         * @brief Render the whole document again
+         */
+        void clearRenderFilter()
         {
-            m_rawContent.push_back(content);
+            m_renderFilter.reset();
         }
 
+        /**
+         * @brief Take an immutable snapshot of the document
+         *
+         * The snapshot is a clone(): it shares its content with this document, and
+         * environments the caller holds a pointer to (returned by addTable(),
+         * addList()...) are replaced by shallow copies whose data is copied only when
+         * this document next modifies them. The snapshot can therefore be rendered on
+         * another thread while this document keeps being modified. Take the snapshot on
+         * the thread that modifies the document; the snapshot itself is never modified.
+         *
+         * @return Pointer to the snapshot
+         */
+        std::shared_ptr<const Document> snapshot() const;
+
+        /**
+         * @brief List the external files the generated document reads
+         *
+         * Covers the images of figures (including those in reserved slots) and the
+         * .bib file of the bibliography when citations are used. Lazy environments are
+         * not built for this and are left out, and files referenced in raw content are
+         * only found by scanning the generated source (see
+         * DocumentDependencies::addReferences()).
+         *
+         * @return Files, each listed once in document order
+         */
+        DocumentDependencies collectDependencies() const;
+
         virtual std::string generatePreamble() const;
-        virtual std::string generateDocument() const;
+
+        /**
+         * @brief Generate the body, from \begin{document} to \end{document}
+         *
+         * Glossary references are left unresolved (see generate()).
+         *
+         * @return String containing LaTeX code
+         */
+        std::string generateDocument() const;
+
+        /**
+         * @brief Write the body (see generateDocument()) as its parts are rendered
+         * @param out Stream receiving the LaTeX code
+         */
+        virtual void writeDocument(std::ostream &out) const;
+
         virtual std::string generate() const;
 
         bool saveToFile(const std::string &Path, const std::string &filePath) const;
 
+        /**
+         * @brief Save the document and a dependency file for make or ninja
+         *
+         * The dependency file has a Makefile rule making the PDF (the .tex path with a
+         * .pdf extension) depend on the .tex file and on every file the source reads:
+         * figures, .bib files, \input fragments and plot data, found from the model and
+         * by scanning the generated source. Paths are given relative to the current
+         * directory, assuming the engine runs in the directory of the .tex file. Each
+         * dependency also gets an empty rule (like gcc -MP) so deleting a file does not
+         * break the build. The .tex file is only rewritten when its content changes, so
+         * an unchanged document is not compiled again. Both files are written under a
+         * temporary name and renamed (see replaceFile()).
+         *
+         * @param Path Directory of the .tex file (created if needed)
+         * @param filePath Name of the .tex file
+         * @param dependencyFile Path of the dependency file
+         * @param dependencies Receives the files read by the source, as written in it (may be null)
+         * @return true if both files are written
+         */
+        bool saveToFile(const std::string &Path, const std::string &filePath, const std::string &dependencyFile,
+                        DocumentDependencies *dependencies = nullptr) const;
+
+        /**
+         * @brief Write the document to a stream (used by saveToFile())
+         * @param out Output stream
+         */
+        void write(std::ostream &out) const;
+
+        /**
+         * @brief Generate a fast-compiling preview of the document
+         *
+         * The profile applies to this call only: the document is rendered through a
+         * clone sharing its content, so it is neither copied nor modified.
+         *
+         * @param profile Preview settings
+         * @return Preview source
+         */
+        std::string generate(const PreviewProfile &profile) const;
+
+        /**
+         * @brief Write a fast-compiling preview of the document to a stream
+         * @param out Output stream
+         * @param profile Preview settings
+         */
+        void write(std::ostream &out, const PreviewProfile &profile) const;
+
+        /**
+         * @brief Normalise whitespace of the output while it is written
+         *
+         * See CompactStreamBuf: paragraph breaks and verbatim content are preserved.
+         *
+         * @param enable If true, generate() and saveToFile() produce compact output
+         */
+        void enableCompactOutput(bool enable = true)
+        {
+            m_compactOutput = enable;
+        }
+
+        /**
+         * @brief Keep large text blocks compressed in memory
+         *
+         * Raw content and section text of at least @p threshold bytes added after this
+         * call is stored as CompressedText and decoded while the document is generated.
+         * Content filled into slots is not compressed.
+         *
+         * @param threshold Minimum size in bytes (0 disables compression)
+         */
+        void setCompressionThreshold(size_t threshold)
+        {
+            m_compressionThreshold = threshold;
+        }
+
+        /**
+         * @brief Get the size of the stored text and its compression ratio
+         * @return Counters over raw content and section text
+         */
+        virtual TextStorageStats getTextStorageStats() const;
+
         /**
          * @brief Add a citation to the document
          * @param key Citation key from the bibliography
@@ -923,7 +3255,7 @@ namespace LatexGen
          */
         std::string cite(const std::string &key)
         {
-            m_usedCitations.insert(key);
+            m_usedCitations.edit().insert(key);
             return "\\cite{" + key + "}";
         }
 
@@ -935,7 +3267,7 @@ namespace LatexGen
          */
         std::string citePages(const std::string &key, const std::string &pages)
         {
-            m_usedCitations.insert(key);
+            m_usedCitations.edit().insert(key);
             return "\\cite[" + pages + "]{" + key + "}";
         }
 
@@ -948,6 +3280,63 @@ namespace LatexGen
             m_bibliography = bibliography;
         }
 
+        /**
+         * @brief Add a term to the document glossary
+         * @param key Key used with gls()
+         * @param name Text printed for the term
+         * @param description Description shown in the glossary section
+         */
+        void addGlossaryEntry(const std::string &key, const std::string &name, const std::string &description)
+        {
+            m_glossary.edit().addEntry(key, name, description);
+        }
+
+        /**
+         * @brief Add an acronym to the document glossary
+         * @param key Key used with gls()
+         * @param shortForm Abbreviation
+         * @param longForm Expanded form, printed on first use
+         * @param description Optional description shown in the glossary section
+         */
+        void addAcronym(const std::string &key, const std::string &shortForm,
+                        const std::string &longForm, const std::string &description = "")
+        {
+            m_glossary.edit().addAcronym(key, shortForm, longForm, description);
+        }
+
+        /**
+         * @brief Reference a glossary term or acronym
+         *
+         * The reference is resolved during generation: the first use of an acronym
+         * in the document is expanded, later uses are abbreviated.
+         *
+         * @param key Glossary key
+         * @return Glossary reference string
+         */
+        std::string gls(const std::string &key) const
+        {
+            return "\\gls{" + key + "}";
+        }
+
+        /**
+         * @brief List the glossary references whose key is not in the glossary
+         *
+         * Such references are printed as a bold "??". Generates the document body.
+         *
+         * @return Unknown keys, each listed once in reading order (none when the glossary
+         *         is empty, since references are then left unchanged)
+         */
+        std::vector<std::string> findUnknownGlossaryKeys() const;
+
+        /**
+         * @brief Enable or disable the glossary section at the end of the document
+         * @param include If true, list the used terms before \end{document}
+         */
+        void includeGlossary(bool include = true)
+        {
+            m_includeGlossary = include;
+        }
+
         /**
          * @brief Add theorem setup to the document preamble
          */
@@ -964,6 +3353,14 @@ namespace LatexGen
             m_algorithmsEnabled = true;
         }
 
+        /**
+         * @brief Add code listing support to the document preamble
+         */
+        void enableCodeListings()
+        {
+            m_codeListingsEnabled = true;
+        }
+
         /**
          * @brief Add custom preamble content
          * @param content Preamble content
@@ -973,6 +3370,17 @@ namespace LatexGen
             m_customPreamble.push_back(content);
         }
 
+        /**
+         * @brief Replace repeated blocks of the generated document by macros
+         * @param enable If true, run extractMacros() on the output of generate()
+         * @param options Extraction settings
+         */
+        void enableMacroExtraction(bool enable = true, const MacroExtractionOptions &options = MacroExtractionOptions())
+        {
+            m_macroExtractionEnabled = enable;
+            m_macroExtractionOptions = options;
+        }
+
         /**
          * @brief Add a figure to the document
          * @param imagePath Path to the image file
@@ -1046,24 +3454,142 @@ namespace LatexGen
                                                      const std::string &content,
                                                      const std::string &title = "");
 
+        /**
+         * @brief Add a highlighted code listing to the document
+         * @param code Source code
+         * @param language Language of the source code
+         * @param title Optional title printed on the listing frame
+         * @return Pointer to the created CodeListing object
+         */
+        std::shared_ptr<CodeListing> addCodeListing(const std::string &code,
+                                                    CodeListing::SourceLanguage language = CodeListing::SourceLanguage::CPP,
+                                                    const std::string &title = "");
+
+        /**
+         * @brief Add content with {{placeholder}} slots to the document
+         * @param text Template text, compiled once
+         * @return Pointer to the created TemplateBlock object, to be filled per record
+         */
+        std::shared_ptr<TemplateBlock> addTemplate(const std::string &text);
+
+        /**
+         * @brief Add an environment built only when the document is generated
+         * @param factory Callback building the environment
+         * @param memoize If true, the callback is invoked at most once
+         * @return Pointer to the created LazyEnvironment object
+         */
+        std::shared_ptr<LazyEnvironment> addLazyEnvironment(LazyEnvironment::Factory factory, bool memoize = true);
+
     protected:
         DocumentType m_type;
         std::string m_title;
         std::string m_author;
         std::string m_date;
         Language m_language;
-        std::map<std::string, std::string> m_packages;
-        std::vector<Section> m_sections;
-        std::vector<std::shared_ptr<Environment>> m_environments;
-        std::vector<std::string> m_rawContent;
-        std::vector<std::string> m_customPreamble;
-        std::set<std::string> m_usedCitations;
+        CopyOnWrite<std::map<std::string, std::string>> m_packages;
+        SharedVector<Section> m_sections;
+        SharedVector<std::shared_ptr<Environment>> m_environments;
+        SharedVector<StoredText> m_rawContent;
+        SharedVector<std::string> m_customPreamble;
+        CopyOnWrite<std::set<std::string>> m_usedCitations;
         Bibliography m_bibliography;
+        CopyOnWrite<Glossary> m_glossary;
+        ContentSlots m_slots;
+        std::shared_ptr<const RenderFilter> m_renderFilter;
+        std::shared_ptr<const PreviewProfile> m_previewProfile; // Set on the clones rendered as previews
+        std::shared_ptr<FragmentCache> m_fragmentCache;
+        std::shared_ptr<EnvironmentPool> m_environmentPool;
+        std::vector<size_t> m_exposedEnvironments; // Environments whose pointer was handed out
+        size_t m_exposedLimit = 64;                // Size of m_exposedEnvironments that triggers pruning
         bool m_theoremsEnabled = false;
         bool m_algorithmsEnabled = false;
+        bool m_codeListingsEnabled = false;
+        bool m_includeGlossary = false;
+        bool m_macroExtractionEnabled = false;
+        bool m_compactOutput = false;
+        size_t m_compressionThreshold = 0;
+        MacroExtractionOptions m_macroExtractionOptions;
 
         std::string getDocumentClass() const;
         std::string getLanguageConfiguration() const;
+        std::string getGlossaryHeading() const;
+        std::string generateBody() const;
+
+        /**
+         * @brief Write the body with its glossary references resolved
+         * @param out Stream receiving the LaTeX code
+         */
+        void writeBody(std::ostream &out) const;
+
+        class SectionWriter;     // Writes sections through the render filter
+        class GlossaryStreamBuf; // Resolves glossary references while the body is written
+
+        bool includesOtherContent() const
+        {
+            return !m_renderFilter || m_renderFilter->includeOtherContent;
+        }
+
+        bool includesContentLists() const
+        {
+            return !m_previewProfile || !m_previewProfile->omitContentLists;
+        }
+
+        /**
+         * @brief Check whether a package is loaded (and not dropped by the preview profile)
+         */
+        bool includesPackage(const std::string &name) const;
+
+        std::string generateDocumentClass(const std::string &documentClass) const;
+        std::string generatePackages() const;
+        std::string generateBibliographyCommands() const;
+
+        /**
+         * @brief Filled slots with the position they are written at (see reserveSlots())
+         */
+        using SlotList = std::vector<std::pair<size_t, const ContentSlots::Item *>>;
+
+        /**
+         * @brief Filled slots grouped by the content they are written among
+         */
+        struct PlacedSlots
+        {
+            SlotList sections;
+            SlotList environments;
+            SlotList rawContent;
+            std::map<size_t, SlotList> chapters; // Book chapter slots, by part
+        };
+
+        /**
+         * @brief Get the position of slots reserved now
+         */
+        virtual ContentSlots::Anchor getSlotAnchor() const;
+
+        PlacedSlots placeSlots() const;
+
+        void writeRawContent(std::ostream &ss, const SlotList &slots) const;
+        void writeSections(std::ostream &ss, SectionWriter &writer, const SharedVector<Section> &sections,
+                           const SlotList &slots) const;
+        void writeEnvironments(std::ostream &ss, const SlotList &slots) const;
+
+        /**
+         * @brief Write the raw content, sections and environments with their slots
+         */
+        void writeContent(std::ostream &ss, SectionWriter &writer) const;
+
+        std::string renderSection(const Section &section) const;
+        std::string renderEnvironment(const Environment &env) const;
+
+        /**
+         * @brief Record that a pointer to an environment was handed out
+         * @param index Position of the environment
+         */
+        void exposeEnvironment(size_t index);
+
+        /**
+         * @brief Give a fresh copy of this document its own reachable environments (see clone())
+         * @param copy Copy of this document, not shared yet
+         */
+        void detachEnvironments(Document &copy) const;
     };
 
     /**
@@ -1133,12 +3659,19 @@ namespace LatexGen
 
         void setBibliography(const Bibliography& bibliography);
 
-        std::string generateDocument() const override;
+        void writeDocument(std::ostream &out) const override;
+
+        std::shared_ptr<Document> clone() const override
+        {
+            auto copy = std::make_shared<Article>(*this);
+            detachEnvironments(*copy);
+            return copy;
+        }
 
     private:
         std::string m_abstract;
-        std::vector<std::string> m_customPreamble; // To store custom preamble content
-        std::vector<std::string> m_keywords;       // To store keywords
+        SharedVector<std::string> m_customPreamble; // To store custom preamble content
+        SharedVector<std::string> m_keywords;       // To store keywords
         bool m_includeIndex = false;               // To enable/disable the index
         bool m_includeTableOfContents = false;     // To enable/disable the table of contents
     };
@@ -1182,7 +3715,14 @@ namespace LatexGen
         }
 
         std::string generatePreamble() const override;
-        std::string generateDocument() const override;
+        void writeDocument(std::ostream &out) const override;
+
+        std::shared_ptr<Document> clone() const override
+        {
+            auto copy = std::make_shared<Report>(*this);
+            detachEnvironments(*copy);
+            return copy;
+        }
 
     private:
         std::string m_abstract;
@@ -1249,17 +3789,38 @@ namespace LatexGen
         {
             if (m_currentPart >= 0 && m_currentPart < m_parts.size())
             {
-                m_partChapters[m_currentPart].push_back(chapter);
+                SharedVector<Section> &chapters = m_partChapters.edit()[m_currentPart];
+                chapters.push_back(chapter);
+                if (m_compressionThreshold > 0)
+                {
+                    chapters.edit(chapters.size() - 1).compress(m_compressionThreshold);
+                }
             }
         }
 
         void addAppendix(const Section &appendix)
         {
             m_appendices.push_back(appendix);
+            if (m_compressionThreshold > 0)
+            {
+                m_appendices.edit(m_appendices.size() - 1).compress(m_compressionThreshold);
+            }
         }
 
+        TextStorageStats getTextStorageStats() const override;
+
         std::string generatePreamble() const override;
-        std::string generateDocument() const override;
+        void writeDocument(std::ostream &out) const override;
+
+        std::shared_ptr<Document> clone() const override
+        {
+            auto copy = std::make_shared<Book>(*this);
+            detachEnvironments(*copy);
+            return copy;
+        }
+
+    protected:
+        ContentSlots::Anchor getSlotAnchor() const override;
 
     private:
         std::string m_abstract;
@@ -1267,9 +3828,9 @@ namespace LatexGen
         bool m_includeListOfFigures = false;
         bool m_includeListOfTables = false;
         bool m_includeIndex = false;
-        std::vector<std::string> m_parts;
-        std::map<size_t, std::vector<Section>> m_partChapters;
-        std::vector<Section> m_appendices; // Add a vector to store appendices
+        SharedVector<std::string> m_parts;
+        CopyOnWrite<std::map<size_t, SharedVector<Section>>> m_partChapters;
+        SharedVector<Section> m_appendices; // Add a vector to store appendices
         size_t m_currentPart = -1;
     };
 
@@ -1418,22 +3979,125 @@ namespace LatexGen
         }
 
         std::string generatePreamble() const override;
-        std::string generateDocument() const override;
+        void writeDocument(std::ostream &out) const override;
+
+        std::shared_ptr<Document> clone() const override
+        {
+            auto copy = std::make_shared<Presentation>(*this);
+            detachEnvironments(*copy);
+            return copy;
+        }
+
+        /**
+         * @brief Frame of the presentation as an independent compile unit
+         *
+         * The source restores the context of the frame in the full presentation (section
+         * and subsection with their numbers, frame number, raw content placed before it)
+         * and follows the shared preamble (see saveFrames()).
+         */
+        struct FrameUnit
+        {
+            size_t index = 0;       // Position in the presentation
+            std::string kind;       // title, toc, raw, section-page, slide, section, environment or glossary
+            std::string title;
+            std::string section;    // Section and subsection the frame belongs to
+            std::string subsection;
+            size_t frameNumber = 0; // Beamer frame number of the (first) frame of the unit
+            unsigned passes = 1;    // LaTeX runs needed (2 for the table of contents)
+            std::string source;     // From \begin{document} to \end{document}
+            uint64_t hash = 0;      // Content hash of the preamble and the source
+        };
+
+        /**
+         * @brief Split the presentation into one compile unit per frame, in order
+         * @return Frame units (their preamble is generatePreamble())
+         */
+        std::vector<FrameUnit> generateFrameUnits() const;
+
+        /**
+         * @brief Write the frames as separate compile units with a manifest
+         *
+         * Writes the shared preamble (preamble.tex), one file per frame (frame-NNNN.tex,
+         * starting with \input{preamble.tex}) and a JSON manifest listing the frames in
+         * order with their section context and content hash, so that frames can be
+         * compiled in parallel and cached individually.
+         *
+         * @param directory Output directory (created if needed)
+         * @param manifestName File name of the manifest
+         * @return true if every file was written
+         */
+        bool saveFrames(const std::string &directory, const std::string &manifestName = "frames.json") const;
+
+        /**
+         * @brief Reuse the frames rendered by previous generations
+         *
+         * Frames of sections and environments are looked up by the hash of their
+         * inputs and taken from the cache when found, so editing one of them renders
+         * only its frame again. generateFrameUnits() and saveFrames() record the frame
+         * unit hashes in the cache, whose change report (FrameCache::getLastChanges())
+         * lists the units to compile again. Use one cache per presentation for the
+         * change reports to compare successive generations of the same slides.
+         *
+         * @param cache Frame cache (nullptr to disable)
+         */
+        void setFrameCache(std::shared_ptr<FrameCache> cache)
+        {
+            m_frameCache = std::move(cache);
+        }
+
+        std::shared_ptr<FrameCache> getFrameCache() const
+        {
+            return m_frameCache;
+        }
 
     private:
+        /**
+         * @brief Piece of the presentation body, in document order
+         */
+        struct BodyPiece
+        {
+            enum class Kind
+            {
+                TITLE,
+                TOC,
+                RAW,
+                SECTION_COMMAND, // Not a frame: changes the section context
+                SECTION_PAGE,
+                SLIDE,
+                SECTION,
+                ENVIRONMENT
+            };
+
+            Kind kind;
+            std::string latex;
+            std::string title;
+            Section::Level level = Section::Level::SECTION;
+        };
+
         std::string m_institute;
         std::string m_subtitle;
         Theme m_theme;
         ColorTheme m_colorTheme;
         Transition m_transition = Transition::NONE;
         bool m_showNavigation = true;
-        std::vector<std::pair<std::string, std::vector<std::string>>> m_slides;
-        std::vector<std::tuple<Section::Level, std::string, bool>> m_structure; // level, title, create a slide
+        SharedVector<std::pair<std::string, std::vector<std::string>>> m_slides;
+        SharedVector<std::tuple<Section::Level, std::string, bool>> m_structure; // level, title, create a slide
+        std::shared_ptr<FrameCache> m_frameCache;
 
         std::string getThemeName() const;
         std::string getColorThemeName() const;
         std::string getTransitionName() const;
         std::string getLevelCommand(Section::Level level) const;
+        std::string generateSectionFrame(const Section &section, std::string &title) const;
+        std::string generateEnvironmentFrame(const Environment &env) const;
+        std::vector<BodyPiece> generateBodyPieces(size_t *rendered = nullptr) const;
+
+        /**
+         * @brief Render the pieces of the body one at a time, in document order
+         * @param visit Receives each piece
+         * @param rendered Receives the number of frames rendered (not taken from the frame cache)
+         */
+        void visitBodyPieces(const std::function<void(BodyPiece &&piece)> &visit, size_t *rendered = nullptr) const;
     };
 
     
@@ -0,0 +1,1010 @@
+#include "latexarrow.h"
+
+#include <charconv>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace LatexGen
+{
+    namespace
+    {
+        /**
+         * Read-only access to FlatBuffers data, with bounds checks
+         *
+         * Positions are byte offsets in the buffer; 0 stands for an absent object since
+         * the root offset is stored there.
+         */
+        class FlatBuffer
+        {
+        public:
+            FlatBuffer(const uint8_t *data, size_t size) : m_data(data), m_size(size) {}
+
+            template <typename T>
+            T read(size_t position) const
+            {
+                T value{};
+                if (position <= m_size && sizeof(T) <= m_size - position)
+                {
+                    std::memcpy(&value, m_data + position, sizeof(T));
+                }
+                else
+                {
+                    m_valid = false;
+                }
+                return value;
+            }
+
+            size_t root() const
+            {
+                return read<uint32_t>(0);
+            }
+
+            /**
+             * Position of a table field, or 0 if the field is not set
+             */
+            size_t field(size_t table, unsigned id) const
+            {
+                if (table == 0)
+                {
+                    return 0;
+                }
+                const int64_t vtable = static_cast<int64_t>(table) - read<int32_t>(table);
+                if (vtable < 0)
+                {
+                    m_valid = false;
+                    return 0;
+                }
+                const size_t entry = 4 + 2 * static_cast<size_t>(id);
+                if (entry + 2 > read<uint16_t>(static_cast<size_t>(vtable)))
+                {
+                    return 0;
+                }
+                const uint16_t offset = read<uint16_t>(static_cast<size_t>(vtable) + entry);
+                return offset == 0 ? 0 : table + offset;
+            }
+
+            template <typename T>
+            T scalar(size_t table, unsigned id, T defaultValue) const
+            {
+                const size_t position = field(table, id);
+                return position == 0 ? defaultValue : read<T>(position);
+            }
+
+            /**
+             * Position of a table, vector or string field, or 0 if the field is not set
+             */
+            size_t object(size_t table, unsigned id) const
+            {
+                const size_t position = field(table, id);
+                return position == 0 ? 0 : position + read<uint32_t>(position);
+            }
+
+            /**
+             * Number of elements of a vector (0 if its elements do not fit in the buffer)
+             */
+            size_t length(size_t vector, size_t elementSize) const
+            {
+                if (vector == 0)
+                {
+                    return 0;
+                }
+                const size_t count = read<uint32_t>(vector);
+                if (vector + 4 > m_size || count > (m_size - vector - 4) / elementSize)
+                {
+                    m_valid = false;
+                    return 0;
+                }
+                return count;
+            }
+
+            /**
+             * Position of the table at an index of a vector of tables
+             */
+            size_t element(size_t vector, size_t index) const
+            {
+                const size_t position = vector + 4 + 4 * index;
+                return position + read<uint32_t>(position);
+            }
+
+            std::string string(size_t table, unsigned id) const
+            {
+                const size_t position = object(table, id);
+                const size_t size = length(position, 1);
+                if (position == 0 || position + 4 > m_size || size > m_size - position - 4)
+                {
+                    return std::string();
+                }
+                return std::string(reinterpret_cast<const char *>(m_data + position + 4), size);
+            }
+
+            bool isValid() const
+            {
+                return m_valid;
+            }
+
+        private:
+            const uint8_t *m_data;
+            size_t m_size;
+            mutable bool m_valid = true;
+        };
+
+        // Field ids and enumerations of the Arrow schema (Message.fbs, Schema.fbs, File.fbs)
+        enum MessageField : unsigned
+        {
+            MESSAGE_HEADER_TYPE = 1,
+            MESSAGE_HEADER = 2,
+            MESSAGE_BODY_LENGTH = 3
+        };
+
+        enum MessageHeader : uint8_t
+        {
+            HEADER_SCHEMA = 1,
+            HEADER_RECORD_BATCH = 3
+        };
+
+        enum SchemaField : unsigned
+        {
+            SCHEMA_ENDIANNESS = 0,
+            SCHEMA_FIELDS = 1
+        };
+
+        enum FieldField : unsigned
+        {
+            FIELD_NAME = 0,
+            FIELD_TYPE_TYPE = 2,
+            FIELD_TYPE = 3,
+            FIELD_DICTIONARY = 4,
+            FIELD_CHILDREN = 5
+        };
+
+        enum RecordBatchField : unsigned
+        {
+            BATCH_LENGTH = 0,
+            BATCH_NODES = 1,
+            BATCH_BUFFERS = 2,
+            BATCH_COMPRESSION = 3
+        };
+
+        enum FooterField : unsigned
+        {
+            FOOTER_SCHEMA = 1,
+            FOOTER_RECORD_BATCHES = 3
+        };
+
+        enum ArrowType : uint8_t
+        {
+            TYPE_NULL = 1,
+            TYPE_INT = 2,
+            TYPE_FLOATING_POINT = 3,
+            TYPE_BINARY = 4,
+            TYPE_UTF8 = 5,
+            TYPE_BOOL = 6,
+            TYPE_DECIMAL = 7,
+            TYPE_DATE = 8,
+            TYPE_TIME = 9,
+            TYPE_TIMESTAMP = 10,
+            TYPE_INTERVAL = 11,
+            TYPE_LIST = 12,
+            TYPE_STRUCT = 13,
+            TYPE_FIXED_SIZE_BINARY = 15,
+            TYPE_FIXED_SIZE_LIST = 16,
+            TYPE_MAP = 17,
+            TYPE_DURATION = 18,
+            TYPE_LARGE_BINARY = 19,
+            TYPE_LARGE_UTF8 = 20,
+            TYPE_LARGE_LIST = 21,
+            TYPE_RUN_END_ENCODED = 22
+        };
+
+        const char ARROW_MAGIC[] = "ARROW1";
+        const size_t ARROW_MAGIC_SIZE = 6;
+        const unsigned MAX_NESTING = 64; // Depth of nested types, against cyclic metadata
+
+        /**
+         * Top-level field of the schema with the number of nodes and buffers it takes
+         * in each record batch
+         */
+        struct FieldPlan
+        {
+            bool exposed = false;
+            ArrowColumn::Type type = ArrowColumn::Type::NULL_VALUE;
+            unsigned width = 0;
+            unsigned unit = 0;
+            std::string name;
+            size_t nodes = 0;
+            size_t buffers = 0;
+        };
+
+        /**
+         * Count the nodes and buffers of a field and its children (IPC buffer layout)
+         */
+        bool countLayout(const FlatBuffer &fb, size_t field, size_t &nodes, size_t &buffers, std::string &error,
+                         unsigned depth = 0)
+        {
+            if (depth > MAX_NESTING)
+            {
+                error = "Arrow schema nested too deeply";
+                return false;
+            }
+            ++nodes;
+            const uint8_t type = fb.scalar<uint8_t>(field, FIELD_TYPE_TYPE, 0);
+            if (fb.object(field, FIELD_DICTIONARY) != 0)
+            {
+                buffers += 2; // Validity and indices
+                return true;
+            }
+
+            switch (type)
+            {
+            case TYPE_NULL:
+            case TYPE_RUN_END_ENCODED:
+                break;
+            case TYPE_STRUCT:
+            case TYPE_FIXED_SIZE_LIST:
+                buffers += 1;
+                break;
+            case TYPE_INT:
+            case TYPE_FLOATING_POINT:
+            case TYPE_BOOL:
+            case TYPE_DECIMAL:
+            case TYPE_DATE:
+            case TYPE_TIME:
+            case TYPE_TIMESTAMP:
+            case TYPE_INTERVAL:
+            case TYPE_FIXED_SIZE_BINARY:
+            case TYPE_DURATION:
+            case TYPE_LIST:
+            case TYPE_LARGE_LIST:
+            case TYPE_MAP:
+                buffers += 2;
+                break;
+            case TYPE_BINARY:
+            case TYPE_UTF8:
+            case TYPE_LARGE_BINARY:
+            case TYPE_LARGE_UTF8:
+                buffers += 3;
+                break;
+            default:
+                error = "unsupported Arrow type " + std::to_string(type) + " for field '" +
+                        fb.string(field, FIELD_NAME) + "'";
+                return false;
+            }
+
+            const size_t children = fb.object(field, FIELD_CHILDREN);
+            for (size_t i = 0; i < fb.length(children, 4); ++i)
+            {
+                if (!countLayout(fb, fb.element(children, i), nodes, buffers, error, depth + 1))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * Build the plan of a top-level field: exposed as a column when its type has a
+         * text form, skipped otherwise
+         */
+        bool planField(const FlatBuffer &fb, size_t field, FieldPlan &plan, std::string &error)
+        {
+            plan.name = fb.string(field, FIELD_NAME);
+            if (!countLayout(fb, field, plan.nodes, plan.buffers, error))
+            {
+                return false;
+            }
+            if (plan.nodes != 1 || fb.object(field, FIELD_DICTIONARY) != 0)
+            {
+                return true;
+            }
+
+            const size_t type = fb.object(field, FIELD_TYPE);
+            switch (fb.scalar<uint8_t>(field, FIELD_TYPE_TYPE, 0))
+            {
+            case TYPE_NULL:
+                plan.exposed = true;
+                plan.type = ArrowColumn::Type::NULL_VALUE;
+                break;
+            case TYPE_INT:
+            {
+                const int32_t bits = fb.scalar<int32_t>(type, 0, 0);
+                if (bits == 8 || bits == 16 || bits == 32 || bits == 64)
+                {
+                    plan.exposed = true;
+                    plan.type = fb.scalar<uint8_t>(type, 1, 0) ? ArrowColumn::Type::INTEGER
+                                                               : ArrowColumn::Type::UNSIGNED;
+                    plan.width = static_cast<unsigned>(bits / 8);
+                }
+                break;
+            }
+            case TYPE_FLOATING_POINT:
+            {
+                const int16_t precision = fb.scalar<int16_t>(type, 0, 0);
+                if (precision == 1 || precision == 2) // Half precision is left out
+                {
+                    plan.exposed = true;
+                    plan.type = ArrowColumn::Type::FLOATING;
+                    plan.width = precision == 1 ? 4 : 8;
+                }
+                break;
+            }
+            case TYPE_BOOL:
+                plan.exposed = true;
+                plan.type = ArrowColumn::Type::BOOLEAN;
+                break;
+            case TYPE_UTF8:
+            case TYPE_LARGE_UTF8:
+                plan.exposed = true;
+                plan.type = ArrowColumn::Type::STRING;
+                plan.width = fb.scalar<uint8_t>(field, FIELD_TYPE_TYPE, 0) == TYPE_UTF8 ? 4 : 8;
+                break;
+            case TYPE_DATE:
+                plan.exposed = true;
+                plan.type = ArrowColumn::Type::DATE;
+                plan.unit = static_cast<unsigned>(fb.scalar<int16_t>(type, 0, 1));
+                plan.width = plan.unit == 0 ? 4 : 8;
+                break;
+            case TYPE_TIMESTAMP:
+                plan.exposed = true;
+                plan.type = ArrowColumn::Type::TIMESTAMP;
+                plan.unit = static_cast<unsigned>(fb.scalar<int16_t>(type, 0, 0));
+                plan.width = 8;
+                break;
+            default:
+                break;
+            }
+            return true;
+        }
+
+        /**
+         * Encapsulated IPC message: FlatBuffers metadata followed by the body
+         */
+        struct Message
+        {
+            const uint8_t *metadata = nullptr;
+            size_t metadataSize = 0;
+            const uint8_t *body = nullptr;
+            size_t bodySize = 0;
+            size_t end = 0; // Position after the message
+        };
+
+        /**
+         * Read the message at a position
+         * @return false at the end-of-stream marker or at the end of the data
+         */
+        bool readMessage(const uint8_t *data, size_t size, size_t position, Message &message, std::string &error)
+        {
+            if (position > size || size - position < 4)
+            {
+                return false;
+            }
+            int32_t length;
+            std::memcpy(&length, data + position, 4);
+            position += 4;
+            if (length == -1) // Continuation marker (format 0.15 and later)
+            {
+                if (size - position < 4)
+                {
+                    return false;
+                }
+                std::memcpy(&length, data + position, 4);
+                position += 4;
+            }
+            if (length == 0)
+            {
+                return false;
+            }
+            if (length < 0 || static_cast<size_t>(length) > size - position)
+            {
+                error = "truncated Arrow message";
+                return false;
+            }
+
+            message.metadata = data + position;
+            message.metadataSize = static_cast<size_t>(length);
+            position += message.metadataSize;
+
+            const FlatBuffer fb(message.metadata, message.metadataSize);
+            const int64_t bodySize = fb.scalar<int64_t>(fb.root(), MESSAGE_BODY_LENGTH, 0);
+            if (!fb.isValid() || bodySize < 0 || static_cast<uint64_t>(bodySize) > size - position)
+            {
+                error = "invalid Arrow message";
+                return false;
+            }
+            message.body = data + position;
+            message.bodySize = static_cast<size_t>(bodySize);
+            message.end = position + message.bodySize;
+            return true;
+        }
+
+        bool isValid(const uint8_t *validity, size_t index)
+        {
+            return validity == nullptr || (validity[index >> 3] >> (index & 7)) & 1;
+        }
+
+        template <typename T>
+        T readValue(const uint8_t *values, size_t index)
+        {
+            T value;
+            std::memcpy(&value, values + index * sizeof(T), sizeof(T));
+            return value;
+        }
+
+        template <typename T>
+        void appendNumber(std::string &out, T value)
+        {
+            char buffer[32];
+            const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+            out.append(buffer, result.ptr);
+        }
+
+        void appendDigits(std::string &out, int64_t value, int digits)
+        {
+            char buffer[24];
+            for (int i = digits - 1; i >= 0; --i)
+            {
+                buffer[i] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            }
+            out.append(buffer, static_cast<size_t>(digits));
+        }
+
+        int64_t floorDivide(int64_t value, int64_t divisor, int64_t &remainder)
+        {
+            int64_t quotient = value / divisor;
+            remainder = value % divisor;
+            if (remainder < 0)
+            {
+                remainder += divisor;
+                --quotient;
+            }
+            return quotient;
+        }
+
+        /**
+         * Append a day count since 1970-01-01 as YYYY-MM-DD (proleptic Gregorian calendar)
+         */
+        void appendDate(std::string &out, int64_t days)
+        {
+            days += 719468;
+            const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+            const int64_t dayOfEra = days - era * 146097;
+            const int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+            const int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+            const int64_t monthIndex = (5 * dayOfYear + 2) / 153;
+            const int64_t day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+            const int64_t month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+            const int64_t year = yearOfEra + era * 400 + (month <= 2 ? 1 : 0);
+
+            if (year < 0)
+            {
+                out += '-';
+            }
+            appendDigits(out, year < 0 ? -year : year, 4);
+            out += '-';
+            appendDigits(out, month, 2);
+            out += '-';
+            appendDigits(out, day, 2);
+        }
+    } // namespace
+
+    /**
+     * Implementation for ArrowColumn class
+     */
+    const ArrowColumn::Chunk &ArrowColumn::findChunk(size_t row, size_t &index) const
+    {
+        auto it = std::upper_bound(m_chunks.begin(), m_chunks.end(), row,
+                                   [](size_t value, const Chunk &chunk)
+                                   { return value < chunk.firstRow; });
+        const Chunk &chunk = *(it - 1);
+        index = row - chunk.firstRow;
+        return chunk;
+    }
+
+    bool ArrowColumn::isNull(size_t row) const
+    {
+        if (m_type == Type::NULL_VALUE)
+        {
+            return true;
+        }
+        size_t index;
+        const Chunk &chunk = findChunk(row, index);
+        return !isValid(chunk.validity, index);
+    }
+
+    int64_t ArrowColumn::readInt(const Chunk &chunk, size_t index) const
+    {
+        const bool isUnsigned = m_type == Type::UNSIGNED;
+        switch (m_width)
+        {
+        case 1:
+            return isUnsigned ? static_cast<int64_t>(readValue<uint8_t>(chunk.values, index))
+                              : static_cast<int64_t>(readValue<int8_t>(chunk.values, index));
+        case 2:
+            return isUnsigned ? static_cast<int64_t>(readValue<uint16_t>(chunk.values, index))
+                              : static_cast<int64_t>(readValue<int16_t>(chunk.values, index));
+        case 4:
+            return isUnsigned ? static_cast<int64_t>(readValue<uint32_t>(chunk.values, index))
+                              : static_cast<int64_t>(readValue<int32_t>(chunk.values, index));
+        case 8:
+            return readValue<int64_t>(chunk.values, index);
+        default:
+            return 0;
+        }
+    }
+
+    std::string_view ArrowColumn::readString(const Chunk &chunk, size_t index) const
+    {
+        const uint64_t begin = m_width == 4 ? readValue<uint32_t>(chunk.values, index) : readValue<uint64_t>(chunk.values, index);
+        const uint64_t end = m_width == 4 ? readValue<uint32_t>(chunk.values, index + 1) : readValue<uint64_t>(chunk.values, index + 1);
+        if (begin > end || end > chunk.dataSize)
+        {
+            return std::string_view();
+        }
+        return std::string_view(reinterpret_cast<const char *>(chunk.data) + begin, static_cast<size_t>(end - begin));
+    }
+
+    int64_t ArrowColumn::getInt(size_t row) const
+    {
+        size_t index;
+        const Chunk &chunk = findChunk(row, index);
+        return readInt(chunk, index);
+    }
+
+    uint64_t ArrowColumn::getUnsigned(size_t row) const
+    {
+        size_t index;
+        const Chunk &chunk = findChunk(row, index);
+        return m_width == 8 ? readValue<uint64_t>(chunk.values, index) : static_cast<uint64_t>(readInt(chunk, index));
+    }
+
+    double ArrowColumn::getDouble(size_t row) const
+    {
+        if (m_type != Type::FLOATING)
+        {
+            return m_type == Type::UNSIGNED ? static_cast<double>(getUnsigned(row)) : static_cast<double>(getInt(row));
+        }
+        size_t index;
+        const Chunk &chunk = findChunk(row, index);
+        return m_width == 4 ? readValue<float>(chunk.values, index) : readValue<double>(chunk.values, index);
+    }
+
+    bool ArrowColumn::getBool(size_t row) const
+    {
+        size_t index;
+        const Chunk &chunk = findChunk(row, index);
+        return (chunk.values[index >> 3] >> (index & 7)) & 1;
+    }
+
+    std::string_view ArrowColumn::getString(size_t row) const
+    {
+        size_t index;
+        const Chunk &chunk = findChunk(row, index);
+        return readString(chunk, index);
+    }
+
+    void ArrowColumn::format(size_t row, std::string &out) const
+    {
+        if (m_type == Type::NULL_VALUE)
+        {
+            return;
+        }
+        size_t index;
+        const Chunk &chunk = findChunk(row, index);
+        if (!isValid(chunk.validity, index))
+        {
+            return;
+        }
+
+        switch (m_type)
+        {
+        case Type::INTEGER:
+            appendNumber(out, readInt(chunk, index));
+            break;
+        case Type::UNSIGNED:
+            appendNumber(out, m_width == 8 ? readValue<uint64_t>(chunk.values, index)
+                                           : static_cast<uint64_t>(readInt(chunk, index)));
+            break;
+        case Type::FLOATING:
+            if (m_width == 4)
+            {
+                appendNumber(out, readValue<float>(chunk.values, index));
+            }
+            else
+            {
+                appendNumber(out, readValue<double>(chunk.values, index));
+            }
+            break;
+        case Type::BOOLEAN:
+            out += (chunk.values[index >> 3] >> (index & 7)) & 1 ? "true" : "false";
+            break;
+        case Type::STRING:
+            out += readString(chunk, index);
+            break;
+        case Type::DATE:
+        {
+            int64_t remainder;
+            const int64_t value = readInt(chunk, index);
+            appendDate(out, m_unit == 0 ? value : floorDivide(value, 86400000, remainder));
+            break;
+        }
+        case Type::TIMESTAMP:
+        {
+            static const int64_t unitsPerSecond[] = {1, 1000, 1000000, 1000000000};
+            static const int fractionDigits[] = {0, 3, 6, 9};
+            const unsigned unit = m_unit < 4 ? m_unit : 0;
+
+            int64_t fraction;
+            int64_t secondOfDay;
+            const int64_t seconds = floorDivide(readInt(chunk, index), unitsPerSecond[unit], fraction);
+            const int64_t days = floorDivide(seconds, 86400, secondOfDay);
+            appendDate(out, days);
+            out += ' ';
+            appendDigits(out, secondOfDay / 3600, 2);
+            out += ':';
+            appendDigits(out, secondOfDay / 60 % 60, 2);
+            out += ':';
+            appendDigits(out, secondOfDay % 60, 2);
+            if (fraction != 0)
+            {
+                out += '.';
+                appendDigits(out, fraction, fractionDigits[unit]);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    /**
+     * Implementation for ArrowTable class
+     */
+    std::shared_ptr<ArrowTable> ArrowTable::open(const std::string &path, std::string *error)
+    {
+        std::shared_ptr<ArrowTable> table(new ArrowTable());
+        std::string reason;
+
+#ifndef _WIN32
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat status;
+        if (fd < 0 || fstat(fd, &status) != 0)
+        {
+            reason = "cannot open " + path;
+        }
+        else if (status.st_size > 0)
+        {
+            void *mapping = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED)
+            {
+                reason = "cannot map " + path;
+            }
+            else
+            {
+                table->m_mapping = mapping;
+                table->m_data = static_cast<const uint8_t *>(mapping);
+                table->m_size = static_cast<size_t>(status.st_size);
+            }
+        }
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            reason = "cannot open " + path;
+        }
+        else
+        {
+            std::stringstream content;
+            content << file.rdbuf();
+            table->m_buffer = content.str();
+            table->m_data = reinterpret_cast<const uint8_t *>(table->m_buffer.data());
+            table->m_size = table->m_buffer.size();
+        }
+#endif
+
+        if (reason.empty() && table->load(reason))
+        {
+            return table;
+        }
+        if (error)
+        {
+            *error = reason;
+        }
+        return nullptr;
+    }
+
+    std::shared_ptr<ArrowTable> ArrowTable::fromBuffer(std::string data, std::string *error)
+    {
+        std::shared_ptr<ArrowTable> table(new ArrowTable());
+        table->m_buffer = std::move(data);
+        table->m_data = reinterpret_cast<const uint8_t *>(table->m_buffer.data());
+        table->m_size = table->m_buffer.size();
+
+        std::string reason;
+        if (table->load(reason))
+        {
+            return table;
+        }
+        if (error)
+        {
+            *error = reason;
+        }
+        return nullptr;
+    }
+
+    ArrowTable::~ArrowTable()
+    {
+#ifndef _WIN32
+        if (m_mapping)
+        {
+            munmap(m_mapping, m_size);
+        }
+#endif
+    }
+
+    bool ArrowTable::load(std::string &error)
+    {
+        if (m_size == 0)
+        {
+            error = "empty Arrow data";
+            return false;
+        }
+
+        std::vector<FieldPlan> plans;
+        bool hasSchema = false;
+
+        auto readSchema = [&](const FlatBuffer &fb, size_t schema)
+        {
+            if (fb.scalar<int16_t>(schema, SCHEMA_ENDIANNESS, 0) != 0)
+            {
+                error = "big-endian Arrow data is not supported";
+                return false;
+            }
+            const size_t fields = fb.object(schema, SCHEMA_FIELDS);
+            plans.resize(fb.length(fields, 4));
+            for (size_t i = 0; i < plans.size(); ++i)
+            {
+                if (!planField(fb, fb.element(fields, i), plans[i], error))
+                {
+                    return false;
+                }
+            }
+            for (const auto &plan : plans)
+            {
+                if (plan.exposed)
+                {
+                    ArrowColumn column;
+                    column.m_name = plan.name;
+                    column.m_type = plan.type;
+                    column.m_width = plan.width;
+                    column.m_unit = plan.unit;
+                    m_columns.push_back(std::move(column));
+                }
+            }
+            hasSchema = true;
+            return fb.isValid() || (error = "invalid Arrow schema", false);
+        };
+
+        auto readRecordBatch = [&](const Message &message)
+        {
+            const FlatBuffer fb(message.metadata, message.metadataSize);
+            const size_t batch = fb.object(fb.root(), MESSAGE_HEADER);
+            if (fb.object(batch, BATCH_COMPRESSION) != 0)
+            {
+                error = "compressed Arrow record batches are not supported";
+                return false;
+            }
+            const int64_t length = fb.scalar<int64_t>(batch, BATCH_LENGTH, 0);
+            const size_t nodes = fb.object(batch, BATCH_NODES);
+            const size_t buffers = fb.object(batch, BATCH_BUFFERS);
+            if (length < 0 || !fb.isValid())
+            {
+                error = "invalid Arrow record batch";
+                return false;
+            }
+            const size_t rows = static_cast<size_t>(length);
+
+            // Buffer of the body, checked against its size
+            auto buffer = [&](size_t index, size_t minSize, const uint8_t *&data, size_t &size)
+            {
+                const size_t position = buffers + 4 + 16 * index;
+                const int64_t offset = fb.read<int64_t>(position);
+                const int64_t bufferSize = fb.read<int64_t>(position + 8);
+                if (offset < 0 || bufferSize < 0 || static_cast<uint64_t>(offset) > message.bodySize ||
+                    static_cast<uint64_t>(bufferSize) > message.bodySize - static_cast<uint64_t>(offset) ||
+                    static_cast<size_t>(bufferSize) < minSize)
+                {
+                    return false;
+                }
+                data = bufferSize == 0 ? nullptr : message.body + offset;
+                size = static_cast<size_t>(bufferSize);
+                return true;
+            };
+
+            size_t node = 0;
+            size_t bufferIndex = 0;
+            size_t columnIndex = 0;
+            for (const auto &plan : plans)
+            {
+                if (node + plan.nodes > fb.length(nodes, 16) || bufferIndex + plan.buffers > fb.length(buffers, 16))
+                {
+                    error = "Arrow record batch does not match the schema";
+                    return false;
+                }
+                if (plan.exposed)
+                {
+                    ArrowColumn &column = m_columns[columnIndex++];
+                    const int64_t nodeLength = fb.read<int64_t>(nodes + 4 + 16 * node);
+                    const int64_t nullCount = fb.read<int64_t>(nodes + 4 + 16 * node + 8);
+                    if (nodeLength != length)
+                    {
+                        error = "Arrow column '" + plan.name + "' has a wrong length";
+                        return false;
+                    }
+
+                    ArrowColumn::Chunk chunk{column.m_size, rows, nullptr, nullptr, nullptr, 0};
+                    bool valid = true;
+                    if (plan.type != ArrowColumn::Type::NULL_VALUE)
+                    {
+                        size_t size;
+                        valid = buffer(bufferIndex, nullCount > 0 ? (rows + 7) / 8 : 0, chunk.validity, size);
+                        if (nullCount == 0)
+                        {
+                            chunk.validity = nullptr;
+                        }
+                        if (plan.type == ArrowColumn::Type::BOOLEAN)
+                        {
+                            valid = valid && buffer(bufferIndex + 1, (rows + 7) / 8, chunk.values, size);
+                        }
+                        else if (plan.type == ArrowColumn::Type::STRING)
+                        {
+                            valid = valid && buffer(bufferIndex + 1, rows == 0 ? 0 : (rows + 1) * plan.width, chunk.values, size) &&
+                                    buffer(bufferIndex + 2, 0, chunk.data, chunk.dataSize);
+                        }
+                        else
+                        {
+                            valid = valid && buffer(bufferIndex + 1, rows * plan.width, chunk.values, size);
+                        }
+                    }
+                    if (!valid)
+                    {
+                        error = "Arrow column '" + plan.name + "' has invalid buffers";
+                        return false;
+                    }
+                    if (rows > 0)
+                    {
+                        column.m_chunks.push_back(chunk);
+                        column.m_size += rows;
+                    }
+                }
+                node += plan.nodes;
+                bufferIndex += plan.buffers;
+            }
+            m_rowCount += rows;
+            return fb.isValid() || (error = "invalid Arrow record batch", false);
+        };
+
+        auto headerType = [](const Message &message)
+        {
+            const FlatBuffer fb(message.metadata, message.metadataSize);
+            return fb.scalar<uint8_t>(fb.root(), MESSAGE_HEADER_TYPE, 0);
+        };
+
+        const bool isFile = m_size >= 2 * ARROW_MAGIC_SIZE + 4 &&
+                            std::memcmp(m_data, ARROW_MAGIC, ARROW_MAGIC_SIZE) == 0 &&
+                            std::memcmp(m_data + m_size - ARROW_MAGIC_SIZE, ARROW_MAGIC, ARROW_MAGIC_SIZE) == 0;
+        if (isFile)
+        {
+            // File format: the footer holds the schema and the position of each record batch
+            int32_t footerSize;
+            std::memcpy(&footerSize, m_data + m_size - ARROW_MAGIC_SIZE - 4, 4);
+            if (footerSize <= 0 || static_cast<size_t>(footerSize) > m_size - ARROW_MAGIC_SIZE - 4 - 8)
+            {
+                error = "invalid Arrow file footer";
+                return false;
+            }
+            const FlatBuffer footer(m_data + m_size - ARROW_MAGIC_SIZE - 4 - footerSize, static_cast<size_t>(footerSize));
+            if (!readSchema(footer, footer.object(footer.root(), FOOTER_SCHEMA)))
+            {
+                return false;
+            }
+            const size_t blocks = footer.object(footer.root(), FOOTER_RECORD_BATCHES);
+            for (size_t i = 0; i < footer.length(blocks, 24); ++i)
+            {
+                const int64_t offset = footer.read<int64_t>(blocks + 4 + 24 * i);
+                Message message;
+                if (offset < 0 || !readMessage(m_data, m_size, static_cast<size_t>(offset), message, error) ||
+                    headerType(message) != HEADER_RECORD_BATCH)
+                {
+                    if (error.empty())
+                    {
+                        error = "invalid Arrow record batch block";
+                    }
+                    return false;
+                }
+                if (!readRecordBatch(message))
+                {
+                    return false;
+                }
+            }
+            return footer.isValid() || (error = "invalid Arrow file footer", false);
+        }
+
+        // Stream format: schema message, then dictionary and record batch messages
+        Message message;
+        size_t position = 0;
+        while (readMessage(m_data, m_size, position, message, error))
+        {
+            const uint8_t type = headerType(message);
+            if (type == HEADER_SCHEMA && !hasSchema)
+            {
+                const FlatBuffer fb(message.metadata, message.metadataSize);
+                if (!readSchema(fb, fb.object(fb.root(), MESSAGE_HEADER)))
+                {
+                    return false;
+                }
+            }
+            else if (type == HEADER_RECORD_BATCH)
+            {
+                if (!hasSchema)
+                {
+                    error = "Arrow record batch before the schema";
+                    return false;
+                }
+                if (!readRecordBatch(message))
+                {
+                    return false;
+                }
+            }
+            position = message.end;
+        }
+        if (!error.empty())
+        {
+            return false;
+        }
+        if (!hasSchema)
+        {
+            error = "no Arrow schema found";
+            return false;
+        }
+        return true;
+    }
+
+    const ArrowColumn *ArrowTable::findColumn(const std::string &name) const
+    {
+        for (const auto &column : m_columns)
+        {
+            if (column.getName() == name)
+            {
+                return &column;
+            }
+        }
+        return nullptr;
+    }
+
+    std::vector<std::string> ArrowTable::getColumnNames() const
+    {
+        std::vector<std::string> names;
+        names.reserve(m_columns.size());
+        for (const auto &column : m_columns)
+        {
+            names.push_back(column.getName());
+        }
+        return names;
+    }
+
+    bool ArrowTable::fingerprint(ContentHasher &hasher) const
+    {
+        hasher.add("arrow").add(std::string_view(reinterpret_cast<const char *>(m_data), m_size));
+        return true;
+    }
+
+} // namespace LatexGen
@@ -0,0 +1,1084 @@
+#include "latexbatch.h"
+
+#include <cerrno>
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace LatexGen
+{
+    namespace
+    {
+        // Largest protocol message accepted (a shard of large records)
+        const size_t MAX_MESSAGE_SIZE = 256 * 1024 * 1024;
+
+        /**
+         * Escape a field of a tab-separated line (manifests and protocol messages)
+         */
+        void appendField(std::string &line, const std::string &value)
+        {
+            if (!line.empty() && line.back() != '\n')
+            {
+                line += '\t';
+            }
+            for (char c : value)
+            {
+                switch (c)
+                {
+                case '\\':
+                    line += "\\\\";
+                    break;
+                case '\t':
+                    line += "\\t";
+                    break;
+                case '\n':
+                    line += "\\n";
+                    break;
+                case '\r':
+                    line += "\\r";
+                    break;
+                default:
+                    line += c;
+                }
+            }
+        }
+
+        /**
+         * Split a tab-separated line into unescaped fields
+         */
+        std::vector<std::string> splitFields(const std::string &line)
+        {
+            std::vector<std::string> fields(1);
+            for (size_t i = 0; i < line.size(); ++i)
+            {
+                if (line[i] == '\t')
+                {
+                    fields.emplace_back();
+                }
+                else if (line[i] == '\\' && i + 1 < line.size())
+                {
+                    const char next = line[++i];
+                    fields.back() += next == 't' ? '\t' : (next == 'n' ? '\n' : (next == 'r' ? '\r' : next));
+                }
+                else
+                {
+                    fields.back() += line[i];
+                }
+            }
+            return fields;
+        }
+
+        std::vector<std::string> splitLines(const std::string &text)
+        {
+            std::vector<std::string> lines;
+            std::istringstream in(text);
+            std::string line;
+            while (std::getline(in, line))
+            {
+                lines.push_back(line);
+            }
+            return lines;
+        }
+
+        /**
+         * Check that a path of a spec stays in the directory it is relative to
+         */
+        bool isContainedPath(const std::string &path)
+        {
+            const std::filesystem::path relative(path);
+            if (relative.empty() || relative.has_root_name() || relative.has_root_directory())
+            {
+                return false;
+            }
+            for (const auto &part : relative)
+            {
+                if (part == "..")
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * Check the paths of a spec, as they are used to read templates and write outputs
+         * @return Reason of the rejection, or an empty string for a valid spec
+         */
+        std::string checkSpecPaths(const DocumentSpec &spec)
+        {
+            if (!isContainedPath(spec.name))
+            {
+                return "invalid name \"" + spec.name + "\" (empty, absolute or with ..)";
+            }
+            if (!spec.templateName.empty() && !isContainedPath(spec.templateName))
+            {
+                return "invalid template \"" + spec.templateName + "\" (absolute or with ..)";
+            }
+            if (!spec.bibliography.empty() && !isContainedPath(spec.bibliography))
+            {
+                return "invalid bibliography \"" + spec.bibliography + "\" (absolute or with ..)";
+            }
+            return "";
+        }
+
+        std::string encodeSpec(const DocumentSpec &spec)
+        {
+            std::string line;
+            appendField(line, spec.name);
+            appendField(line, spec.templateName);
+            appendField(line, spec.bibliography);
+            for (const auto &field : spec.fields)
+            {
+                appendField(line, field.first);
+                appendField(line, field.second);
+            }
+            return line;
+        }
+
+        DocumentSpec decodeSpec(const std::string &line)
+        {
+            const std::vector<std::string> fields = splitFields(line);
+            DocumentSpec spec;
+            spec.name = fields[0];
+            spec.templateName = fields.size() > 1 ? fields[1] : "";
+            spec.bibliography = fields.size() > 2 ? fields[2] : "";
+            for (size_t i = 3; i + 1 < fields.size(); i += 2)
+            {
+                spec.fields[fields[i]] = fields[i + 1];
+            }
+            return spec;
+        }
+
+        std::string encodeStats(const BatchWorker::Stats &stats)
+        {
+            std::string line;
+            for (size_t value : {stats.shards, stats.documents, stats.failures, stats.templatesLoaded, stats.templateHits,
+                                 stats.bibliographiesLoaded, stats.bibliographyHits, stats.bytesWritten})
+            {
+                appendField(line, std::to_string(value));
+            }
+            appendField(line, std::to_string(stats.seconds));
+            return line;
+        }
+
+        void addStats(BatchWorker::Stats &total, const std::string &line)
+        {
+            const std::vector<std::string> fields = splitFields(line);
+            if (fields.size() < 9)
+            {
+                return;
+            }
+            size_t *counters[] = {&total.shards, &total.documents, &total.failures, &total.templatesLoaded,
+                                  &total.templateHits, &total.bibliographiesLoaded, &total.bibliographyHits,
+                                  &total.bytesWritten};
+            for (size_t i = 0; i < 8; ++i)
+            {
+                *counters[i] += std::strtoull(fields[i].c_str(), nullptr, 10);
+            }
+            total.seconds += std::strtod(fields[8].c_str(), nullptr);
+        }
+
+        BatchWorker::Stats subtractStats(const BatchWorker::Stats &after, const BatchWorker::Stats &before)
+        {
+            BatchWorker::Stats delta;
+            delta.shards = after.shards - before.shards;
+            delta.documents = after.documents - before.documents;
+            delta.failures = after.failures - before.failures;
+            delta.templatesLoaded = after.templatesLoaded - before.templatesLoaded;
+            delta.templateHits = after.templateHits - before.templateHits;
+            delta.bibliographiesLoaded = after.bibliographiesLoaded - before.bibliographiesLoaded;
+            delta.bibliographyHits = after.bibliographyHits - before.bibliographyHits;
+            delta.bytesWritten = after.bytesWritten - before.bytesWritten;
+            delta.seconds = after.seconds - before.seconds;
+            return delta;
+        }
+
+        /**
+         * Take a complete message ("TYPE size\n" then size bytes) from received data
+         * @return 1 if a message was taken, 0 if more data is needed, -1 if the data is malformed
+         */
+        int takeMessage(std::string &inbox, std::string &type, std::string &payload)
+        {
+            const size_t newline = inbox.find('\n');
+            if (newline == std::string::npos)
+            {
+                return inbox.size() > 64 ? -1 : 0;
+            }
+            const size_t space = inbox.find(' ');
+            if (space == std::string::npos || space > newline)
+            {
+                return -1;
+            }
+            const size_t size = std::strtoull(inbox.c_str() + space + 1, nullptr, 10);
+            if (size > MAX_MESSAGE_SIZE)
+            {
+                return -1;
+            }
+            if (inbox.size() - newline - 1 < size)
+            {
+                return 0;
+            }
+            type = inbox.substr(0, space);
+            payload = inbox.substr(newline + 1, size);
+            inbox.erase(0, newline + 1 + size);
+            return 1;
+        }
+
+#ifndef _WIN32
+        bool sendMessage(int fd, const std::string &type, const std::string &payload)
+        {
+            const std::string message = type + " " + std::to_string(payload.size()) + "\n" + payload;
+#ifdef MSG_NOSIGNAL
+            const int flags = MSG_NOSIGNAL;
+#else
+            const int flags = 0;
+#endif
+            size_t sent = 0;
+            while (sent < message.size())
+            {
+                const ssize_t count = ::send(fd, message.data() + sent, message.size() - sent, flags);
+                if (count < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (count <= 0)
+                {
+                    return false;
+                }
+                sent += static_cast<size_t>(count);
+            }
+            return true;
+        }
+
+        /**
+         * Append received data to an inbox
+         * @return false when the connection is closed or failed
+         */
+        bool receive(int fd, std::string &inbox, bool wait)
+        {
+            char buffer[65536];
+            ssize_t count;
+            do
+            {
+                count = ::recv(fd, buffer, sizeof(buffer), wait ? 0 : MSG_DONTWAIT);
+            } while (count < 0 && errno == EINTR);
+
+            if (count < 0 && !wait && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                return true;
+            }
+            if (count <= 0)
+            {
+                return false;
+            }
+            inbox.append(buffer, static_cast<size_t>(count));
+            return true;
+        }
+
+        addrinfo *resolve(const std::string &host, int port, bool passive)
+        {
+            addrinfo hints;
+            std::memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            hints.ai_flags = passive ? AI_PASSIVE : 0;
+            addrinfo *addresses = nullptr;
+            if (getaddrinfo(host.empty() ? nullptr : host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+            {
+                return nullptr;
+            }
+            return addresses;
+        }
+#endif
+
+        double secondsSince(std::chrono::steady_clock::time_point start)
+        {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    } // namespace
+
+    /**
+     * Implementation for the manifest reader
+     */
+    bool readManifest(const std::string &path, std::vector<DocumentSpec> &specs, std::string *error)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open())
+        {
+            if (error)
+            {
+                *error = "cannot open " + path;
+            }
+            return false;
+        }
+
+        std::vector<std::string> columns;
+        std::string line;
+        size_t lineNumber = 0;
+        while (std::getline(in, line))
+        {
+            ++lineNumber;
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+
+            const std::vector<std::string> fields = splitFields(line);
+            if (columns.empty())
+            {
+                columns = fields;
+                if (std::find(columns.begin(), columns.end(), "name") == columns.end())
+                {
+                    if (error)
+                    {
+                        *error = path + ": no name column";
+                    }
+                    return false;
+                }
+                continue;
+            }
+
+            DocumentSpec spec;
+            for (size_t i = 0; i < columns.size() && i < fields.size(); ++i)
+            {
+                if (columns[i] == "name")
+                {
+                    spec.name = fields[i];
+                }
+                else if (columns[i] == "template")
+                {
+                    spec.templateName = fields[i];
+                }
+                else if (columns[i] == "bibliography")
+                {
+                    spec.bibliography = fields[i];
+                }
+                else
+                {
+                    spec.fields[columns[i]] = fields[i];
+                }
+            }
+            const std::string reason = checkSpecPaths(spec);
+            if (!reason.empty())
+            {
+                if (error)
+                {
+                    *error = path + ":" + std::to_string(lineNumber) + ": " + reason;
+                }
+                return false;
+            }
+            specs.push_back(std::move(spec));
+        }
+        return true;
+    }
+
+    /**
+     * Implementation for BatchWorker class
+     */
+    BatchWorker::BatchWorker()
+        : BatchWorker(Options())
+    {
+    }
+
+    BatchWorker::BatchWorker(Options options)
+        : m_options(std::move(options))
+    {
+    }
+
+    std::shared_ptr<const ContentTemplate> BatchWorker::getTemplate(const std::string &name)
+    {
+        auto it = m_templates.find(name);
+        if (it != m_templates.end())
+        {
+            ++m_stats.templateHits;
+            return it->second;
+        }
+
+        std::ifstream in(std::filesystem::path(m_options.templateDirectory) / name, std::ios::binary);
+        if (!in.is_open())
+        {
+            return nullptr;
+        }
+        const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        auto compiled = std::make_shared<const ContentTemplate>(text);
+        m_templates.emplace(name, compiled);
+        ++m_stats.templatesLoaded;
+        return compiled;
+    }
+
+    const Bibliography *BatchWorker::getBibliography(const std::string &name)
+    {
+        // Compiled documents run in a workspace and refer to the .bib file by its full
+        // path; written .tex files refer to the copy staged next to them
+        std::error_code error;
+        const std::filesystem::path path = std::filesystem::path(m_options.bibliographyDirectory) / name;
+        const std::string file =
+            m_compiler ? std::filesystem::absolute(path, error).lexically_normal().generic_string() : name;
+
+        auto it = m_bibliographies.find(file);
+        if (it != m_bibliographies.end())
+        {
+            ++m_stats.bibliographyHits;
+            return it->second.get();
+        }
+        if (!std::filesystem::is_regular_file(path.string() + ".bib", error))
+        {
+            return nullptr;
+        }
+
+        auto bibliography = std::make_unique<Bibliography>(file);
+        const Bibliography *shared = bibliography.get();
+        m_bibliographies.emplace(file, std::move(bibliography));
+        ++m_stats.bibliographiesLoaded;
+        return shared;
+    }
+
+    bool BatchWorker::stageBibliography(const std::string &name, const std::string &directory)
+    {
+        const std::filesystem::path target = (std::filesystem::path(directory) / (name + ".bib")).lexically_normal();
+        if (m_stagedBibliographies.count(target.generic_string()) != 0)
+        {
+            return true;
+        }
+
+        // Linked (or copied) once per directory holding documents that use it
+        std::error_code error;
+        const std::filesystem::path source = std::filesystem::path(m_options.bibliographyDirectory) / (name + ".bib");
+        if (!std::filesystem::is_regular_file(source, error))
+        {
+            return false;
+        }
+        if (!std::filesystem::equivalent(source, target, error))
+        {
+            // Linked under a temporary name then renamed, as another worker may stage it too
+            std::filesystem::create_directories(target.parent_path(), error);
+            const std::string temporary = createTemporaryFile(target.string());
+            if (temporary.empty())
+            {
+                return false;
+            }
+            std::filesystem::remove(temporary, error);
+            std::filesystem::create_hard_link(source, temporary, error);
+            if (error)
+            {
+                std::filesystem::copy_file(source, temporary, std::filesystem::copy_options::overwrite_existing, error);
+            }
+            if (!error)
+            {
+                std::filesystem::rename(temporary, target, error);
+            }
+            if (error)
+            {
+                std::filesystem::remove(temporary, error);
+                return false;
+            }
+        }
+        m_stagedBibliographies.insert(target.generic_string());
+        return true;
+    }
+
+    std::shared_ptr<Document> BatchWorker::createDocument(const DocumentSpec &spec, std::string &error)
+    {
+        std::shared_ptr<const ContentTemplate> contentTemplate = getTemplate(spec.templateName);
+        if (!contentTemplate)
+        {
+            error = "cannot read template " + spec.templateName;
+            return nullptr;
+        }
+
+        auto field = [&](const std::string &key, const std::string &fallback)
+        {
+            auto it = spec.fields.find(key);
+            return it == spec.fields.end() ? fallback : it->second;
+        };
+        auto document = std::make_shared<Article>(field("title", ""), field("author", ""), field("date", "\\today"));
+
+        if (!spec.bibliography.empty())
+        {
+            const Bibliography *bibliography = getBibliography(spec.bibliography);
+            if (!bibliography)
+            {
+                error = "cannot find bibliography " + spec.bibliography;
+                return nullptr;
+            }
+            document->setBibliography(*bibliography);
+
+            std::istringstream keys(field("citations", ""));
+            std::string key;
+            while (std::getline(keys, key, ','))
+            {
+                const size_t first = key.find_first_not_of(" \t");
+                if (first != std::string::npos)
+                {
+                    document->cite(key.substr(first, key.find_last_not_of(" \t") - first + 1));
+                }
+            }
+        }
+
+        auto block = std::make_shared<TemplateBlock>(contentTemplate);
+        block->setRecord(spec.fields);
+        document->addEnvironment(block);
+        return document;
+    }
+
+    std::vector<DocumentOutcome> BatchWorker::renderShard(const std::vector<DocumentSpec> &specs)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<DocumentOutcome> outcomes;
+        outcomes.reserve(specs.size());
+
+        for (const auto &spec : specs)
+        {
+            DocumentOutcome outcome;
+            outcome.name = spec.name;
+
+            // Specs come from the network: their paths must stay in the worker directories
+            std::string error = checkSpecPaths(spec);
+            if (!error.empty())
+            {
+                outcome.message = error;
+                ++m_stats.documents;
+                ++m_stats.failures;
+                outcomes.push_back(std::move(outcome));
+                continue;
+            }
+
+            std::shared_ptr<Document> document = m_factory ? m_factory(spec, *this, error) : createDocument(spec, error);
+            const std::filesystem::path base = std::filesystem::path(m_options.outputDirectory) / spec.name;
+            std::error_code fileError;
+            if (!document)
+            {
+                outcome.message = error.empty() ? "no document" : error;
+            }
+            else if (m_compiler)
+            {
+                CompileResult result = m_compiler->compile(*document, base.filename().string());
+                outcome.output = base.string() + ".pdf";
+                if (!result.success)
+                {
+                    outcome.message = result.log;
+                }
+                else
+                {
+                    // A failed compile leaves the previous PDF, and a reader never sees a partial one
+                    std::filesystem::create_directories(base.parent_path(), fileError);
+                    if (replaceFile(outcome.output, result.pdf))
+                    {
+                        outcome.success = true;
+                        outcome.bytes = result.pdf.size();
+                    }
+                    else
+                    {
+                        outcome.message = "cannot write " + outcome.output;
+                    }
+                }
+            }
+            else
+            {
+                // BibTeX looks for the .bib file in the directory of the .tex file
+                outcome.output = base.string() + ".tex";
+                if (!spec.bibliography.empty() && !stageBibliography(spec.bibliography, base.parent_path().string()))
+                {
+                    outcome.message = "cannot stage bibliography " + spec.bibliography;
+                }
+                else if (document->saveToFile(base.parent_path().string(), base.filename().string() + ".tex"))
+                {
+                    outcome.success = true;
+                    outcome.bytes = std::filesystem::file_size(outcome.output, fileError);
+                }
+                else
+                {
+                    outcome.message = "cannot write " + outcome.output;
+                }
+            }
+
+            ++m_stats.documents;
+            if (!outcome.success)
+            {
+                ++m_stats.failures;
+            }
+            m_stats.bytesWritten += outcome.bytes;
+            outcomes.push_back(std::move(outcome));
+        }
+
+        ++m_stats.shards;
+        m_stats.seconds += secondsSince(start);
+        return outcomes;
+    }
+
+    int BatchWorker::serve(const std::string &host, int port)
+    {
+#ifdef _WIN32
+        (void)host;
+        (void)port;
+        return 1;
+#else
+        addrinfo *addresses = resolve(host, port, false);
+        int fd = -1;
+        for (addrinfo *address = addresses; address && fd < 0; address = address->ai_next)
+        {
+            fd = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (fd >= 0 && ::connect(fd, address->ai_addr, address->ai_addrlen) != 0)
+            {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        if (addresses)
+        {
+            freeaddrinfo(addresses);
+        }
+        if (fd < 0)
+        {
+            return 1;
+        }
+
+        char hostName[256] = {};
+        gethostname(hostName, sizeof(hostName) - 1);
+        int status = 1;
+        if (sendMessage(fd, "HELO", std::string(hostName) + ":" + std::to_string(getpid())))
+        {
+            std::string inbox;
+            std::string type;
+            std::string payload;
+            while (true)
+            {
+                const int taken = takeMessage(inbox, type, payload);
+                if (taken < 0)
+                {
+                    break;
+                }
+                if (taken == 0)
+                {
+                    if (!receive(fd, inbox, true))
+                    {
+                        break;
+                    }
+                    continue;
+                }
+
+                if (type == "STOP")
+                {
+                    status = 0;
+                    break;
+                }
+                if (type != "SHRD")
+                {
+                    continue;
+                }
+
+                // Shard id, then one spec per line
+                const std::vector<std::string> lines = splitLines(payload);
+                if (lines.empty())
+                {
+                    continue;
+                }
+                std::vector<DocumentSpec> specs;
+                for (size_t i = 1; i < lines.size(); ++i)
+                {
+                    specs.push_back(decodeSpec(lines[i]));
+                }
+
+                const Stats before = m_stats;
+                const std::vector<DocumentOutcome> outcomes = renderShard(specs);
+
+                std::string reply = lines[0] + "\n" + encodeStats(subtractStats(m_stats, before)) + "\n";
+                for (const auto &outcome : outcomes)
+                {
+                    std::string line;
+                    appendField(line, outcome.name);
+                    appendField(line, outcome.success ? "1" : "0");
+                    appendField(line, outcome.output);
+                    appendField(line, std::to_string(outcome.bytes));
+                    appendField(line, outcome.message);
+                    reply += line + "\n";
+                }
+                if (!sendMessage(fd, "DONE", reply))
+                {
+                    break;
+                }
+            }
+        }
+
+        ::close(fd);
+        return status;
+#endif
+    }
+
+    /**
+     * Implementation for BatchCoordinator class
+     */
+    BatchCoordinator::BatchCoordinator(std::vector<DocumentSpec> specs)
+        : BatchCoordinator(std::move(specs), Options())
+    {
+    }
+
+    BatchCoordinator::BatchCoordinator(std::vector<DocumentSpec> specs, Options options)
+        : m_specs(std::move(specs)), m_options(std::move(options))
+    {
+        m_options.shardSize = std::max<size_t>(m_options.shardSize, 1);
+        m_options.maxAttempts = std::max(m_options.maxAttempts, 1u);
+    }
+
+    BatchCoordinator::~BatchCoordinator()
+    {
+#ifndef _WIN32
+        if (m_listenFd >= 0)
+        {
+            ::close(m_listenFd);
+        }
+        for (int child : m_children)
+        {
+            waitpid(child, nullptr, 0);
+        }
+#endif
+    }
+
+    int BatchCoordinator::listen(const std::string &host, int port)
+    {
+#ifdef _WIN32
+        (void)host;
+        (void)port;
+        return -1;
+#else
+        if (m_listenFd >= 0)
+        {
+            return m_port;
+        }
+
+        addrinfo *addresses = resolve(host, port, true);
+        for (addrinfo *address = addresses; address && m_listenFd < 0; address = address->ai_next)
+        {
+            m_listenFd = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (m_listenFd < 0)
+            {
+                continue;
+            }
+            const int reuse = 1;
+            setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            if (::bind(m_listenFd, address->ai_addr, address->ai_addrlen) != 0 || ::listen(m_listenFd, 128) != 0)
+            {
+                ::close(m_listenFd);
+                m_listenFd = -1;
+            }
+        }
+        if (addresses)
+        {
+            freeaddrinfo(addresses);
+        }
+        if (m_listenFd < 0)
+        {
+            return -1;
+        }
+
+        sockaddr_storage bound;
+        socklen_t length = sizeof(bound);
+        if (getsockname(m_listenFd, reinterpret_cast<sockaddr *>(&bound), &length) != 0)
+        {
+            return -1;
+        }
+        m_port = ntohs(bound.ss_family == AF_INET6 ? reinterpret_cast<sockaddr_in6 *>(&bound)->sin6_port
+                                                   : reinterpret_cast<sockaddr_in *>(&bound)->sin_port);
+        return m_port;
+#endif
+    }
+
+    bool BatchCoordinator::forkLocalWorkers(size_t count, const std::function<int(int port)> &workerMain)
+    {
+#ifdef _WIN32
+        (void)count;
+        (void)workerMain;
+        return false;
+#else
+        if (m_listenFd < 0)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            const pid_t pid = fork();
+            if (pid < 0)
+            {
+                return false;
+            }
+            if (pid == 0)
+            {
+                ::close(m_listenFd);
+                _exit(workerMain(m_port));
+            }
+            m_children.push_back(pid);
+        }
+        return true;
+#endif
+    }
+
+    void BatchCoordinator::requeue(const std::vector<size_t> &documents, const std::string &reason,
+                                   std::deque<size_t> &pending)
+    {
+        std::vector<size_t> retry;
+        for (size_t document : documents)
+        {
+            if (!reason.empty())
+            {
+                m_results[document].message = reason;
+            }
+            if (m_results[document].attempts < m_options.maxAttempts)
+            {
+                retry.push_back(document);
+            }
+        }
+        if (!retry.empty())
+        {
+            m_shards.push_back(std::move(retry));
+            pending.push_back(m_shards.size() - 1);
+            ++m_stats.retries;
+        }
+    }
+
+    void BatchCoordinator::closeConnection(Connection &connection, std::deque<size_t> &pending)
+    {
+#ifndef _WIN32
+        ::close(connection.fd);
+#endif
+        connection.fd = -1;
+        if (connection.shard != npos)
+        {
+            ++m_stats.workersLost;
+            const size_t shard = connection.shard;
+            connection.shard = npos;
+            requeue(m_shards[shard], "worker " + connection.name + " lost", pending);
+        }
+    }
+
+    bool BatchCoordinator::finishShard(Connection &connection, const std::string &payload, std::deque<size_t> &pending)
+    {
+        // Shard id, worker statistics, then one outcome per document
+        const std::vector<std::string> lines = splitLines(payload);
+        if (connection.shard == npos || lines.size() < 2 || std::to_string(connection.shard) != lines[0])
+        {
+            return false;
+        }
+        addStats(m_stats.work, lines[1]);
+
+        const std::vector<size_t> &documents = m_shards[connection.shard];
+        std::vector<size_t> failed;
+        for (size_t i = 0; i < documents.size(); ++i)
+        {
+            DocumentOutcome &result = m_results[documents[i]];
+            const std::vector<std::string> fields =
+                i + 2 < lines.size() ? splitFields(lines[i + 2]) : std::vector<std::string>();
+            if (fields.size() >= 5 && fields[0] == result.name && fields[1] == "1")
+            {
+                result.success = true;
+                result.output = fields[2];
+                result.bytes = std::strtoull(fields[3].c_str(), nullptr, 10);
+                result.message.clear();
+                continue;
+            }
+            result.message = fields.size() >= 5 ? fields[4] : "no outcome from worker " + connection.name;
+            failed.push_back(documents[i]);
+        }
+
+        connection.shard = npos;
+        requeue(failed, "", pending);
+        return true;
+    }
+
+    bool BatchCoordinator::run()
+    {
+        const auto start = std::chrono::steady_clock::now();
+        m_results.clear();
+        m_shards.clear();
+        m_stats = Stats();
+        for (const auto &spec : m_specs)
+        {
+            DocumentOutcome outcome;
+            outcome.name = spec.name;
+            m_results.push_back(std::move(outcome));
+        }
+        m_stats.documents = m_results.size();
+
+        std::deque<size_t> pending;
+        for (size_t first = 0; first < m_specs.size(); first += m_options.shardSize)
+        {
+            std::vector<size_t> documents;
+            for (size_t i = first; i < std::min(first + m_options.shardSize, m_specs.size()); ++i)
+            {
+                documents.push_back(i);
+            }
+            m_shards.push_back(std::move(documents));
+            pending.push_back(m_shards.size() - 1);
+        }
+        m_stats.shards = m_shards.size();
+
+#ifdef _WIN32
+        for (auto &result : m_results)
+        {
+            result.message = "Batch distribution is not supported on this system";
+        }
+#else
+        if (m_listenFd < 0 && listen() < 0)
+        {
+            for (auto &result : m_results)
+            {
+                result.message = "cannot listen for workers";
+            }
+            pending.clear();
+        }
+
+        std::vector<Connection> connections;
+        auto lastWorker = std::chrono::steady_clock::now();
+        while (true)
+        {
+            // Hand the pending shards to idle workers
+            for (auto &connection : connections)
+            {
+                if (connection.fd < 0 || connection.shard != npos || pending.empty())
+                {
+                    continue;
+                }
+                const size_t shard = pending.front();
+                pending.pop_front();
+
+                std::string payload = std::to_string(shard) + "\n";
+                for (size_t document : m_shards[shard])
+                {
+                    ++m_results[document].attempts;
+                    payload += encodeSpec(m_specs[document]) + "\n";
+                }
+                connection.shard = shard;
+                connection.dispatched = std::chrono::steady_clock::now();
+                ++m_stats.dispatches;
+                if (!sendMessage(connection.fd, "SHRD", payload))
+                {
+                    closeConnection(connection, pending);
+                }
+            }
+            connections.erase(std::remove_if(connections.begin(), connections.end(),
+                                             [](const Connection &connection)
+                                             { return connection.fd < 0; }),
+                              connections.end());
+
+            const bool busy = std::any_of(connections.begin(), connections.end(),
+                                          [](const Connection &connection)
+                                          { return connection.shard != npos; });
+            if (pending.empty() && !busy)
+            {
+                break;
+            }
+            if (!connections.empty())
+            {
+                lastWorker = std::chrono::steady_clock::now();
+            }
+            else if (secondsSince(lastWorker) >= m_options.workerWait)
+            {
+                for (size_t shard : pending)
+                {
+                    for (size_t document : m_shards[shard])
+                    {
+                        m_results[document].message = "no worker available";
+                    }
+                }
+                pending.clear();
+                break;
+            }
+
+            std::vector<pollfd> descriptors(1 + connections.size());
+            descriptors[0] = {m_listenFd, POLLIN, 0};
+            for (size_t i = 0; i < connections.size(); ++i)
+            {
+                descriptors[i + 1] = {connections[i].fd, POLLIN, 0};
+            }
+            if (poll(descriptors.data(), descriptors.size(), 100) < 0 && errno != EINTR)
+            {
+                break;
+            }
+
+            for (size_t i = 0; i < connections.size(); ++i)
+            {
+                Connection &connection = connections[i];
+                if (descriptors[i + 1].revents != 0)
+                {
+                    bool open = receive(connection.fd, connection.inbox, false);
+                    std::string type;
+                    std::string payload;
+                    int taken;
+                    while (open && (taken = takeMessage(connection.inbox, type, payload)) != 0)
+                    {
+                        if (taken < 0)
+                        {
+                            open = false;
+                        }
+                        else if (type == "HELO")
+                        {
+                            connection.name = payload;
+                        }
+                        else if (type == "DONE" && !finishShard(connection, payload, pending))
+                        {
+                            // A reply for another shard: the worker cannot be trusted with its shard
+                            open = false;
+                        }
+                    }
+                    if (!open)
+                    {
+                        closeConnection(connection, pending);
+                        continue;
+                    }
+                }
+
+                // A worker holding its shard too long is given up
+                if (connection.shard != npos && m_options.shardTimeout > 0 &&
+                    secondsSince(connection.dispatched) > m_options.shardTimeout)
+                {
+                    closeConnection(connection, pending);
+                }
+            }
+
+            if (descriptors[0].revents & POLLIN)
+            {
+                const int fd = ::accept(m_listenFd, nullptr, nullptr);
+                if (fd >= 0)
+                {
+                    connections.push_back({fd, "", "#" + std::to_string(m_stats.workers), npos, {}});
+                    ++m_stats.workers;
+                }
+            }
+        }
+
+        for (auto &connection : connections)
+        {
+            if (connection.fd >= 0)
+            {
+                sendMessage(connection.fd, "STOP", "");
+                closeConnection(connection, pending);
+            }
+        }
+        ::close(m_listenFd);
+        m_listenFd = -1;
+        for (int child : m_children)
+        {
+            waitpid(child, nullptr, 0);
+        }
+        m_children.clear();
+#endif
+
+        for (const auto &result : m_results)
+        {
+            ++(result.success ? m_stats.succeeded : m_stats.failed);
+        }
+        m_stats.seconds = secondsSince(start);
+        return m_stats.failed == 0;
+    }
+
+} // namespace LatexGen
@@ -0,0 +1,1217 @@
+#include "latexcompile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/magic.h>
+#include <sys/vfs.h>
+#endif
+
+extern char **environ;
+#endif
+
+namespace LatexGen
+{
+    namespace
+    {
+        std::string toHex(uint64_t value)
+        {
+            char text[17];
+            std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+            return text;
+        }
+
+        bool readFile(const std::string &path, std::string &out)
+        {
+            std::ifstream file(path, std::ios::binary);
+            if (!file.is_open())
+            {
+                return false;
+            }
+            out.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            return !file.bad();
+        }
+
+        bool writeFile(const std::string &path, const std::string &content)
+        {
+            std::ofstream file(path, std::ios::binary);
+            if (!file.is_open())
+            {
+                return false;
+            }
+            file.write(content.data(), static_cast<std::streamsize>(content.size()));
+            return static_cast<bool>(file);
+        }
+
+        // Extensions tried by graphicx for an image given without one
+        const char *const IMAGE_EXTENSIONS[] = {".pdf", ".png", ".jpg", ".jpeg", ".eps"};
+
+#ifndef _WIN32
+        /**
+         * Create a new private directory under the system temporary directory
+         */
+        bool makeTempDirectory(std::string &directory)
+        {
+            std::error_code error;
+            std::string pattern = (std::filesystem::temp_directory_path(error) / "latexgen-XXXXXX").string();
+            if (error || !mkdtemp(&pattern[0]))
+            {
+                return false;
+            }
+            directory = pattern;
+            return true;
+        }
+
+        /**
+         * Find an executable in PATH (names with a slash are used as they are)
+         */
+        std::string findExecutable(const std::string &name)
+        {
+            if (name.find('/') != std::string::npos)
+            {
+                return name;
+            }
+
+            const char *path = std::getenv("PATH");
+            std::string directories = path ? path : "/usr/local/bin:/usr/bin:/bin";
+            size_t begin = 0;
+            while (begin <= directories.size())
+            {
+                size_t end = directories.find(':', begin);
+                if (end == std::string::npos)
+                {
+                    end = directories.size();
+                }
+                std::string directory = directories.substr(begin, end - begin);
+                std::string candidate = (directory.empty() ? "." : directory) + "/" + name;
+                if (access(candidate.c_str(), X_OK) == 0)
+                {
+                    return candidate;
+                }
+                begin = end + 1;
+            }
+            return name;
+        }
+
+        /**
+         * Copy of the environment with search path variables prefixed by a directory
+         */
+        std::vector<std::string> makeEnvironment(const std::string &inputDirectory)
+        {
+            const char *const SEARCH_PATHS[] = {"TEXINPUTS", "BIBINPUTS"};
+
+            std::vector<std::string> environment;
+            for (char **variable = environ; *variable; ++variable)
+            {
+                environment.push_back(*variable);
+            }
+
+            for (const char *name : SEARCH_PATHS)
+            {
+                // A trailing colon keeps the default search path of the engine
+                const char *current = std::getenv(name);
+                std::string value = std::string(name) + "=" + inputDirectory + ":" + (current ? current : "");
+                auto it = std::find_if(environment.begin(), environment.end(), [&](const std::string &entry)
+                                       { return entry.compare(0, std::strlen(name) + 1, std::string(name) + "=") == 0; });
+                if (it != environment.end())
+                {
+                    *it = value;
+                }
+                else
+                {
+                    environment.push_back(value);
+                }
+            }
+            return environment;
+        }
+
+        /**
+         * Start a process in a directory, with its output sent to a file descriptor
+         *
+         * Everything is prepared before fork() so the child only makes system calls.
+         *
+         * @return Process identifier, or -1 on failure
+         */
+        pid_t spawnProcess(const std::vector<std::string> &command, const std::string &directory,
+                           const std::vector<std::string> &environment, int inputFd, int outputFd)
+        {
+            const std::string executable = findExecutable(command[0]);
+            std::vector<char *> argv;
+            for (const auto &argument : command)
+            {
+                argv.push_back(const_cast<char *>(argument.c_str()));
+            }
+            argv.push_back(nullptr);
+            std::vector<char *> envp;
+            for (const auto &variable : environment)
+            {
+                envp.push_back(const_cast<char *>(variable.c_str()));
+            }
+            envp.push_back(nullptr);
+
+            const pid_t pid = fork();
+            if (pid == 0)
+            {
+                if (chdir(directory.c_str()) != 0 || dup2(inputFd, 0) < 0 || dup2(outputFd, 1) < 0 || dup2(outputFd, 2) < 0)
+                {
+                    _exit(127);
+                }
+                execve(executable.c_str(), argv.data(), envp.data());
+                _exit(127);
+            }
+            return pid;
+        }
+
+        /**
+         * Wait for a process and get its exit code (-1 if it did not exit normally)
+         */
+        int waitProcess(pid_t pid)
+        {
+            int status = 0;
+            while (waitpid(pid, &status, 0) < 0)
+            {
+                if (errno != EINTR)
+                {
+                    return -1;
+                }
+            }
+            return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        }
+
+        /**
+         * Run a process to completion with its output written to a file
+         * @return Exit code, or -1 if the process could not run
+         */
+        int runProcess(const std::vector<std::string> &command, const std::string &directory,
+                       const std::vector<std::string> &environment, const std::string &outputPath)
+        {
+            const int inputFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+            const int outputFd = open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            int exitCode = -1;
+            if (inputFd >= 0 && outputFd >= 0)
+            {
+                const pid_t pid = spawnProcess(command, directory, environment, inputFd, outputFd);
+                if (pid > 0)
+                {
+                    exitCode = waitProcess(pid);
+                }
+            }
+            if (inputFd >= 0)
+            {
+                close(inputFd);
+            }
+            if (outputFd >= 0)
+            {
+                close(outputFd);
+            }
+            return exitCode;
+        }
+
+        /**
+         * Open a named pipe for non-blocking writes once a process opened it for reading
+         * @return File descriptor, or -1 if the process exited without opening it
+         */
+        int openPipeWriter(const std::string &path, pid_t reader)
+        {
+            for (;;)
+            {
+                const int fd = open(path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+                if (fd >= 0)
+                {
+                    return fd;
+                }
+                if (errno != ENXIO && errno != EINTR)
+                {
+                    return -1;
+                }
+
+                // Check the reader without reaping it (its exit code is read later)
+                siginfo_t info = {};
+                if (waitid(P_PID, static_cast<id_t>(reader), &info, WEXITED | WNOHANG | WNOWAIT) != 0 || info.si_pid != 0)
+                {
+                    return -1;
+                }
+                usleep(1000);
+            }
+        }
+
+        /**
+         * Output to a non-blocking pipe that also keeps a copy of the text
+         *
+         * Each piece written by the document (preamble, then body) is sent at once, as
+         * far as the pipe takes it; the rest waits in the copy, so generation never
+         * waits for the reader. finish() sends what is left. Write errors (the reader
+         * stopped) are remembered and the following text is only copied.
+         */
+        class DescriptorStreamBuf : public std::streambuf
+        {
+        public:
+            DescriptorStreamBuf(int fd, std::string &copy) : m_fd(fd), m_copy(copy) {}
+
+            /**
+             * Send the text not taken by the pipe yet, waiting for the reader
+             */
+            void finish()
+            {
+                send(true);
+            }
+
+        protected:
+            int_type overflow(int_type c) override
+            {
+                if (traits_type::eq_int_type(c, traits_type::eof()))
+                {
+                    return traits_type::not_eof(c);
+                }
+                const char character = traits_type::to_char_type(c);
+                xsputn(&character, 1);
+                return c;
+            }
+
+            std::streamsize xsputn(const char *text, std::streamsize count) override
+            {
+                m_copy.append(text, static_cast<size_t>(count));
+                send(false);
+                return count;
+            }
+
+        private:
+            int m_fd;
+            std::string &m_copy;
+            size_t m_sent = 0;
+
+            void send(bool wait)
+            {
+                while (m_fd >= 0 && m_sent < m_copy.size())
+                {
+                    const ssize_t result = ::write(m_fd, m_copy.data() + m_sent, m_copy.size() - m_sent);
+                    if (result > 0)
+                    {
+                        m_sent += static_cast<size_t>(result);
+                    }
+                    else if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    {
+                        if (!wait)
+                        {
+                            return;
+                        }
+                        pollfd ready = {m_fd, POLLOUT, 0};
+                        poll(&ready, 1, -1);
+                    }
+                    else if (result < 0 && errno != EINTR)
+                    {
+                        m_fd = -1;
+                    }
+                }
+            }
+        };
+#endif
+    }
+
+    /**
+     * Implementation for CompileCache class
+     */
+    CompileCache::CompileCache(const std::string &directory, size_t maxBytes)
+        : m_directory(directory), m_maxBytes(maxBytes)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(m_directory, error);
+
+        // Files of previous runs, ordered by their last use
+        std::vector<std::pair<std::filesystem::file_time_type, std::pair<uint64_t, size_t>>> files;
+        for (std::filesystem::directory_iterator it(m_directory, error), end; !error && it != end; it.increment(error))
+        {
+            const std::string name = it->path().filename().string();
+            if (name.size() != 20 || name.compare(16, 4, ".pdf") != 0 ||
+                name.find_first_not_of("0123456789abcdef") < 16)
+            {
+                continue;
+            }
+
+            std::error_code fileError;
+            const uintmax_t bytes = it->file_size(fileError);
+            const auto time = it->last_write_time(fileError);
+            if (!fileError)
+            {
+                files.push_back({time, {std::stoull(name.substr(0, 16), nullptr, 16), static_cast<size_t>(bytes)}});
+            }
+        }
+        std::sort(files.begin(), files.end());
+
+        for (const auto &file : files)
+        {
+            m_entries[file.second.first] = {file.second.second, ++m_clock};
+            m_storedBytes += file.second.second;
+        }
+    }
+
+    std::string CompileCache::getPath(uint64_t key) const
+    {
+        return m_directory + "/" + toHex(key) + ".pdf";
+    }
+
+    bool CompileCache::lookup(uint64_t key, std::string &pdf)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_entries.find(key);
+        if (it == m_entries.end())
+        {
+            ++m_stats.misses;
+            return false;
+        }
+        if (!readFile(getPath(key), pdf))
+        {
+            // Removed by another process (or unreadable): forget the entry
+            m_storedBytes -= it->second.bytes;
+            m_entries.erase(it);
+            pdf.clear();
+            ++m_stats.misses;
+            return false;
+        }
+
+        it->second.lastUse = ++m_clock;
+        std::error_code error;
+        std::filesystem::last_write_time(getPath(key), std::filesystem::file_time_type::clock::now(), error);
+        ++m_stats.hits;
+        m_stats.bytesServed += pdf.size();
+        return true;
+    }
+
+    bool CompileCache::store(uint64_t key, const std::string &pdf)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // Written under a temporary name then renamed, so readers never see a partial file
+        const std::string path = getPath(key);
+        const std::string temporary = createTemporaryFile(path);
+        if (temporary.empty())
+        {
+            return false;
+        }
+        std::error_code error;
+        if (!writeFile(temporary, pdf))
+        {
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+        std::filesystem::rename(temporary, path, error);
+        if (error)
+        {
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+
+        auto it = m_entries.find(key);
+        if (it != m_entries.end())
+        {
+            m_storedBytes -= it->second.bytes;
+        }
+        m_entries[key] = {pdf.size(), ++m_clock};
+        m_storedBytes += pdf.size();
+        ++m_stats.stores;
+
+        evict();
+        return true;
+    }
+
+    void CompileCache::evict()
+    {
+        if (m_storedBytes <= m_maxBytes)
+        {
+            return;
+        }
+
+        std::vector<std::pair<uint64_t, uint64_t>> byUse; // Last use, key
+        for (const auto &entry : m_entries)
+        {
+            byUse.push_back({entry.second.lastUse, entry.first});
+        }
+        std::sort(byUse.begin(), byUse.end());
+
+        for (const auto &entry : byUse)
+        {
+            if (m_storedBytes <= m_maxBytes)
+            {
+                break;
+            }
+            std::error_code error;
+            std::filesystem::remove(getPath(entry.second), error);
+            m_storedBytes -= m_entries[entry.second].bytes;
+            m_entries.erase(entry.second);
+            ++m_stats.evictions;
+        }
+    }
+
+    size_t CompileCache::size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries.size();
+    }
+
+    size_t CompileCache::getStoredBytes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_storedBytes;
+    }
+
+    void CompileCache::clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto &entry : m_entries)
+        {
+            std::error_code error;
+            std::filesystem::remove(getPath(entry.first), error);
+        }
+        m_entries.clear();
+        m_storedBytes = 0;
+    }
+
+    CompileCache::Stats CompileCache::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+    /**
+     * Implementation for WorkspacePool class
+     */
+    WorkspacePool::WorkspacePool(const std::string &root, size_t maxIdle)
+        : m_maxIdle(maxIdle)
+    {
+        std::error_code error;
+        std::filesystem::path parent = root;
+        if (parent.empty())
+        {
+            parent = std::filesystem::is_directory("/dev/shm", error) ? std::filesystem::path("/dev/shm")
+                                                                       : std::filesystem::temp_directory_path(error);
+        }
+#ifdef __linux__
+        struct statfs status;
+        m_memoryBacked = statfs(parent.c_str(), &status) == 0 && status.f_type == TMPFS_MAGIC;
+#endif
+
+#ifndef _WIN32
+        std::string pattern = (parent / "latexgen-pool-XXXXXX").string();
+        if (mkdtemp(&pattern[0]))
+        {
+            m_root = pattern;
+        }
+#else
+        m_root = (parent / "latexgen-pool").string();
+        std::filesystem::create_directories(m_root, error);
+#endif
+    }
+
+    WorkspacePool::~WorkspacePool()
+    {
+        if (!m_root.empty())
+        {
+            std::error_code error;
+            std::filesystem::remove_all(m_root, error);
+        }
+    }
+
+    std::string WorkspacePool::acquire()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_root.empty())
+        {
+            return "";
+        }
+
+        ++m_stats.acquired;
+        if (!m_idle.empty())
+        {
+            std::string workspace = std::move(m_idle.back());
+            m_idle.pop_back();
+            ++m_stats.recycled;
+            for (auto &input : m_staged[workspace])
+            {
+                input.second.current = false;
+            }
+            return workspace;
+        }
+
+        const std::string workspace = m_root + "/job-" + std::to_string(m_nextId++);
+        std::error_code error;
+        if (!std::filesystem::create_directory(workspace, error))
+        {
+            --m_stats.acquired;
+            return "";
+        }
+        ++m_stats.created;
+        m_staged[workspace];
+        return workspace;
+    }
+
+    bool WorkspacePool::stage(const std::string &workspace, const std::string &source, const std::string &name)
+    {
+        // Jobs name their inputs relative to their own input directory (and working
+        // directory): only the full path tells whether a staged file is the same one
+        std::error_code error;
+        const std::string path = std::filesystem::absolute(source, error).lexically_normal().string();
+        const auto time = error ? std::filesystem::file_time_type() : std::filesystem::last_write_time(path, error);
+        const uintmax_t size = error ? 0 : std::filesystem::file_size(path, error);
+        if (error)
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto &inputs = m_staged[workspace];
+
+        // Staged by a previous job from the same file, unchanged since
+        auto it = inputs.find(name);
+        if (it != inputs.end() && it->second.source == path && it->second.time == time && it->second.size == size)
+        {
+            it->second.current = true;
+            ++m_stats.reusedInputs;
+            m_stats.bytesReused += size;
+            return true;
+        }
+
+        const std::filesystem::path target = std::filesystem::path(workspace) / name;
+        std::filesystem::create_directories(target.parent_path(), error);
+        std::filesystem::remove(target, error);
+
+        // A hard link shares the data; other file systems need a copy
+        std::filesystem::create_hard_link(path, target, error);
+        if (!error)
+        {
+            ++m_stats.linkedInputs;
+        }
+        else if (std::filesystem::copy_file(path, target, error))
+        {
+            ++m_stats.copiedInputs;
+            m_stats.bytesCopied += size;
+        }
+        else
+        {
+            inputs.erase(name);
+            return false;
+        }
+
+        inputs[name] = {path, time, size, true};
+        return true;
+    }
+
+    void WorkspacePool::prune(const std::string &workspace)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto staged = m_staged.find(workspace);
+        if (staged == m_staged.end())
+        {
+            return;
+        }
+
+        for (auto it = staged->second.begin(); it != staged->second.end();)
+        {
+            if (it->second.current)
+            {
+                ++it;
+                continue;
+            }
+            // Its directory, if left empty, is deleted on release like the job's own
+            std::error_code error;
+            std::filesystem::remove(std::filesystem::path(workspace) / it->first, error);
+            it = staged->second.erase(it);
+        }
+    }
+
+    void WorkspacePool::release(const std::string &workspace)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto staged = m_staged.find(workspace);
+        if (staged == m_staged.end())
+        {
+            return;
+        }
+
+        // Delete what the job wrote, deepest entries first, and keep the staged inputs
+        std::vector<std::filesystem::path> written;
+        std::error_code error;
+        for (std::filesystem::recursive_directory_iterator it(workspace, error), end; !error && it != end; it.increment(error))
+        {
+            const std::string name = std::filesystem::relative(it->path(), workspace, error).generic_string();
+            if (staged->second.count(name) == 0)
+            {
+                written.push_back(it->path());
+            }
+        }
+        std::sort(written.rbegin(), written.rend());
+        for (const auto &path : written)
+        {
+            std::error_code fileError;
+            if (std::filesystem::is_directory(path, fileError))
+            {
+                // Directories holding staged inputs are not empty and stay
+                std::filesystem::remove(path, fileError);
+                continue;
+            }
+            const uintmax_t size = std::filesystem::file_size(path, fileError);
+            const bool sized = !fileError;
+            if (std::filesystem::remove(path, fileError))
+            {
+                ++m_stats.scratchFiles;
+                m_stats.scratchBytes += sized ? size : 0;
+            }
+        }
+
+        if (m_idle.size() < m_maxIdle)
+        {
+            m_idle.push_back(workspace);
+        }
+        else
+        {
+            std::filesystem::remove_all(workspace, error);
+            m_staged.erase(staged);
+        }
+    }
+
+    WorkspacePool::Stats WorkspacePool::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+    /**
+     * Implementation for Compiler class
+     */
+    Compiler::Compiler(CompileOptions options)
+        : m_options(std::move(options))
+    {
+    }
+
+    std::string Compiler::getEngineIdentity() const
+    {
+        auto identify = [this]()
+        {
+            m_engineIdentity = m_options.engine;
+#ifndef _WIN32
+            std::string directory;
+            if (!makeTempDirectory(directory))
+            {
+                return;
+            }
+
+            const std::string outputPath = directory + "/version.out";
+            std::string output;
+            if (runProcess({m_options.engine, "--version"}, directory, makeEnvironment("."), outputPath) == 0 &&
+                readFile(outputPath, output) && !output.empty())
+            {
+                m_engineIdentity = output.substr(0, output.find('\n'));
+            }
+
+            std::error_code error;
+            std::filesystem::remove_all(directory, error);
+#endif
+        };
+        std::call_once(m_engineIdentityOnce, identify);
+        return m_engineIdentity;
+    }
+
+    void Compiler::addFile(ContentHasher &hasher, const std::string &path) const
+    {
+        const std::filesystem::path fullPath = std::filesystem::path(m_options.inputDirectory) / path;
+        hasher.add(path);
+
+        std::error_code error;
+        const auto time = std::filesystem::last_write_time(fullPath, error);
+        const uintmax_t size = error ? 0 : std::filesystem::file_size(fullPath, error);
+        if (error)
+        {
+            hasher.add("missing");
+            return;
+        }
+
+        // Files are read again only when their time or size changed
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_fileHashes.find(fullPath.string());
+            if (it != m_fileHashes.end() && it->second.time == time && it->second.size == size)
+            {
+                hasher.add(it->second.hash);
+                return;
+            }
+        }
+
+        std::string content;
+        if (!readFile(fullPath.string(), content))
+        {
+            hasher.add("missing");
+            return;
+        }
+        const uint64_t hash = ContentHasher().add(content).digest();
+        hasher.add(hash);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_fileHashes[fullPath.string()] = {time, size, hash};
+    }
+
+    uint64_t Compiler::computeKey(const std::string &source, const DocumentDependencies &dependencies) const
+    {
+        ContentHasher hasher;
+        hasher.add("LatexGen compile 1").add(getEngineIdentity()).add(m_options.engine);
+        for (const auto &argument : m_options.arguments)
+        {
+            hasher.add(argument);
+        }
+        hasher.add(static_cast<uint64_t>(m_options.passes)).add(m_options.bibtex);
+        hasher.add(source);
+
+        for (const auto &image : dependencies.images)
+        {
+            addFile(hasher, image);
+            if (!std::filesystem::path(image).has_extension())
+            {
+                for (const char *extension : IMAGE_EXTENSIONS)
+                {
+                    addFile(hasher, image + extension);
+                }
+            }
+        }
+        for (const auto *files : {&dependencies.bibliographies, &dependencies.inputs, &dependencies.dataFiles})
+        {
+            for (const auto &file : *files)
+            {
+                addFile(hasher, file);
+            }
+        }
+        return hasher.digest();
+    }
+
+    CompileResult Compiler::compile(const Document &document, const std::string &jobName) const
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const std::string source = document.generate();
+        const double generationSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        CompileResult result = compileSource(source, document.collectDependencies(), jobName);
+        result.generationSeconds = generationSeconds;
+        result.seconds += generationSeconds;
+        return result;
+    }
+
+    CompileResult Compiler::compileSource(const std::string &source, const DocumentDependencies &declared,
+                                          const std::string &jobName) const
+    {
+        const auto start = std::chrono::steady_clock::now();
+        auto finish = [&](CompileResult &result)
+        {
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return result;
+        };
+
+        // Files referenced by the source are keyed and staged like the declared ones
+        DocumentDependencies dependencies = declared;
+        dependencies.addReferences(source, m_options.inputDirectory);
+        dependencies.removeDuplicates();
+
+        CompileResult result;
+        result.key = computeKey(source, dependencies);
+        if (m_cache && m_cache->lookup(result.key, result.pdf))
+        {
+            result.success = true;
+            result.cached = true;
+            result.exitCode = 0;
+            return finish(result);
+        }
+
+#ifdef _WIN32
+        result.log = "Compiling is not supported on this system";
+        return finish(result);
+#else
+        const std::string directory = openWorkspace(dependencies);
+        if (directory.empty())
+        {
+            result.log = "Cannot create a working directory";
+            return finish(result);
+        }
+
+        const std::string base = directory + "/" + jobName;
+        if (!writeFile(base + ".tex", source))
+        {
+            result.log = "Cannot write " + base + ".tex";
+        }
+        else
+        {
+            runPasses(directory, jobName, !dependencies.bibliographies.empty(), 0, result);
+        }
+
+        closeWorkspace(directory);
+
+        if (result.success && m_cache)
+        {
+            m_cache->store(result.key, result.pdf);
+        }
+        return finish(result);
+#endif
+    }
+
+    std::string Compiler::openWorkspace(const DocumentDependencies &dependencies) const
+    {
+        if (!m_workspaces)
+        {
+#ifndef _WIN32
+            std::string directory;
+            if (makeTempDirectory(directory))
+            {
+                return directory;
+            }
+#endif
+            return "";
+        }
+
+        const std::string directory = m_workspaces->acquire();
+        if (directory.empty())
+        {
+            return directory;
+        }
+
+        // Inputs outside the input directory are left to the search path
+        auto stage = [&](const std::string &path)
+        {
+            const std::filesystem::path relative(path);
+            if (relative.is_absolute() || path.find("..") != std::string::npos)
+            {
+                return;
+            }
+            std::error_code error;
+            const std::filesystem::path source = std::filesystem::path(m_options.inputDirectory) / relative;
+            if (std::filesystem::is_regular_file(source, error))
+            {
+                m_workspaces->stage(directory, source.string(), relative.generic_string());
+            }
+        };
+        for (const auto &image : dependencies.images)
+        {
+            stage(image);
+            if (!std::filesystem::path(image).has_extension())
+            {
+                for (const char *extension : IMAGE_EXTENSIONS)
+                {
+                    stage(image + extension);
+                }
+            }
+        }
+        for (const auto *files : {&dependencies.bibliographies, &dependencies.inputs, &dependencies.dataFiles})
+        {
+            for (const auto &file : *files)
+            {
+                stage(file);
+            }
+        }
+        m_workspaces->prune(directory);
+        return directory;
+    }
+
+    void Compiler::closeWorkspace(const std::string &directory) const
+    {
+        if (m_workspaces)
+        {
+            m_workspaces->release(directory);
+        }
+        else
+        {
+            std::error_code error;
+            std::filesystem::remove_all(directory, error);
+        }
+    }
+
+    void Compiler::runPasses(const std::string &directory, const std::string &jobName, bool hasBibliography,
+                             unsigned firstPass, CompileResult &result) const
+    {
+#ifndef _WIN32
+        const std::string base = directory + "/" + jobName;
+        std::error_code error;
+        const std::vector<std::string> environment =
+            makeEnvironment(std::filesystem::absolute(m_options.inputDirectory, error).string());
+
+        std::vector<std::string> command = {m_options.engine};
+        command.insert(command.end(), m_options.arguments.begin(), m_options.arguments.end());
+        command.push_back(jobName + ".tex");
+
+        for (unsigned pass = firstPass; pass < std::max(m_options.passes, 1u); ++pass)
+        {
+            // Citations are resolved by BibTeX between the first two passes
+            if (pass == 1 && hasBibliography && !m_options.bibtex.empty())
+            {
+                runProcess({m_options.bibtex, jobName}, directory, environment, base + ".blg.out");
+            }
+
+            result.exitCode = runProcess(command, directory, environment, base + ".out");
+            if (result.exitCode != 0)
+            {
+                break;
+            }
+        }
+
+        readFile(base + ".out", result.log);
+        result.success = result.exitCode == 0 && readFile(base + ".pdf", result.pdf);
+#else
+        (void)directory;
+        (void)jobName;
+        (void)hasBibliography;
+        (void)firstPass;
+        (void)result;
+#endif
+    }
+
+    CompileResult Compiler::compileStreaming(const Document &document, const std::string &jobName) const
+    {
+        const auto start = std::chrono::steady_clock::now();
+        auto elapsed = [&]()
+        {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        CompileResult result;
+#ifdef _WIN32
+        (void)document;
+        (void)jobName;
+        result.log = "Compiling is not supported on this system";
+        return result;
+#else
+        const DocumentDependencies dependencies = document.collectDependencies();
+        const std::string directory = openWorkspace(dependencies);
+        if (directory.empty())
+        {
+            result.log = "Cannot create a working directory";
+            result.seconds = elapsed();
+            return result;
+        }
+
+        const std::string base = directory + "/" + jobName;
+        std::string source;
+
+        const int inputFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        const int outputFd = open((base + ".out").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        pid_t pid = -1;
+        if (inputFd >= 0 && outputFd >= 0 && mkfifo((base + ".tex").c_str(), 0600) == 0)
+        {
+            std::error_code error;
+            std::vector<std::string> command = {m_options.engine};
+            command.insert(command.end(), m_options.arguments.begin(), m_options.arguments.end());
+            // The engine must not open the pipe a first time to look for a %& format line
+            if (std::find(command.begin(), command.end(), "-no-parse-first-line") == command.end() &&
+                std::find(command.begin(), command.end(), "--no-parse-first-line") == command.end())
+            {
+                command.push_back("-no-parse-first-line");
+            }
+            command.push_back(jobName + ".tex");
+            pid = spawnProcess(command, directory,
+                               makeEnvironment(std::filesystem::absolute(m_options.inputDirectory, error).string()),
+                               inputFd, outputFd);
+        }
+        if (inputFd >= 0)
+        {
+            close(inputFd);
+        }
+        if (outputFd >= 0)
+        {
+            close(outputFd);
+        }
+
+        if (pid > 0)
+        {
+            // Writing to an engine that stopped reading must fail instead of raising SIGPIPE
+            sigset_t pipeSignal, previousMask;
+            sigemptyset(&pipeSignal);
+            sigaddset(&pipeSignal, SIGPIPE);
+            pthread_sigmask(SIG_BLOCK, &pipeSignal, &previousMask);
+
+            const int pipeFd = openPipeWriter(base + ".tex", pid);
+            {
+                DescriptorStreamBuf buffer(pipeFd, source);
+                std::ostream out(&buffer);
+                document.write(out);
+                result.generationSeconds = elapsed();
+                buffer.finish();
+            }
+            if (pipeFd >= 0)
+            {
+                close(pipeFd);
+            }
+
+            if (!sigismember(&previousMask, SIGPIPE))
+            {
+                const timespec noWait = {0, 0};
+                while (sigtimedwait(&pipeSignal, nullptr, &noWait) > 0)
+                {
+                }
+            }
+            pthread_sigmask(SIG_SETMASK, &previousMask, nullptr);
+
+            result.exitCode = waitProcess(pid);
+        }
+        else
+        {
+            source = document.generate();
+            result.generationSeconds = elapsed();
+        }
+
+        // Further passes (and a failed start) read the complete source from a file
+        std::error_code error;
+        std::filesystem::remove(base + ".tex", error);
+        if (!writeFile(base + ".tex", source))
+        {
+            result.log = "Cannot write " + base + ".tex";
+        }
+        else if (pid > 0 && result.exitCode == 0)
+        {
+            runPasses(directory, jobName, !dependencies.bibliographies.empty(), 1, result);
+        }
+        else if (pid > 0)
+        {
+            readFile(base + ".out", result.log);
+        }
+        else
+        {
+            result.log = "Cannot start " + m_options.engine;
+        }
+
+        closeWorkspace(directory);
+
+        // Files referenced by raw content are only known from the complete source
+        DocumentDependencies referenced = dependencies;
+        referenced.addReferences(source, m_options.inputDirectory);
+        referenced.removeDuplicates();
+        result.key = computeKey(source, referenced);
+        if (result.success && m_cache)
+        {
+            m_cache->store(result.key, result.pdf);
+        }
+        result.seconds = elapsed();
+        return result;
+#endif
+    }
+
+    /**
+     * Implementation for the ninja file generation
+     */
+    namespace
+    {
+        // Quotes a word for the shell and escapes it for ninja
+        std::string quoteCommandWord(const std::string &word)
+        {
+            std::string quoted = word;
+            if (word.empty() || word.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                                       "0123456789_-+=.,/:@%") != std::string::npos)
+            {
+                quoted = "'";
+                for (char c : word)
+                {
+                    quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+                }
+                quoted += "'";
+            }
+
+            std::string escaped;
+            for (char c : quoted)
+            {
+                if (c == '$')
+                {
+                    escaped += '$';
+                }
+                escaped += c;
+            }
+            return escaped;
+        }
+
+        // Escapes a path in a ninja build statement
+        std::string escapeNinjaPath(const std::string &path)
+        {
+            std::string escaped;
+            for (char c : path)
+            {
+                if (c == '$' || c == ' ' || c == ':')
+                {
+                    escaped += '$';
+                }
+                escaped += c;
+            }
+            return escaped;
+        }
+    } // namespace
+
+    bool writeNinjaFile(const std::string &path, const std::vector<BuildEntry> &entries, const CompileOptions &options)
+    {
+        std::string engine = quoteCommandWord(options.engine);
+        for (const auto &argument : options.arguments)
+        {
+            engine += " " + quoteCommandWord(argument);
+        }
+        engine += " $job.tex";
+
+        // Same runs as Compiler: BibTeX between the first two passes
+        const unsigned passes = std::max(options.passes, 1u);
+        std::string command = "cd $dir && " + engine;
+        std::string bibtexCommand = command;
+        for (unsigned pass = 1; pass < passes; ++pass)
+        {
+            if (pass == 1 && !options.bibtex.empty())
+            {
+                bibtexCommand += " && " + quoteCommandWord(options.bibtex) + " $job";
+            }
+            command += " && " + engine;
+            bibtexCommand += " && " + engine;
+        }
+
+        std::ostringstream ninja;
+        ninja << "# Generated by LatexGen\n\n";
+        ninja << "rule latex\n"
+              << "  command = " << command << "\n"
+              << "  depfile = $out.d\n"
+              << "  description = LATEX $out\n\n";
+        if (bibtexCommand != command)
+        {
+            ninja << "rule latex_bibtex\n"
+                  << "  command = " << bibtexCommand << "\n"
+                  << "  depfile = $out.d\n"
+                  << "  description = LATEX $out\n\n";
+        }
+
+        bool success = true;
+        for (const auto &entry : entries)
+        {
+            if (!entry.document)
+            {
+                continue;
+            }
+            const std::filesystem::path tex =
+                std::filesystem::path(entry.directory.empty() ? "." : entry.directory) / entry.fileName;
+            std::filesystem::path pdf = tex;
+            pdf.replace_extension(".pdf");
+            const std::string pdfPath = pdf.lexically_normal().generic_string();
+
+            DocumentDependencies dependencies;
+            if (!entry.document->saveToFile(entry.directory, entry.fileName, pdfPath + ".d", &dependencies))
+            {
+                success = false;
+                continue;
+            }
+
+            const bool bibtex = bibtexCommand != command && !dependencies.bibliographies.empty();
+            const std::string directory = tex.parent_path().lexically_normal().generic_string();
+            ninja << "build " << escapeNinjaPath(pdfPath) << ": " << (bibtex ? "latex_bibtex" : "latex") << " "
+                  << escapeNinjaPath(tex.lexically_normal().generic_string()) << "\n"
+                  << "  dir = " << quoteCommandWord(directory) << "\n"
+                  << "  job = " << quoteCommandWord(tex.stem().string()) << "\n";
+        }
+
+        return writeFile(path, ninja.str()) && success;
+    }
+
+} // namespace LatexGen
@@ -1,5 +1,12 @@
 #include "latexgen.h"
 
+#include <chrono>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace LatexGen
 {
 
@@ -95,6 +102,210 @@ namespace LatexGen
         return result;
     }
 
+    /**
+     * Utility function to detect frame content that Beamer must treat as fragile
+     * (verbatim material such as listings or pre-highlighted code)
+     */
+    bool needsFragileFrame(const std::string &content)
+    {
+        return content.find("\\begin{lstlisting}") != std::string::npos ||
+               content.find("\\begin{Verbatim}") != std::string::npos ||
+               content.find("\\begin{verbatim}") != std::string::npos;
+    }
+
+    namespace
+    {
+        const char *const VERBATIM_ENVIRONMENTS[] = {"verbatim", "verbatim*", "Verbatim", "lstlisting"};
+
+        /**
+         * Find the end of verbatim material starting at a backslash (a verbatim
+         * environment or \verb), which must be copied unchanged
+         * @return Position after the material, or npos if none starts here
+         */
+        size_t findVerbatimEnd(const std::string &text, size_t slash)
+        {
+            if (text.compare(slash, 7, "\\begin{") == 0)
+            {
+                for (const char *name : VERBATIM_ENVIRONMENTS)
+                {
+                    const std::string begin = std::string("\\begin{") + name + "}";
+                    if (text.compare(slash, begin.size(), begin) == 0)
+                    {
+                        const std::string end = std::string("\\end{") + name + "}";
+                        const size_t position = text.find(end, slash + begin.size());
+                        return position == std::string::npos ? text.size() : position + end.size();
+                    }
+                }
+                return std::string::npos;
+            }
+
+            // \verb|...| and \verb*|...|, with any delimiter that is not a letter
+            if (text.compare(slash, 5, "\\verb") != 0)
+            {
+                return std::string::npos;
+            }
+            size_t delimiter = slash + 5;
+            if (delimiter < text.size() && text[delimiter] == '*')
+            {
+                ++delimiter;
+            }
+            if (delimiter >= text.size() || std::isalpha(static_cast<unsigned char>(text[delimiter])) ||
+                std::isspace(static_cast<unsigned char>(text[delimiter])))
+            {
+                return std::string::npos;
+            }
+            const size_t close = text.find(text[delimiter], delimiter + 1);
+            return close == std::string::npos ? text.size() : close + 1;
+        }
+    } // namespace
+
+    /**
+     * Implementation for the LaTeX escaping functions
+     */
+    void appendEscapedLatex(std::string &out, std::string_view text)
+    {
+        size_t chunk = 0;
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            const char *replacement = nullptr;
+            switch (text[i])
+            {
+            case '\\':
+                replacement = "\\textbackslash{}";
+                break;
+            case '{':
+                replacement = "\\{";
+                break;
+            case '}':
+                replacement = "\\}";
+                break;
+            case '$':
+                replacement = "\\$";
+                break;
+            case '&':
+                replacement = "\\&";
+                break;
+            case '#':
+                replacement = "\\#";
+                break;
+            case '%':
+                replacement = "\\%";
+                break;
+            case '_':
+                replacement = "\\_";
+                break;
+            case '^':
+                replacement = "\\textasciicircum{}";
+                break;
+            case '~':
+                replacement = "\\textasciitilde{}";
+                break;
+            default:
+                continue;
+            }
+            out.append(text.data() + chunk, i - chunk);
+            out.append(replacement);
+            chunk = i + 1;
+        }
+        out.append(text.data() + chunk, text.size() - chunk);
+    }
+
+    std::string escapeLatex(const std::string &text)
+    {
+        std::string result;
+        result.reserve(text.size() + text.size() / 8);
+        appendEscapedLatex(result, text);
+        return result;
+    }
+
+    /**
+     * Implementation for ContentHasher class
+     */
+    void ContentHasher::addBytes(const char *data, size_t size)
+    {
+        // Words are assembled little-endian so the hash does not depend on the platform
+        const auto *bytes = reinterpret_cast<const unsigned char *>(data);
+        while (size >= 8)
+        {
+            uint64_t word = 0;
+            for (int i = 7; i >= 0; --i)
+            {
+                word = (word << 8) | bytes[i];
+            }
+            mix(word);
+            bytes += 8;
+            size -= 8;
+        }
+
+        uint64_t tail = 0;
+        for (size_t i = 0; i < size; ++i)
+        {
+            tail |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+        }
+        mix(tail ^ (static_cast<uint64_t>(size) << 56));
+    }
+
+    /**
+     * Implementation for the createTemporaryFile function
+     */
+    std::string createTemporaryFile(const std::string &path)
+    {
+        std::string name = path + ".XXXXXX";
+#ifndef _WIN32
+        int fd = mkstemp(&name[0]);
+        if (fd < 0)
+        {
+            return "";
+        }
+
+        // mkstemp() creates the file for the owner only; give it the permissions of a
+        // file created normally, since it replaces one
+        static const mode_t mask = []
+        {
+            mode_t current = umask(0);
+            umask(current);
+            return current;
+        }();
+        fchmod(fd, 0666 & ~mask);
+        close(fd);
+        return name;
+#else
+        if (_mktemp_s(&name[0], name.size() + 1) != 0)
+        {
+            return "";
+        }
+        std::ofstream create(name, std::ios::binary);
+        return create ? name : "";
+#endif
+    }
+
+    bool replaceFile(const std::string &path, const std::string &content)
+    {
+        const std::string temporary = createTemporaryFile(path);
+        if (temporary.empty())
+        {
+            return false;
+        }
+
+        std::error_code error;
+        {
+            std::ofstream out(temporary, std::ios::binary);
+            if (!out.write(content.data(), static_cast<std::streamsize>(content.size())) || !out.flush())
+            {
+                out.close();
+                std::filesystem::remove(temporary, error);
+                return false;
+            }
+        }
+        std::filesystem::rename(temporary, path, error);
+        if (error)
+        {
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+        return true;
+    }
+
     /**
      * Implementation for the getBabelLanguageName function
      */
@@ -129,6 +340,238 @@ namespace LatexGen
         }
     }
 
+    /**
+     * Implementation for CompressedText class
+     */
+    namespace
+    {
+        const size_t MIN_MATCH = 4;      // Shortest match
+        const size_t LAST_LITERALS = 5;  // The last bytes of a chunk are always literals
+        const size_t MATCH_LIMIT = 12;   // No match starts in the last bytes of a chunk
+        const unsigned HASH_BITS = 12;
+
+        uint32_t read32(const char *data)
+        {
+            uint32_t value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+        void writeLength(std::string &out, size_t length)
+        {
+            while (length >= 255)
+            {
+                out += static_cast<char>(255);
+                length -= 255;
+            }
+            out += static_cast<char>(length);
+        }
+
+        void writeSequence(std::string &out, const char *literals, size_t literalCount, size_t offset, size_t matchLength)
+        {
+            const size_t matchCode = matchLength - MIN_MATCH;
+            out += static_cast<char>(((literalCount < 15 ? literalCount : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+            if (literalCount >= 15)
+            {
+                writeLength(out, literalCount - 15);
+            }
+            out.append(literals, literalCount);
+            out += static_cast<char>(offset & 0xFF);
+            out += static_cast<char>(offset >> 8);
+            if (matchCode >= 15)
+            {
+                writeLength(out, matchCode - 15);
+            }
+        }
+
+        /**
+         * Compress one chunk (at most 64 KiB, so offsets fit in 16 bits) with greedy
+         * hash-table matching
+         */
+        void compressChunk(const char *src, size_t size, std::string &out)
+        {
+            uint16_t table[1u << HASH_BITS] = {};
+            size_t anchor = 0;
+            size_t pos = 0;
+            size_t misses = 0;
+
+            while (size > MATCH_LIMIT && pos < size - MATCH_LIMIT)
+            {
+                const uint32_t sequence = read32(src + pos);
+                const uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+                const size_t candidate = table[hash];
+                table[hash] = static_cast<uint16_t>(pos);
+
+                if (candidate >= pos || read32(src + candidate) != sequence)
+                {
+                    // Skip faster through data that does not compress
+                    pos += 1 + (misses++ >> 6);
+                    continue;
+                }
+
+                size_t length = MIN_MATCH;
+                while (pos + length < size - LAST_LITERALS && src[candidate + length] == src[pos + length])
+                {
+                    ++length;
+                }
+                writeSequence(out, src + anchor, pos - anchor, pos - candidate, length);
+                pos += length;
+                anchor = pos;
+                misses = 0;
+            }
+
+            // Last literals
+            const size_t literalCount = size - anchor;
+            out += static_cast<char>((literalCount < 15 ? literalCount : 15) << 4);
+            if (literalCount >= 15)
+            {
+                writeLength(out, literalCount - 15);
+            }
+            out.append(src + anchor, literalCount);
+        }
+
+        size_t readLength(const unsigned char *&src)
+        {
+            size_t length = 0;
+            unsigned char byte;
+            do
+            {
+                byte = *src++;
+                length += byte;
+            } while (byte == 255);
+            return length;
+        }
+    } // namespace
+
+    CompressedText::CompressedText(std::string_view text)
+        : m_size(text.size()), m_digest(ContentHasher().add(text).digest())
+    {
+        m_data.reserve(text.size() / 2);
+        for (size_t offset = 0; offset < text.size(); offset += CHUNK_SIZE)
+        {
+            compressChunk(text.data() + offset, std::min(CHUNK_SIZE, text.size() - offset), m_data);
+            m_chunkEnds.push_back(m_data.size());
+        }
+        m_data.shrink_to_fit();
+    }
+
+    size_t CompressedText::decodeChunk(size_t chunk, char *out) const
+    {
+        const unsigned char *src = reinterpret_cast<const unsigned char *>(m_data.data()) +
+                                   (chunk == 0 ? 0 : m_chunkEnds[chunk - 1]);
+        const unsigned char *end = reinterpret_cast<const unsigned char *>(m_data.data()) + m_chunkEnds[chunk];
+        char *dst = out;
+
+        while (src < end)
+        {
+            const unsigned token = *src++;
+            size_t literalCount = token >> 4;
+            if (literalCount == 15)
+            {
+                literalCount += readLength(src);
+            }
+            std::memcpy(dst, src, literalCount);
+            dst += literalCount;
+            src += literalCount;
+            if (src >= end)
+            {
+                break;
+            }
+
+            const size_t offset = src[0] | (static_cast<size_t>(src[1]) << 8);
+            src += 2;
+            size_t length = token & 15;
+            if (length == 15)
+            {
+                length += readLength(src);
+            }
+            length += MIN_MATCH;
+
+            const char *match = dst - offset;
+            if (offset >= length)
+            {
+                std::memcpy(dst, match, length);
+                dst += length;
+            }
+            else
+            {
+                // Overlapping match: repeats the last offset bytes
+                for (size_t i = 0; i < length; ++i)
+                {
+                    *dst++ = match[i];
+                }
+            }
+        }
+        return static_cast<size_t>(dst - out);
+    }
+
+    void CompressedText::addDecode(uint64_t bytes, uint64_t nanoseconds) const
+    {
+        m_decodedBytes.fetch_add(bytes, std::memory_order_relaxed);
+        m_decodeNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    }
+
+    void CompressedText::appendTo(std::string &out) const
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const size_t offset = out.size();
+        out.resize(offset + m_size);
+        char *dst = &out[offset];
+        for (size_t chunk = 0; chunk < m_chunkEnds.size(); ++chunk)
+        {
+            dst += decodeChunk(chunk, dst);
+        }
+        addDecode(m_size, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    void CompressedText::write(std::ostream &out) const
+    {
+        // Only decoding is timed, not the writes to the stream
+        std::vector<char> buffer(std::min(CHUNK_SIZE, m_size));
+        std::chrono::steady_clock::duration decoding{0};
+        for (size_t chunk = 0; chunk < m_chunkEnds.size(); ++chunk)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const size_t size = decodeChunk(chunk, buffer.data());
+            decoding += std::chrono::steady_clock::now() - start;
+            out.write(buffer.data(), static_cast<std::streamsize>(size));
+        }
+        addDecode(m_size, std::chrono::duration_cast<std::chrono::nanoseconds>(decoding).count());
+    }
+
+    /**
+     * Implementation for LazyContent class
+     */
+    std::string LazyContent::evaluate() const
+    {
+        if (!m_memoize)
+        {
+            return m_provider ? m_provider() : std::string();
+        }
+
+        // The lock is held during the call so concurrent generations compute it once
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_evaluated)
+        {
+            m_value = m_provider ? m_provider() : std::string();
+            m_evaluated = true;
+        }
+        return m_value;
+    }
+
+    bool LazyContent::isEvaluated() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_evaluated;
+    }
+
+    void LazyContent::reset()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_evaluated = false;
+        m_value.clear();
+    }
+
     /**
      * Implementation for Section class
      */
@@ -158,93 +601,332 @@ namespace LatexGen
         // Add content
         for (const auto &content : m_content)
         {
-            result += content + "\n";
+            if (content.lazy)
+            {
+                result += content.lazy->evaluate();
+            }
+            else
+            {
+                content.text.appendTo(result);
+            }
+            result += "\n";
         }
 
         return result;
     }
 
+    bool Section::fingerprint(ContentHasher &hasher) const
+    {
+        hasher.add("section").add(static_cast<uint64_t>(static_cast<int>(m_level) + 1)).add(m_title);
+        for (const auto &content : m_content)
+        {
+            if (content.lazy)
+            {
+                return false;
+            }
+            content.text.fingerprint(hasher);
+        }
+        return true;
+    }
+
+    void Section::compress(size_t threshold)
+    {
+        for (auto &content : m_content)
+        {
+            content.text.compress(threshold);
+        }
+    }
+
+    void Section::addStorageStats(TextStorageStats &stats) const
+    {
+        for (const auto &content : m_content)
+        {
+            if (!content.lazy)
+            {
+                content.text.addStats(stats);
+            }
+        }
+    }
+
     /**
      * Implementation for Table class
      */
-    std::string Table::generate() const
+    void Table::Column::append(uint32_t id)
     {
-        std::stringstream ss;
-
-        // Begin table environment with position
-        ss << "\\begin{table}";
-        if (!m_options.empty() && m_options.find("position") != m_options.end())
+        if (m_size % IDS_PER_BLOCK == 0)
         {
-            ss << "[" << m_options.at("position") << "]";
+            std::vector<uint32_t> block;
+            block.reserve(IDS_PER_BLOCK);
+            block.push_back(id);
+            m_ids.push_back(std::move(block));
         }
-        ss << "\n\\centering\n";
-
-        // Calculate number of columns and set tabular environment
-        size_t numCols = m_headers.size();
-        ss << "\\begin{tabular}{";
-        for (size_t i = 0; i < numCols; ++i)
+        else
         {
-            ss << "|c";
+            m_ids.edit(m_ids.size() - 1).push_back(id);
         }
-        ss << "|}\n\\hline\n";
+        ++m_size;
+    }
 
-        // Add headers
-        for (size_t i = 0; i < numCols; ++i)
+    void Table::Column::add(const std::string &value, bool escape)
+    {
+        Dictionary &dictionary = m_dictionary.edit();
+        if (dictionary.deduplicate)
         {
-            ss << m_headers[i];
-            if (i < numCols - 1)
+            auto found = dictionary.index.find(value);
+            if (found != dictionary.index.end())
             {
-                ss << " & ";
+                append(found->second);
+                return;
             }
         }
-        ss << " \\\\ \\hline\n";
 
-        // Add rows
-        for (const auto &row : m_rows)
+        const uint32_t id = static_cast<uint32_t>(dictionary.values.size());
+        dictionary.values.push_back(value);
+        if (escape)
         {
-            for (size_t i = 0; i < row.size() && i < numCols; ++i)
+            dictionary.escaped.push_back(escapeLatex(value));
+        }
+        if (dictionary.deduplicate)
+        {
+            dictionary.index.emplace(value, id);
+
+            // Mostly distinct values: the index costs more than it saves
+            if (m_size >= DEDUPLICATION_CHECK && dictionary.values.size() * 2 > m_size)
             {
-                ss << row[i];
-                if (i < numCols - 1)
-                {
-                    ss << " & ";
-                }
+                dictionary.deduplicate = false;
+                std::unordered_map<std::string, uint32_t>().swap(dictionary.index);
             }
-            ss << " \\\\ \\hline\n";
         }
+        append(id);
+    }
 
-        // End tabular environment
-        ss << "\\end{tabular}\n";
+    void Table::Column::addAbsent()
+    {
+        append(ABSENT);
+    }
 
-        // Add caption and label if provided
-        if (!m_caption.empty())
+    void Table::Column::setEscape(bool escape)
+    {
+        Dictionary &dictionary = m_dictionary.edit();
+        dictionary.escaped.clear();
+        if (escape)
         {
-            ss << "\\caption{" << m_caption << "}\n";
+            dictionary.escaped.reserve(dictionary.values.size());
+            for (const auto &value : dictionary.values)
+            {
+                dictionary.escaped.push_back(escapeLatex(value));
+            }
         }
-
-        if (!m_label.empty())
+        else
         {
-            ss << "\\label{" << m_label << "}\n";
+            dictionary.escaped.shrink_to_fit();
         }
-
-        // End table environment
-        ss << "\\end{table}\n";
-
-        return ss.str();
     }
 
-    /**
-     * Implementation for Figure class
-     */
-    std::string Figure::generate() const
+    void Table::addRow(const std::vector<std::string> &row)
     {
-        std::stringstream ss;
-
-        // Begin figure environment with position
-        ss << "\\begin{figure}";
-        if (!m_options.empty() && m_options.find("position") != m_options.end())
+        for (size_t i = 0; i < m_columns.size(); ++i)
         {
-            ss << "[" << m_options.at("position") << "]";
+            if (i < row.size())
+            {
+                m_columns[i].add(row[i], m_escapeCells);
+            }
+            else
+            {
+                m_columns[i].addAbsent();
+            }
+        }
+        ++m_rowCount;
+    }
+
+    void Table::setEscapeCells(bool escape)
+    {
+        if (escape == m_escapeCells)
+        {
+            return;
+        }
+        m_escapeCells = escape;
+        for (auto &column : m_columns)
+        {
+            column.setEscape(escape);
+        }
+    }
+
+    const std::string &Table::getCell(size_t row, size_t column) const
+    {
+        static const std::string empty;
+        if (row >= m_rowCount || column >= m_columns.size())
+        {
+            return empty;
+        }
+        const uint32_t id = m_columns[column].getId(row);
+        return id == Column::ABSENT ? empty : m_columns[column].getValues()[id];
+    }
+
+    size_t Table::getDistinctValueCount(size_t column) const
+    {
+        return column < m_columns.size() ? m_columns[column].getValues().size() : 0;
+    }
+
+    std::string Table::generate() const
+    {
+        std::string out;
+
+        // Begin table environment with position
+        out += "\\begin{table}";
+        if (!m_options.empty() && m_options.find("position") != m_options.end())
+        {
+            out += "[" + m_options.at("position") + "]";
+        }
+        out += "\n\\centering\n";
+
+        // Calculate number of columns and set tabular environment
+        size_t numCols = m_headers.size();
+        out += "\\begin{tabular}{";
+        for (size_t i = 0; i < numCols; ++i)
+        {
+            out += "|c";
+        }
+        out += "|}\n\\hline\n";
+
+        // Add headers
+        for (size_t i = 0; i < numCols; ++i)
+        {
+            out += m_headers[i];
+            if (i < numCols - 1)
+            {
+                out += " & ";
+            }
+        }
+        out += " \\\\ \\hline\n";
+
+        // Add rows: cells are copied from the pre-rendered column dictionaries
+        std::vector<const std::vector<std::string> *> rendered(numCols);
+        std::vector<const std::vector<uint32_t> *> ids(numCols);
+        for (size_t i = 0; i < numCols; ++i)
+        {
+            rendered[i] = &m_columns[i].getRendered(m_escapeCells);
+        }
+        for (size_t first = 0; first < m_rowCount; first += Column::IDS_PER_BLOCK)
+        {
+            for (size_t i = 0; i < numCols; ++i)
+            {
+                ids[i] = &m_columns[i].getBlock(first / Column::IDS_PER_BLOCK);
+            }
+            const size_t count = std::min(Column::IDS_PER_BLOCK, m_rowCount - first);
+            for (size_t row = 0; row < count; ++row)
+            {
+                for (size_t i = 0; i < numCols; ++i)
+                {
+                    const uint32_t id = (*ids[i])[row];
+                    if (id == Column::ABSENT)
+                    {
+                        break;
+                    }
+                    out += (*rendered[i])[id];
+                    if (i < numCols - 1)
+                    {
+                        out += " & ";
+                    }
+                }
+                out += " \\\\ \\hline\n";
+            }
+        }
+
+        // Add the rows of the data source, formatted now
+        if (m_dataSource)
+        {
+            const size_t sourceColumns = std::min(numCols, m_dataSource->getColumnCount());
+            const size_t sourceRows = m_dataSource->getRowCount();
+            std::string cell;
+            for (size_t row = 0; row < sourceRows; ++row)
+            {
+                for (size_t i = 0; i < sourceColumns; ++i)
+                {
+                    if (m_escapeCells)
+                    {
+                        cell.clear();
+                        m_dataSource->formatCell(row, i, cell);
+                        appendEscapedLatex(out, cell);
+                    }
+                    else
+                    {
+                        m_dataSource->formatCell(row, i, out);
+                    }
+                    if (i < numCols - 1)
+                    {
+                        out += " & ";
+                    }
+                }
+                out += " \\\\ \\hline\n";
+            }
+        }
+
+        // End tabular environment
+        out += "\\end{tabular}\n";
+
+        // Add caption and label if provided
+        if (!m_caption.empty())
+        {
+            out += "\\caption{" + m_caption + "}\n";
+        }
+
+        if (!m_label.empty())
+        {
+            out += "\\label{" + m_label + "}\n";
+        }
+
+        // End table environment
+        out += "\\end{table}\n";
+
+        return out;
+    }
+
+    bool Table::fingerprint(ContentHasher &hasher) const
+    {
+        hasher.add(m_name).add(m_caption).add(m_label);
+        for (const auto &option : m_options)
+        {
+            hasher.add(option.first).add(option.second);
+        }
+        hasher.add(static_cast<uint64_t>(m_headers.size()));
+        for (const auto &header : m_headers)
+        {
+            hasher.add(header);
+        }
+        hasher.add(static_cast<uint64_t>(m_escapeCells)).add(static_cast<uint64_t>(m_rowCount));
+        for (const auto &column : m_columns)
+        {
+            const auto &values = column.getValues();
+            hasher.add(static_cast<uint64_t>(values.size()));
+            for (const auto &value : values)
+            {
+                hasher.add(value);
+            }
+            for (size_t row = 0; row < m_rowCount; ++row)
+            {
+                hasher.add(static_cast<uint64_t>(column.getId(row)));
+            }
+        }
+        if (m_dataSource)
+        {
+            return m_dataSource->fingerprint(hasher.add("source"));
+        }
+        return true;
+    }
+
+    /**
+     * Implementation for Figure class
+     */
+    std::string Figure::generate() const
+    {
+        std::stringstream ss;
+
+        // Begin figure environment with position
+        ss << "\\begin{figure}";
+        if (!m_options.empty() && m_options.find("position") != m_options.end())
+        {
+            ss << "[" << m_options.at("position") << "]";
         }
         ss << "\n\\centering\n";
 
@@ -273,6 +955,16 @@ namespace LatexGen
         return ss.str();
     }
 
+    bool Figure::fingerprint(ContentHasher &hasher) const
+    {
+        hasher.add(m_name).add(m_imagePath).add(m_caption).add(m_label).add(m_width);
+        for (const auto &option : m_options)
+        {
+            hasher.add(option.first).add(option.second);
+        }
+        return true;
+    }
+
     /**
      * Implementation for Equation class
      */
@@ -298,1560 +990,5466 @@ namespace LatexGen
         return ss.str();
     }
 
+    bool Equation::fingerprint(ContentHasher &hasher) const
+    {
+        hasher.add(m_name).add(m_content).add(m_label);
+        return true;
+    }
+
     /**
      * Implementation for List class
      */
+    std::shared_ptr<List> List::addSubList(ListType type)
+    {
+        std::vector<Item> &items = m_items.edit();
+        if (items.empty())
+        {
+            items.push_back({"", "", nullptr});
+        }
+
+        auto child = std::make_shared<List>(type);
+        items.back().child = child;
+
+        return child;
+    }
+
+    std::shared_ptr<Environment> List::clone() const
+    {
+        auto copy = std::make_shared<List>(*this);
+
+        // Items are shared until one of the copies is modified, but nested lists can be
+        // modified through the pointers returned by addSubList(): lists holding nested
+        // lists get their own items pointing to copies of them, without recursion
+        std::vector<List *> pending{copy.get()};
+        while (!pending.empty())
+        {
+            List *list = pending.back();
+            pending.pop_back();
+            const std::vector<Item> &items = *list->m_items;
+            if (std::none_of(items.begin(), items.end(), [](const Item &item)
+                             { return item.child != nullptr; }))
+            {
+                continue;
+            }
+
+            for (auto &item : list->m_items.edit())
+            {
+                if (item.child)
+                {
+                    item.child = std::make_shared<List>(*item.child);
+                    pending.push_back(item.child.get());
+                }
+            }
+        }
+
+        return copy;
+    }
+
+    bool List::fingerprint(ContentHasher &hasher) const
+    {
+        // Same traversal as generate(), with markers around nested lists
+        std::vector<std::pair<const List *, size_t>> stack{{this, 0}};
+        hasher.add(m_name);
+        while (!stack.empty())
+        {
+            auto &top = stack.back();
+            const List *list = top.first;
+            if (top.second == list->m_items->size())
+            {
+                hasher.add("end");
+                stack.pop_back();
+                continue;
+            }
+
+            const Item &item = (*list->m_items)[top.second++];
+            hasher.add(item.text).add(item.label);
+            if (item.child)
+            {
+                hasher.add(item.child->m_name);
+                stack.push_back({item.child.get(), 0});
+            }
+        }
+        return true;
+    }
+
     std::string List::generate() const
     {
-        std::stringstream ss;
+        std::string result;
+        result.reserve(m_items->size() * 32);
+
+        // Nested lists are rendered with an explicit stack of (list, next item) pairs
+        std::vector<std::pair<const List *, size_t>> stack;
 
         // Begin list environment
-        ss << begin();
+        result += begin();
+        stack.push_back({this, 0});
 
-        // Add items
-        for (size_t i = 0; i < m_items.size(); ++i)
+        while (!stack.empty())
         {
-            ss << "\\item ";
+            const List *list = stack.back().first;
+            size_t index = stack.back().second;
+
+            // End list environment once all its items are written
+            if (index == list->m_items->size())
+            {
+                result += list->end();
+                stack.pop_back();
+                continue;
+            }
+            stack.back().second = index + 1;
+
+            const Item &item = (*list->m_items)[index];
+            result += "\\item ";
 
             // For description lists, add an optional label
-            if (m_type == ListType::DESCRIPTION && m_itemLabels.find(i) != m_itemLabels.end())
+            if (list->m_type == ListType::DESCRIPTION && !item.label.empty())
             {
-                ss << "[" << m_itemLabels.at(i) << "] ";
+                result += "[";
+                result += item.label;
+                result += "] ";
             }
 
-            ss << m_items[i] << "\n";
-        }
+            result += item.text;
+            result += '\n';
 
-        // End list environment
-        ss << end();
+            // Descend into the nested list
+            if (item.child)
+            {
+                result += item.child->begin();
+                stack.push_back({item.child.get(), 0});
+            }
+        }
 
-        return ss.str();
+        return result;
     }
 
     /**
-     * Implementation for Document class
+     * Implementation for FragmentCache class
      */
-    Document::Document(DocumentType type, const std::string &title,
-                       const std::string &author, const std::string &date,
-                       Language language)
-        : m_type(type), m_title(title), m_author(author), m_date(date), m_language(language)
+    namespace
     {
-        // Do not load natbib by default
-        
-        // Add common packages used in most document types
-        addPackage("inputenc", "utf8");
-        addPackage("fontenc", "T1");
+        const char FRAGMENT_CACHE_MAGIC[8] = {'L', 'G', 'F', 'C', 'A', 'C', 'H', 'E'};
+        const uint32_t FRAGMENT_CACHE_VERSION = 1;
+        const size_t FRAGMENT_CACHE_HEADER_SIZE = 32;
+        const size_t FRAGMENT_CACHE_RECORD_SIZE = 32;
 
-        // Add language support packages
-        if (m_language != Language::ENGLISH)
+        void putUint64(std::string &out, uint64_t value)
         {
-            addPackage("babel", getBabelLanguageName(m_language));
+            for (int i = 0; i < 8; ++i)
+            {
+                out += static_cast<char>((value >> (8 * i)) & 0xFF);
+            }
         }
 
-        // Add special packages based on the language
-        switch (m_language)
+        uint64_t getUint64(const char *data)
         {
-        case Language::RUSSIAN:
-            // Add cyrillic support for Russian
-            addPackage("cyrillic");
-            break;
-        case Language::CHINESE:
-        case Language::JAPANESE:
-            // Add CJK support for Chinese and Japanese
-            addPackage("xeCJK");
-            break;
-        case Language::ARABIC:
-            // Add right-to-left support for Arabic
-            addPackage("arabxetex");
-            break;
-        default:
-            break;
+            uint64_t value = 0;
+            for (int i = 7; i >= 0; --i)
+            {
+                value = (value << 8) | static_cast<unsigned char>(data[i]);
+            }
+            return value;
         }
     }
 
-    std::string Document::getLanguageConfiguration() const
+    FragmentCache::FragmentCache(const std::string &filePath, size_t maxBytes)
+        : m_filePath(filePath), m_maxBytes(maxBytes)
     {
-        std::stringstream ss;
+        load();
+    }
 
-        // Configure document according to language specifics
-        switch (m_language)
+    FragmentCache::~FragmentCache()
+    {
+        if (m_dirty)
         {
-        case Language::FRENCH:
-            ss << "\\frenchbsetup{StandardLayout=true}\n";
-            break;
-        case Language::GERMAN:
-            ss << "\\selectlanguage{ngerman}\n"; // Changed from "german" to "ngerman"
-            break;
-        case Language::SPANISH:
-            ss << "\\selectlanguage{spanish}\n";
-            break;
-        case Language::ITALIAN:
-            ss << "\\selectlanguage{italian}\n";
-            break;
-        case Language::PORTUGUESE:
-            ss << "\\selectlanguage{portuguese}\n";
-            break;
-        case Language::DUTCH:
-            ss << "\\selectlanguage{dutch}\n";
-            break;
-        case Language::RUSSIAN:
-            ss << "\\selectlanguage{russian}\n";
-            break;
-        case Language::CHINESE:
-            ss << "\\setCJKmainfont{SimSun}\n";
-            break;
-        case Language::JAPANESE:
-            ss << "\\setCJKmainfont{IPAMincho}\n";
-            break;
-        case Language::ARABIC:
-            ss << "\\setmainlanguage{arabic}\n";
-            break;
-        case Language::ENGLISH:
-        default:
-            // No special configuration needed for English
-            break;
+            save();
         }
-
-        return ss.str();
     }
 
-    std::string Document::getDocumentClass() const
+    void FragmentCache::load()
     {
-        std::string documentClass;
-
-        switch (m_type)
+        m_file.open(m_filePath, std::ios::binary);
+        if (!m_file)
         {
-        case DocumentType::ARTICLE:
-            documentClass = "article";
-            break;
-        case DocumentType::REPORT:
-            documentClass = "report";
-            break;
-        case DocumentType::BOOK:
-            documentClass = "book";
-            break;
-        case DocumentType::PRESENTATION:
-            documentClass = "beamer";
-            break;
-        default:
-            documentClass = "article";
+            return;
         }
 
-        return documentClass;
-    }
-
-    std::string Document::generatePreamble() const
-    {
-        std::stringstream ss;
-
-        // Document class
-        ss << "\\documentclass{" << getDocumentClass() << "}\n\n";
-
-        // Packages
-        for (const auto &package : m_packages)
+        std::string header(FRAGMENT_CACHE_HEADER_SIZE, '\0');
+        if (!m_file.read(&header[0], header.size()) ||
+            std::memcmp(header.data(), FRAGMENT_CACHE_MAGIC, sizeof(FRAGMENT_CACHE_MAGIC)) != 0 ||
+            static_cast<uint32_t>(getUint64(header.data() + 8)) != FRAGMENT_CACHE_VERSION)
         {
-            ss << "\\usepackage";
-            if (!package.second.empty())
-            {
-                ss << "[" << package.second << "]";
-            }
-            ss << "{" << package.first << "}\n";
+            // Unknown or damaged file: start empty, it is replaced on save
+            m_file.close();
+            return;
         }
-        ss << "\n";
 
-        // Language configuration
-        ss << getLanguageConfiguration();
+        uint64_t lastRun = getUint64(header.data() + 16);
+        uint64_t count = getUint64(header.data() + 24);
 
-        // Document information
-        if (!m_title.empty())
+        m_file.seekg(0, std::ios::end);
+        uint64_t fileSize = static_cast<uint64_t>(m_file.tellg());
+        if (count > (fileSize - FRAGMENT_CACHE_HEADER_SIZE) / FRAGMENT_CACHE_RECORD_SIZE)
         {
-            ss << "\\title{" << m_title << "}\n";
+            m_file.close();
+            return;
         }
 
-        if (!m_author.empty())
+        std::string index(count * FRAGMENT_CACHE_RECORD_SIZE, '\0');
+        m_file.seekg(FRAGMENT_CACHE_HEADER_SIZE);
+        if (!m_file.read(&index[0], index.size()))
         {
-            ss << "\\author{" << m_author << "}\n";
+            m_file.close();
+            return;
         }
 
-        if (!m_date.empty())
+        m_run = lastRun + 1;
+        m_dataStart = FRAGMENT_CACHE_HEADER_SIZE + index.size();
+        uint64_t dataSize = fileSize - m_dataStart;
+
+        m_entries.reserve(count);
+        for (uint64_t i = 0; i < count; ++i)
         {
-            ss << "\\date{" << m_date << "}\n";
+            const char *record = index.data() + i * FRAGMENT_CACHE_RECORD_SIZE;
+            Entry entry;
+            entry.offset = getUint64(record + 8);
+            entry.length = getUint64(record + 16);
+            entry.lastUsed = getUint64(record + 24);
+            if (entry.offset <= dataSize && entry.length <= dataSize - entry.offset)
+            {
+                m_entries[getUint64(record)] = entry;
+            }
         }
-        
-        // Add theorem environment support if enabled
-        if (m_theoremsEnabled)
+    }
+
+    bool FragmentCache::readData(const Entry &entry, std::string &out)
+    {
+        if (entry.data)
         {
-            ss << TheoremEnvironment::getTheoremSetup(m_language);
+            out = *entry.data;
+            return true;
         }
-        
-        // Add algorithm environment support if enabled
-        if (m_algorithmsEnabled)
+
+        out.resize(entry.length);
+        m_file.clear();
+        m_file.seekg(static_cast<std::streamoff>(m_dataStart + entry.offset));
+        return entry.length == 0 || static_cast<bool>(m_file.read(&out[0], entry.length));
+    }
+
+    bool FragmentCache::lookup(uint64_t key, std::string &out)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_entries.find(key);
+        if (it == m_entries.end() || !readData(it->second, out))
         {
-            ss << Algorithm::getAlgorithmPackages();
+            ++m_stats.misses;
+            return false;
         }
-        
-        // Add bibliography configuration if a bibliography is set
-        if (!m_usedCitations.empty())
+
+        // Keep fragments read from the file, nodes often repeat within a run
+        if (!it->second.data)
         {
-            ss << m_bibliography.getPreambleConfig();
+            it->second.data = std::make_shared<const std::string>(out);
         }
-        
-        // Add custom preamble content
-        for (const auto &content : m_customPreamble)
+
+        if (it->second.lastUsed != m_run)
         {
-            ss << content << "\n";
+            it->second.lastUsed = m_run;
+            m_dirty = true;
         }
 
-        ss << "\n";
-
-        return ss.str();
+        ++m_stats.hits;
+        m_stats.bytesReused += out.size();
+        return true;
     }
 
-    std::string Document::generateDocument() const
+    void FragmentCache::store(uint64_t key, const std::string &fragment)
     {
-        std::stringstream ss;
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        Entry &entry = m_entries[key];
+        entry.offset = 0;
+        entry.length = fragment.size();
+        entry.lastUsed = m_run;
+        entry.data = std::make_shared<const std::string>(fragment);
+        m_dirty = true;
+    }
 
-        // Begin document
-        ss << "\\begin{document}\n\n";
+    bool FragmentCache::save()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
 
-        // Generate title page if title is set
-        if (!m_title.empty())
+        // Keep the most recently used fragments within the size limit
+        std::vector<std::pair<uint64_t, Entry *>> kept;
+        kept.reserve(m_entries.size());
+        for (auto &entry : m_entries)
         {
-            ss << "\\maketitle\n\n";
+            kept.push_back({entry.first, &entry.second});
         }
+        std::sort(kept.begin(), kept.end(), [](const auto &a, const auto &b)
+                  { return a.second->lastUsed != b.second->lastUsed ? a.second->lastUsed > b.second->lastUsed
+                                                                    : a.first < b.first; });
 
-        // Add raw content
-        for (const auto &content : m_rawContent)
+        uint64_t dataSize = 0;
+        size_t keptCount = 0;
+        while (keptCount < kept.size() && dataSize + kept[keptCount].second->length <= m_maxBytes)
         {
-            ss << content << "\n\n";
+            dataSize += kept[keptCount].second->length;
+            ++keptCount;
         }
+        m_stats.evictions = kept.size() - keptCount;
+        kept.resize(keptCount);
 
-        // Add sections
-        for (const auto &section : m_sections)
+        std::filesystem::path path(m_filePath);
+        if (path.has_parent_path())
         {
-            ss << section.generate() << "\n";
+            std::error_code error;
+            std::filesystem::create_directories(path.parent_path(), error);
         }
 
-        // Add environments
-        for (const auto &env : m_environments)
+        // Write a new file next to the old one (the old one is still read from), under
+        // a name of its own so processes saving the same cache do not mix their writes
+        std::string tmpPath = createTemporaryFile(m_filePath);
+        if (tmpPath.empty())
         {
-            ss << env->generate() << "\n";
+            return false;
         }
-        
-        // Add bibliography if citations are used
-        if (!m_usedCitations.empty())
+        std::error_code error;
         {
-            ss << m_bibliography.getIncludeCommands() << "\n";
-        }
+            std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!out)
+            {
+                std::filesystem::remove(tmpPath, error);
+                return false;
+            }
 
-        // End document
-        ss << "\\end{document}\n";
+            std::string header(FRAGMENT_CACHE_MAGIC, sizeof(FRAGMENT_CACHE_MAGIC));
+            putUint64(header, FRAGMENT_CACHE_VERSION);
+            putUint64(header, m_run);
+            putUint64(header, kept.size());
+            out.write(header.data(), header.size());
 
-        return ss.str();
-    }
+            std::string index;
+            index.reserve(kept.size() * FRAGMENT_CACHE_RECORD_SIZE);
+            uint64_t offset = 0;
+            for (const auto &entry : kept)
+            {
+                putUint64(index, entry.first);
+                putUint64(index, offset);
+                putUint64(index, entry.second->length);
+                putUint64(index, entry.second->lastUsed);
+                offset += entry.second->length;
+            }
+            out.write(index.data(), index.size());
 
-    bool Document::saveToFile(const std::string &Path, const std::string &filePath) const
-    {
-        // Create directory if it doesn't exist and Path is not empty
-        if (!Path.empty())
-        {
-            // Create directory if it doesn't exist
-            std::filesystem::path dirPath(Path);
-            if (!std::filesystem::exists(dirPath))
+            std::string data;
+            for (const auto &entry : kept)
             {
-                std::filesystem::create_directories(dirPath);
+                if (!readData(*entry.second, data))
+                {
+                    out.close();
+                    std::filesystem::remove(tmpPath, error);
+                    return false;
+                }
+                out.write(data.data(), data.size());
+            }
+
+            out.close();
+            if (!out)
+            {
+                std::filesystem::remove(tmpPath, error);
+                return false;
             }
         }
-        // Combine Path and filePath
-        std::filesystem::path fullPath = Path.empty() ? filePath : (Path + "/" + filePath);
 
-        // Open file for writing
-        std::ofstream outFile(fullPath);
-        if (!outFile.is_open())
+        m_file.close();
+        std::filesystem::rename(tmpPath, m_filePath, error);
+        if (error)
         {
+            std::filesystem::remove(tmpPath, error);
+            m_file.open(m_filePath, std::ios::binary);
             return false;
         }
 
-        outFile << generate();
-        outFile.close();
+        // Entries now point into the new file
+        std::unordered_map<uint64_t, Entry> entries;
+        entries.reserve(kept.size());
+        uint64_t offset = 0;
+        for (const auto &entry : kept)
+        {
+            Entry &saved = entries[entry.first];
+            saved.offset = offset;
+            saved.length = entry.second->length;
+            saved.lastUsed = entry.second->lastUsed;
+            offset += saved.length;
+        }
+        m_entries.swap(entries);
+        m_dataStart = FRAGMENT_CACHE_HEADER_SIZE + kept.size() * FRAGMENT_CACHE_RECORD_SIZE;
+        m_file.open(m_filePath, std::ios::binary);
+        m_dirty = false;
 
         return true;
     }
 
-    std::string Document::generate() const
+    size_t FragmentCache::size() const
     {
-        return generatePreamble() + generateDocument();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries.size();
     }
 
-    std::shared_ptr<Figure> Document::addFigure(const std::string &imagePath, 
-                                     const std::string &caption,
-                                     const std::string &label, 
-                                     const std::string &width,
-                                     const std::string &position)
+    FragmentCache::Stats FragmentCache::getStats() const
     {
-        // Create the Figure object with the provided parameters
-        auto figure = std::make_shared<Figure>(imagePath, position);
-        
-        // Configure the properties of the figure
-        figure->setCaption(caption);
-        figure->setWidth(width);
-        
-        if (!label.empty()) {
-            figure->setLabel(label);
-        }
-        
-        // Automatically add the graphicx package required for figures
-        addPackage("graphicx");
-        
-        // Add the figure to the document environments
-        addEnvironment(figure);
-        
-        return figure;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
     }
 
-    std::shared_ptr<Table> Document::addTable(const std::vector<std::string> &headers,
-                                   const std::string &caption,
-                                   const std::string &label,
-                                   const std::string &position)
+    /**
+     * Implementation for EnvironmentPool class
+     */
+    std::shared_ptr<Environment> EnvironmentPool::intern(std::shared_ptr<Environment> env)
     {
-        // Create the table with the specified headers and position
-        auto table = std::make_shared<Table>(headers, position);
-        
-        // Configure the properties of the table
-        table->setCaption(caption);
-        
-        if (!label.empty()) {
-            table->setLabel(label);
+        if (!env)
+        {
+            return env;
         }
-        
-        // Add the table to the document environments
-        addEnvironment(table);
-        
-        return table;
+
+        // The class is part of the key: a subclass may render the same inputs differently
+        ContentHasher hasher;
+        hasher.add(typeid(*env).name());
+        bool hashable = env->cacheable() && env->fingerprint(hasher);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_stats.interned;
+        if (!hashable)
+        {
+            ++m_stats.unique;
+            return env;
+        }
+
+        auto inserted = m_byKey.insert({hasher.digest(), env});
+        if (inserted.second)
+        {
+            ++m_stats.unique;
+            m_rendered[env.get()] = nullptr;
+        }
+        return inserted.first->second;
     }
 
-    std::shared_ptr<List> Document::addList(List::ListType type)
+    bool EnvironmentPool::contains(const Environment *env) const
     {
-        // Create a new List object with the specified type
-        auto list = std::make_shared<List>(type);
-        
-        // Add the list to the document environments
-        addEnvironment(list);
-        
-        return list;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_rendered.count(env) > 0;
     }
 
-    std::shared_ptr<Equation> Document::addEquation(const std::string &content,
-                                           const std::string &label,
-                                           bool numbered)
+    bool EnvironmentPool::lookupRendered(const Environment &env, std::string &out)
     {
-        // Create a new equation with the numbered parameter
-        auto equation = std::make_shared<Equation>(numbered);
-        
-        // Configure the content and optionally the label
-        equation->setContent(content);
-        
-        if (!label.empty()) {
-            equation->setLabel(label);
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_rendered.find(&env);
+        if (it == m_rendered.end())
+        {
+            return false;
         }
-        
-        // Ensure the amsmath package is loaded
-        addPackage("amsmath");
-        
-        // Add the equation to the document environments
-        addEnvironment(equation);
-        
-        return equation;
-    }
 
-    std::string Document::addInlineEquation(const std::string &content)
-    {
-        // Inline equations use $ delimiters in LaTeX
-        // Ensure the amsmath package is loaded for some math commands
-        addPackage("amsmath");
-        
-        return "$" + content + "$";
+        ++m_stats.renders;
+        if (!it->second)
+        {
+            return false;
+        }
+
+        out = *it->second;
+        ++m_stats.reusedRenders;
+        m_stats.bytesReused += out.size();
+        return true;
     }
 
-    std::shared_ptr<Algorithm> Document::addAlgorithm(const std::string &caption,
-                                             const std::string &label)
+    void EnvironmentPool::storeRendered(const Environment &env, const std::string &fragment)
     {
-        // Create a new algorithm
-        auto algorithm = std::make_shared<Algorithm>(caption);
-        
-        // Add a label if specified
-        if (!label.empty()) {
-            algorithm->setLabel(label);
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_rendered.find(&env);
+        if (it != m_rendered.end() && !it->second)
+        {
+            it->second = std::make_shared<const std::string>(fragment);
         }
-        
-        // Enable algorithm support
-        enableAlgorithms();
-        
-        // Add the algorithm to the document environments
-        addEnvironment(algorithm);
-        
-        return algorithm;
     }
 
-    std::shared_ptr<TheoremEnvironment> Document::addTheorem(TheoremEnvironment::Type type,
-                                                   const std::string &content,
-                                                   const std::string &title)
+    EnvironmentPool::Stats EnvironmentPool::getStats() const
     {
-        // Create a new theorem environment
-        auto theorem = std::make_shared<TheoremEnvironment>(type, content, title);
-        
-        // Enable theorem support
-        enableTheorems();
-        
-        // Add the theorem to the document environments
-        addEnvironment(theorem);
-        
-        return theorem;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
     }
 
     /**
-     * Implementation for Article class
+     * Implementation for FrameCache class
      */
-    std::string Article::generatePreamble() const
+    bool FrameCache::lookup(uint64_t key, Frame &out)
     {
-        std::stringstream ss;
+        std::lock_guard<std::mutex> lock(m_mutex);
 
-        // Get base preamble
-        ss << Document::generatePreamble();
-        
-        // Configure listings to handle accented characters correctly
-        ss << "\\lstset{\n";
-        ss << "  basicstyle=\\small\\ttfamily,\n";
-        ss << "  keywordstyle=\\color{blue}\\bfseries,\n";
-        ss << "  commentstyle=\\color{green!60!black}\\itshape,\n";
-        ss << "  stringstyle=\\color{purple},\n";
-        ss << "  frame=single,\n";
-        ss << "  breaklines=true,\n";
-        ss << "  showstringspaces=false,\n";
-        ss << "  inputencoding=utf8,\n";
-        ss << "  extendedchars=true,\n";
-        ss << "  literate={é}{{\\'e}}1 {è}{{\\`e}}1 {ê}{{\\^e}}1 {ë}{{\\\"e}}1\n";
-        ss << "           {à}{{\\`a}}1 {â}{{\\^a}}1 {ä}{{\\\"a}}1\n";
-        ss << "           {î}{{\\^i}}1 {ï}{{\\\"i}}1\n";
-        ss << "           {ô}{{\\^o}}1 {ö}{{\\\"o}}1\n";
-        ss << "           {ù}{{\\`u}}1 {û}{{\\^u}}1 {ü}{{\\\"u}}1\n";
-        ss << "           {ç}{{\\c c}}1\n";
-        ss << "}\n\n";
-        
-        // Add custom preamble content
-        for (const auto &content : m_customPreamble)
+        auto it = m_entries.find(key);
+        if (it == m_entries.end())
         {
-            ss << content << "\n";
-        }
-        
-        // Define the keywords command according to the language
-        if (!m_keywords.empty())
-        {
-            // Define the \keywords command with an appropriate name according to the language
-            std::string keywordsTitle;
-            switch (m_language)
-            {
-            case Language::FRENCH:
-                keywordsTitle = "Mots-clés:";
-                break;
-            case Language::GERMAN:
-                keywordsTitle = "Schlüsselwörter:";
-                break;
-            case Language::SPANISH:
-                keywordsTitle = "Palabras clave:";
-                break;
-            case Language::ITALIAN:
-                keywordsTitle = "Parole chiave:";
-                break;
-            case Language::PORTUGUESE:
-                keywordsTitle = "Palavras-chave:";
-                break;
-            case Language::DUTCH:
-                keywordsTitle = "Trefwoorden:";
-                break;
-            case Language::RUSSIAN:
-                keywordsTitle = "Ключевые слова:";
-                break;
-            case Language::CHINESE:
-                keywordsTitle = "关键词:";
-                break;
-            case Language::JAPANESE:
-                keywordsTitle = "キーワード:";
-                break;
-            case Language::ARABIC:
-                keywordsTitle = "الكلمات المفتاحية:";
-                break;
-            case Language::ENGLISH:
-            default:
-                keywordsTitle = "Keywords:";
-                break;
-            }
-            
-            ss << "\\providecommand{\\keywords}[1]{\\par\\noindent\\textbf{" << keywordsTitle << "} #1}\n\n";
-        }
-        
-        // Add index configuration if enabled
-        if (m_includeIndex)
-        {
-            // Choose the index title according to the language
-            std::string indexTitle;
-            switch (m_language)
-            {
-            case Language::FRENCH:
-                indexTitle = "Index alphabétique";
-                break;
-            case Language::GERMAN:
-                indexTitle = "Alphabetischer Index";
-                break;
-            case Language::SPANISH:
-                indexTitle = "Índice alfabético";
-                break;
-            case Language::ITALIAN:
-                indexTitle = "Indice alfabetico";
-                break;
-            case Language::PORTUGUESE:
-                indexTitle = "Índice alfabético";
-                break;
-            case Language::DUTCH:
-                indexTitle = "Alfabetische index";
-                break;
-            case Language::RUSSIAN:
-                indexTitle = "Алфавитный указатель";
-                break;
-            case Language::CHINESE:
-                indexTitle = "索引";
-                break;
-            case Language::JAPANESE:
-                indexTitle = "索引";
-                break;
-            case Language::ARABIC:
-                indexTitle = "فهرس";
-                break;
-            case Language::ENGLISH:
-            default:
-                indexTitle = "Alphabetical Index";
-                break;
-            }
-
-            ss << "\\makeindex[columns=2, title=" << indexTitle << ", intoc]\n\n";
+            ++m_stats.misses;
+            return false;
         }
 
-        return ss.str();
+        it->second.generation = m_generation;
+        out = *it->second.frame;
+        ++m_stats.hits;
+        m_stats.bytesReused += out.latex.size();
+        return true;
     }
 
-    void Article::setBibliography(const Bibliography& bibliography)
+    void FrameCache::store(uint64_t key, const Frame &frame)
     {
-        m_bibliography = bibliography;
-    
-        // Automatically add the .bib file to the output directory
-        if (!m_bibliography.getBibFile().empty()) {
-            createBibFile();
-        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries[key] = {std::make_shared<const Frame>(frame), m_generation};
     }
 
-    void Article::createBibFile() const
+    FrameCache::ChangeReport FrameCache::record(const std::vector<uint64_t> &frameHashes, size_t rendered)
     {
-        std::string outputPath = "output/";
-        std::string bibFilePath = outputPath + m_bibliography.getBibFile() + ".bib";
-        
-        // Create the output directory if it doesn't exist
-        std::filesystem::path dirPath(outputPath);
-        if (!std::filesystem::exists(dirPath))
-        {
-            std::filesystem::create_directories(dirPath);
-        }
-        
-        // Create a sample bib file if not existing
-        if (!std::filesystem::exists(bibFilePath))
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        ChangeReport report;
+        report.frames = frameHashes.size();
+        report.rendered = rendered;
+        for (size_t i = 0; i < frameHashes.size(); ++i)
         {
-            std::ofstream bibFile(bibFilePath);
-            if (bibFile.is_open())
+            if (i >= m_lastHashes.size() || m_lastHashes[i] != frameHashes[i])
             {
-                bibFile << "@article{smith2023,\n";
-                bibFile << "  author  = {John Smith},\n";
-                bibFile << "  title   = {Introduction to LaTeX Programming},\n";
-                bibFile << "  journal = {Journal of Document Engineering},\n";
-                bibFile << "  year    = {2023},\n";
-                bibFile << "  volume  = {42},\n";
-                bibFile << "  number  = {1},\n";
-                bibFile << "  pages   = {123--456}\n";
-                bibFile << "}\n";
-                
-                bibFile.close();
+                report.changed.push_back(i);
             }
         }
-    }
-
-    std::string Article::generateDocument() const
-    {
-        std::stringstream ss;
-
-        // Begin document
-        ss << "\\begin{document}\n\n";
+        if (m_lastHashes.size() > frameHashes.size())
+        {
+            report.removed = m_lastHashes.size() - frameHashes.size();
+        }
 
-        // Generate title page if title is set
-        if (!m_title.empty())
+        // Drop the frames not used by this generation or the previous one
+        if (m_entries.size() > m_maxFrames)
         {
-            ss << "\\maketitle\n\n";
-            
-            // Add keywords after the title page
-            if (!m_keywords.empty())
+            for (auto it = m_entries.begin(); it != m_entries.end();)
             {
-                ss << "\\keywords{";
-                for (size_t i = 0; i < m_keywords.size(); ++i)
+                if (it->second.generation + 1 < m_generation)
                 {
-                    ss << m_keywords[i];
-                    if (i < m_keywords.size() - 1)
-                    {
-                        ss << ", ";
-                    }
+                    it = m_entries.erase(it);
+                    ++m_stats.evictions;
+                }
+                else
+                {
+                    ++it;
                 }
-                ss << "}\n\n";
             }
         }
 
-        // Abstract if set
-        if (!m_abstract.empty())
-        {
-            ss << "\\begin{abstract}\n"
-               << m_abstract << "\n\\end{abstract}\n\n";
-        }
-
-        // Table of contents if requested
-        if (m_includeTableOfContents)
-        {
-            ss << "\\tableofcontents\n\\clearpage\n\n";
-        }
-
-        // Add raw content
-        for (const auto &content : m_rawContent)
-        {
-            ss << content << "\n\n";
-        }
+        ++m_generation;
+        m_lastHashes = frameHashes;
+        m_lastChanges = report;
+        return report;
+    }
 
-        // Add sections
-        for (const auto &section : m_sections)
-        {
-            ss << section.generate() << "\n";
-        }
+    FrameCache::ChangeReport FrameCache::getLastChanges() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_lastChanges;
+    }
 
-        // Add environments
-        for (const auto &env : m_environments)
-        {
-            ss << env->generate() << "\n";
-        }
-            
-        // Add bibliography if citations are used
-        if (!m_usedCitations.empty())
-        {
-            ss << m_bibliography.getIncludeCommands() << "\n";
-        }
+    size_t FrameCache::size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries.size();
+    }
 
-        // End document
-        ss << "\\end{document}\n";
+    void FrameCache::clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+        m_lastHashes.clear();
+        m_lastChanges = ChangeReport();
+    }
 
-        return ss.str();
+    FrameCache::Stats FrameCache::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
     }
 
     /**
-     * Implementation for Report class
+     * Implementation for ContentSlots class
      */
-    std::string Report::generatePreamble() const
+    ContentSlots::ContentSlots(const ContentSlots &other)
     {
-        std::stringstream ss;
-
-        // Get base preamble
-        ss << Document::generatePreamble();
-
-        return ss.str();
+        copyFrom(other);
     }
 
-    std::string Report::generateDocument() const
+    ContentSlots &ContentSlots::operator=(const ContentSlots &other)
     {
-        std::stringstream ss;
+        if (this != &other)
+        {
+            clear();
+            copyFrom(other);
+        }
+        return *this;
+    }
 
-        // Begin document
-        ss << "\\begin{document}\n\n";
+    ContentSlots::~ContentSlots()
+    {
+        clear();
+    }
 
-        // Generate title page if title is set
-        if (!m_title.empty())
+    size_t ContentSlots::locate(size_t index, size_t &offset)
+    {
+        // Segment k holds FIRST_SEGMENT_SIZE << k slots
+        size_t block = index / FIRST_SEGMENT_SIZE + 1;
+        size_t segment = 0;
+        while (block >>= 1)
         {
-            ss << "\\maketitle\n\n";
+            ++segment;
         }
+        offset = index - FIRST_SEGMENT_SIZE * ((size_t(1) << segment) - 1);
+        return segment;
+    }
 
-        // Abstract if set
-        if (!m_abstract.empty())
+    ContentSlots::Slot *ContentSlots::slot(size_t index) const
+    {
+        size_t offset;
+        size_t segment = locate(index, offset);
+        Slot *slots = m_segments[segment].load(std::memory_order_acquire);
+        return slots ? slots + offset : nullptr;
+    }
+
+    size_t ContentSlots::reserve(size_t count, const Anchor &anchor)
+    {
+        size_t first = allocate(count);
+        if (count > 0)
         {
-            ss << "\\begin{abstract}\n"
-               << m_abstract << "\n\\end{abstract}\n\n";
+            publish({first, count, anchor});
         }
+        return first;
+    }
 
-        // Table of contents if requested
-        if (m_includeTableOfContents)
+    std::vector<ContentSlots::Reservation> ContentSlots::getReservations() const
+    {
+        std::vector<Reservation> reservations;
+        for (const ReservationNode *node = m_reservations.load(std::memory_order_acquire); node; node = node->next)
         {
-            ss << "\\tableofcontents\n\\clearpage\n\n";
+            reservations.push_back(node->reservation);
         }
+        return reservations;
+    }
 
-        // List of figures if requested
-        if (m_includeListOfFigures)
+    void ContentSlots::publish(const Reservation &reservation)
+    {
+        ReservationNode *node = new ReservationNode{reservation, m_reservations.load(std::memory_order_relaxed)};
+        while (!m_reservations.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
         {
-            ss << "\\listoffigures\n\\clearpage\n\n";
         }
+    }
 
-        // List of tables if requested
-        if (m_includeListOfTables)
+    size_t ContentSlots::allocate(size_t count)
+    {
+        size_t first = m_reserved.fetch_add(count, std::memory_order_acq_rel);
+        if (count == 0)
         {
-            ss << "\\listoftables\n\\clearpage\n\n";
+            return first;
         }
 
-        // Add raw content
-        for (const auto &content : m_rawContent)
+        // Allocate the segments covering the new slots; a racing thread may install
+        // the same segment first, in which case ours is dropped
+        size_t offset;
+        size_t lastSegment = locate(first + count - 1, offset);
+        for (size_t segment = locate(first, offset); segment <= lastSegment; ++segment)
         {
-            ss << content << "\n\n";
+            if (m_segments[segment].load(std::memory_order_acquire))
+            {
+                continue;
+            }
+
+            size_t segmentSize = FIRST_SEGMENT_SIZE << segment;
+            Slot *slots = new Slot[segmentSize];
+            for (size_t i = 0; i < segmentSize; ++i)
+            {
+                slots[i].store(nullptr, std::memory_order_relaxed);
+            }
+
+            Slot *expected = nullptr;
+            if (!m_segments[segment].compare_exchange_strong(expected, slots, std::memory_order_acq_rel))
+            {
+                delete[] slots;
+            }
         }
 
-        // Add sections
-        for (const auto &section : m_sections)
+        return first;
+    }
+
+    bool ContentSlots::fill(size_t index, Item item)
+    {
+        Slot *target = index < size() ? slot(index) : nullptr;
+        if (!target)
         {
-            ss << section.generate() << "\n";
+            return false;
         }
 
-        // Add environments
-        for (const auto &env : m_environments)
+        Item *published = new Item(std::move(item));
+        Item *expected = nullptr;
+        if (!target->compare_exchange_strong(expected, published, std::memory_order_release, std::memory_order_relaxed))
         {
-            ss << env->generate() << "\n";
+            delete published;
+            return false;
         }
 
-        // End document
-        ss << "\\end{document}\n";
-
-        return ss.str();
+        return true;
     }
 
-    /**
-     * Implementation for Book class
-     */
-    std::string Book::generatePreamble() const
+    const ContentSlots::Item *ContentSlots::get(size_t index) const
     {
-        std::stringstream ss;
+        const Slot *target = index < size() ? slot(index) : nullptr;
+        return target ? target->load(std::memory_order_acquire) : nullptr;
+    }
 
-        // Get base preamble
-        ss << Document::generatePreamble();
+    std::string ContentSlots::generate() const
+    {
+        std::string result;
 
-        // Add specific configurations for books
-        // Add the makeindex command in the preamble if the index is enabled
-        if (m_includeIndex)
+        size_t count = size();
+        for (size_t i = 0; i < count; ++i)
         {
-            // Choose the index title according to the language
-            std::string indexTitle;
-            switch (m_language)
+            const Item *item = get(i);
+            if (!item)
             {
-            case Language::FRENCH:
-                indexTitle = "Index alphabétique";
-                break;
-            case Language::GERMAN:
-                indexTitle = "Alphabetischer Index";
-                break;
-            case Language::SPANISH:
-                indexTitle = "Índice alfabético";
-                break;
-            case Language::ITALIAN:
-                indexTitle = "Indice alfabetico";
-                break;
-            case Language::PORTUGUESE:
-                indexTitle = "Índice alfabético";
-                break;
-            case Language::DUTCH:
-                indexTitle = "Alfabetische index";
-                break;
-            case Language::RUSSIAN:
-                indexTitle = "Алфавитный указатель";
-                break;
-            case Language::CHINESE:
-                indexTitle = "索引";
-                break;
-            case Language::JAPANESE:
-                indexTitle = "索引";
-                break;
-            case Language::ARABIC:
-                indexTitle = "فهرس";
-                break;
-            case Language::ENGLISH:
-            default:
-                indexTitle = "Alphabetical Index";
-                break;
+                continue;
             }
 
-            ss << "\\makeindex[columns=2, title=" << indexTitle << ", intoc]\n\n";
+            if (item->section)
+            {
+                result += item->section->generate();
+                result += '\n';
+            }
+            else if (item->environment)
+            {
+                result += item->environment->generate();
+                result += '\n';
+            }
+            else if (item->rawContent)
+            {
+                result += *item->rawContent;
+                result += "\n\n";
+            }
         }
 
-        // Define abstract environment for book class if not already defined
-        ss << "\\providecommand{\\abstractname}{Abstract}\n";
-        ss << "\\ifdefined\\abstract\\else\n";
-        ss << "  \\newenvironment{abstract}{\\chapter*{\\abstractname}}{}\n";
-        ss << "\\fi\n";
+        return result;
+    }
 
-        return ss.str();
+    void ContentSlots::detachEnvironments()
+    {
+        size_t count = size();
+        for (size_t i = 0; i < count; ++i)
+        {
+            Slot *target = slot(i);
+            Item *item = target ? target->load(std::memory_order_relaxed) : nullptr;
+            if (item && item->environment)
+            {
+                if (std::shared_ptr<Environment> copy = item->environment->clone())
+                {
+                    item->environment = std::move(copy);
+                }
+            }
+        }
     }
 
-    std::string Book::generateDocument() const
+    void ContentSlots::copyFrom(const ContentSlots &other)
     {
-        std::stringstream ss;
+        // Published slots are copied, slots still being filled stay empty in the copy
+        size_t count = other.size();
+        allocate(count);
+        for (const Reservation &reservation : other.getReservations())
+        {
+            if (reservation.first < count)
+            {
+                publish(reservation);
+            }
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (const Item *item = other.get(i))
+            {
+                fill(i, *item);
+            }
+        }
+    }
 
-        // Begin document
-        ss << "\\begin{document}\n\n";
+    void ContentSlots::clear()
+    {
+        m_reserved.store(0, std::memory_order_release);
+        for (size_t segment = 0; segment < MAX_SEGMENTS; ++segment)
+        {
+            Slot *slots = m_segments[segment].exchange(nullptr, std::memory_order_acq_rel);
+            if (!slots)
+            {
+                continue;
+            }
 
-        // Generate title page
-        ss << "\\maketitle\n\n";
+            size_t segmentSize = FIRST_SEGMENT_SIZE << segment;
+            for (size_t i = 0; i < segmentSize; ++i)
+            {
+                delete slots[i].load(std::memory_order_relaxed);
+            }
+            delete[] slots;
+        }
 
-        // Abstract if present
-        if (!m_abstract.empty())
+        ReservationNode *node = m_reservations.exchange(nullptr, std::memory_order_acq_rel);
+        while (node)
         {
-            ss << "\\begin{abstract}\n"
-               << m_abstract << "\n\\end{abstract}\n\n";
+            ReservationNode *next = node->next;
+            delete node;
+            node = next;
         }
+    }
 
-        // Table of contents, list of figures, list of tables
-        if (m_includeTableOfContents)
+    /**
+     * Implementation for DocumentDependencies struct
+     */
+    namespace
+    {
+        enum class Reference
         {
-            ss << "\\tableofcontents\n\n";
+            INPUT,        // \input: .tex added when there is no extension
+            INCLUDE,      // \include: .tex always added
+            LISTING,      // \lstinputlisting, \VerbatimInput
+            IMAGE,        // \includegraphics
+            PLOT,         // \addplot table or file
+            PLOT_TABLE,   // \pgfplotstableread
+            BIBLIOGRAPHY, // \bibliography: comma-separated, .bib added
+            BIB_RESOURCE  // \addbibresource
+        };
+
+        const std::unordered_map<std::string_view, Reference> &getReferenceCommands()
+        {
+            static const std::unordered_map<std::string_view, Reference> commands = {
+                {"input", Reference::INPUT},
+                {"include", Reference::INCLUDE},
+                {"lstinputlisting", Reference::LISTING},
+                {"VerbatimInput", Reference::LISTING},
+                {"includegraphics", Reference::IMAGE},
+                {"addplot", Reference::PLOT},
+                {"pgfplotstableread", Reference::PLOT_TABLE},
+                {"bibliography", Reference::BIBLIOGRAPHY},
+                {"addbibresource", Reference::BIB_RESOURCE}};
+            return commands;
         }
 
-        if (m_includeListOfFigures)
+        bool isCommentedOut(const std::string &source, size_t pos)
         {
-            ss << "\\listoffigures\n\n";
+            const size_t lineStart = source.rfind('\n', pos);
+            for (size_t i = lineStart == std::string::npos ? 0 : lineStart + 1; i < pos; ++i)
+            {
+                if (source[i] == '\\')
+                {
+                    ++i;
+                }
+                else if (source[i] == '%')
+                {
+                    return true;
+                }
+            }
+            return false;
         }
 
-        if (m_includeListOfTables)
+        void skipSpaces(const std::string &source, size_t &pos)
         {
-            ss << "\\listoftables\n\n";
+            while (pos < source.size() && std::isspace(static_cast<unsigned char>(source[pos])))
+            {
+                ++pos;
+            }
         }
 
-        // Parts and chapters
-        for (size_t i = 0; i < m_parts.size(); ++i)
+        // Skips a bracketed optional argument (nested brackets included)
+        void skipOptions(const std::string &source, size_t &pos)
         {
-            ss << "\\part{" << m_parts[i] << "}\n\n";
-
-            auto it = m_partChapters.find(i);
-            if (it != m_partChapters.end())
+            skipSpaces(source, pos);
+            if (pos >= source.size() || source[pos] != '[')
             {
-                for (const auto &chapter : it->second)
+                return;
+            }
+            int depth = 0;
+            for (; pos < source.size(); ++pos)
+            {
+                depth += source[pos] == '[' ? 1 : (source[pos] == ']' ? -1 : 0);
+                if (depth == 0)
                 {
-                    ss << chapter.generate() << "\n";
+                    ++pos;
+                    return;
                 }
             }
         }
 
-        // Regular sections (outside parts)
-        for (const auto &section : m_sections)
+        // Reads a braced argument holding a file name; false for inline data or macros
+        bool readFileArgument(const std::string &source, size_t &pos, std::string &argument)
         {
-            ss << section.generate() << "\n";
-        }
+            skipSpaces(source, pos);
+            if (pos >= source.size() || source[pos] != '{')
+            {
+                return false;
+            }
+            const size_t close = source.find('}', pos);
+            if (close == std::string::npos)
+            {
+                return false;
+            }
+            argument = source.substr(pos + 1, close - pos - 1);
+            pos = close + 1;
 
-        // Environments
-        for (const auto &env : m_environments)
-        {
-            ss << env->generate() << "\n";
+            const size_t first = argument.find_first_not_of(" \t");
+            const size_t last = argument.find_last_not_of(" \t");
+            argument = first == std::string::npos ? "" : argument.substr(first, last - first + 1);
+            return !argument.empty() && argument.find_first_of("\\#{\n") == std::string::npos;
         }
 
-        // Raw content
-        for (const auto &content : m_rawContent)
+        bool readKeyword(const std::string &source, size_t &pos, std::string_view keyword)
         {
-            ss << content << "\n\n";
+            if (source.compare(pos, keyword.size(), keyword) != 0 ||
+                (pos + keyword.size() < source.size() && std::isalpha(static_cast<unsigned char>(source[pos + keyword.size()]))))
+            {
+                return false;
+            }
+            pos += keyword.size();
+            return true;
         }
 
-        // Appendices
-        if (!m_appendices.empty())
+        /**
+         * Add the files referenced by source to the dependencies
+         * @param texInputs Receives the files of \input and \include, which TeX reads as source
+         */
+        void scanReferences(const std::string &source, DocumentDependencies &dependencies,
+                            std::vector<std::string> &texInputs)
         {
-            ss << "\\appendix\n\n";
-            for (const auto &appendix : m_appendices)
+            const auto &commands = getReferenceCommands();
+            for (size_t pos = source.find('\\'); pos != std::string::npos; pos = source.find('\\', pos))
             {
-                ss << appendix.generate() << "\n";
+                const size_t start = pos++;
+                while (pos < source.size() && std::isalpha(static_cast<unsigned char>(source[pos])))
+                {
+                    ++pos;
+                }
+                const auto command = commands.find(std::string_view(source).substr(start + 1, pos - start - 1));
+                if (command == commands.end() || isCommentedOut(source, start))
+                {
+                    if (pos == start + 1)
+                    {
+                        ++pos; // Escaped character such as \\ or \%
+                    }
+                    continue;
+                }
+
+                std::string file;
+                switch (command->second)
+                {
+                case Reference::INPUT:
+                case Reference::INCLUDE:
+                    if (readFileArgument(source, pos, file))
+                    {
+                        const bool addExtension = command->second == Reference::INCLUDE ||
+                                                  !std::filesystem::path(file).has_extension();
+                        dependencies.inputs.push_back(addExtension ? file + ".tex" : file);
+                        texInputs.push_back(dependencies.inputs.back());
+                    }
+                    break;
+                case Reference::LISTING:
+                    skipOptions(source, pos);
+                    if (readFileArgument(source, pos, file))
+                    {
+                        dependencies.inputs.push_back(file);
+                    }
+                    break;
+                case Reference::IMAGE:
+                    skipOptions(source, pos);
+                    if (readFileArgument(source, pos, file))
+                    {
+                        dependencies.images.push_back(file);
+                    }
+                    break;
+                case Reference::PLOT:
+                    // \addplot3+[options] table[options]{file} or \addplot file{file}
+                    if (pos < source.size() && source[pos] == '3')
+                    {
+                        ++pos;
+                    }
+                    if (pos < source.size() && source[pos] == '+')
+                    {
+                        ++pos;
+                    }
+                    skipOptions(source, pos);
+                    skipSpaces(source, pos);
+                    if (readKeyword(source, pos, "table") || readKeyword(source, pos, "file"))
+                    {
+                        skipOptions(source, pos);
+                        if (readFileArgument(source, pos, file))
+                        {
+                            dependencies.dataFiles.push_back(file);
+                        }
+                    }
+                    break;
+                case Reference::PLOT_TABLE:
+                    if (readFileArgument(source, pos, file))
+                    {
+                        dependencies.dataFiles.push_back(file);
+                    }
+                    break;
+                case Reference::BIBLIOGRAPHY:
+                    if (readFileArgument(source, pos, file))
+                    {
+                        std::istringstream names(file);
+                        std::string name;
+                        while (std::getline(names, name, ','))
+                        {
+                            const size_t first = name.find_first_not_of(" \t");
+                            if (first == std::string::npos)
+                            {
+                                continue;
+                            }
+                            name = name.substr(first, name.find_last_not_of(" \t") - first + 1);
+                            const bool hasExtension = name.size() > 4 && name.compare(name.size() - 4, 4, ".bib") == 0;
+                            dependencies.bibliographies.push_back(hasExtension ? name : name + ".bib");
+                        }
+                    }
+                    break;
+                case Reference::BIB_RESOURCE:
+                    skipOptions(source, pos);
+                    if (readFileArgument(source, pos, file))
+                    {
+                        dependencies.bibliographies.push_back(file);
+                    }
+                    break;
+                }
             }
         }
+    } // namespace
 
-        // Index if enabled
-        if (m_includeIndex)
+    void DocumentDependencies::addReferences(const std::string &source, const std::string &baseDirectory)
+    {
+        std::vector<std::string> pending;
+        scanReferences(source, *this, pending);
+        if (baseDirectory.empty())
         {
-            ss << "\\printindex\n\n";
+            return;
         }
 
-        // End of document
-        ss << "\\end{document}\n";
+        // Files read as source are scanned in turn; their references stay relative to
+        // the base directory, where TeX resolves them too
+        std::set<std::string> visited;
+        for (size_t i = 0; i < pending.size(); ++i)
+        {
+            const std::string file = pending[i];
+            if (!visited.insert(file).second)
+            {
+                continue;
+            }
 
-        return ss.str();
+            const std::filesystem::path path(file);
+            std::ifstream in(path.is_absolute() ? path : std::filesystem::path(baseDirectory) / path, std::ios::binary);
+            if (!in.is_open())
+            {
+                continue;
+            }
+            const std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            scanReferences(content, *this, pending);
+        }
+    }
+
+    void DocumentDependencies::removeDuplicates()
+    {
+        auto removeFrom = [](std::vector<std::string> &files)
+        {
+            std::set<std::string> seen;
+            files.erase(std::remove_if(files.begin(), files.end(),
+                                       [&](const std::string &file)
+                                       { return !seen.insert(file).second; }),
+                        files.end());
+        };
+        removeFrom(images);
+        removeFrom(bibliographies);
+        removeFrom(inputs);
+        removeFrom(dataFiles);
     }
 
     /**
-     * Implementation for Presentation class
+     * Implementation for Document class
      */
-    std::string Presentation::getThemeName() const
+    Document::Document(DocumentType type, const std::string &title,
+                       const std::string &author, const std::string &date,
+                       Language language)
+        : m_type(type), m_title(title), m_author(author), m_date(date), m_language(language)
     {
-        switch (m_theme)
+        // Do not load natbib by default
+        
+        // Add common packages used in most document types
+        addPackage("inputenc", "utf8");
+        addPackage("fontenc", "T1");
+
+        // Add language support packages
+        if (m_language != Language::ENGLISH)
         {
-        case Theme::BERKELEY:
-            return "Berkeley";
-        case Theme::MADRID:
-            return "Madrid";
-        case Theme::ANTIBES:
-            return "Antibes";
-        case Theme::COPENHAGEN:
-            return "Copenhagen";
-        case Theme::BERLIN:
-            return "Berlin";
-        case Theme::MANHATTAN:
-            return "Manhattan";
-        case Theme::WARSAW:
-            return "Warsaw";
-        case Theme::SINGAPORE:
-            return "Singapore";
-        case Theme::DEFAULT:
-        default:
-            return "default";
+            addPackage("babel", getBabelLanguageName(m_language));
         }
-    }
 
-    std::string Presentation::getColorThemeName() const
-    {
-        switch (m_colorTheme)
+        // Add special packages based on the language
+        switch (m_language)
         {
-        case ColorTheme::BEAVER:
-            return "beaver";
-        case ColorTheme::CRANE:
-            return "crane";
-        case ColorTheme::DOLPHIN:
-            return "dolphin";
-        case ColorTheme::DOVE:
-            return "dove";
-        case ColorTheme::FLY:
-            return "fly";
-        case ColorTheme::SEAGULL:
-            return "seagull";
-        case ColorTheme::WOLVERINE:
-            return "wolverine";
-        case ColorTheme::DEFAULT:
+        case Language::RUSSIAN:
+            // Add cyrillic support for Russian
+            addPackage("cyrillic");
+            break;
+        case Language::CHINESE:
+        case Language::JAPANESE:
+            // Add CJK support for Chinese and Japanese
+            addPackage("xeCJK");
+            break;
+        case Language::ARABIC:
+            // Add right-to-left support for Arabic
+            addPackage("arabxetex");
+            break;
         default:
-            return "default";
+            break;
         }
     }
 
-    std::string Presentation::getTransitionName() const
+    std::string Document::getLanguageConfiguration() const
     {
-        switch (m_transition)
-        {
-        case Transition::FADE:
-            return "transparent";
-        case Transition::PUSH:
-            return "push";
-        case Transition::COVER:
-            return "dynamic";
-        case Transition::UNCOVER:
-            return "invisible";
-        case Transition::SPLIT:
-            return "split";
-        case Transition::BLINDS:
-            return "dynamic";
-        case Transition::WIPE:
-            return "dynamic";
-        case Transition::NONE:
+        std::stringstream ss;
+
+        // Configure document according to language specifics
+        switch (m_language)
+        {
+        case Language::FRENCH:
+            ss << "\\frenchbsetup{StandardLayout=true}\n";
+            break;
+        case Language::GERMAN:
+            ss << "\\selectlanguage{ngerman}\n"; // Changed from "german" to "ngerman"
+            break;
+        case Language::SPANISH:
+            ss << "\\selectlanguage{spanish}\n";
+            break;
+        case Language::ITALIAN:
+            ss << "\\selectlanguage{italian}\n";
+            break;
+        case Language::PORTUGUESE:
+            ss << "\\selectlanguage{portuguese}\n";
+            break;
+        case Language::DUTCH:
+            ss << "\\selectlanguage{dutch}\n";
+            break;
+        case Language::RUSSIAN:
+            ss << "\\selectlanguage{russian}\n";
+            break;
+        case Language::CHINESE:
+            ss << "\\setCJKmainfont{SimSun}\n";
+            break;
+        case Language::JAPANESE:
+            ss << "\\setCJKmainfont{IPAMincho}\n";
+            break;
+        case Language::ARABIC:
+            ss << "\\setmainlanguage{arabic}\n";
+            break;
+        case Language::ENGLISH:
         default:
-            return "invisible";
+            // No special configuration needed for English
+            break;
         }
+
+        return ss.str();
     }
 
-    std::string Presentation::getLevelCommand(Section::Level level) const
+    std::string Document::getDocumentClass() const
     {
-        switch (level)
+        std::string documentClass;
+
+        switch (m_type)
         {
-        case Section::Level::SECTION:
-            return "\\section";
-        case Section::Level::SUBSECTION:
-            return "\\subsection";
-        case Section::Level::SUBSUBSECTION:
-            return "\\subsubsection";
+        case DocumentType::ARTICLE:
+            documentClass = "article";
+            break;
+        case DocumentType::REPORT:
+            documentClass = "report";
+            break;
+        case DocumentType::BOOK:
+            documentClass = "book";
+            break;
+        case DocumentType::PRESENTATION:
+            documentClass = "beamer";
+            break;
         default:
-            return "\\section";
+            documentClass = "article";
         }
+
+        return documentClass;
     }
 
-    std::string Presentation::generatePreamble() const
+    std::string Document::generatePreamble() const
     {
         std::stringstream ss;
 
-        // Document class for beamer
-        ss << "\\documentclass{beamer}\n\n";
+        // Document class
+        ss << generateDocumentClass(getDocumentClass());
 
         // Packages
-        for (const auto &package : m_packages)
-        {
-            ss << "\\usepackage";
-            if (!package.second.empty())
-            {
-                ss << "[" << package.second << "]";
-            }
-            ss << "{" << package.first << "}\n";
-        }
-        ss << "\n";
-
-        // Configuration for listings with accented character support
-        ss << "\\lstset{\n";
-        ss << "  basicstyle=\\small\\ttfamily,\n";
-        ss << "  breaklines=true,\n";
-        ss << "  inputencoding=utf8,\n";
-        ss << "  extendedchars=true,\n";
-        ss << "  literate={é}{{\\'e}}1 {è}{{\\`e}}1 {ê}{{\\^e}}1 {ë}{{\\\"e}}1\n";
-        ss << "           {à}{{\\`a}}1 {â}{{\\^a}}1 {ä}{{\\\"a}}1\n";
-        ss << "           {î}{{\\^i}}1 {ï}{{\\\"i}}1\n";
-        ss << "           {ô}{{\\^o}}1 {ö}{{\\\"o}}1\n";
-        ss << "           {ù}{{\\`u}}1 {û}{{\\^u}}1 {ü}{{\\\"u}}1\n";
-        ss << "           {ç}{{\\c c}}1\n";
-        ss << "}\n\n";
+        ss << generatePackages();
 
         // Language configuration
         ss << getLanguageConfiguration();
 
-        // Beamer theme
-        if (m_theme != Theme::DEFAULT)
+        // Document information
+        if (!m_title.empty())
         {
-            ss << "\\usetheme{" << getThemeName() << "}\n";
+            ss << "\\title{" << m_title << "}\n";
         }
 
-        // Beamer color theme
-        if (m_colorTheme != ColorTheme::DEFAULT)
+        if (!m_author.empty())
         {
-            ss << "\\usecolortheme{" << getColorThemeName() << "}\n";
+            ss << "\\author{" << m_author << "}\n";
         }
 
-        // Slide transition
-        if (m_transition != Transition::NONE)
+        if (!m_date.empty())
         {
-            ss << "\\setbeamercovered{" << getTransitionName() << "}\n";
+            ss << "\\date{" << m_date << "}\n";
         }
-
-        // Navigation bar
-        if (!m_showNavigation)
+        
+        // Add theorem environment support if enabled
+        if (m_theoremsEnabled)
         {
-            ss << "\\setbeamertemplate{navigation symbols}{}\n";
+            ss << TheoremEnvironment::getTheoremSetup(m_language);
         }
-
-        // Document information
-        if (!m_title.empty())
+        
+        // Add algorithm environment support if enabled
+        if (m_algorithmsEnabled)
         {
-            ss << "\\title{" << m_title << "}\n";
+            ss << Algorithm::getAlgorithmPackages();
         }
 
-        if (!m_subtitle.empty())
+        // Add code listing support if enabled
+        if (m_codeListingsEnabled)
         {
-            ss << "\\subtitle{" << m_subtitle << "}\n";
+            ss << CodeListing::getListingSetup();
+        }
+        
+        // Add bibliography configuration if a bibliography is set
+        if (!m_usedCitations->empty())
+        {
+            ss << m_bibliography.getPreambleConfig();
+        }
+        
+        // Add custom preamble content
+        for (const auto &content : m_customPreamble)
+        {
+            ss << content << "\n";
         }
 
-        if (!m_author.empty())
+        ss << "\n";
+
+        return ss.str();
+    }
+
+    bool Document::includesPackage(const std::string &name) const
+    {
+        if (m_packages->find(name) == m_packages->end())
         {
-            ss << "\\author{" << m_author << "}\n";
+            return false;
         }
+        return !m_previewProfile || m_previewProfile->droppedPackages.count(name) == 0;
+    }
 
-        if (!m_institute.empty())
+    std::string Document::generateDocumentClass(const std::string &documentClass) const
+    {
+        if (m_previewProfile && m_previewProfile->draft)
         {
-            ss << "\\institute{" << m_institute << "}\n";
+            return "\\documentclass[draft]{" + documentClass + "}\n\n";
         }
+        return "\\documentclass{" + documentClass + "}\n\n";
+    }
 
-        if (!m_date.empty())
+    std::string Document::generatePackages() const
+    {
+        std::stringstream ss;
+        bool listingsDropped = false;
+
+        for (const auto &package : *m_packages)
         {
-            ss << "\\date{" << m_date << "}\n";
+            std::string options = package.second;
+            if (m_previewProfile)
+            {
+                if (m_previewProfile->droppedPackages.count(package.first))
+                {
+                    listingsDropped = listingsDropped || package.first == "listings";
+                    continue;
+                }
+
+                // The draft class option also applies to graphicx unless it is overridden
+                if (package.first == "graphicx" && m_previewProfile->draftFigures != m_previewProfile->draft)
+                {
+                    options += std::string(options.empty() ? "" : ",") + (m_previewProfile->draftFigures ? "draft" : "final");
+                }
+            }
+
+            ss << "\\usepackage";
+            if (!options.empty())
+            {
+                ss << "[" << options << "]";
+            }
+            ss << "{" << package.first << "}\n";
         }
 
+        // Listings left out of a preview are shown as plain verbatim text
+        if (listingsDropped)
+        {
+            ss << "\\usepackage{verbatim}\n";
+            ss << "\\providecommand{\\lstset}[1]{}\n";
+            ss << "\\newenvironment{lstlisting}{\\verbatim}{\\endverbatim}\n";
+        }
         ss << "\n";
 
         return ss.str();
     }
 
-    std::string Presentation::generateDocument() const
+    std::string Document::generateBibliographyCommands() const
     {
-        std::stringstream ss;
-
-        // Begin document
-        ss << "\\begin{document}\n\n";
-
-        // Title frame
-        if (!m_title.empty())
+        // A preview reuses the bibliography typeset by a previous full compile
+        if (m_previewProfile && !m_previewProfile->bibliographyOutput.empty())
         {
-            ss << "\\begin{frame}\n";
-            ss << "\\titlepage\n";
-            ss << "\\end{frame}\n\n";
+            return "\\input{" + m_previewProfile->bibliographyOutput + "}\n";
         }
+        return m_bibliography.getIncludeCommands();
+    }
 
-        // Table of contents frame
-        ss << "\\begin{frame}{Plan}\n";
-        ss << "\\tableofcontents\n";
-        ss << "\\end{frame}\n\n";
-
-        // Add raw content
-        for (const auto &content : m_rawContent)
+    /**
+     * Writes sections in document order, through the render filter if any
+     */
+    class Document::SectionWriter
+    {
+    public:
+        explicit SectionWriter(const Document &document)
+            : m_document(document), m_filter(document.m_renderFilter.get()) {}
+
+        /**
+         * Start a part; returns true if the part heading must be written
+         */
+        bool beginPart(size_t index)
         {
-            ss << content << "\n\n";
+            m_partSelected = m_filter && m_filter->parts.count(index) > 0;
+            m_inSelection = false;
+            return !m_filter || m_partSelected;
         }
 
-        // Add structure (sections, subsections...)
-        for (const auto &structureItem : m_structure)
+        void endParts()
         {
-            Section::Level level;
-            std::string title;
-            bool createFrame;
-            std::tie(level, title, createFrame) = structureItem;
+            m_partSelected = false;
+            m_inSelection = false;
+        }
 
-            // Add the section/subsection command
-            ss << getLevelCommand(level) << "{" << title << "}\n\n";
+        /**
+         * Chapters after \appendix are not counted as chapter indices
+         */
+        void setChapterIndexing(bool enabled)
+        {
+            m_countChapters = enabled;
+            m_inSelection = false;
+        }
 
-            // Create a title slide for this section if requested
-            if (createFrame)
+        void write(const Section &section, std::ostream &ss)
+        {
+            if (!m_filter)
             {
-                ss << "\\begin{frame}\n";
-                ss << "\\";
-
-                // Use the appropriate command for the slide title
-                switch (level)
-                {
-                case Section::Level::SECTION:
-                    ss << "sectionpage";
-                    break;
-                case Section::Level::SUBSECTION:
-                    ss << "subsectionpage";
-                    break;
-                case Section::Level::SUBSUBSECTION:
-                default:
-                    // For subsubsections, use a simple title
-                    ss << "begin{center}\\Large " << title << "\\end{center}";
-                    break;
-                }
-
-                ss << "\n\\end{frame}\n\n";
+                ss << m_document.renderSection(section) << "\n";
+                return;
             }
-        }
 
-        // Add slides
-        for (const auto &slide : m_slides)
-        {
-            // Check if the slide contains code (lstlisting) to add the fragile option
-            bool needsFragile = false;
-            for (const auto &content : slide.second)
+            int level = static_cast<int>(section.getLevel());
+            size_t chapterIndex = std::numeric_limits<size_t>::max();
+            if (section.getLevel() == Section::Level::CHAPTER && m_countChapters)
             {
-                if (content.find("\\begin{lstlisting}") != std::string::npos)
-                {
-                    needsFragile = true;
-                    break;
-                }
+                chapterIndex = m_chapterCount++;
             }
 
-            if (needsFragile)
+            // A selected section keeps its subsections
+            if (m_inSelection && level <= m_rootLevel)
             {
-                ss << "\\begin{frame}[fragile]{" << slide.first << "}\n";
+                m_inSelection = false;
             }
-            else
+            if (!m_inSelection && (m_partSelected || matches(section, chapterIndex)))
             {
-                ss << "\\begin{frame}{" << slide.first << "}\n";
+                m_inSelection = true;
+                m_rootLevel = level;
             }
 
-            for (const auto &content : slide.second)
+            if (m_inSelection)
             {
-                ss << content << "\n";
+                ss << m_document.renderSection(section) << "\n";
+            }
+            else
+            {
+                writeSkipped(getCounterName(section.getLevel()), section.getTitle(), ss);
             }
-            ss << "\\end{frame}\n\n";
         }
 
-        // Add sections from the Document class - each treated as a regular section
-        for (const auto &section : m_sections)
+        /**
+         * Step the counter and add the TOC entry of a heading that is not rendered
+         */
+        static void writeSkipped(const std::string &counter, const std::string &title, std::ostream &ss)
         {
-            // Extract the level and title of the section
-            // Section::Level level = section.Level::SECTION; // Default level
-            std::string title = "Section";
-            std::string sectionContent = section.generate();
-
-            // Parse the content to extract the title
-            size_t startPos = sectionContent.find("{");
-            size_t endPos = sectionContent.find("}");
-            if (startPos != std::string::npos && endPos != std::string::npos)
+            ss << "\\refstepcounter{" << counter << "}\\addcontentsline{toc}{" << counter << "}{";
+            if (counter == "part")
             {
-                title = sectionContent.substr(startPos + 1, endPos - startPos - 1);
+                ss << "\\thepart\\hspace{1em}";
             }
+            else
+            {
+                ss << "\\protect\\numberline{\\the" << counter << "}";
+            }
+            ss << title << "}\n";
+        }
 
-            // Add a Beamer section
-            ss << "\\section{" << title << "}\n\n";
-
-            // Add a slide with the section content
-            ss << "\\begin{frame}{" << title << "}\n";
+    private:
+        const Document &m_document;
+        const RenderFilter *m_filter;
+        bool m_partSelected = false;
+        bool m_countChapters = true;
+        bool m_inSelection = false;
+        int m_rootLevel = 0;
+        size_t m_chapterCount = 0;
 
-            // If the content contains equations, ensure they are properly formatted
-            std::string content = sectionContent.substr(endPos + 1);
-            content = sanitizeMathContent(content);
+        bool matches(const Section &section, size_t chapterIndex) const
+        {
+            return m_filter->chapters.count(chapterIndex) > 0 ||
+                   (!section.getId().empty() && m_filter->sectionIds.count(section.getId()) > 0) ||
+                   (m_filter->predicate && m_filter->predicate(section));
+        }
 
-            ss << content;
-            ss << "\\end{frame}\n\n";
+        static const char *getCounterName(Section::Level level)
+        {
+            switch (level)
+            {
+            case Section::Level::CHAPTER:
+                return "chapter";
+            case Section::Level::SUBSECTION:
+                return "subsection";
+            case Section::Level::SUBSUBSECTION:
+                return "subsubsection";
+            case Section::Level::SECTION:
+            default:
+                return "section";
+            }
         }
+    };
 
-        // Add environments - each treated as a separate frame
-        for (const auto &env : m_environments)
+    namespace
+    {
+        /**
+         * Visit content items with the slots placed among them: a slot placed at n comes
+         * right after the first n items
+         */
+        template <typename Items, typename VisitItem, typename VisitSlot>
+        void interleaveSlots(const Items &items, const std::vector<std::pair<size_t, const ContentSlots::Item *>> &slots,
+                             VisitItem visitItem, VisitSlot visitSlot)
         {
-            // Check if the environment contains code (lstlisting) to add the fragile option
-            std::string envContent = env->generate();
-            if (envContent.find("\\begin{lstlisting}") != std::string::npos)
+            size_t next = 0;
+            size_t index = 0;
+            for (const auto &item : items)
             {
-                ss << "\\begin{frame}[fragile]\n";
+                while (next < slots.size() && slots[next].first <= index)
+                {
+                    visitSlot(*slots[next++].second);
+                }
+                visitItem(item);
+                ++index;
             }
-            else
+            while (next < slots.size())
             {
-                ss << "\\begin{frame}\n";
+                visitSlot(*slots[next++].second);
             }
-            ss << envContent << "\n";
-            ss << "\\end{frame}\n\n";
         }
-
-        // End document
-        ss << "\\end{document}\n";
-
-        return ss.str();
     }
 
-    /**
-     * Implementation for Bibliography class
-     */
-    std::string Bibliography::getStyleName() const
+    ContentSlots::Anchor Document::getSlotAnchor() const
     {
-        switch (m_style)
+        ContentSlots::Anchor anchor;
+        anchor.sections = m_sections.size();
+        anchor.environments = m_environments.size();
+        anchor.rawContent = m_rawContent.size();
+        return anchor;
+    }
+
+    Document::PlacedSlots Document::placeSlots() const
+    {
+        PlacedSlots placed;
+
+        // Reservations in slot order, so slots placed at the same position keep it
+        std::vector<ContentSlots::Reservation> reservations = m_slots.getReservations();
+        std::sort(reservations.begin(), reservations.end(),
+                  [](const ContentSlots::Reservation &a, const ContentSlots::Reservation &b)
+                  { return a.first < b.first; });
+
+        for (const auto &reservation : reservations)
         {
-        case BibStyle::PLAIN:
-            return "plain";
-        case BibStyle::ALPHA:
-            return "alpha";
-        case BibStyle::ABBRV:
-            return "abbrv";
-        case BibStyle::ACM:
-            return "acm";
-        case BibStyle::IEEE:
-            return "ieeetr";
-        case BibStyle::APA:
-            return "apalike";
-        case BibStyle::CHICAGO:
-            return "chicago";
-        case BibStyle::MLA:
-            return "mla";
-        case BibStyle::HARVARD:
-            return "harvard";
-        case BibStyle::CUSTOM:
-            return m_customStyle;
-        default:
-            return "plain";
+            const ContentSlots::Anchor &anchor = reservation.anchor;
+            for (size_t i = reservation.first; i < reservation.first + reservation.count; ++i)
+            {
+                const ContentSlots::Item *item = m_slots.get(i);
+                if (!item)
+                {
+                    continue;
+                }
+
+                if (item->section)
+                {
+                    SlotList &list = anchor.part != static_cast<size_t>(-1) ? placed.chapters[anchor.part] : placed.sections;
+                    list.push_back({anchor.sections, item});
+                }
+                else if (item->environment)
+                {
+                    placed.environments.push_back({anchor.environments, item});
+                }
+                else if (item->rawContent)
+                {
+                    placed.rawContent.push_back({anchor.rawContent, item});
+                }
+            }
+        }
+
+        auto byPosition = [](const SlotList::value_type &a, const SlotList::value_type &b)
+        {
+            return a.first < b.first;
+        };
+        std::stable_sort(placed.sections.begin(), placed.sections.end(), byPosition);
+        std::stable_sort(placed.environments.begin(), placed.environments.end(), byPosition);
+        std::stable_sort(placed.rawContent.begin(), placed.rawContent.end(), byPosition);
+        for (auto &chapters : placed.chapters)
+        {
+            std::stable_sort(chapters.second.begin(), chapters.second.end(), byPosition);
         }
+
+        return placed;
     }
 
-    std::string Bibliography::getPreambleConfig() const
+    void Document::writeRawContent(std::ostream &ss, const SlotList &slots) const
     {
-        // No need to configure natbib since we use standard LaTeX bibliography
-        return "";
+        interleaveSlots(
+            m_rawContent, slots,
+            [&](const StoredText &content)
+            { ss << content << "\n\n"; },
+            [&](const ContentSlots::Item &item)
+            { ss << *item.rawContent << "\n\n"; });
     }
 
-    std::string Bibliography::getIncludeCommands(const std::string& title) const
+    void Document::writeSections(std::ostream &ss, SectionWriter &writer, const SharedVector<Section> &sections,
+                                 const SlotList &slots) const
     {
-        std::stringstream ss;
-        
-        // Get the appropriate title based on language, if not provided
-        std::string bibTitle = title;
-        if (bibTitle.empty())
-        {
-            // Default title is "References" or appropriate translation
-            bibTitle = "References";
-        }
-        
-        // Add bibliography commands
-        ss << "\n\\bibliographystyle{" << getStyleName() << "}\n";
-        ss << "\\bibliography{" << m_bibFile << "}\n";
-        
-        return ss.str();
+        interleaveSlots(
+            sections, slots,
+            [&](const Section &section)
+            { writer.write(section, ss); },
+            [&](const ContentSlots::Item &item)
+            { writer.write(*item.section, ss); });
     }
 
-    std::string Bibliography::getBibFile() const
+    void Document::writeEnvironments(std::ostream &ss, const SlotList &slots) const
     {
-        return m_bibFile;
+        interleaveSlots(
+            m_environments, slots,
+            [&](const std::shared_ptr<Environment> &env)
+            { ss << renderEnvironment(*env) << "\n"; },
+            [&](const ContentSlots::Item &item)
+            { ss << renderEnvironment(*item.environment) << "\n"; });
     }
 
-    bool Bibliography::generateBibFile(const std::string &outputDir) const
+    void Document::writeContent(std::ostream &ss, SectionWriter &writer) const
     {
-        // If the bibliography does not contain manual entries, nothing to generate
-        if (m_entries.empty()) {
-            return false;
-        }
-        
-        // Determine the file path
-        std::string filePath = m_bibFile + ".bib";
-        if (!outputDir.empty()) {
-            // Create the output directory if it doesn't exist
-            std::filesystem::path dirPath(outputDir);
-            if (!std::filesystem::exists(dirPath)) {
-                std::filesystem::create_directories(dirPath);
-            }
-            filePath = outputDir + "/" + filePath;
-        }
-        
-        // Open the file for writing
-        std::ofstream bibFile(filePath);
-        if (!bibFile.is_open()) {
-            return false;
+        const PlacedSlots slots = placeSlots();
+
+        // Raw content and environments may be left out by the render filter
+        if (includesOtherContent())
+        {
+            writeRawContent(ss, slots.rawContent);
         }
-        
-        // Write all bibliography entries
-        for (const auto &entry : m_entries) {
-            bibFile << entry.generate() << "\n";
+        writeSections(ss, writer, m_sections, slots.sections);
+        if (includesOtherContent())
+        {
+            writeEnvironments(ss, slots.environments);
         }
-        
-        bibFile.close();
-        return true;
     }
 
-    /**
-     * Implementation for BibEntry class
-     */
-    std::string BibEntry::getTypeString(EntryType type)
+    namespace
     {
-        switch (type)
+        // Sections cannot be subclassed to render differently; environments must opt in
+        bool isCacheable(const Section &)
         {
-        case EntryType::ARTICLE:
-            return "article";
-        case EntryType::BOOK:
-            return "book";
-        case EntryType::INPROCEEDINGS:
-            return "inproceedings";
-        case EntryType::TECHREPORT:
-            return "techreport";
-        case EntryType::PHDTHESIS:
-            return "phdthesis";
-        case EntryType::MASTERSTHESIS:
-            return "mastersthesis";
-        case EntryType::MISC:
-        default:
-            return "misc";
+            return true;
         }
-    }
 
-    std::string BibEntry::generate() const
-    {
-        std::stringstream ss;
-        
-        // Start of the bibliography entry
-        ss << "@" << getTypeString(m_type) << "{" << m_key << ",\n";
-        
-        // Add fields
-        for (auto it = m_fields.begin(); it != m_fields.end(); ++it)
+        bool isCacheable(const Environment &env)
         {
-            ss << "  " << it->first << " = {" << it->second << "}";
-            
-            // Add a comma except for the last field
-            if (std::next(it) != m_fields.end())
+            return env.cacheable();
+        }
+
+        /**
+         * Cache key of a fragment: format revision, document language, node class and inputs
+         */
+        template <typename Node>
+        bool fragmentKey(const Node &node, Language language, uint64_t &key)
+        {
+            ContentHasher hasher;
+            hasher.add("LatexGen fragment 1").add(static_cast<uint64_t>(language)).add(typeid(node).name());
+            if (!isCacheable(node) || !node.fingerprint(hasher))
             {
-                ss << ",";
+                return false;
             }
-            ss << "\n";
+            key = hasher.digest();
+            return true;
+        }
+
+        template <typename Node>
+        std::string renderCached(const Node &node, Language language, FragmentCache *cache)
+        {
+            uint64_t key;
+            if (!cache || !fragmentKey(node, language, key))
+            {
+                return node.generate();
+            }
+
+            std::string fragment;
+            if (!cache->lookup(key, fragment))
+            {
+                fragment = node.generate();
+                cache->store(key, fragment);
+            }
+            return fragment;
         }
-        
-        // End of the bibliography entry
-        ss << "}\n";
-        
-        return ss.str();
     }
 
-    /**
-     * Implementation for TheoremEnvironment class
-     */
-    std::string TheoremEnvironment::getEnvironmentName(Type type)
+    std::string Document::renderSection(const Section &section) const
     {
-        switch (type)
+        return renderCached(section, m_language, m_fragmentCache.get());
+    }
+
+    std::string Document::renderEnvironment(const Environment &env) const
+    {
+        // Interned environments are generated once for every document sharing the pool
+        std::string fragment;
+        if (m_environmentPool && m_environmentPool->lookupRendered(env, fragment))
         {
-        case Type::THEOREM:
-            return "theorem";
-        case Type::LEMMA:
-            return "lemma";
-        case Type::PROPOSITION:
-            return "proposition";
-        case Type::COROLLARY:
-            return "corollary";
-        case Type::DEFINITION:
-            return "definition";
-        case Type::EXAMPLE:
-            return "example";
-        case Type::REMARK:
-            return "remark";
-        case Type::PROOF:
-            return "proof";
-        case Type::CUSTOM:
-            return "customtheorem";
-        default:
-            return "theorem";
+            return fragment;
         }
+
+        fragment = renderCached(env, m_language, m_fragmentCache.get());
+        if (m_environmentPool)
+        {
+            m_environmentPool->storeRendered(env, fragment);
+        }
+        return fragment;
     }
 
-    std::string TheoremEnvironment::generate() const
+    std::shared_ptr<Environment> Document::addSharedEnvironment(std::shared_ptr<Environment> env)
     {
-        std::stringstream ss;
+        if (!m_environmentPool)
+        {
+            m_environmentPool = std::make_shared<EnvironmentPool>();
+        }
 
-        // Begin the theorem environment
-        ss << "\\begin{" << m_name << "}";
-        
-        // Add title if provided
+        std::shared_ptr<Environment> shared = m_environmentPool->intern(std::move(env));
+        addEnvironment(shared);
+
+        return shared;
+    }
+
+    void Document::writeDocument(std::ostream &ss) const
+    {
+        // Begin document
+        ss << "\\begin{document}\n\n";
+
+        // Generate title page if title is set
         if (!m_title.empty())
         {
-            ss << "[" << m_title << "]";
+            ss << "\\maketitle\n\n";
         }
-        
-        ss << "\n";
-        
-        // Add content
-        ss << m_content << "\n";
-        
-        // End the theorem environment
-        ss << "\\end{" << m_name << "}\n";
-        
-        return ss.str();
+
+        // Add raw content, sections and environments, with the slots reserved among them
+        SectionWriter writer(*this);
+        writeContent(ss, writer);
+
+        // Add bibliography if citations are used
+        if (!m_usedCitations->empty())
+        {
+            ss << generateBibliographyCommands() << "\n";
+        }
+
+        // End document
+        ss << "\\end{document}\n";
     }
 
-    std::string TheoremEnvironment::getTheoremSetup(Language language)
+    bool Document::saveToFile(const std::string &Path, const std::string &filePath) const
     {
-        std::stringstream ss;
-        
-        // Add necessary packages
-        ss << "\\usepackage{amsthm}\n";
-        
-        // Define theorem styles
-        ss << "\\theoremstyle{plain}\n";
-        
-        // Set up theorem environment names based on language
-        std::string theorem, lemma, proposition, corollary, definition, example, remark, proof;
-        
-        switch (language)
+        // Create directory if it doesn't exist and Path is not empty
+        if (!Path.empty())
         {
-        case Language::FRENCH:
-            theorem = "Théorème";
-            lemma = "Lemme";
-            proposition = "Proposition";
-            corollary = "Corollaire";
-            definition = "Définition";
-            example = "Exemple";
-            remark = "Remarque";
-            proof = "Preuve";
-            break;
-        case Language::GERMAN:
-            theorem = "Satz";
-            lemma = "Lemma";
-            proposition = "Behauptung";
-            corollary = "Korollar";
-            definition = "Definition";
-            example = "Beispiel";
-            remark = "Bemerkung";
-            proof = "Beweis";
-            break;
-        case Language::SPANISH:
-            theorem = "Teorema";
-            lemma = "Lema";
-            proposition = "Proposición";
-            corollary = "Corolario";
-            definition = "Definición";
-            example = "Ejemplo";
-            remark = "Observación";
-            proof = "Demostración";
+            // Create directory if it doesn't exist
+            std::filesystem::path dirPath(Path);
+            if (!std::filesystem::exists(dirPath))
+            {
+                std::filesystem::create_directories(dirPath);
+            }
+        }
+        // Combine Path and filePath
+        std::filesystem::path fullPath = Path.empty() ? filePath : (Path + "/" + filePath);
+
+        // Written under a temporary name then renamed, so a reader (or another process
+        // saving the same file) never sees a partial document
+        const std::string temporary = createTemporaryFile(fullPath.string());
+        if (temporary.empty())
+        {
+            return false;
+        }
+
+        std::error_code error;
+        {
+            std::ofstream outFile(temporary);
+            if (outFile.is_open())
+            {
+                write(outFile);
+            }
+            if (!outFile.is_open() || !outFile.flush())
+            {
+                outFile.close();
+                std::filesystem::remove(temporary, error);
+                return false;
+            }
+        }
+        std::filesystem::rename(temporary, fullPath, error);
+        if (error)
+        {
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+
+        return true;
+    }
+
+    namespace
+    {
+        // Escapes a path for a Makefile rule (also read by ninja depfiles)
+        std::string escapeMakePath(const std::string &path)
+        {
+            std::string escaped;
+            for (char c : path)
+            {
+                if (c == ' ' || c == '#' || c == '\\')
+                {
+                    escaped += '\\';
+                }
+                else if (c == '$')
+                {
+                    escaped += '$';
+                }
+                escaped += c;
+            }
+            return escaped;
+        }
+    } // namespace
+
+    bool Document::saveToFile(const std::string &Path, const std::string &filePath, const std::string &dependencyFile,
+                              DocumentDependencies *found) const
+    {
+        std::ostringstream out;
+        write(out);
+        const std::string source = out.str();
+
+        std::error_code error;
+        if (!Path.empty())
+        {
+            std::filesystem::create_directories(Path, error);
+        }
+        const std::filesystem::path fullPath = Path.empty() ? filePath : (Path + "/" + filePath);
+
+        // Leave an unchanged file alone so its modification time tracks its content
+        bool unchanged = false;
+        if (std::filesystem::file_size(fullPath, error) == source.size() && !error)
+        {
+            std::ifstream in(fullPath, std::ios::binary);
+            const std::string previous((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            unchanged = previous == source;
+        }
+        if (!unchanged && !replaceFile(fullPath.string(), source))
+        {
+            return false;
+        }
+
+        // Dependencies are read from the directory of the .tex file
+        const std::filesystem::path directory = fullPath.parent_path();
+        DocumentDependencies dependencies = collectDependencies();
+        dependencies.addReferences(source, directory.empty() ? "." : directory.string());
+        dependencies.removeDuplicates();
+        if (found)
+        {
+            *found = dependencies;
+        }
+
+        auto resolve = [&](const std::string &file)
+        {
+            const std::filesystem::path path(file);
+            return (path.is_absolute() ? path : directory / path).lexically_normal().generic_string();
+        };
+        std::vector<std::string> prerequisites;
+        for (const auto &image : dependencies.images)
+        {
+            // graphicx picks the first existing extension
+            std::string resolved = resolve(image);
+            if (!std::filesystem::path(image).has_extension())
+            {
+                for (const char *extension : {".pdf", ".png", ".jpg", ".jpeg", ".eps"})
+                {
+                    if (std::filesystem::exists(resolved + extension, error))
+                    {
+                        resolved += extension;
+                        break;
+                    }
+                }
+            }
+            prerequisites.push_back(resolved);
+        }
+        for (const auto *files : {&dependencies.bibliographies, &dependencies.inputs, &dependencies.dataFiles})
+        {
+            for (const auto &file : *files)
+            {
+                prerequisites.push_back(resolve(file));
+            }
+        }
+
+        std::filesystem::path target = fullPath;
+        target.replace_extension(".pdf");
+        std::string rules = escapeMakePath(target.lexically_normal().generic_string()) + ":";
+        rules += " " + escapeMakePath(fullPath.lexically_normal().generic_string());
+        for (const auto &file : prerequisites)
+        {
+            rules += " \\\n  " + escapeMakePath(file);
+        }
+        rules += "\n";
+        for (const auto &file : prerequisites)
+        {
+            rules += "\n" + escapeMakePath(file) + ":\n";
+        }
+
+        return replaceFile(dependencyFile, rules);
+    }
+
+    std::string Document::generate() const
+    {
+        if (!m_compactOutput && !m_macroExtractionEnabled)
+        {
+            return generatePreamble() + generateBody();
+        }
+
+        std::ostringstream out;
+        write(out);
+        return out.str();
+    }
+
+    void Document::write(std::ostream &out) const
+    {
+        // The compact filter works on the pieces as they are written
+        CompactStreamBuf compact(out.rdbuf());
+        std::ostream compactOut(&compact);
+        std::ostream &target = m_compactOutput ? compactOut : out;
+
+        if (m_macroExtractionEnabled)
+        {
+            // Repeated blocks are only known once the whole document is generated
+            target << extractMacros(generatePreamble() + generateBody(), m_macroExtractionOptions);
+        }
+        else
+        {
+            // Sections and environments go through the filters as they are rendered
+            target << generatePreamble();
+            writeBody(target);
+        }
+
+        compact.finish();
+    }
+
+    std::string Document::generate(const PreviewProfile &profile) const
+    {
+        std::ostringstream out;
+        write(out, profile);
+        return out.str();
+    }
+
+    void Document::write(std::ostream &out, const PreviewProfile &profile) const
+    {
+        // The clone shares the content of this document, which stays unchanged
+        std::shared_ptr<Document> preview = clone();
+        preview->m_previewProfile = std::make_shared<const PreviewProfile>(profile);
+        preview->write(out);
+    }
+
+    TextStorageStats Document::getTextStorageStats() const
+    {
+        TextStorageStats stats;
+        for (const auto &content : m_rawContent)
+        {
+            content.addStats(stats);
+        }
+        for (const auto &section : m_sections)
+        {
+            section.addStorageStats(stats);
+        }
+        return stats;
+    }
+
+    /**
+     * Resolves glossary references while the body is written: complete lines are
+     * resolved in chunks that do not split verbatim material or a reference, and the
+     * text from \end{document} on is held back so the glossary can be inserted before it
+     */
+    class Document::GlossaryStreamBuf : public std::streambuf
+    {
+    public:
+        GlossaryStreamBuf(const Document &document, std::streambuf *target)
+            : m_document(document), m_glossary(*document.m_glossary), m_target(target) {}
+
+        /**
+         * Write the text held back, with the glossary section if the document has one
+         */
+        void finish()
+        {
+            std::string body = resolve(m_pending);
+            m_pending.clear();
+
+            if (!m_glossary.empty() && m_document.m_includeGlossary)
+            {
+                std::string glossarySection = m_glossary.generate(m_used, m_document.getGlossaryHeading());
+                if (m_document.m_type == DocumentType::PRESENTATION && !glossarySection.empty())
+                {
+                    glossarySection = "\\begin{frame}\n" + glossarySection + "\\end{frame}\n";
+                }
+
+                size_t endPos = body.rfind("\\end{document}");
+                if (!glossarySection.empty() && endPos != std::string::npos)
+                {
+                    body.insert(endPos, glossarySection + "\n");
+                }
+            }
+
+            m_target->sputn(body.data(), static_cast<std::streamsize>(body.size()));
+            m_target->pubsync();
+        }
+
+    protected:
+        int_type overflow(int_type ch) override
+        {
+            if (traits_type::eq_int_type(ch, traits_type::eof()))
+            {
+                return traits_type::not_eof(ch);
+            }
+
+            const char c = traits_type::to_char_type(ch);
+            xsputn(&c, 1);
+            return ch;
+        }
+
+        std::streamsize xsputn(const char *data, std::streamsize count) override
+        {
+            m_pending.append(data, static_cast<size_t>(count));
+            if (m_pending.size() < m_nextAttempt)
+            {
+                return count;
+            }
+
+            const size_t cut = findCut();
+            if (cut > 0)
+            {
+                const std::string chunk = resolve(m_pending.substr(0, cut));
+                m_target->sputn(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+                m_pending.erase(0, cut);
+            }
+
+            // Text that cannot be cut yet (long verbatim material) is retried less often
+            m_nextAttempt = cut > 0 ? m_pending.size() + CHUNK_SIZE : m_pending.size() * 2;
+            return count;
+        }
+
+    private:
+        static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+        const Document &m_document;
+        const Glossary &m_glossary;
+        std::streambuf *m_target;
+        std::string m_pending;     // Text not resolved yet
+        std::vector<bool> m_used;  // Entries already referenced, so first uses are expanded
+        size_t m_nextAttempt = CHUNK_SIZE;
+
+        std::string resolve(const std::string &text)
+        {
+            if (m_glossary.empty())
+            {
+                return text;
+            }
+            return m_glossary.resolve(text, m_used);
+        }
+
+        static size_t lineStart(const std::string &text, size_t position)
+        {
+            const size_t newline = position == 0 ? std::string::npos : text.rfind('\n', position - 1);
+            return newline == std::string::npos ? 0 : newline + 1;
+        }
+
+        /**
+         * Find the end of the longest prefix of complete lines that can be resolved alone
+         */
+        size_t findCut() const
+        {
+            const std::string &text = m_pending;
+            size_t cut = lineStart(text, std::min(text.size(), text.find("\\end{document}")));
+
+            // Move the cut before verbatim material or a reference it would split
+            bool moved = true;
+            while (moved && cut > 0)
+            {
+                moved = false;
+                for (const char *name : VERBATIM_ENVIRONMENTS)
+                {
+                    const std::string begin = std::string("\\begin{") + name + "}";
+                    const size_t position = cut < begin.size() ? std::string::npos : text.rfind(begin, cut - begin.size());
+                    if (position == std::string::npos)
+                    {
+                        continue;
+                    }
+
+                    const std::string end = std::string("\\end{") + name + "}";
+                    const size_t close = text.find(end, position + begin.size());
+                    if (close == std::string::npos || close + end.size() > cut)
+                    {
+                        cut = lineStart(text, position);
+                        moved = true;
+                    }
+                }
+                for (const char *command : {"\\gls{", "\\Gls{", "\\acrshort{", "\\acrlong{", "\\acrfull{"})
+                {
+                    const size_t length = std::strlen(command);
+                    const size_t position = cut < length ? std::string::npos : text.rfind(command, cut - length);
+                    if (position != std::string::npos && text.find('}', position) >= cut)
+                    {
+                        cut = lineStart(text, position);
+                        moved = true;
+                    }
+                }
+            }
+            return cut;
+        }
+    };
+
+    std::string Document::generateDocument() const
+    {
+        std::ostringstream out;
+        writeDocument(out);
+        return out.str();
+    }
+
+    std::string Document::generateBody() const
+    {
+        std::ostringstream out;
+        writeBody(out);
+        return out.str();
+    }
+
+    void Document::writeBody(std::ostream &out) const
+    {
+        // Without glossary entries, references are left to a glossaries package loaded by the user
+        if (m_glossary->empty())
+        {
+            writeDocument(out);
+            return;
+        }
+
+        // Glossary references are resolved in reading order so that first uses are expanded
+        GlossaryStreamBuf glossary(*this, out.rdbuf());
+        std::ostream glossaryOut(&glossary);
+        writeDocument(glossaryOut);
+        glossary.finish();
+    }
+
+    std::vector<std::string> Document::findUnknownGlossaryKeys() const
+    {
+        std::vector<bool> used;
+        std::vector<std::string> keys;
+        if (m_glossary->empty())
+        {
+            return keys;
+        }
+        m_glossary->resolve(generateDocument(), used, &keys);
+
+        // Keep the first occurrence of each key
+        std::set<std::string> seen;
+        keys.erase(std::remove_if(keys.begin(), keys.end(),
+                                  [&](const std::string &key)
+                                  { return !seen.insert(key).second; }),
+                   keys.end());
+        return keys;
+    }
+
+    std::string Document::getGlossaryHeading() const
+    {
+        // Choose the glossary title according to the language
+        std::string glossaryTitle;
+        switch (m_language)
+        {
+        case Language::FRENCH:
+            glossaryTitle = "Glossaire";
+            break;
+        case Language::GERMAN:
+            glossaryTitle = "Glossar";
+            break;
+        case Language::SPANISH:
+            glossaryTitle = "Glosario";
             break;
         case Language::ITALIAN:
-            theorem = "Teorema";
-            lemma = "Lemma";
-            proposition = "Proposizione";
-            corollary = "Corollario";
-            definition = "Definizione";
-            example = "Esempio";
-            remark = "Osservazione";
-            proof = "Dimostrazione";
+            glossaryTitle = "Glossario";
+            break;
+        case Language::PORTUGUESE:
+            glossaryTitle = "Glossário";
+            break;
+        case Language::DUTCH:
+            glossaryTitle = "Woordenlijst";
+            break;
+        case Language::RUSSIAN:
+            glossaryTitle = "Глоссарий";
+            break;
+        case Language::CHINESE:
+            glossaryTitle = "术语表";
+            break;
+        case Language::JAPANESE:
+            glossaryTitle = "用語集";
+            break;
+        case Language::ARABIC:
+            glossaryTitle = "مسرد المصطلحات";
             break;
         case Language::ENGLISH:
         default:
-            theorem = "Theorem";
-            lemma = "Lemma";
-            proposition = "Proposition";
-            corollary = "Corollary";
-            definition = "Definition";
-            example = "Example";
-            remark = "Remark";
-            proof = "Proof";
+            glossaryTitle = "Glossary";
             break;
         }
-        
-        // Define theorem-like environments
-        ss << "\\newtheorem{theorem}{" << theorem << "}\n";
-        ss << "\\newtheorem{lemma}[theorem]{" << lemma << "}\n";
-        ss << "\\newtheorem{proposition}[theorem]{" << proposition << "}\n";
-        ss << "\\newtheorem{corollary}[theorem]{" << corollary << "}\n";
-        
-        // Define definition-like environments
-        ss << "\\theoremstyle{definition}\n";
-        ss << "\\newtheorem{definition}{" << definition << "}\n";
-        ss << "\\newtheorem{example}{" << example << "}\n";
-        
-        // Define remark-like environments
-        ss << "\\theoremstyle{remark}\n";
-        ss << "\\newtheorem{remark}{" << remark << "}\n";
-        
-        // Redefine proof environment
-        ss << "\\renewcommand{\\proofname}{" << proof << "}\n";
-        
-        return ss.str();
+
+        switch (m_type)
+        {
+        case DocumentType::REPORT:
+        case DocumentType::BOOK:
+            return "\\chapter*{" + glossaryTitle + "}\n";
+        case DocumentType::PRESENTATION:
+            return "\\frametitle{" + glossaryTitle + "}\n";
+        case DocumentType::ARTICLE:
+        default:
+            return "\\section*{" + glossaryTitle + "}\n";
+        }
+    }
+
+    std::shared_ptr<const Document> Document::snapshot() const
+    {
+        // clone() already copies the environments the caller can reach; these copies
+        // share their rows, items and lines with the originals until either is modified
+        return clone();
+    }
+
+    DocumentDependencies Document::collectDependencies() const
+    {
+        DocumentDependencies dependencies;
+        for (const auto &env : m_environments)
+        {
+            env->collectDependencies(dependencies);
+        }
+        for (size_t i = 0; i < m_slots.size(); ++i)
+        {
+            const ContentSlots::Item *item = m_slots.get(i);
+            if (item && item->environment)
+            {
+                item->environment->collectDependencies(dependencies);
+            }
+        }
+
+        // The bibliography is only read when citations are used
+        if (!m_usedCitations->empty() && !m_bibliography.getBibFile().empty())
+        {
+            dependencies.bibliographies.push_back(m_bibliography.getBibFile() + ".bib");
+        }
+
+        dependencies.removeDuplicates();
+
+        return dependencies;
+    }
+
+    std::shared_ptr<Environment> Document::editEnvironment(size_t index)
+    {
+        if (index >= m_environments.size())
+        {
+            return nullptr;
+        }
+
+        std::shared_ptr<Environment> &env = m_environments.edit(index);
+        if (env.use_count() > 1)
+        {
+            // Shared with a clone or held by the caller: work on a private copy
+            std::shared_ptr<Environment> copy = env->clone();
+            if (!copy)
+            {
+                return nullptr;
+            }
+            env = copy;
+        }
+        exposeEnvironment(index);
+
+        return env;
+    }
+
+    void Document::exposeEnvironment(size_t index)
+    {
+        m_exposedEnvironments.push_back(index);
+        if (m_exposedEnvironments.size() < m_exposedLimit)
+        {
+            return;
+        }
+
+        // Forget the environments nobody else holds any more, so clone() stays
+        // proportional to the pointers actually kept by the caller
+        std::sort(m_exposedEnvironments.begin(), m_exposedEnvironments.end());
+        m_exposedEnvironments.erase(std::unique(m_exposedEnvironments.begin(), m_exposedEnvironments.end()),
+                                    m_exposedEnvironments.end());
+        size_t kept = 0;
+        for (size_t exposed : m_exposedEnvironments)
+        {
+            if (m_environments[exposed].use_count() > 1)
+            {
+                m_exposedEnvironments[kept++] = exposed;
+            }
+        }
+        m_exposedEnvironments.resize(kept);
+        m_exposedLimit = std::max<size_t>(64, kept * 2);
+    }
+
+    void Document::detachEnvironments(Document &copy) const
+    {
+        for (size_t index : m_exposedEnvironments)
+        {
+            // Pooled environments are immutable, and one held by this document alone
+            // can only change through editEnvironment(), which copies it
+            const std::shared_ptr<Environment> &env = m_environments[index];
+            if (env.use_count() <= 1 || (m_environmentPool && m_environmentPool->contains(env.get())))
+            {
+                continue;
+            }
+
+            if (std::shared_ptr<Environment> detached = env->clone())
+            {
+                copy.m_environments.set(index, std::move(detached));
+            }
+        }
+        copy.m_exposedEnvironments.clear();
+        copy.m_exposedLimit = 64;
+        copy.m_slots.detachEnvironments();
+    }
+
+    std::shared_ptr<Figure> Document::addFigure(const std::string &imagePath, 
+                                     const std::string &caption,
+                                     const std::string &label, 
+                                     const std::string &width,
+                                     const std::string &position)
+    {
+        // Create the Figure object with the provided parameters
+        auto figure = std::make_shared<Figure>(imagePath, position);
+        
+        // Configure the properties of the figure
+        figure->setCaption(caption);
+        figure->setWidth(width);
+        
+        if (!label.empty()) {
+            figure->setLabel(label);
+        }
+        
+        // Automatically add the graphicx package required for figures
+        addPackage("graphicx");
+        
+        // Add the figure to the document environments
+        addEnvironment(figure);
+        
+        return figure;
+    }
+
+    std::shared_ptr<Table> Document::addTable(const std::vector<std::string> &headers,
+                                   const std::string &caption,
+                                   const std::string &label,
+                                   const std::string &position)
+    {
+        // Create the table with the specified headers and position
+        auto table = std::make_shared<Table>(headers, position);
+        
+        // Configure the properties of the table
+        table->setCaption(caption);
+        
+        if (!label.empty()) {
+            table->setLabel(label);
+        }
+        
+        // Add the table to the document environments
+        addEnvironment(table);
+        
+        return table;
+    }
+
+    std::shared_ptr<List> Document::addList(List::ListType type)
+    {
+        // Create a new List object with the specified type
+        auto list = std::make_shared<List>(type);
+        
+        // Add the list to the document environments
+        addEnvironment(list);
+        
+        return list;
+    }
+
+    std::shared_ptr<Equation> Document::addEquation(const std::string &content,
+                                           const std::string &label,
+                                           bool numbered)
+    {
+        // Create a new equation with the numbered parameter
+        auto equation = std::make_shared<Equation>(numbered);
+        
+        // Configure the content and optionally the label
+        equation->setContent(content);
+        
+        if (!label.empty()) {
+            equation->setLabel(label);
+        }
+        
+        // Ensure the amsmath package is loaded
+        addPackage("amsmath");
+        
+        // Add the equation to the document environments
+        addEnvironment(equation);
+        
+        return equation;
+    }
+
+    std::string Document::addInlineEquation(const std::string &content)
+    {
+        // Inline equations use $ delimiters in LaTeX
+        // Ensure the amsmath package is loaded for some math commands
+        addPackage("amsmath");
+        
+        return "$" + content + "$";
+    }
+
+    std::shared_ptr<Algorithm> Document::addAlgorithm(const std::string &caption,
+                                             const std::string &label)
+    {
+        // Create a new algorithm
+        auto algorithm = std::make_shared<Algorithm>(caption);
+        
+        // Add a label if specified
+        if (!label.empty()) {
+            algorithm->setLabel(label);
+        }
+        
+        // Enable algorithm support
+        enableAlgorithms();
+        
+        // Add the algorithm to the document environments
+        addEnvironment(algorithm);
+        
+        return algorithm;
+    }
+
+    std::shared_ptr<TheoremEnvironment> Document::addTheorem(TheoremEnvironment::Type type,
+                                                   const std::string &content,
+                                                   const std::string &title)
+    {
+        // Create a new theorem environment
+        auto theorem = std::make_shared<TheoremEnvironment>(type, content, title);
+        
+        // Enable theorem support
+        enableTheorems();
+        
+        // Add the theorem to the document environments
+        addEnvironment(theorem);
+        
+        return theorem;
+    }
+
+    std::shared_ptr<CodeListing> Document::addCodeListing(const std::string &code,
+                                                          CodeListing::SourceLanguage language,
+                                                          const std::string &title)
+    {
+        // Create a new code listing
+        auto listing = std::make_shared<CodeListing>(code, language);
+
+        if (!title.empty())
+        {
+            listing->setTitle(title);
+        }
+
+        // Enable code listing support
+        enableCodeListings();
+
+        // Add the listing to the document environments
+        addEnvironment(listing);
+
+        return listing;
+    }
+
+    std::shared_ptr<TemplateBlock> Document::addTemplate(const std::string &text)
+    {
+        // Compile the template once; the block is filled for each record
+        auto block = std::make_shared<TemplateBlock>(std::make_shared<const ContentTemplate>(text));
+
+        // Add the block to the document environments
+        addEnvironment(block);
+
+        return block;
+    }
+
+    std::shared_ptr<LazyEnvironment> Document::addLazyEnvironment(LazyEnvironment::Factory factory, bool memoize)
+    {
+        auto env = std::make_shared<LazyEnvironment>(std::move(factory), memoize);
+
+        // Add the environment to the document
+        addEnvironment(env);
+
+        return env;
+    }
+
+    /**
+     * Implementation for Article class
+     */
+    std::string Article::generatePreamble() const
+    {
+        std::stringstream ss;
+
+        // Get base preamble
+        ss << Document::generatePreamble();
+        
+        // Configure listings to handle accented characters correctly
+        // (only when the package is loaded; CodeListing does not need it)
+        if (includesPackage("listings"))
+        {
+            ss << "\\lstset{\n";
+            ss << "  basicstyle=\\small\\ttfamily,\n";
+            ss << "  keywordstyle=\\color{blue}\\bfseries,\n";
+            ss << "  commentstyle=\\color{green!60!black}\\itshape,\n";
+            ss << "  stringstyle=\\color{purple},\n";
+            ss << "  frame=single,\n";
+            ss << "  breaklines=true,\n";
+            ss << "  showstringspaces=false,\n";
+            ss << "  inputencoding=utf8,\n";
+            ss << "  extendedchars=true,\n";
+            ss << "  literate={é}{{\\'e}}1 {è}{{\\`e}}1 {ê}{{\\^e}}1 {ë}{{\\\"e}}1\n";
+            ss << "           {à}{{\\`a}}1 {â}{{\\^a}}1 {ä}{{\\\"a}}1\n";
+            ss << "           {î}{{\\^i}}1 {ï}{{\\\"i}}1\n";
+            ss << "           {ô}{{\\^o}}1 {ö}{{\\\"o}}1\n";
+            ss << "           {ù}{{\\`u}}1 {û}{{\\^u}}1 {ü}{{\\\"u}}1\n";
+            ss << "           {ç}{{\\c c}}1\n";
+            ss << "}\n\n";
+        }
+        
+        // Add custom preamble content
+        for (const auto &content : m_customPreamble)
+        {
+            ss << content << "\n";
+        }
+        
+        // Define the keywords command according to the language
+        if (!m_keywords.empty())
+        {
+            // Define the \keywords command with an appropriate name according to the language
+            std::string keywordsTitle;
+            switch (m_language)
+            {
+            case Language::FRENCH:
+                keywordsTitle = "Mots-clés:";
+                break;
+            case Language::GERMAN:
+                keywordsTitle = "Schlüsselwörter:";
+                break;
+            case Language::SPANISH:
+                keywordsTitle = "Palabras clave:";
+                break;
+            case Language::ITALIAN:
+                keywordsTitle = "Parole chiave:";
+                break;
+            case Language::PORTUGUESE:
+                keywordsTitle = "Palavras-chave:";
+                break;
+            case Language::DUTCH:
+                keywordsTitle = "Trefwoorden:";
+                break;
+            case Language::RUSSIAN:
+                keywordsTitle = "Ключевые слова:";
+                break;
+            case Language::CHINESE:
+                keywordsTitle = "关键词:";
+                break;
+            case Language::JAPANESE:
+                keywordsTitle = "キーワード:";
+                break;
+            case Language::ARABIC:
+                keywordsTitle = "الكلمات المفتاحية:";
+                break;
+            case Language::ENGLISH:
+            default:
+                keywordsTitle = "Keywords:";
+                break;
+            }
+            
+            ss << "\\providecommand{\\keywords}[1]{\\par\\noindent\\textbf{" << keywordsTitle << "} #1}\n\n";
+        }
+        
+        // Add index configuration if enabled
+        if (m_includeIndex && includesContentLists())
+        {
+            // Choose the index title according to the language
+            std::string indexTitle;
+            switch (m_language)
+            {
+            case Language::FRENCH:
+                indexTitle = "Index alphabétique";
+                break;
+            case Language::GERMAN:
+                indexTitle = "Alphabetischer Index";
+                break;
+            case Language::SPANISH:
+                indexTitle = "Índice alfabético";
+                break;
+            case Language::ITALIAN:
+                indexTitle = "Indice alfabetico";
+                break;
+            case Language::PORTUGUESE:
+                indexTitle = "Índice alfabético";
+                break;
+            case Language::DUTCH:
+                indexTitle = "Alfabetische index";
+                break;
+            case Language::RUSSIAN:
+                indexTitle = "Алфавитный указатель";
+                break;
+            case Language::CHINESE:
+                indexTitle = "索引";
+                break;
+            case Language::JAPANESE:
+                indexTitle = "索引";
+                break;
+            case Language::ARABIC:
+                indexTitle = "فهرس";
+                break;
+            case Language::ENGLISH:
+            default:
+                indexTitle = "Alphabetical Index";
+                break;
+            }
+
+            ss << "\\makeindex[columns=2, title=" << indexTitle << ", intoc]\n\n";
+        }
+
+        return ss.str();
+    }
+
+    void Article::setBibliography(const Bibliography& bibliography)
+    {
+        m_bibliography = bibliography;
+    
+        // Automatically add the .bib file to the output directory
+        if (!m_bibliography.getBibFile().empty()) {
+            createBibFile();
+        }
+    }
+
+    void Article::createBibFile() const
+    {
+        std::string outputPath = "output/";
+        std::string bibFilePath = outputPath + m_bibliography.getBibFile() + ".bib";
+        
+        // Create the output directory if it doesn't exist
+        std::filesystem::path dirPath(outputPath);
+        if (!std::filesystem::exists(dirPath))
+        {
+            std::filesystem::create_directories(dirPath);
+        }
+        
+        // Create a sample bib file if not existing
+        if (!std::filesystem::exists(bibFilePath))
+        {
+            std::ofstream bibFile(bibFilePath);
+            if (bibFile.is_open())
+            {
+                bibFile << "@article{smith2023,\n";
+                bibFile << "  author  = {John Smith},\n";
+                bibFile << "  title   = {Introduction to LaTeX Programming},\n";
+                bibFile << "  journal = {Journal of Document Engineering},\n";
+                bibFile << "  year    = {2023},\n";
+                bibFile << "  volume  = {42},\n";
+                bibFile << "  number  = {1},\n";
+                bibFile << "  pages   = {123--456}\n";
+                bibFile << "}\n";
+                
+                bibFile.close();
+            }
+        }
+    }
+
+    void Article::writeDocument(std::ostream &ss) const
+    {
+        // Begin document
+        ss << "\\begin{document}\n\n";
+
+        // Generate title page if title is set
+        if (!m_title.empty())
+        {
+            ss << "\\maketitle\n\n";
+            
+            // Add keywords after the title page
+            if (!m_keywords.empty())
+            {
+                ss << "\\keywords{";
+                for (size_t i = 0; i < m_keywords.size(); ++i)
+                {
+                    ss << m_keywords[i];
+                    if (i < m_keywords.size() - 1)
+                    {
+                        ss << ", ";
+                    }
+                }
+                ss << "}\n\n";
+            }
+        }
+
+        // Abstract if set
+        if (!m_abstract.empty())
+        {
+            ss << "\\begin{abstract}\n"
+               << m_abstract << "\n\\end{abstract}\n\n";
+        }
+
+        // Table of contents if requested
+        if (m_includeTableOfContents && includesContentLists())
+        {
+            ss << "\\tableofcontents\n\\clearpage\n\n";
+        }
+
+        // Add raw content, sections and environments, with the slots reserved among them
+        SectionWriter writer(*this);
+        writeContent(ss, writer);
+
+        // Add bibliography if citations are used
+        if (!m_usedCitations->empty())
+        {
+            ss << generateBibliographyCommands() << "\n";
+        }
+
+        // End document
+        ss << "\\end{document}\n";
+    }
+
+    /**
+     * Implementation for Report class
+     */
+    std::string Report::generatePreamble() const
+    {
+        std::stringstream ss;
+
+        // Get base preamble
+        ss << Document::generatePreamble();
+
+        return ss.str();
+    }
+
+    void Report::writeDocument(std::ostream &ss) const
+    {
+        // Begin document
+        ss << "\\begin{document}\n\n";
+
+        // Generate title page if title is set
+        if (!m_title.empty())
+        {
+            ss << "\\maketitle\n\n";
+        }
+
+        // Abstract if set
+        if (!m_abstract.empty())
+        {
+            ss << "\\begin{abstract}\n"
+               << m_abstract << "\n\\end{abstract}\n\n";
+        }
+
+        // Table of contents if requested
+        if (m_includeTableOfContents && includesContentLists())
+        {
+            ss << "\\tableofcontents\n\\clearpage\n\n";
+        }
+
+        // List of figures if requested
+        if (m_includeListOfFigures && includesContentLists())
+        {
+            ss << "\\listoffigures\n\\clearpage\n\n";
+        }
+
+        // List of tables if requested
+        if (m_includeListOfTables && includesContentLists())
+        {
+            ss << "\\listoftables\n\\clearpage\n\n";
+        }
+
+        // Add raw content, sections and environments, with the slots reserved among them
+        SectionWriter writer(*this);
+        writeContent(ss, writer);
+
+        // End document
+        ss << "\\end{document}\n";
+    }
+
+    /**
+     * Implementation for Book class
+     */
+    ContentSlots::Anchor Book::getSlotAnchor() const
+    {
+        ContentSlots::Anchor anchor = Document::getSlotAnchor();
+        if (m_currentPart < m_parts.size())
+        {
+            auto chapters = m_partChapters->find(m_currentPart);
+            anchor.part = m_currentPart;
+            anchor.sections = chapters != m_partChapters->end() ? chapters->second.size() : 0;
+        }
+        return anchor;
+    }
+
+    std::string Book::generatePreamble() const
+    {
+        std::stringstream ss;
+
+        // Get base preamble
+        ss << Document::generatePreamble();
+
+        // Add specific configurations for books
+        // Add the makeindex command in the preamble if the index is enabled
+        if (m_includeIndex && includesContentLists())
+        {
+            // Choose the index title according to the language
+            std::string indexTitle;
+            switch (m_language)
+            {
+            case Language::FRENCH:
+                indexTitle = "Index alphabétique";
+                break;
+            case Language::GERMAN:
+                indexTitle = "Alphabetischer Index";
+                break;
+            case Language::SPANISH:
+                indexTitle = "Índice alfabético";
+                break;
+            case Language::ITALIAN:
+                indexTitle = "Indice alfabetico";
+                break;
+            case Language::PORTUGUESE:
+                indexTitle = "Índice alfabético";
+                break;
+            case Language::DUTCH:
+                indexTitle = "Alfabetische index";
+                break;
+            case Language::RUSSIAN:
+                indexTitle = "Алфавитный указатель";
+                break;
+            case Language::CHINESE:
+                indexTitle = "索引";
+                break;
+            case Language::JAPANESE:
+                indexTitle = "索引";
+                break;
+            case Language::ARABIC:
+                indexTitle = "فهرس";
+                break;
+            case Language::ENGLISH:
+            default:
+                indexTitle = "Alphabetical Index";
+                break;
+            }
+
+            ss << "\\makeindex[columns=2, title=" << indexTitle << ", intoc]\n\n";
+        }
+
+        // Define abstract environment for book class if not already defined
+        ss << "\\providecommand{\\abstractname}{Abstract}\n";
+        ss << "\\ifdefined\\abstract\\else\n";
+        ss << "  \\newenvironment{abstract}{\\chapter*{\\abstractname}}{}\n";
+        ss << "\\fi\n";
+
+        return ss.str();
+    }
+
+    TextStorageStats Book::getTextStorageStats() const
+    {
+        TextStorageStats stats = Document::getTextStorageStats();
+        for (const auto &part : *m_partChapters)
+        {
+            for (const auto &chapter : part.second)
+            {
+                chapter.addStorageStats(stats);
+            }
+        }
+        for (const auto &appendix : m_appendices)
+        {
+            appendix.addStorageStats(stats);
+        }
+        return stats;
+    }
+
+    void Book::writeDocument(std::ostream &ss) const
+    {
+        // Begin document
+        ss << "\\begin{document}\n\n";
+
+        // Generate title page
+        ss << "\\maketitle\n\n";
+
+        // Abstract if present
+        if (!m_abstract.empty())
+        {
+            ss << "\\begin{abstract}\n"
+               << m_abstract << "\n\\end{abstract}\n\n";
+        }
+
+        // Table of contents, list of figures, list of tables
+        if (m_includeTableOfContents && includesContentLists())
+        {
+            ss << "\\tableofcontents\n\n";
+        }
+
+        if (m_includeListOfFigures && includesContentLists())
+        {
+            ss << "\\listoffigures\n\n";
+        }
+
+        if (m_includeListOfTables && includesContentLists())
+        {
+            ss << "\\listoftables\n\n";
+        }
+
+        // Parts and chapters, with the chapter slots reserved in each part
+        const PlacedSlots slots = placeSlots();
+        const SharedVector<Section> noChapters;
+        const SlotList noSlots;
+        SectionWriter writer(*this);
+        for (size_t i = 0; i < m_parts.size(); ++i)
+        {
+            if (writer.beginPart(i))
+            {
+                ss << "\\part{" << m_parts[i] << "}\n\n";
+            }
+            else
+            {
+                SectionWriter::writeSkipped("part", m_parts[i], ss);
+            }
+
+            auto chapters = m_partChapters->find(i);
+            auto chapterSlots = slots.chapters.find(i);
+            writeSections(ss, writer, chapters != m_partChapters->end() ? chapters->second : noChapters,
+                          chapterSlots != slots.chapters.end() ? chapterSlots->second : noSlots);
+        }
+        writer.endParts();
+
+        // Regular sections (outside parts)
+        writeSections(ss, writer, m_sections, slots.sections);
+
+        // Environments and raw content
+        if (includesOtherContent())
+        {
+            writeEnvironments(ss, slots.environments);
+            writeRawContent(ss, slots.rawContent);
+        }
+
+        // Appendices
+        if (!m_appendices.empty())
+        {
+            ss << "\\appendix\n\n";
+            writer.setChapterIndexing(false);
+            for (const auto &appendix : m_appendices)
+            {
+                writer.write(appendix, ss);
+            }
+        }
+
+        // Index if enabled
+        if (m_includeIndex && includesContentLists())
+        {
+            ss << "\\printindex\n\n";
+        }
+
+        // End of document
+        ss << "\\end{document}\n";
+    }
+
+    /**
+     * Implementation for Presentation class
+     */
+    std::string Presentation::getThemeName() const
+    {
+        switch (m_theme)
+        {
+        case Theme::BERKELEY:
+            return "Berkeley";
+        case Theme::MADRID:
+            return "Madrid";
+        case Theme::ANTIBES:
+            return "Antibes";
+        case Theme::COPENHAGEN:
+            return "Copenhagen";
+        case Theme::BERLIN:
+            return "Berlin";
+        case Theme::MANHATTAN:
+            return "Manhattan";
+        case Theme::WARSAW:
+            return "Warsaw";
+        case Theme::SINGAPORE:
+            return "Singapore";
+        case Theme::DEFAULT:
+        default:
+            return "default";
+        }
+    }
+
+    std::string Presentation::getColorThemeName() const
+    {
+        switch (m_colorTheme)
+        {
+        case ColorTheme::BEAVER:
+            return "beaver";
+        case ColorTheme::CRANE:
+            return "crane";
+        case ColorTheme::DOLPHIN:
+            return "dolphin";
+        case ColorTheme::DOVE:
+            return "dove";
+        case ColorTheme::FLY:
+            return "fly";
+        case ColorTheme::SEAGULL:
+            return "seagull";
+        case ColorTheme::WOLVERINE:
+            return "wolverine";
+        case ColorTheme::DEFAULT:
+        default:
+            return "default";
+        }
+    }
+
+    std::string Presentation::getTransitionName() const
+    {
+        switch (m_transition)
+        {
+        case Transition::FADE:
+            return "transparent";
+        case Transition::PUSH:
+            return "push";
+        case Transition::COVER:
+            return "dynamic";
+        case Transition::UNCOVER:
+            return "invisible";
+        case Transition::SPLIT:
+            return "split";
+        case Transition::BLINDS:
+            return "dynamic";
+        case Transition::WIPE:
+            return "dynamic";
+        case Transition::NONE:
+        default:
+            return "invisible";
+        }
+    }
+
+    std::string Presentation::getLevelCommand(Section::Level level) const
+    {
+        switch (level)
+        {
+        case Section::Level::SECTION:
+            return "\\section";
+        case Section::Level::SUBSECTION:
+            return "\\subsection";
+        case Section::Level::SUBSUBSECTION:
+            return "\\subsubsection";
+        default:
+            return "\\section";
+        }
+    }
+
+    std::string Presentation::generatePreamble() const
+    {
+        std::stringstream ss;
+
+        // Document class for beamer
+        ss << generateDocumentClass("beamer");
+
+        // Packages
+        ss << generatePackages();
+
+        // Configuration for listings with accented character support
+        if (includesPackage("listings"))
+        {
+            ss << "\\lstset{\n";
+            ss << "  basicstyle=\\small\\ttfamily,\n";
+            ss << "  breaklines=true,\n";
+            ss << "  inputencoding=utf8,\n";
+            ss << "  extendedchars=true,\n";
+            ss << "  literate={é}{{\\'e}}1 {è}{{\\`e}}1 {ê}{{\\^e}}1 {ë}{{\\\"e}}1\n";
+            ss << "           {à}{{\\`a}}1 {â}{{\\^a}}1 {ä}{{\\\"a}}1\n";
+            ss << "           {î}{{\\^i}}1 {ï}{{\\\"i}}1\n";
+            ss << "           {ô}{{\\^o}}1 {ö}{{\\\"o}}1\n";
+            ss << "           {ù}{{\\`u}}1 {û}{{\\^u}}1 {ü}{{\\\"u}}1\n";
+            ss << "           {ç}{{\\c c}}1\n";
+            ss << "}\n\n";
+        }
+
+        // Add code listing support if enabled
+        if (m_codeListingsEnabled)
+        {
+            ss << CodeListing::getListingSetup();
+        }
+
+        // Language configuration
+        ss << getLanguageConfiguration();
+
+        // Beamer theme
+        if (m_theme != Theme::DEFAULT)
+        {
+            ss << "\\usetheme{" << getThemeName() << "}\n";
+        }
+
+        // Beamer color theme
+        if (m_colorTheme != ColorTheme::DEFAULT)
+        {
+            ss << "\\usecolortheme{" << getColorThemeName() << "}\n";
+        }
+
+        // Slide transition
+        if (m_transition != Transition::NONE)
+        {
+            ss << "\\setbeamercovered{" << getTransitionName() << "}\n";
+        }
+
+        // Navigation bar
+        if (!m_showNavigation)
+        {
+            ss << "\\setbeamertemplate{navigation symbols}{}\n";
+        }
+
+        // Document information
+        if (!m_title.empty())
+        {
+            ss << "\\title{" << m_title << "}\n";
+        }
+
+        if (!m_subtitle.empty())
+        {
+            ss << "\\subtitle{" << m_subtitle << "}\n";
+        }
+
+        if (!m_author.empty())
+        {
+            ss << "\\author{" << m_author << "}\n";
+        }
+
+        if (!m_institute.empty())
+        {
+            ss << "\\institute{" << m_institute << "}\n";
+        }
+
+        if (!m_date.empty())
+        {
+            ss << "\\date{" << m_date << "}\n";
+        }
+
+        ss << "\n";
+
+        return ss.str();
+    }
+
+    std::string Presentation::generateSectionFrame(const Section &section, std::string &title) const
+    {
+        std::stringstream ss;
+
+        // Extract the level and title of the section
+        // Section::Level level = section.Level::SECTION; // Default level
+        title = "Section";
+        std::string sectionContent = renderSection(section);
+
+        // Parse the content to extract the title
+        size_t startPos = sectionContent.find("{");
+        size_t endPos = sectionContent.find("}");
+        if (startPos != std::string::npos && endPos != std::string::npos)
+        {
+            title = sectionContent.substr(startPos + 1, endPos - startPos - 1);
+        }
+
+        // If the content contains equations, ensure they are properly formatted
+        std::string content = sectionContent.substr(endPos + 1);
+        content = sanitizeMathContent(content);
+
+        // Add a slide with the section content
+        if (needsFragileFrame(content))
+        {
+            ss << "\\begin{frame}[fragile]{" << title << "}\n";
+        }
+        else
+        {
+            ss << "\\begin{frame}{" << title << "}\n";
+        }
+
+        ss << content;
+        ss << "\\end{frame}\n\n";
+
+        return ss.str();
+    }
+
+    std::string Presentation::generateEnvironmentFrame(const Environment &env) const
+    {
+        std::stringstream ss;
+
+        // Check if the environment contains verbatim code to add the fragile option
+        std::string envContent = renderEnvironment(env);
+        if (needsFragileFrame(envContent))
+        {
+            ss << "\\begin{frame}[fragile]\n";
+        }
+        else
+        {
+            ss << "\\begin{frame}\n";
+        }
+        ss << envContent << "\n";
+        ss << "\\end{frame}\n\n";
+
+        return ss.str();
+    }
+
+    std::vector<Presentation::BodyPiece> Presentation::generateBodyPieces(size_t *rendered) const
+    {
+        std::vector<BodyPiece> pieces;
+        visitBodyPieces([&pieces](BodyPiece &&piece)
+                        { pieces.push_back(std::move(piece)); },
+                        rendered);
+        return pieces;
+    }
+
+    void Presentation::visitBodyPieces(const std::function<void(BodyPiece &&piece)> &visit, size_t *rendered) const
+    {
+        using Kind = BodyPiece::Kind;
+        size_t renderedFrames = 0;
+
+        // Frames of sections and environments are taken from the frame cache when possible
+        auto cachedFrame = [&](const auto &node, FrameCache::Frame &frame, auto render)
+        {
+            uint64_t key = 0;
+            const bool cacheable = m_frameCache && fragmentKey(node, m_language, key);
+            if (cacheable)
+            {
+                key = ContentHasher().add("LatexGen frame 1").add(key).digest();
+                if (m_frameCache->lookup(key, frame))
+                {
+                    return;
+                }
+            }
+
+            render(frame);
+            ++renderedFrames;
+            if (cacheable)
+            {
+                m_frameCache->store(key, frame);
+            }
+        };
+
+        auto addEnvironment = [&](const Environment &env)
+        {
+            FrameCache::Frame frame;
+            cachedFrame(env, frame, [&](FrameCache::Frame &out)
+                        { out.latex = generateEnvironmentFrame(env); });
+            visit({Kind::ENVIRONMENT, std::move(frame.latex), ""});
+        };
+
+        // Title frame
+        if (!m_title.empty())
+        {
+            visit({Kind::TITLE, "\\begin{frame}\n\\titlepage\n\\end{frame}\n\n", m_title});
+        }
+
+        // Table of contents frame
+        if (includesContentLists())
+        {
+            visit({Kind::TOC, "\\begin{frame}{Plan}\n\\tableofcontents\n\\end{frame}\n\n", "Plan"});
+        }
+
+        // Add raw content, with the slots reserved among it
+        const PlacedSlots slots = placeSlots();
+        interleaveSlots(
+            m_rawContent, slots.rawContent,
+            [&](const StoredText &content)
+            { visit({Kind::RAW, content.str() + "\n\n", ""}); },
+            [&](const ContentSlots::Item &item)
+            { visit({Kind::RAW, *item.rawContent + "\n\n", ""}); });
+
+        // Add structure (sections, subsections...)
+        for (const auto &structureItem : m_structure)
+        {
+            Section::Level level;
+            std::string title;
+            bool createFrame;
+            std::tie(level, title, createFrame) = structureItem;
+
+            // Add the section/subsection command
+            visit({Kind::SECTION_COMMAND, getLevelCommand(level) + "{" + title + "}\n\n", title, level});
+
+            // Create a title slide for this section if requested
+            if (createFrame)
+            {
+                std::string frame = "\\begin{frame}\n\\";
+
+                // Use the appropriate command for the slide title
+                switch (level)
+                {
+                case Section::Level::SECTION:
+                    frame += "sectionpage";
+                    break;
+                case Section::Level::SUBSECTION:
+                    frame += "subsectionpage";
+                    break;
+                case Section::Level::SUBSUBSECTION:
+                default:
+                    // For subsubsections, use a simple title
+                    frame += "begin{center}\\Large " + title + "\\end{center}";
+                    break;
+                }
+
+                frame += "\n\\end{frame}\n\n";
+                visit({Kind::SECTION_PAGE, frame, title, level});
+            }
+        }
+
+        // Add slides
+        for (const auto &slide : m_slides)
+        {
+            // Check if the slide contains verbatim code to add the fragile option
+            bool needsFragile = false;
+            for (const auto &content : slide.second)
+            {
+                if (needsFragileFrame(content))
+                {
+                    needsFragile = true;
+                    break;
+                }
+            }
+
+            std::string frame = needsFragile ? "\\begin{frame}[fragile]{" : "\\begin{frame}{";
+            frame += slide.first + "}\n";
+            for (const auto &content : slide.second)
+            {
+                frame += content + "\n";
+            }
+            frame += "\\end{frame}\n\n";
+            visit({Kind::SLIDE, frame, slide.first});
+        }
+
+        // Sections from the Document class get a Beamer section and a frame each
+        auto addSection = [&](const Section &section)
+        {
+            FrameCache::Frame frame;
+            cachedFrame(section, frame, [&](FrameCache::Frame &out)
+                        { out.latex = generateSectionFrame(section, out.title); });
+            visit({Kind::SECTION_COMMAND, "\\section{" + frame.title + "}\n\n", frame.title});
+            visit({Kind::SECTION, std::move(frame.latex), frame.title});
+        };
+
+        interleaveSlots(
+            m_sections, slots.sections, addSection,
+            [&](const ContentSlots::Item &item)
+            { addSection(*item.section); });
+
+        // Add environments - each treated as a separate frame
+        interleaveSlots(
+            m_environments, slots.environments,
+            [&](const std::shared_ptr<Environment> &env)
+            { addEnvironment(*env); },
+            [&](const ContentSlots::Item &item)
+            { addEnvironment(*item.environment); });
+
+        if (rendered)
+        {
+            *rendered = renderedFrames;
+        }
+    }
+
+    void Presentation::writeDocument(std::ostream &ss) const
+    {
+        ss << "\\begin{document}\n\n";
+        visitBodyPieces([&ss](BodyPiece &&piece)
+                        { ss << piece.latex; });
+        ss << "\\end{document}\n";
+    }
+
+    std::vector<Presentation::FrameUnit> Presentation::generateFrameUnits() const
+    {
+        using Kind = BodyPiece::Kind;
+        static const char *const kindNames[] = {"title", "toc", "raw", "", "section-page", "slide", "section", "environment"};
+        static const char *const counters[] = {"section", "subsection", "subsubsection"};
+
+        size_t rendered = 0;
+        const std::vector<BodyPiece> pieces = generateBodyPieces(&rendered);
+        const std::string preamble = generatePreamble();
+
+        // The table of contents is built from every section command (second pass)
+        std::string sectionCommands;
+        for (const auto &piece : pieces)
+        {
+            if (piece.kind == Kind::SECTION_COMMAND)
+            {
+                sectionCommands += piece.latex;
+            }
+        }
+
+        std::vector<FrameUnit> units;
+        std::vector<bool> used; // Glossary entries already expanded, as in the full document
+        std::string context;    // Raw content without frames, placed before the next frames
+        std::string titles[3];
+        size_t numbers[3] = {0, 0, 0};
+        size_t frameCount = 0;
+
+        auto addUnit = [&](const std::string &kind, const std::string &title, const std::string &latex, size_t frames)
+        {
+            FrameUnit unit;
+            unit.index = units.size();
+            unit.kind = kind;
+            unit.title = title;
+            unit.section = titles[0];
+            unit.subsection = titles[1];
+            unit.frameNumber = frameCount + 1;
+
+            // Restore the section context and numbering of the frame
+            std::string source = "\\begin{document}\n\n" + context;
+            for (int level = 0; level < 3; ++level)
+            {
+                if (numbers[level] > 0)
+                {
+                    source += "\\setcounter{" + std::string(counters[level]) + "}{" + std::to_string(numbers[level] - 1) + "}" +
+                              getLevelCommand(static_cast<Section::Level>(level)) + "{" + titles[level] + "}\n";
+                }
+            }
+            source += "\\setcounter{framenumber}{" + std::to_string(frameCount) + "}\n\n" + latex;
+            if (kind == "toc")
+            {
+                source += sectionCommands;
+                unit.passes = 2;
+            }
+            source += "\\end{document}\n";
+
+            unit.source = m_glossary->empty() ? source : m_glossary->resolve(source, used);
+            unit.hash = ContentHasher().add(preamble).add(unit.source).digest();
+            units.push_back(std::move(unit));
+            frameCount += frames;
+        };
+
+        for (const auto &piece : pieces)
+        {
+            if (piece.kind == Kind::SECTION_COMMAND)
+            {
+                const int level = static_cast<int>(piece.level);
+                ++numbers[level];
+                titles[level] = piece.title;
+                for (int deeper = level + 1; deeper < 3; ++deeper)
+                {
+                    numbers[deeper] = 0;
+                    titles[deeper].clear();
+                }
+                continue;
+            }
+
+            size_t frames = 1;
+            if (piece.kind == Kind::RAW)
+            {
+                frames = 0;
+                for (size_t pos = piece.latex.find("\\begin{frame}"); pos != std::string::npos;
+                     pos = piece.latex.find("\\begin{frame}", pos + 1))
+                {
+                    ++frames;
+                }
+                if (frames == 0)
+                {
+                    context += piece.latex;
+                    continue;
+                }
+            }
+            addUnit(kindNames[static_cast<int>(piece.kind)], piece.title, piece.latex, frames);
+        }
+
+        // Glossary frame, last as in the full document
+        if (!m_glossary->empty() && m_includeGlossary)
+        {
+            const std::string glossarySection = m_glossary->generate(used, getGlossaryHeading());
+            if (!glossarySection.empty())
+            {
+                addUnit("glossary", getGlossaryHeading(), "\\begin{frame}\n" + glossarySection + "\\end{frame}\n\n", 1);
+            }
+        }
+
+        if (m_frameCache)
+        {
+            std::vector<uint64_t> hashes;
+            hashes.reserve(units.size());
+            for (const auto &unit : units)
+            {
+                hashes.push_back(unit.hash);
+            }
+            m_frameCache->record(hashes, rendered);
+        }
+        return units;
+    }
+
+    namespace
+    {
+        std::string escapeJson(const std::string &text)
+        {
+            std::string result;
+            result.reserve(text.size() + 2);
+            for (unsigned char c : text)
+            {
+                switch (c)
+                {
+                case '"':
+                    result += "\\\"";
+                    break;
+                case '\\':
+                    result += "\\\\";
+                    break;
+                case '\n':
+                    result += "\\n";
+                    break;
+                case '\t':
+                    result += "\\t";
+                    break;
+                default:
+                    if (c < 0x20)
+                    {
+                        char buffer[8];
+                        std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                        result += buffer;
+                    }
+                    else
+                    {
+                        result += static_cast<char>(c);
+                    }
+                }
+            }
+            return result;
+        }
+
+        bool writeTextFile(const std::string &path, const std::string &content)
+        {
+            std::ofstream file(path, std::ios::binary);
+            file << content;
+            return static_cast<bool>(file);
+        }
+
+        std::string toHex(uint64_t value)
+        {
+            char buffer[17];
+            std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(value));
+            return buffer;
+        }
+    } // namespace
+
+    bool Presentation::saveFrames(const std::string &directory, const std::string &manifestName) const
+    {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+
+        const std::string preamble = generatePreamble();
+        if (!writeTextFile(directory + "/preamble.tex", preamble))
+        {
+            return false;
+        }
+
+        const std::vector<FrameUnit> units = generateFrameUnits();
+        std::stringstream manifest;
+        manifest << "{\n  \"preamble\": \"preamble.tex\",\n  \"preambleHash\": \"" << toHex(ContentHasher().add(preamble).digest())
+                 << "\",\n  \"frames\": [";
+        for (const auto &unit : units)
+        {
+            char name[32];
+            std::snprintf(name, sizeof(name), "frame-%04zu.tex", unit.index + 1);
+            if (!writeTextFile(directory + "/" + name, "\\input{preamble.tex}\n" + unit.source))
+            {
+                return false;
+            }
+
+            manifest << (unit.index == 0 ? "\n" : ",\n")
+                     << "    {\"index\": " << unit.index
+                     << ", \"file\": \"" << name
+                     << "\", \"kind\": \"" << unit.kind
+                     << "\", \"title\": \"" << escapeJson(unit.title)
+                     << "\", \"section\": \"" << escapeJson(unit.section)
+                     << "\", \"subsection\": \"" << escapeJson(unit.subsection)
+                     << "\", \"frameNumber\": " << unit.frameNumber
+                     << ", \"passes\": " << unit.passes
+                     << ", \"hash\": \"" << toHex(unit.hash) << "\"}";
+        }
+        manifest << "\n  ]\n}\n";
+
+        return writeTextFile(directory + "/" + manifestName, manifest.str());
+    }
+
+    /**
+     * Implementation for Bibliography class
+     */
+    std::string Bibliography::getStyleName() const
+    {
+        switch (m_style)
+        {
+        case BibStyle::PLAIN:
+            return "plain";
+        case BibStyle::ALPHA:
+            return "alpha";
+        case BibStyle::ABBRV:
+            return "abbrv";
+        case BibStyle::ACM:
+            return "acm";
+        case BibStyle::IEEE:
+            return "ieeetr";
+        case BibStyle::APA:
+            return "apalike";
+        case BibStyle::CHICAGO:
+            return "chicago";
+        case BibStyle::MLA:
+            return "mla";
+        case BibStyle::HARVARD:
+            return "harvard";
+        case BibStyle::CUSTOM:
+            return m_customStyle;
+        default:
+            return "plain";
+        }
+    }
+
+    std::string Bibliography::getPreambleConfig() const
+    {
+        // No need to configure natbib since we use standard LaTeX bibliography
+        return "";
+    }
+
+    std::string Bibliography::getIncludeCommands(const std::string& title) const
+    {
+        std::stringstream ss;
+        
+        // Get the appropriate title based on language, if not provided
+        std::string bibTitle = title;
+        if (bibTitle.empty())
+        {
+            // Default title is "References" or appropriate translation
+            bibTitle = "References";
+        }
+        
+        // Add bibliography commands
+        ss << "\n\\bibliographystyle{" << getStyleName() << "}\n";
+        ss << "\\bibliography{" << m_bibFile << "}\n";
+        
+        return ss.str();
+    }
+
+    std::string Bibliography::getBibFile() const
+    {
+        return m_bibFile;
+    }
+
+    bool Bibliography::generateBibFile(const std::string &outputDir) const
+    {
+        // If the bibliography does not contain manual entries, nothing to generate
+        if (m_entries.empty()) {
+            return false;
+        }
+        
+        // Determine the file path
+        std::string filePath = m_bibFile + ".bib";
+        if (!outputDir.empty()) {
+            // Create the output directory if it doesn't exist
+            std::filesystem::path dirPath(outputDir);
+            if (!std::filesystem::exists(dirPath)) {
+                std::filesystem::create_directories(dirPath);
+            }
+            filePath = outputDir + "/" + filePath;
+        }
+        
+        // Open the file for writing
+        std::ofstream bibFile(filePath);
+        if (!bibFile.is_open()) {
+            return false;
+        }
+        
+        // Write all bibliography entries
+        for (const auto &entry : m_entries) {
+            bibFile << entry.generate() << "\n";
+        }
+        
+        bibFile.close();
+        return true;
+    }
+
+    /**
+     * Implementation for BibEntry class
+     */
+    std::string BibEntry::getTypeString(EntryType type)
+    {
+        switch (type)
+        {
+        case EntryType::ARTICLE:
+            return "article";
+        case EntryType::BOOK:
+            return "book";
+        case EntryType::INPROCEEDINGS:
+            return "inproceedings";
+        case EntryType::TECHREPORT:
+            return "techreport";
+        case EntryType::PHDTHESIS:
+            return "phdthesis";
+        case EntryType::MASTERSTHESIS:
+            return "mastersthesis";
+        case EntryType::MISC:
+        default:
+            return "misc";
+        }
+    }
+
+    std::string BibEntry::generate() const
+    {
+        std::stringstream ss;
+        
+        // Start of the bibliography entry
+        ss << "@" << getTypeString(m_type) << "{" << m_key << ",\n";
+        
+        // Add fields
+        for (auto it = m_fields.begin(); it != m_fields.end(); ++it)
+        {
+            ss << "  " << it->first << " = {" << it->second << "}";
+            
+            // Add a comma except for the last field
+            if (std::next(it) != m_fields.end())
+            {
+                ss << ",";
+            }
+            ss << "\n";
+        }
+        
+        // End of the bibliography entry
+        ss << "}\n";
+        
+        return ss.str();
+    }
+
+    /**
+     * Implementation for Glossary class
+     */
+    void Glossary::insertEntry(Entry entry)
+    {
+        auto it = m_index.find(entry.key);
+        if (it != m_index.end())
+        {
+            // Redefining a key replaces the previous entry
+            m_entries[it->second] = std::move(entry);
+            return;
+        }
+
+        m_index[entry.key] = m_entries.size();
+        m_entries.push_back(std::move(entry));
+    }
+
+    void Glossary::addEntry(const std::string &key, const std::string &name, const std::string &description)
+    {
+        Entry entry;
+        entry.key = key;
+        entry.name = name;
+        entry.description = description;
+        insertEntry(std::move(entry));
+    }
+
+    void Glossary::addAcronym(const std::string &key, const std::string &shortForm,
+                              const std::string &longForm, const std::string &description)
+    {
+        Entry entry;
+        entry.key = key;
+        entry.name = shortForm;
+        entry.longForm = longForm;
+        entry.description = description;
+        entry.acronym = true;
+        insertEntry(std::move(entry));
+    }
+
+    const Glossary::Entry *Glossary::find(const std::string &key) const
+    {
+        auto it = m_index.find(key);
+        return it != m_index.end() ? &m_entries[it->second] : nullptr;
+    }
+
+    std::string Glossary::resolve(const std::string &text, std::vector<bool> &used,
+                                  std::vector<std::string> *unknownKeys) const
+    {
+        enum class Command
+        {
+            GLS,
+            GLS_CAPITALIZED,
+            ACR_SHORT,
+            ACR_LONG,
+            ACR_FULL
+        };
+
+        static const std::pair<std::string, Command> commands[] = {
+            {"gls{", Command::GLS},
+            {"Gls{", Command::GLS_CAPITALIZED},
+            {"acrshort{", Command::ACR_SHORT},
+            {"acrlong{", Command::ACR_LONG},
+            {"acrfull{", Command::ACR_FULL}};
+
+        used.resize(m_entries.size(), false);
+
+        std::string result;
+        result.reserve(text.size());
+
+        size_t pos = 0;
+        while (pos < text.size())
+        {
+            size_t slash = text.find('\\', pos);
+            if (slash == std::string::npos)
+            {
+                break;
+            }
+            result.append(text, pos, slash - pos);
+
+            // An escaped backslash (\\) can never start a reference
+            if (slash + 1 < text.size() && text[slash + 1] == '\\')
+            {
+                result.append("\\\\");
+                pos = slash + 2;
+                continue;
+            }
+
+            // Verbatim material is copied unchanged
+            const size_t verbatimEnd = findVerbatimEnd(text, slash);
+            if (verbatimEnd != std::string::npos)
+            {
+                result.append(text, slash, verbatimEnd - slash);
+                pos = verbatimEnd;
+                continue;
+            }
+
+            // Match one of the reference commands and its key
+            bool resolved = false;
+            for (const auto &command : commands)
+            {
+                if (text.compare(slash + 1, command.first.size(), command.first) != 0)
+                {
+                    continue;
+                }
+
+                size_t keyStart = slash + 1 + command.first.size();
+                size_t keyEnd = text.find('}', keyStart);
+                if (keyEnd == std::string::npos)
+                {
+                    break;
+                }
+
+                const std::string key = text.substr(keyStart, keyEnd - keyStart);
+                auto it = m_index.find(key);
+                if (it == m_index.end())
+                {
+                    // No glossaries package is loaded: an unknown reference would be an
+                    // undefined command, so it is marked like an undefined \ref
+                    result += "\\textbf{??}";
+                    if (unknownKeys)
+                    {
+                        unknownKeys->push_back(key);
+                    }
+                    pos = keyEnd + 1;
+                    resolved = true;
+                    break;
+                }
+
+                const Entry &entry = m_entries[it->second];
+                const std::string &longForm = entry.longForm.empty() ? entry.name : entry.longForm;
+                size_t start = result.size();
+
+                switch (command.second)
+                {
+                case Command::GLS:
+                case Command::GLS_CAPITALIZED:
+                    if (entry.acronym && !used[it->second])
+                    {
+                        // First use: expand the acronym
+                        result += longForm + " (" + entry.name + ")";
+                    }
+                    else
+                    {
+                        result += entry.name;
+                    }
+                    if (command.second == Command::GLS_CAPITALIZED && start < result.size() &&
+                        result[start] >= 'a' && result[start] <= 'z')
+                    {
+                        result[start] = static_cast<char>(result[start] - 'a' + 'A');
+                    }
+                    break;
+                case Command::ACR_SHORT:
+                    result += entry.name;
+                    break;
+                case Command::ACR_LONG:
+                    result += longForm;
+                    break;
+                case Command::ACR_FULL:
+                    result += longForm + " (" + entry.name + ")";
+                    break;
+                }
+
+                used[it->second] = true;
+                pos = keyEnd + 1;
+                resolved = true;
+                break;
+            }
+
+            if (!resolved)
+            {
+                // Not a glossary reference: copy the backslash and continue
+                result += '\\';
+                pos = slash + 1;
+            }
+        }
+
+        if (pos < text.size())
+        {
+            result.append(text, pos, std::string::npos);
+        }
+
+        return result;
+    }
+
+    std::string Glossary::generate(const std::vector<bool> &used, const std::string &heading) const
+    {
+        // Collect the used entries in alphabetical order
+        std::vector<size_t> indices;
+        for (size_t i = 0; i < m_entries.size() && i < used.size(); ++i)
+        {
+            if (used[i])
+            {
+                indices.push_back(i);
+            }
+        }
+
+        if (indices.empty())
+        {
+            return "";
+        }
+
+        std::sort(indices.begin(), indices.end(), [this](size_t a, size_t b)
+                  { return m_entries[a].name < m_entries[b].name; });
+
+        std::stringstream ss;
+        ss << heading;
+        ss << "\\begin{description}\n";
+        for (size_t index : indices)
+        {
+            const Entry &entry = m_entries[index];
+            ss << "\\item[" << entry.name << "] ";
+            if (entry.acronym)
+            {
+                ss << entry.longForm;
+                if (!entry.description.empty())
+                {
+                    ss << ": " << entry.description;
+                }
+            }
+            else
+            {
+                ss << entry.description;
+            }
+            ss << "\n";
+        }
+        ss << "\\end{description}\n";
+
+        return ss.str();
+    }
+
+    /**
+     * Implementation for TheoremEnvironment class
+     */
+    std::string TheoremEnvironment::getEnvironmentName(Type type)
+    {
+        switch (type)
+        {
+        case Type::THEOREM:
+            return "theorem";
+        case Type::LEMMA:
+            return "lemma";
+        case Type::PROPOSITION:
+            return "proposition";
+        case Type::COROLLARY:
+            return "corollary";
+        case Type::DEFINITION:
+            return "definition";
+        case Type::EXAMPLE:
+            return "example";
+        case Type::REMARK:
+            return "remark";
+        case Type::PROOF:
+            return "proof";
+        case Type::CUSTOM:
+            return "customtheorem";
+        default:
+            return "theorem";
+        }
+    }
+
+    std::string TheoremEnvironment::generate() const
+    {
+        std::stringstream ss;
+
+        // Begin the theorem environment
+        ss << "\\begin{" << m_name << "}";
+        
+        // Add title if provided
+        if (!m_title.empty())
+        {
+            ss << "[" << m_title << "]";
+        }
+        
+        ss << "\n";
+        
+        // Add content
+        ss << m_content << "\n";
+        
+        // End the theorem environment
+        ss << "\\end{" << m_name << "}\n";
+        
+        return ss.str();
+    }
+
+    bool TheoremEnvironment::fingerprint(ContentHasher &hasher) const
+    {
+        hasher.add(m_name).add(static_cast<uint64_t>(m_type)).add(m_customType).add(m_title).add(m_content);
+        return true;
+    }
+
+    std::string TheoremEnvironment::getTheoremSetup(Language language)
+    {
+        std::stringstream ss;
+        
+        // Add necessary packages
+        ss << "\\usepackage{amsthm}\n";
+        
+        // Define theorem styles
+        ss << "\\theoremstyle{plain}\n";
+        
+        // Set up theorem environment names based on language
+        std::string theorem, lemma, proposition, corollary, definition, example, remark, proof;
+        
+        switch (language)
+        {
+        case Language::FRENCH:
+            theorem = "Théorème";
+            lemma = "Lemme";
+            proposition = "Proposition";
+            corollary = "Corollaire";
+            definition = "Définition";
+            example = "Exemple";
+            remark = "Remarque";
+            proof = "Preuve";
+            break;
+        case Language::GERMAN:
+            theorem = "Satz";
+            lemma = "Lemma";
+            proposition = "Behauptung";
+            corollary = "Korollar";
+            definition = "Definition";
+            example = "Beispiel";
+            remark = "Bemerkung";
+            proof = "Beweis";
+            break;
+        case Language::SPANISH:
+            theorem = "Teorema";
+            lemma = "Lema";
+            proposition = "Proposición";
+            corollary = "Corolario";
+            definition = "Definición";
+            example = "Ejemplo";
+            remark = "Observación";
+            proof = "Demostración";
+            break;
+        case Language::ITALIAN:
+            theorem = "Teorema";
+            lemma = "Lemma";
+            proposition = "Proposizione";
+            corollary = "Corollario";
+            definition = "Definizione";
+            example = "Esempio";
+            remark = "Osservazione";
+            proof = "Dimostrazione";
+            break;
+        case Language::ENGLISH:
+        default:
+            theorem = "Theorem";
+            lemma = "Lemma";
+            proposition = "Proposition";
+            corollary = "Corollary";
+            definition = "Definition";
+            example = "Example";
+            remark = "Remark";
+            proof = "Proof";
+            break;
+        }
+        
+        // Define theorem-like environments
+        ss << "\\newtheorem{theorem}{" << theorem << "}\n";
+        ss << "\\newtheorem{lemma}[theorem]{" << lemma << "}\n";
+        ss << "\\newtheorem{proposition}[theorem]{" << proposition << "}\n";
+        ss << "\\newtheorem{corollary}[theorem]{" << corollary << "}\n";
+        
+        // Define definition-like environments
+        ss << "\\theoremstyle{definition}\n";
+        ss << "\\newtheorem{definition}{" << definition << "}\n";
+        ss << "\\newtheorem{example}{" << example << "}\n";
+        
+        // Define remark-like environments
+        ss << "\\theoremstyle{remark}\n";
+        ss << "\\newtheorem{remark}{" << remark << "}\n";
+        
+        // Redefine proof environment
+        ss << "\\renewcommand{\\proofname}{" << proof << "}\n";
+        
+        return ss.str();
+    }
+
+    /**
+     * Implementation for Algorithm class
+     */
+    bool Algorithm::pushOp(OpCode code, int indent, const std::string &arg, const std::string &extra)
+    {
+        // Offsets and lengths are 32-bit
+        const size_t limit = std::numeric_limits<uint32_t>::max();
+        const size_t used = m_program->arena.size();
+        if (used > limit || arg.size() + extra.size() > limit - used)
+        {
+            return false;
+        }
+
+        Op op;
+        op.offset = static_cast<uint32_t>(used);
+        op.length = static_cast<uint32_t>(arg.size());
+        op.extraLength = static_cast<uint32_t>(extra.size());
+        op.indent = indent > 0 ? indent : 0;
+        op.code = code;
+
+        Program &program = m_program.edit();
+        program.arena.append(arg);
+        program.arena.append(extra);
+        program.ops.push_back(op);
+        return true;
+    }
+
+    bool Algorithm::openBlock(OpCode code, int indent, const std::string &arg, const std::string &extra)
+    {
+        if (!pushOp(code, indent, arg, extra))
+        {
+            return false;
+        }
+        Program &program = m_program.edit();
+        program.openBlocks.push_back(program.ops.size() - 1);
+        return true;
+    }
+
+    bool Algorithm::addLine(const std::string &line, int indent)
+    {
+        if (!pushOp(OpCode::LINE, indent, line))
+        {
+            return false;
+        }
+
+        // A closing command written by the caller closes its block
+        const size_t first = line.find_first_not_of(" \t");
+        if (first != std::string::npos && line.compare(first, 4, "\\End") == 0)
+        {
+            const size_t last = line.find_last_not_of(" \t\r\n");
+            closeOpenBlock(line.substr(first + 4, last + 1 - first - 4));
+        }
+        return true;
+    }
+
+    void Algorithm::closeOpenBlock(const std::string &statement)
+    {
+        // Close the innermost open block of the same kind
+        const Program &program = *m_program;
+        for (size_t i = program.openBlocks.size(); i-- > 0;)
+        {
+            if (statement == getEndStatement(program.ops[program.openBlocks[i]].code))
+            {
+                std::vector<size_t> &openBlocks = m_program.edit().openBlocks;
+                openBlocks.erase(openBlocks.begin() + static_cast<std::ptrdiff_t>(i));
+                break;
+            }
+        }
+    }
+
+    const char *Algorithm::getEndStatement(OpCode code)
+    {
+        switch (code)
+        {
+        case OpCode::FOR:
+            return "For";
+        case OpCode::WHILE:
+            return "While";
+        case OpCode::IF:
+            return "If";
+        case OpCode::FUNCTION:
+            return "Function";
+        default:
+            return "";
+        }
+    }
+
+    bool Algorithm::addEnd(const std::string &statement, int indent)
+    {
+        if (!pushOp(OpCode::END, indent, statement))
+        {
+            return false;
+        }
+        closeOpenBlock(statement);
+        return true;
+    }
+
+    bool Algorithm::closeBlock()
+    {
+        const Program &program = *m_program;
+        if (program.openBlocks.empty())
+        {
+            return false;
+        }
+
+        const Op &opener = program.ops[program.openBlocks.back()];
+        return addEnd(getEndStatement(opener.code), opener.indent);
+    }
+
+    std::string Algorithm::generate() const
+    {
+        // Text written around the arguments of each op code: prefix, infix, suffix
+        struct Syntax
+        {
+            const char *prefix;
+            const char *infix;
+            const char *suffix;
+        };
+        static const Syntax syntax[] = {
+            {"", "", ""},                 // LINE
+            {"\\Comment{", "", "}"},      // COMMENT
+            {"\\For{", "", "}"},          // FOR
+            {"\\While{", "", "}"},        // WHILE
+            {"\\If{", "", "}"},           // IF
+            {"\\Else", "", ""},           // ELSE
+            {"\\ElsIf{", "", "}"},        // ELSE_IF
+            {"\\End", "", ""},            // END
+            {"\n\\Return{", "", "}"},     // RETURN
+            {"\\Break", "", ""},          // BREAK
+            {"\\Continue", "", ""},       // CONTINUE
+            {"\\Function{", "}(", ")"}};  // FUNCTION
+
+        // Indentation is copied from a precomputed run of spaces
+        static const std::string indentation(4 * 16, ' ');
+
+        const Program &program = *m_program;
+        std::string result;
+        result.reserve(program.arena.size() + program.ops.size() * 24 + m_caption.size() + m_label.size() + 128);
+
+        auto appendIndent = [&result](int level)
+        {
+            size_t width = static_cast<size_t>(level) * 4;
+            while (width > indentation.size())
+            {
+                result.append(indentation);
+                width -= indentation.size();
+            }
+            result.append(indentation, 0, width);
+        };
+
+        // Begin algorithm environment
+        result += "\\begin{algorithm}\n";
+        
+        // Add caption if provided
+        if (!m_caption.empty())
+        {
+            result += "\\caption{" + m_caption + "}\n";
+        }
+        
+        // Add label if provided
+        if (!m_label.empty())
+        {
+            result += "\\label{" + m_label + "}\n";
+        }
+        
+        // Begin algorithmic environment
+        result += "\\begin{algorithmic}[1]\n";
+        
+        // Emit all lines in a single pass
+        for (const auto &op : program.ops)
+        {
+            const Syntax &s = syntax[static_cast<size_t>(op.code)];
+
+            appendIndent(op.indent);
+            if (op.code == OpCode::COMMENT && op.indent > 0)
+            {
+                result += "\\>";
+            }
+            result += s.prefix;
+            result.append(program.arena, op.offset, op.length);
+            if (op.code == OpCode::FUNCTION)
+            {
+                result += s.infix;
+                result.append(program.arena, op.offset + op.length, op.extraLength);
+            }
+            result += s.suffix;
+            result += '\n';
+        }
+
+        // Close the blocks that were left open, innermost first
+        for (size_t i = program.openBlocks.size(); i-- > 0;)
+        {
+            const Op &opener = program.ops[program.openBlocks[i]];
+            appendIndent(opener.indent);
+            result += "\\End";
+            result += getEndStatement(opener.code);
+            result += '\n';
+        }
+        
+        // End algorithmic environment
+        result += "\\end{algorithmic}\n";
+        
+        // End algorithm environment
+        result += "\\end{algorithm}\n";
+        
+        return result;
+    }
+
+    bool Algorithm::fingerprint(ContentHasher &hasher) const
+    {
+        const Program &program = *m_program;
+        hasher.add(m_name).add(m_caption).add(m_label).add(program.arena);
+        for (const auto &op : program.ops)
+        {
+            hasher.add((static_cast<uint64_t>(op.code) << 32) | static_cast<uint32_t>(op.indent));
+            hasher.add((static_cast<uint64_t>(op.offset) << 32) | op.length).add(static_cast<uint64_t>(op.extraLength));
+        }
+        for (size_t block : program.openBlocks)
+        {
+            hasher.add(static_cast<uint64_t>(block));
+        }
+        return true;
+    }
+
+    std::string Algorithm::getAlgorithmPackages()
+    {
+        // Use algpseudocode instead of algorithmic for better compatibility
+        return "\\usepackage{algorithm}\n"
+               "\\usepackage{algpseudocode}\n";
+    }
+
+    /**
+     * Implementation for CodeListing class
+     */
+    namespace
+    {
+        enum class TokenClass
+        {
+            PLAIN,
+            KEYWORD,
+            COMMENT,
+            STRING,
+            NUMBER,
+            PREPROCESSOR
+        };
+
+        /**
+         * Lexical rules of a highlighted language
+         */
+        struct LexerRules
+        {
+            std::unordered_set<std::string_view> keywords;
+            const char *lineComment;    // Line comment marker ("" if none)
+            bool blockComments;         // C-style /* */ comments
+            bool preprocessor;          // # directives at the start of a line
+            bool tripleQuotedStrings;   // Python """ and ''' strings
+        };
+
+        const LexerRules &getLexerRules(CodeListing::SourceLanguage language)
+        {
+            static const LexerRules plainRules{{}, "", false, false, false};
+            static const LexerRules cppRules{
+                {"alignas", "alignof", "and", "asm", "auto", "bool", "break", "case", "catch", "char",
+                 "char16_t", "char32_t", "char8_t", "class", "concept", "const", "consteval", "constexpr",
+                 "constinit", "const_cast", "continue", "co_await", "co_return", "co_yield", "decltype",
+                 "default", "delete", "do", "double", "dynamic_cast", "else", "enum", "explicit", "export",
+                 "extern", "false", "final", "float", "for", "friend", "goto", "if", "inline", "int", "long",
+                 "mutable", "namespace", "new", "noexcept", "not", "nullptr", "operator", "or", "override",
+                 "private", "protected", "public", "register", "reinterpret_cast", "requires", "return",
+                 "short", "signed", "sizeof", "static", "static_assert", "static_cast", "struct", "switch",
+                 "template", "this", "thread_local", "throw", "true", "try", "typedef", "typeid", "typename",
+                 "union", "unsigned", "using", "virtual", "void", "volatile", "wchar_t", "while"},
+                "//", true, true, false};
+            static const LexerRules javaRules{
+                {"abstract", "assert", "boolean", "break", "byte", "case", "catch", "char", "class", "const",
+                 "continue", "default", "do", "double", "else", "enum", "extends", "final", "finally", "float",
+                 "for", "goto", "if", "implements", "import", "instanceof", "int", "interface", "long", "native",
+                 "new", "null", "package", "private", "protected", "public", "record", "return", "short",
+                 "static", "strictfp", "super", "switch", "synchronized", "this", "throw", "throws",
+                 "transient", "true", "false", "try", "var", "void", "volatile", "while", "yield"},
+                "//", true, false, false};
+            static const LexerRules pythonRules{
+                {"False", "None", "True", "and", "as", "assert", "async", "await", "break", "class",
+                 "continue", "def", "del", "elif", "else", "except", "finally", "for", "from", "global",
+                 "if", "import", "in", "is", "lambda", "nonlocal", "not", "or", "pass", "raise", "return",
+                 "try", "while", "with", "yield"},
+                "#", false, false, true};
+            static const LexerRules shellRules{
+                {"case", "do", "done", "elif", "else", "esac", "exit", "export", "fi", "for", "function",
+                 "if", "in", "local", "readonly", "return", "select", "shift", "then", "until", "while"},
+                "#", false, false, false};
+
+            switch (language)
+            {
+            case CodeListing::SourceLanguage::CPP:
+                return cppRules;
+            case CodeListing::SourceLanguage::JAVA:
+                return javaRules;
+            case CodeListing::SourceLanguage::PYTHON:
+                return pythonRules;
+            case CodeListing::SourceLanguage::SHELL:
+                return shellRules;
+            case CodeListing::SourceLanguage::PLAIN:
+            default:
+                return plainRules;
+            }
+        }
+
+        inline bool isIdentifierStart(unsigned char c)
+        {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+        }
+
+        inline bool isIdentifierChar(unsigned char c)
+        {
+            return isIdentifierStart(c) || (c >= '0' && c <= '9');
+        }
+
+        /**
+         * Append source text, escaping the Verbatim command characters
+         */
+        void appendEscaped(std::string &out, const char *begin, const char *end)
+        {
+            const char *chunk = begin;
+            for (const char *p = begin; p < end; ++p)
+            {
+                const char *replacement = nullptr;
+                switch (*p)
+                {
+                case '\\':
+                    replacement = "\\LGbs{}";
+                    break;
+                case '{':
+                    replacement = "\\LGob{}";
+                    break;
+                case '}':
+                    replacement = "\\LGcb{}";
+                    break;
+                default:
+                    continue;
+                }
+                out.append(chunk, p);
+                out.append(replacement);
+                chunk = p + 1;
+            }
+            out.append(chunk, end);
+        }
+
+        /**
+         * Append a token wrapped in its style macro; the macro is reopened on each line
+         * because Verbatim processes the listing line by line
+         */
+        void appendToken(std::string &out, TokenClass tokenClass, const char *begin, const char *end)
+        {
+            static const char *const macros[] = {"", "\\LGkw{", "\\LGcm{", "\\LGst{", "\\LGnu{", "\\LGpp{"};
+
+            if (tokenClass == TokenClass::PLAIN)
+            {
+                appendEscaped(out, begin, end);
+                return;
+            }
+
+            const char *macro = macros[static_cast<size_t>(tokenClass)];
+            while (begin < end)
+            {
+                const char *lineEnd = static_cast<const char *>(std::memchr(begin, '\n', static_cast<size_t>(end - begin)));
+                const char *segmentEnd = lineEnd ? lineEnd : end;
+                if (segmentEnd > begin)
+                {
+                    out.append(macro);
+                    appendEscaped(out, begin, segmentEnd);
+                    out += '}';
+                }
+                if (!lineEnd)
+                {
+                    break;
+                }
+                out += '\n';
+                begin = lineEnd + 1;
+            }
+        }
+    }
+
+    void CodeListing::highlight(const std::string &code, SourceLanguage language, std::string &out)
+    {
+        const LexerRules &rules = getLexerRules(language);
+        const size_t lineCommentLength = std::strlen(rules.lineComment);
+
+        const char *const begin = code.data();
+        const char *const end = begin + code.size();
+        const char *p = begin;
+        const char *plainStart = begin; // Start of the pending run of plain text
+        bool lineStart = true;          // Only whitespace seen since the last newline
+
+        auto flushPlain = [&](const char *upTo)
+        {
+            if (upTo > plainStart)
+            {
+                appendEscaped(out, plainStart, upTo);
+            }
+        };
+        auto emit = [&](TokenClass tokenClass, const char *tokenEnd)
+        {
+            flushPlain(p);
+            appendToken(out, tokenClass, p, tokenEnd);
+            p = tokenEnd;
+            plainStart = p;
+            lineStart = false;
+        };
+        auto findLineEnd = [&](const char *from)
+        {
+            const char *lineEnd = static_cast<const char *>(std::memchr(from, '\n', static_cast<size_t>(end - from)));
+            return lineEnd ? lineEnd : end;
+        };
+
+        out.reserve(out.size() + code.size() + code.size() / 4);
+
+        if (language == SourceLanguage::PLAIN)
+        {
+            appendEscaped(out, begin, end);
+            return;
+        }
+
+        while (p < end)
+        {
+            const unsigned char c = static_cast<unsigned char>(*p);
+
+            if (c == '\n')
+            {
+                lineStart = true;
+                ++p;
+                continue;
+            }
+            if (c == ' ' || c == '\t' || c == '\r')
+            {
+                ++p;
+                continue;
+            }
+
+            // Comments
+            if (lineCommentLength > 0 && static_cast<size_t>(end - p) >= lineCommentLength &&
+                std::memcmp(p, rules.lineComment, lineCommentLength) == 0 &&
+                (language != SourceLanguage::SHELL || p == begin || p[-1] == ' ' || p[-1] == '\t' || p[-1] == '\n'))
+            {
+                emit(TokenClass::COMMENT, findLineEnd(p));
+                continue;
+            }
+            if (rules.blockComments && c == '/' && p + 1 < end && p[1] == '*')
+            {
+                const char *close = p + 2;
+                while (close + 1 < end && !(close[0] == '*' && close[1] == '/'))
+                {
+                    ++close;
+                }
+                emit(TokenClass::COMMENT, close + 1 < end ? close + 2 : end);
+                continue;
+            }
+
+            // Preprocessor directives
+            if (rules.preprocessor && c == '#' && lineStart)
+            {
+                emit(TokenClass::PREPROCESSOR, findLineEnd(p));
+                continue;
+            }
+
+            // Strings
+            if (c == '"' || c == '\'')
+            {
+                const char *close = p + 1;
+                if (rules.tripleQuotedStrings && end - p >= 3 && p[1] == c && p[2] == c)
+                {
+                    close = p + 3;
+                    while (close + 2 < end && !(close[0] == c && close[1] == c && close[2] == c))
+                    {
+                        close += (*close == '\\' && close + 1 < end) ? 2 : 1;
+                    }
+                    emit(TokenClass::STRING, close + 2 < end ? close + 3 : end);
+                    continue;
+                }
+
+                // Single-line string literal with backslash escapes
+                while (close < end && *close != c && *close != '\n')
+                {
+                    close += (*close == '\\' && close + 1 < end && close[1] != '\n') ? 2 : 1;
+                }
+                emit(TokenClass::STRING, (close < end && *close == c) ? close + 1 : close);
+                continue;
+            }
+
+            // Numbers
+            if (c >= '0' && c <= '9')
+            {
+                const char *close = p + 1;
+                while (close < end && (isIdentifierChar(static_cast<unsigned char>(*close)) || *close == '.' || *close == '\''))
+                {
+                    ++close;
+                }
+                emit(TokenClass::NUMBER, close);
+                continue;
+            }
+
+            // Identifiers and keywords
+            if (isIdentifierStart(c))
+            {
+                const char *close = p + 1;
+                while (close < end && isIdentifierChar(static_cast<unsigned char>(*close)))
+                {
+                    ++close;
+                }
+                if (rules.keywords.count(std::string_view(p, static_cast<size_t>(close - p))) > 0)
+                {
+                    emit(TokenClass::KEYWORD, close);
+                }
+                else
+                {
+                    p = close;
+                    lineStart = false;
+                }
+                continue;
+            }
+
+            ++p;
+            lineStart = false;
+        }
+
+        flushPlain(end);
+    }
+
+    std::string CodeListing::generate() const
+    {
+        const std::string &code = *m_code;
+        std::string result;
+        result.reserve(code.size() + code.size() / 4 + 128);
+
+        // Begin the Verbatim environment with \ { } as command characters
+        result += "\\begin{Verbatim}[commandchars=\\\\\\{\\},frame=single,fontsize=\\small";
+        if (m_lineNumbers)
+        {
+            result += ",numbers=left";
+        }
+        if (!m_title.empty())
+        {
+            result += ",label={" + m_title + "}";
+        }
+        result += "]\n";
+
+        // Add the highlighted code
+        highlight(code, m_language, result);
+        if (!code.empty() && code.back() != '\n')
+        {
+            result += '\n';
+        }
+
+        // End the Verbatim environment
+        result += "\\end{Verbatim}\n";
+
+        return result;
+    }
+
+    bool CodeListing::fingerprint(ContentHasher &hasher) const
+    {
+        hasher.add(m_name).add(static_cast<uint64_t>(m_language)).add(m_title);
+        hasher.add(static_cast<uint64_t>(m_lineNumbers)).add(*m_code);
+        return true;
+    }
+
+    std::string CodeListing::getListingSetup()
+    {
+        // Styles match the listings configuration used by the document classes
+        return "\\usepackage{fancyvrb}\n"
+               "\\usepackage{xcolor}\n"
+               "\\providecommand{\\LGbs}{\\char92}\n"
+               "\\providecommand{\\LGob}{\\char123}\n"
+               "\\providecommand{\\LGcb}{\\char125}\n"
+               "\\providecommand{\\LGkw}[1]{\\textcolor{blue}{\\textbf{#1}}}\n"
+               "\\providecommand{\\LGcm}[1]{\\textcolor{green!60!black}{\\textit{#1}}}\n"
+               "\\providecommand{\\LGst}[1]{\\textcolor{purple}{#1}}\n"
+               "\\providecommand{\\LGnu}[1]{\\textcolor{orange!80!black}{#1}}\n"
+               "\\providecommand{\\LGpp}[1]{\\textcolor{brown}{#1}}\n";
+    }
+
+    /**
+     * Implementation for ContentTemplate class
+     */
+    ContentTemplate::ContentTemplate(const std::string &text)
+    {
+        auto isNameChar = [](char c)
+        {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                   c == '_' || c == '-' || c == '.';
+        };
+        auto addLiteral = [this](const std::string &source, size_t from, size_t to)
+        {
+            if (to <= from)
+            {
+                return;
+            }
+            // Merge with the previous literal when possible
+            if (!m_segments.empty() && m_segments.back().slot == npos)
+            {
+                m_segments.back().length += to - from;
+            }
+            else
+            {
+                m_segments.push_back({m_literals.size(), to - from, npos, false});
+            }
+            m_literals.append(source, from, to - from);
+        };
+
+        m_literals.reserve(text.size());
+
+        size_t pos = 0;
+        size_t literalStart = 0;
+        while ((pos = text.find("{{", pos)) != std::string::npos)
+        {
+            // Parse {{ [&] name }}
+            size_t cursor = pos + 2;
+            bool raw = false;
+            while (cursor < text.size() && text[cursor] == ' ')
+            {
+                ++cursor;
+            }
+            if (cursor < text.size() && text[cursor] == '&')
+            {
+                raw = true;
+                ++cursor;
+            }
+            while (cursor < text.size() && text[cursor] == ' ')
+            {
+                ++cursor;
+            }
+            size_t nameStart = cursor;
+            while (cursor < text.size() && isNameChar(text[cursor]))
+            {
+                ++cursor;
+            }
+            size_t nameEnd = cursor;
+            while (cursor < text.size() && text[cursor] == ' ')
+            {
+                ++cursor;
+            }
+
+            if (nameEnd == nameStart || text.compare(cursor, 2, "}}") != 0)
+            {
+                // Not a placeholder (e.g. LaTeX {{...}} groups): keep it as literal text
+                ++pos;
+                continue;
+            }
+
+            addLiteral(text, literalStart, pos);
+
+            std::string name = text.substr(nameStart, nameEnd - nameStart);
+            auto it = m_slotIndex.find(name);
+            size_t slot;
+            if (it == m_slotIndex.end())
+            {
+                slot = m_slotNames.size();
+                m_slotIndex[name] = slot;
+                m_slotNames.push_back(name);
+            }
+            else
+            {
+                slot = it->second;
+            }
+            m_segments.push_back({0, 0, slot, raw});
+
+            pos = cursor + 2;
+            literalStart = pos;
+        }
+
+        addLiteral(text, literalStart, text.size());
+    }
+
+    size_t ContentTemplate::findSlot(const std::string &name) const
+    {
+        auto it = m_slotIndex.find(name);
+        return it != m_slotIndex.end() ? it->second : npos;
+    }
+
+    void ContentTemplate::render(std::string &out, const std::vector<std::string> &values) const
+    {
+        for (const auto &segment : m_segments)
+        {
+            if (segment.slot == npos)
+            {
+                out.append(m_literals, segment.offset, segment.length);
+            }
+            else if (segment.slot < values.size())
+            {
+                if (segment.raw)
+                {
+                    out.append(values[segment.slot]);
+                }
+                else
+                {
+                    appendEscapedLatex(out, values[segment.slot]);
+                }
+            }
+        }
+    }
+
+    std::string ContentTemplate::fillSlots(const std::vector<std::string> &values) const
+    {
+        std::string result;
+        result.reserve(m_literals.size() + 16 * m_slotNames.size());
+        render(result, values);
+        return result;
+    }
+
+    void ContentTemplate::fingerprint(ContentHasher &hasher) const
+    {
+        hasher.add(m_literals).add(static_cast<uint64_t>(m_segments.size()));
+        for (const auto &segment : m_segments)
+        {
+            hasher.add(static_cast<uint64_t>(segment.offset)).add(static_cast<uint64_t>(segment.length));
+            hasher.add(static_cast<uint64_t>(segment.slot)).add(static_cast<uint64_t>(segment.raw));
+        }
+    }
+
+    std::string ContentTemplate::fill(const std::map<std::string, std::string> &record) const
+    {
+        // Bind the record to slots once, then render
+        std::vector<std::string> values(m_slotNames.size());
+        for (size_t slot = 0; slot < m_slotNames.size(); ++slot)
+        {
+            auto it = record.find(m_slotNames[slot]);
+            if (it != record.end())
+            {
+                values[slot] = it->second;
+            }
+        }
+
+        return fillSlots(values);
+    }
+
+    /**
+     * Implementation for TemplateBlock class
+     */
+    void TemplateBlock::setValue(const std::string &name, const std::string &value)
+    {
+        if (!m_template)
+        {
+            return;
+        }
+
+        size_t slot = m_template->findSlot(name);
+        if (slot != ContentTemplate::npos)
+        {
+            m_values[slot] = value;
+        }
+    }
+
+    void TemplateBlock::setRecord(const std::map<std::string, std::string> &record)
+    {
+        if (!m_template)
+        {
+            return;
+        }
+
+        const auto &names = m_template->getSlotNames();
+        for (size_t slot = 0; slot < names.size(); ++slot)
+        {
+            auto it = record.find(names[slot]);
+            if (it != record.end())
+            {
+                m_values[slot] = it->second;
+            }
+            else
+            {
+                m_values[slot].clear();
+            }
+        }
+    }
+
+    std::string TemplateBlock::generate() const
+    {
+        return m_template ? m_template->fillSlots(m_values) : "";
+    }
+
+    bool TemplateBlock::fingerprint(ContentHasher &hasher) const
+    {
+        if (!m_template)
+        {
+            return false;
+        }
+
+        hasher.add(m_name);
+        m_template->fingerprint(hasher);
+        for (const auto &value : m_values)
+        {
+            hasher.add(value);
+        }
+        return true;
+    }
+
+    /**
+     * Implementation for LazyEnvironment class
+     */
+    LazyEnvironment::LazyEnvironment(Factory factory, bool memoize)
+        : Environment("lazy")
+    {
+        // Only the rendered LaTeX is kept, the built environment is released
+        auto render = [factory = std::move(factory)]()
+        {
+            std::shared_ptr<Environment> env = factory ? factory() : nullptr;
+            return env ? env->generate() : std::string();
+        };
+        m_content = std::make_shared<LazyContent>(std::move(render), memoize);
+    }
+
+    std::string LazyEnvironment::generate() const
+    {
+        return m_content->evaluate();
+    }
+
+
+    /**
+     * Implementation for CompactStreamBuf class
+     */
+    namespace
+    {
+        bool isBlankChar(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+
+        /**
+         * Check whether a normalised line starts with a sectioning command
+         */
+        bool isHeadingLine(const std::string &line)
+        {
+            static const char *const commands[] = {"\\part", "\\chapter", "\\section", "\\subsection",
+                                                   "\\subsubsection"};
+            for (const char *command : commands)
+            {
+                const size_t length = std::strlen(command);
+                if (line.compare(0, length, command) == 0 && line.size() > length &&
+                    (line[length] == '{' || line[length] == '*' || line[length] == '['))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * Strip indentation and trailing blanks, collapse runs of spaces
+         */
+        std::string compactLine(const std::string &line)
+        {
+            size_t begin = 0;
+            while (begin < line.size() && isBlankChar(line[begin]))
+            {
+                ++begin;
+            }
+            size_t end = line.size();
+            while (end > begin && isBlankChar(line[end - 1]))
+            {
+                --end;
+            }
+
+            // A trailing control space ("\ ") keeps one space
+            size_t backslashes = 0;
+            while (backslashes < end - begin && line[end - 1 - backslashes] == '\\')
+            {
+                ++backslashes;
+            }
+            const bool keepTrailingSpace = (backslashes % 2 == 1) && end < line.size();
+
+            std::string result;
+            result.reserve(end - begin + 1);
+            if (line.find("\\verb", begin) != std::string::npos || line.find("\\lstinline", begin) != std::string::npos)
+            {
+                result.assign(line, begin, end - begin);
+            }
+            else
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const char c = line[i];
+                    if (c == '\\' && i + 1 < end)
+                    {
+                        result += c;
+                        result += line[++i];
+                    }
+                    else if (c == ' ' || c == '\t')
+                    {
+                        result += ' ';
+                        while (i + 1 < end && (line[i + 1] == ' ' || line[i + 1] == '\t'))
+                        {
+                            ++i;
+                        }
+                    }
+                    else
+                    {
+                        result += c;
+                    }
+                }
+            }
+            if (keepTrailingSpace)
+            {
+                result += ' ';
+            }
+            return result;
+        }
+    } // namespace
+
+    CompactStreamBuf::int_type CompactStreamBuf::overflow(int_type ch)
+    {
+        if (traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            return traits_type::not_eof(ch);
+        }
+
+        const char c = traits_type::to_char_type(ch);
+        xsputn(&c, 1);
+        return ch;
+    }
+
+    std::streamsize CompactStreamBuf::xsputn(const char *data, std::streamsize count)
+    {
+        m_bytesIn += static_cast<size_t>(count);
+        const char *end = data + count;
+        while (data != end)
+        {
+            const char *newline = static_cast<const char *>(std::memchr(data, '\n', static_cast<size_t>(end - data)));
+            if (!newline)
+            {
+                m_line.append(data, end);
+                break;
+            }
+            m_line.append(data, newline);
+            processLine(true);
+            data = newline + 1;
+        }
+        return count;
+    }
+
+    int CompactStreamBuf::sync()
+    {
+        // Incomplete lines stay buffered: they cannot be compacted yet
+        return m_target->pubsync();
+    }
+
+    void CompactStreamBuf::finish()
+    {
+        if (!m_line.empty())
+        {
+            processLine(false);
+        }
+        m_target->pubsync();
+    }
+
+    void CompactStreamBuf::put(const char *data, size_t size)
+    {
+        m_target->sputn(data, static_cast<std::streamsize>(size));
+        m_bytesOut += size;
+    }
+
+    void CompactStreamBuf::processLine(bool complete)
+    {
+        std::string line;
+        line.swap(m_line);
+
+        // Verbatim material is copied unchanged up to and including its end line
+        if (!m_verbatimEnd.empty())
+        {
+            if (line.find(m_verbatimEnd) != std::string::npos)
+            {
+                m_verbatimEnd.clear();
+            }
+            if (complete)
+            {
+                line += '\n';
+            }
+            put(line.data(), line.size());
+            return;
+        }
+
+        for (const char *name : VERBATIM_ENVIRONMENTS)
+        {
+            const std::string begin = std::string("\\begin{") + name + "}";
+            const size_t position = line.find(begin);
+            if (position == std::string::npos)
+            {
+                continue;
+            }
+
+            const std::string endCommand = std::string("\\end{") + name + "}";
+            if (line.find(endCommand, position + begin.size()) == std::string::npos)
+            {
+                m_verbatimEnd = endCommand;
+            }
+            if (m_pendingBlank)
+            {
+                put("\n", 1);
+            }
+            m_pendingBlank = false;
+            m_afterHeading = false;
+            if (complete)
+            {
+                line += '\n';
+            }
+            put(line.data(), line.size());
+            return;
+        }
+
+        std::string compacted = compactLine(line);
+        if (compacted.empty())
+        {
+            // Blank lines of the preamble are kept: one may be a paragraph break inside
+            // a macro definition. In the body, runs become one break, none next to headings
+            if (!m_inBody)
+            {
+                if (complete)
+                {
+                    put("\n", 1);
+                }
+            }
+            else if (!m_afterHeading)
+            {
+                m_pendingBlank = true;
+            }
+            return;
+        }
+
+        const bool heading = isHeadingLine(compacted) || compacted.compare(0, 14, "\\end{document}") == 0;
+        if (m_pendingBlank && !heading)
+        {
+            put("\n", 1);
+        }
+        m_pendingBlank = false;
+
+        if (!m_inBody && compacted.find("\\begin{document}") != std::string::npos)
+        {
+            m_inBody = true;
+            m_afterHeading = true;
+        }
+        else
+        {
+            m_afterHeading = heading;
+        }
+
+        if (complete)
+        {
+            compacted += '\n';
+        }
+        put(compacted.data(), compacted.size());
     }
 
+
     /**
-     * Implementation for Algorithm class
+     * Implementation for the macro extraction pass
      */
-    std::string Algorithm::generate() const
+    namespace
     {
-        std::stringstream ss;
-        
-        // Begin algorithm environment
-        ss << "\\begin{algorithm}\n";
-        
-        // Add caption if provided
-        if (!m_caption.empty())
+        /**
+         * Line of the document as seen by the macro extraction pass
+         */
+        struct MacroLine
         {
-            ss << "\\caption{" << m_caption << "}\n";
+            std::string_view text;
+            uint64_t id = 0;        // Equal lines have equal ids
+            bool eligible = false;  // May be part of an extracted block
+            int braceDelta = 0;     // Opened minus closed braces
+            int braceMin = 0;       // Lowest brace depth reached within the line
+            std::vector<std::pair<bool, std::string_view>> environments; // (begin?, name) in order
+        };
+
+        bool isVerbatimEnvironment(std::string_view name)
+        {
+            return name == "Verbatim" || name == "verbatim" || name == "lstlisting";
         }
-        
-        // Add label if provided
-        if (!m_label.empty())
+
+        void analyzeMacroLine(MacroLine &line)
         {
-            ss << "\\label{" << m_label << "}\n";
+            std::string_view text = line.text;
+            int depth = 0;
+            for (size_t i = 0; i < text.size(); ++i)
+            {
+                char c = text[i];
+                if (c == '\\')
+                {
+                    // \begin{name} and \end{name}; escaped characters are skipped
+                    bool begin = text.compare(i, 7, "\\begin{") == 0;
+                    bool end = text.compare(i, 5, "\\end{") == 0;
+                    if (begin || end)
+                    {
+                        size_t nameStart = i + (begin ? 7 : 5);
+                        size_t nameEnd = text.find('}', nameStart);
+                        if (nameEnd != std::string_view::npos)
+                        {
+                            line.environments.push_back({begin, text.substr(nameStart, nameEnd - nameStart)});
+                        }
+                    }
+                    ++i;
+                }
+                else if (c == '{')
+                {
+                    ++depth;
+                }
+                else if (c == '}')
+                {
+                    line.braceMin = std::min(line.braceMin, --depth);
+                }
+            }
+            line.braceDelta = depth;
         }
-        
-        // Begin algorithmic environment
-        ss << "\\begin{algorithmic}[1]\n";
-        
-        // Add lines with appropriate indentation
-        for (const auto& line : m_lines)
+
+        /**
+         * A block can become a macro if its braces and environments are balanced
+         */
+        bool isSelfContained(const std::vector<MacroLine> &lines, size_t first, size_t count)
         {
-            // Add indentation
-            for (int i = 0; i < line.second; ++i)
+            int depth = 0;
+            std::vector<std::string_view> open;
+            for (size_t i = first; i < first + count; ++i)
             {
-                ss << "    ";
+                if (depth + lines[i].braceMin < 0)
+                {
+                    return false;
+                }
+                depth += lines[i].braceDelta;
+
+                for (const auto &env : lines[i].environments)
+                {
+                    if (env.first)
+                    {
+                        open.push_back(env.second);
+                    }
+                    else if (open.empty() || open.back() != env.second)
+                    {
+                        return false;
+                    }
+                    else
+                    {
+                        open.pop_back();
+                    }
+                }
             }
-            
-            // Add line content
-            ss << line.first << "\n";
+            return depth == 0 && open.empty();
+        }
+
+        std::string getMacroName(size_t index)
+        {
+            std::string letters;
+            do
+            {
+                letters.insert(letters.begin(), static_cast<char>('a' + index % 26));
+                index /= 26;
+            } while (index > 0);
+            return "\\LGm" + letters;
         }
-        
-        // End algorithmic environment
-        ss << "\\end{algorithmic}\n";
-        
-        // End algorithm environment
-        ss << "\\end{algorithm}\n";
-        
-        return ss.str();
     }
 
-    std::string Algorithm::getAlgorithmPackages()
+    std::string extractMacros(const std::string &latex, const MacroExtractionOptions &options, MacroExtractionStats *stats)
     {
-        // Use algpseudocode instead of algorithmic for better compatibility
-        return "\\usepackage{algorithm}\n"
-               "\\usepackage{algpseudocode}\n";
+        MacroExtractionStats localStats;
+        MacroExtractionStats &counters = stats ? *stats : localStats;
+        counters = MacroExtractionStats();
+        counters.inputBytes = latex.size();
+        counters.outputBytes = latex.size();
+
+        // Split into lines (a final line without newline is kept as is)
+        std::vector<MacroLine> lines;
+        std::string_view text(latex);
+        size_t lineStart = 0;
+        while (lineStart < text.size())
+        {
+            size_t lineEnd = text.find('\n', lineStart);
+            if (lineEnd == std::string_view::npos)
+            {
+                lineEnd = text.size();
+            }
+            MacroLine line;
+            line.text = text.substr(lineStart, lineEnd - lineStart);
+            lines.push_back(std::move(line));
+            lineStart = lineEnd + 1;
+        }
+        bool finalNewline = !latex.empty() && latex.back() == '\n';
+
+        // Only the document body is processed
+        size_t bodyBegin = lines.size();
+        size_t bodyEnd = 0;
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            if (bodyBegin == lines.size() && lines[i].text.find("\\begin{document}") != std::string_view::npos)
+            {
+                bodyBegin = i;
+            }
+            if (lines[i].text.find("\\end{document}") != std::string_view::npos)
+            {
+                bodyEnd = i;
+            }
+        }
+        if (bodyBegin >= bodyEnd || options.minRepeats < 2)
+        {
+            return latex;
+        }
+
+        // Classify the body lines and number distinct lines
+        std::unordered_map<std::string_view, uint64_t> lineIds;
+        std::string_view verbatimEnd;
+        for (size_t i = bodyBegin + 1; i < bodyEnd; ++i)
+        {
+            MacroLine &line = lines[i];
+            analyzeMacroLine(line);
+
+            if (!verbatimEnd.empty())
+            {
+                // Inside verbatim material until its \end line (included)
+                for (const auto &env : line.environments)
+                {
+                    if (!env.first && env.second == verbatimEnd)
+                    {
+                        verbatimEnd = std::string_view();
+                    }
+                }
+                continue;
+            }
+
+            bool verbatim = false;
+            for (const auto &env : line.environments)
+            {
+                if (env.first && isVerbatimEnvironment(env.second))
+                {
+                    verbatim = true;
+                    verbatimEnd = env.second;
+                }
+                else if (!env.first && env.second == verbatimEnd)
+                {
+                    verbatimEnd = std::string_view();
+                }
+            }
+
+            line.eligible = !verbatim &&
+                            line.text.find_first_of("#%@") == std::string_view::npos &&
+                            line.text.find("\\verb") == std::string_view::npos;
+            line.id = lineIds.emplace(line.text, lineIds.size() + 1).first->second;
+        }
+
+        // A block repeated n times only contains lines repeated at least n times
+        std::vector<size_t> lineRepeats(lineIds.size() + 1, 0);
+        for (size_t i = bodyBegin + 1; i < bodyEnd; ++i)
+        {
+            ++lineRepeats[lines[i].id];
+        }
+        for (size_t i = bodyBegin + 1; i < bodyEnd; ++i)
+        {
+            lines[i].eligible = lines[i].eligible && lineRepeats[lines[i].id] >= options.minRepeats;
+        }
+
+        // Greedy selection, longest blocks first
+        const uint64_t base = 0x100000001B3ULL;
+        std::vector<bool> taken(lines.size(), false);
+        std::vector<std::pair<size_t, size_t>> replacements; // Block start -> (line count, macro)
+        std::vector<size_t> replacementAt(lines.size(), SIZE_MAX);
+        std::vector<std::pair<size_t, size_t>> macros;       // (first occurrence, line count)
+
+        size_t bodySize = bodyEnd - bodyBegin - 1;
+        size_t maxLines = std::min(options.maxLines, bodySize);
+        std::vector<size_t> blocked(bodySize + 1, 0);
+        std::vector<size_t> bytes(bodySize + 1, 0);
+        std::vector<uint64_t> hashes(bodySize + 1, 0);
+
+        for (size_t i = 0; i < bodySize; ++i)
+        {
+            const MacroLine &line = lines[bodyBegin + 1 + i];
+            bytes[i + 1] = bytes[i] + line.text.size() + 1;
+            hashes[i + 1] = hashes[i] * base + line.id;
+        }
+
+        for (size_t count = maxLines; count >= 1; --count)
+        {
+            for (size_t i = 0; i < bodySize; ++i)
+            {
+                size_t index = bodyBegin + 1 + i;
+                blocked[i + 1] = blocked[i] + (!lines[index].eligible || taken[index] ? 1 : 0);
+            }
+
+            uint64_t power = 1;
+            for (size_t i = 0; i < count; ++i)
+            {
+                power *= base;
+            }
+
+            // Group the candidate blocks by hash (sorted by hash, then position)
+            std::vector<std::pair<uint64_t, size_t>> candidates;
+            for (size_t i = 0; i + count <= bodySize; ++i)
+            {
+                if (blocked[i + count] == blocked[i] && bytes[i + count] - bytes[i] >= options.minLength)
+                {
+                    candidates.push_back({hashes[i + count] - hashes[i] * power, i});
+                }
+            }
+            if (candidates.size() < options.minRepeats)
+            {
+                continue;
+            }
+            std::sort(candidates.begin(), candidates.end());
+
+            // Groups are processed in order of first occurrence for a stable output
+            std::vector<std::pair<size_t, size_t>> groups; // Range in candidates
+            for (size_t i = 0; i < candidates.size();)
+            {
+                size_t j = i + 1;
+                while (j < candidates.size() && candidates[j].first == candidates[i].first)
+                {
+                    ++j;
+                }
+                if (j - i >= options.minRepeats)
+                {
+                    groups.push_back({i, j});
+                }
+                i = j;
+            }
+            std::sort(groups.begin(), groups.end(), [&candidates](const auto &a, const auto &b)
+                      { return candidates[a.first].second < candidates[b.first].second; });
+
+            std::vector<size_t> starts;
+            for (const auto &group : groups)
+            {
+                starts.clear();
+                for (size_t i = group.first; i < group.second; ++i)
+                {
+                    starts.push_back(candidates[i].second);
+                }
+
+                size_t first = bodyBegin + 1 + starts.front();
+                if (!isSelfContained(lines, first, count))
+                {
+                    continue;
+                }
+
+                // Non-overlapping occurrences equal to the first one (hashes may collide)
+                std::vector<size_t> selected;
+                size_t nextFree = 0;
+                for (size_t start : starts)
+                {
+                    size_t index = bodyBegin + 1 + start;
+                    if (start < nextFree)
+                    {
+                        continue;
+                    }
+
+                    bool usable = true;
+                    for (size_t j = 0; j < count && usable; ++j)
+                    {
+                        usable = !taken[index + j] && lines[index + j].id == lines[first + j].id;
+                    }
+                    if (usable)
+                    {
+                        selected.push_back(index);
+                        nextFree = start + count;
+                    }
+                }
+
+                size_t blockBytes = bytes[starts.front() + count] - bytes[starts.front()];
+                size_t callBytes = getMacroName(macros.size()).size() + 1;
+                size_t definitionBytes = blockBytes + callBytes + 16;
+                if (selected.size() < options.minRepeats ||
+                    selected.size() * blockBytes <= definitionBytes + selected.size() * callBytes)
+                {
+                    continue;
+                }
+
+                for (size_t index : selected)
+                {
+                    replacementAt[index] = replacements.size();
+                    replacements.push_back({count, macros.size()});
+                    for (size_t j = 0; j < count; ++j)
+                    {
+                        taken[index + j] = true;
+                    }
+                }
+                macros.push_back({first, count});
+            }
+        }
+
+        if (macros.empty())
+        {
+            return latex;
+        }
+
+        // Rebuild the document with the macro definitions before \begin{document}
+        std::string result;
+        result.reserve(latex.size());
+        for (size_t i = 0; i < lines.size();)
+        {
+            if (i == bodyBegin)
+            {
+                for (size_t m = 0; m < macros.size(); ++m)
+                {
+                    result += "\\newcommand{";
+                    result += getMacroName(m);
+                    result += "}{";
+                    for (size_t j = 0; j < macros[m].second; ++j)
+                    {
+                        result += lines[macros[m].first + j].text;
+                        result += '\n';
+                    }
+                    result += "}\n";
+                }
+            }
+
+            if (replacementAt[i] != SIZE_MAX)
+            {
+                const auto &replacement = replacements[replacementAt[i]];
+                result += getMacroName(replacement.second);
+                result += '\n';
+                i += replacement.first;
+                ++counters.replacements;
+                continue;
+            }
+
+            result += lines[i].text;
+            if (i + 1 < lines.size() || finalNewline)
+            {
+                result += '\n';
+            }
+            ++i;
+        }
+
+        counters.macros = macros.size();
+        counters.outputBytes = result.size();
+        return result;
     }
 
 
@@ -0,0 +1,335 @@
+/**
+ * @file arrow_reader_test.cpp
+ * @brief Checks ArrowTable against Arrow IPC data written by pyarrow.
+ *
+ * Usage: arrow_reader_test <data directory>
+ *
+ * The fixtures of the data directory are made by generate_arrow_fixtures.py:
+ * types.arrow (file format), types.arrows (stream format), legacy.arrows (stream
+ * without continuation markers) and compressed.arrow (LZ4 batches, rejected).
+ * types.tsv holds the expected columns and cells. Damaged copies of the fixtures
+ * are read as well, to check that the reader fails cleanly on bad input; build
+ * with LATEXGEN_SANITIZE=ON to run them under AddressSanitizer and UBSan.
+ */
+
+#include "latexarrow.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace LatexGen;
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const std::string &what)
+    {
+        if (!condition)
+        {
+            ++failures;
+            std::cerr << "FAILED: " << what << std::endl;
+        }
+    }
+
+    std::string readFile(const std::string &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::ostringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    }
+
+    std::vector<std::string> splitLine(const std::string &line)
+    {
+        std::vector<std::string> cells;
+        size_t start = 0;
+        while (true)
+        {
+            size_t tab = line.find('\t', start);
+            cells.push_back(line.substr(start, tab - start));
+            if (tab == std::string::npos)
+            {
+                return cells;
+            }
+            start = tab + 1;
+        }
+    }
+
+    struct Expected
+    {
+        std::vector<std::string> names;
+        std::vector<std::string> types;
+        std::vector<std::vector<std::string>> rows;
+    };
+
+    bool readExpected(const std::string &path, Expected &expected)
+    {
+        std::ifstream in(path);
+        std::string line;
+        std::vector<std::vector<std::string>> lines;
+        while (std::getline(in, line))
+        {
+            lines.push_back(splitLine(line));
+        }
+        if (lines.size() < 2)
+        {
+            return false;
+        }
+        expected.names = lines[0];
+        expected.types = lines[1];
+        expected.rows.assign(lines.begin() + 2, lines.end());
+        return true;
+    }
+
+    const char *typeName(ArrowColumn::Type type)
+    {
+        switch (type)
+        {
+        case ArrowColumn::Type::NULL_VALUE:
+            return "null";
+        case ArrowColumn::Type::INTEGER:
+            return "int";
+        case ArrowColumn::Type::UNSIGNED:
+            return "uint";
+        case ArrowColumn::Type::FLOATING:
+            return "float";
+        case ArrowColumn::Type::BOOLEAN:
+            return "bool";
+        case ArrowColumn::Type::STRING:
+            return "string";
+        case ArrowColumn::Type::DATE:
+            return "date";
+        case ArrowColumn::Type::TIMESTAMP:
+            return "timestamp";
+        }
+        return "?";
+    }
+
+    /**
+     * @brief Compare a loaded table with the expected columns and cells
+     */
+    void checkTable(const std::shared_ptr<ArrowTable> &table, const Expected &expected, const std::string &label)
+    {
+        check(table->getColumnNames() == expected.names, label + ": column names");
+        check(table->getRowCount() == expected.rows.size(), label + ": row count");
+        if (table->getColumnNames() != expected.names || table->getRowCount() != expected.rows.size())
+        {
+            return;
+        }
+
+        for (size_t c = 0; c < expected.names.size(); ++c)
+        {
+            const ArrowColumn &column = table->getColumn(c);
+            const std::string where = label + ": column " + expected.names[c];
+            check(table->findColumn(expected.names[c]) == &column, where + " lookup");
+            check(expected.types[c] == typeName(column.getType()), where + " type");
+            check(column.size() == expected.rows.size(), where + " size");
+
+            for (size_t row = 0; row < expected.rows.size(); ++row)
+            {
+                const std::string &want = expected.rows[row][c];
+                const std::string cell = where + " row " + std::to_string(row);
+                std::string text;
+                table->formatCell(row, c, text);
+
+                if (want == "\\N")
+                {
+                    check(column.isNull(row), cell + " is null");
+                    check(text.empty(), cell + " formats as nothing");
+                    continue;
+                }
+                check(!column.isNull(row), cell + " is not null");
+
+                if (column.getType() == ArrowColumn::Type::FLOATING)
+                {
+                    // Both sides are shortest round-trip forms, which may differ in spelling ("3" and "3.0")
+                    double value = std::strtod(want.c_str(), nullptr);
+                    if (column.getName() == "f32")
+                    {
+                        value = static_cast<float>(value);
+                    }
+                    check(column.getDouble(row) == value && std::signbit(column.getDouble(row)) == std::signbit(value),
+                          cell + " value");
+                    check(std::strtod(text.c_str(), nullptr) == value, cell + " text '" + text + "'");
+                    continue;
+                }
+
+                check(text == want, cell + " text '" + text + "', expected '" + want + "'");
+                if (column.getType() == ArrowColumn::Type::STRING)
+                {
+                    check(column.getString(row) == want, cell + " string");
+                }
+                else if (column.getType() == ArrowColumn::Type::INTEGER)
+                {
+                    check(column.getInt(row) == std::strtoll(want.c_str(), nullptr, 10), cell + " integer");
+                }
+                else if (column.getType() == ArrowColumn::Type::UNSIGNED)
+                {
+                    check(column.getUnsigned(row) == std::strtoull(want.c_str(), nullptr, 10), cell + " unsigned");
+                }
+                else if (column.getType() == ArrowColumn::Type::BOOLEAN)
+                {
+                    check(column.getBool(row) == (want == "true"), cell + " boolean");
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Read every value of a table, whatever its content
+     */
+    size_t touchTable(const ArrowTable &table)
+    {
+        size_t bytes = 0;
+        std::string text;
+        for (size_t c = 0; c < table.getColumnCount(); ++c)
+        {
+            const ArrowColumn &column = table.getColumn(c);
+            for (size_t row = 0; row < table.getRowCount(); ++row)
+            {
+                text.clear();
+                table.formatCell(row, c, text);
+                bytes += text.size();
+                if (row < column.size() && !column.isNull(row) && column.getType() == ArrowColumn::Type::STRING)
+                {
+                    bytes += column.getString(row).size();
+                }
+            }
+        }
+        return bytes;
+    }
+
+    /**
+     * @brief Read truncated and corrupted copies of a fixture
+     *
+     * A damaged buffer must either be rejected with a reason or load a table whose
+     * values can all be read; the sanitizers catch reads out of the buffer.
+     */
+    void checkDamaged(const std::string &data, const std::string &label)
+    {
+        size_t rejected = 0;
+        size_t loaded = 0;
+
+        for (size_t size = 0; size < data.size(); ++size)
+        {
+            std::string error;
+            auto table = ArrowTable::fromBuffer(data.substr(0, size), &error);
+            if (table)
+            {
+                ++loaded;
+                touchTable(*table);
+            }
+            else
+            {
+                ++rejected;
+                check(!error.empty(), label + ": truncation to " + std::to_string(size) + " bytes gives a reason");
+            }
+        }
+
+        // Deterministic byte flips (linear congruential generator)
+        uint64_t state = 0x2545F4914F6CDD1DULL;
+        auto next = [&state]() {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            return static_cast<size_t>(state >> 33);
+        };
+        for (int round = 0; round < 4000; ++round)
+        {
+            std::string damaged = data;
+            int flips = 1 + static_cast<int>(next() % 4);
+            for (int i = 0; i < flips; ++i)
+            {
+                damaged[next() % damaged.size()] ^= static_cast<char>(1 + next() % 255);
+            }
+            std::string error;
+            auto table = ArrowTable::fromBuffer(std::move(damaged), &error);
+            if (table)
+            {
+                ++loaded;
+                touchTable(*table);
+            }
+            else
+            {
+                ++rejected;
+            }
+        }
+
+        std::cout << label << ": " << loaded << " damaged copies loaded, " << rejected << " rejected" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <data directory>" << std::endl;
+        return 2;
+    }
+    const std::string directory = argv[1];
+
+    Expected expected;
+    if (!readExpected(directory + "/types.tsv", expected))
+    {
+        std::cerr << "Cannot read " << directory << "/types.tsv" << std::endl;
+        return 2;
+    }
+
+    for (const char *name : {"types.arrow", "types.arrows", "legacy.arrows"})
+    {
+        const std::string path = directory + "/" + name;
+        std::string error;
+
+        auto mapped = ArrowTable::open(path, &error);
+        check(mapped != nullptr, std::string(name) + ": open (" + error + ")");
+        if (mapped)
+        {
+            checkTable(mapped, expected, std::string(name) + " (open)");
+        }
+
+        const std::string data = readFile(path);
+        auto buffered = ArrowTable::fromBuffer(data, &error);
+        check(buffered != nullptr, std::string(name) + ": fromBuffer (" + error + ")");
+        if (buffered)
+        {
+            checkTable(buffered, expected, std::string(name) + " (fromBuffer)");
+            ContentHasher first;
+            ContentHasher second;
+            check(buffered->fingerprint(first) && mapped && mapped->fingerprint(second) &&
+                      first.digest() == second.digest(),
+                  std::string(name) + ": fingerprint");
+        }
+
+        checkDamaged(data, name);
+    }
+
+    // Compressed record batches are not supported and must be reported
+    std::string error;
+    auto compressed = ArrowTable::open(directory + "/compressed.arrow", &error);
+    check(compressed == nullptr && !error.empty(), "compressed.arrow is rejected");
+
+    check(ArrowTable::open(directory + "/missing.arrow", &error) == nullptr && !error.empty(),
+          "missing file is rejected");
+    check(ArrowTable::fromBuffer(std::string(), &error) == nullptr && !error.empty(), "empty buffer is rejected");
+
+    // Rows of a table filled from Arrow data
+    auto table = ArrowTable::open(directory + "/types.arrow");
+    if (table)
+    {
+        Table latex(table->getColumnNames());
+        latex.setDataSource(table);
+        latex.setEscapeCells(true);
+        const std::string source = latex.generate();
+        check(source.find("& 1969-12-31 & 1969-12-31 &") != std::string::npos, "table row from Arrow data");
+    }
+
+    if (failures)
+    {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
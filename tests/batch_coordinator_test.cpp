@@ -0,0 +1,344 @@
+/**
+ * @file batch_coordinator_test.cpp
+ * @brief Checks BatchCoordinator retries and requeues with local forked workers.
+ *
+ * Usage: batch_coordinator_test <engine>
+ *
+ * Workers are forked with forkLocalWorkers() and compile with
+ * tests/engine/slow-tex in the first batch. The batches cover documents that fail
+ * for good, specs leaving the output directory, a document failing once, a worker
+ * exiting in the middle of a shard, a worker exceeding the shard timeout and a
+ * worker answering for another shard. Failures injected once across processes
+ * use marker files created with O_EXCL.
+ */
+
+#include "latexbatch.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+using namespace LatexGen;
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const std::string &what)
+    {
+        if (!condition)
+        {
+            ++failures;
+            std::cerr << "FAILED: " << what << std::endl;
+        }
+    }
+
+    std::string makeDirectory()
+    {
+        std::error_code error;
+        std::string pattern = (std::filesystem::temp_directory_path(error) / "batch-coordinator-test-XXXXXX").string();
+        return mkdtemp(&pattern[0]) ? pattern : std::string();
+    }
+
+    void writeText(const std::filesystem::path &path, const std::string &text)
+    {
+        std::filesystem::create_directories(path.parent_path());
+        std::ofstream(path, std::ios::binary) << text;
+    }
+
+    /**
+     * @brief Create a marker file, true only for the first caller of all processes
+     */
+    bool firstTime(const std::string &marker)
+    {
+        const int fd = ::open(marker.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0600);
+        if (fd < 0)
+        {
+            return false;
+        }
+        ::close(fd);
+        return true;
+    }
+
+    DocumentSpec makeSpec(const std::string &name, const std::string &templateName = "letter.tex",
+                          const std::string &bibliography = "")
+    {
+        DocumentSpec spec;
+        spec.name = name;
+        spec.templateName = templateName;
+        spec.bibliography = bibliography;
+        spec.fields = {{"title", "Letter " + name}, {"customer", "ACME & Co"}, {"citations", "knuth"}};
+        return spec;
+    }
+
+    const DocumentOutcome *findOutcome(const BatchCoordinator &coordinator, const std::string &name)
+    {
+        for (const auto &outcome : coordinator.getResults())
+        {
+            if (outcome.name == name)
+            {
+                return &outcome;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Worker process body: renders the shards with an optional fault per document
+     */
+    int runWorker(int port, const std::string &root, const std::string &engine,
+                  const std::function<void(const DocumentSpec &spec)> &fault)
+    {
+        BatchWorker::Options options;
+        options.templateDirectory = root + "/templates";
+        options.bibliographyDirectory = root + "/bib";
+        options.outputDirectory = root + "/output";
+        BatchWorker worker(options);
+        if (!engine.empty())
+        {
+            CompileOptions compileOptions;
+            compileOptions.engine = engine;
+            compileOptions.bibtex.clear();
+            worker.setCompiler(std::make_shared<Compiler>(compileOptions));
+        }
+        worker.setFactory([&fault](const DocumentSpec &spec, BatchWorker &self, std::string &error)
+                          {
+                              if (fault)
+                              {
+                                  fault(spec);
+                              }
+                              if (spec.fields.count("fail") && firstTime(spec.fields.at("fail")))
+                              {
+                                  error = "injected failure";
+                                  return std::shared_ptr<Document>();
+                              }
+                              return self.createDocument(spec, error);
+                          });
+        return worker.serve("127.0.0.1", port);
+    }
+
+    void checkCompiledBatch(const std::string &root, const std::string &engine)
+    {
+        std::vector<DocumentSpec> specs;
+        for (int i = 0; i < 5; ++i)
+        {
+            specs.push_back(makeSpec("compiled/doc" + std::to_string(i), "letter.tex", i % 2 ? "refs" : ""));
+        }
+        specs.push_back(makeSpec("compiled/missing", "missing.tex"));
+        specs.push_back(makeSpec("../escape"));
+        specs.push_back(makeSpec("compiled/flaky"));
+        specs.back().fields["fail"] = root + "/markers/flaky";
+
+        BatchCoordinator::Options options;
+        options.shardSize = 2;
+        options.maxAttempts = 2;
+        BatchCoordinator coordinator(specs, options);
+        const int port = coordinator.listen();
+        check(port > 0, "listen on a free port");
+        check(coordinator.forkLocalWorkers(2, [&](int workerPort)
+                                           { return runWorker(workerPort, root, engine, nullptr); }),
+              "fork two workers");
+        check(!coordinator.run(), "batch with failures reports them");
+
+        for (int i = 0; i < 5; ++i)
+        {
+            const DocumentOutcome *outcome = findOutcome(coordinator, "compiled/doc" + std::to_string(i));
+            check(outcome && outcome->success && outcome->attempts == 1, "document " + std::to_string(i) + " compiled");
+            check(outcome && std::filesystem::exists(outcome->output) && outcome->bytes > 0,
+                  "PDF of document " + std::to_string(i) + " written");
+        }
+
+        const DocumentOutcome *missing = findOutcome(coordinator, "compiled/missing");
+        check(missing && !missing->success && missing->attempts == 2, "missing template retried up to the limit");
+        check(missing && missing->message.find("missing.tex") != std::string::npos, "missing template reported");
+
+        const DocumentOutcome *escape = findOutcome(coordinator, "../escape");
+        check(escape && !escape->success && escape->message.find("invalid name") != std::string::npos,
+              "name leaving the output directory rejected by the worker");
+        check(!std::filesystem::exists(root + "/escape.pdf") && !std::filesystem::exists(root + "/escape.tex"),
+              "nothing written outside the output directory");
+
+        const DocumentOutcome *flaky = findOutcome(coordinator, "compiled/flaky");
+        check(flaky && flaky->success && flaky->attempts == 2, "document failing once succeeds on retry");
+
+        const BatchCoordinator::Stats stats = coordinator.getStats();
+        check(stats.shards == 4 && stats.documents == 8, "shards of the manifest");
+        check(stats.succeeded == 6 && stats.failed == 2, "outcomes counted");
+        check(stats.retries >= 1 && stats.dispatches == stats.shards + stats.retries, "retries counted");
+        check(stats.workers == 2 && stats.workersLost == 0, "workers counted");
+        check(stats.work.documents >= 8 && stats.work.templateHits > 0, "worker statistics gathered");
+    }
+
+    void checkLostWorkers(const std::string &root)
+    {
+        std::vector<DocumentSpec> specs;
+        for (int i = 0; i < 4; ++i)
+        {
+            specs.push_back(makeSpec("lost/doc" + std::to_string(i)));
+        }
+        specs.push_back(makeSpec("lost/crash"));
+        specs.push_back(makeSpec("lost/hang"));
+
+        // One worker exits in the middle of a shard, another stops answering
+        auto fault = [&root](const DocumentSpec &spec)
+        {
+            if (spec.name == "lost/crash" && firstTime(root + "/markers/crash"))
+            {
+                _exit(3);
+            }
+            if (spec.name == "lost/hang" && firstTime(root + "/markers/hang"))
+            {
+                std::this_thread::sleep_for(std::chrono::seconds(2));
+            }
+        };
+
+        BatchCoordinator::Options options;
+        options.shardSize = 1;
+        options.shardTimeout = 0.5;
+        BatchCoordinator coordinator(specs, options);
+        check(coordinator.listen() > 0, "listen for lost workers");
+        check(coordinator.forkLocalWorkers(3, [&](int port) { return runWorker(port, root, "", fault); }),
+              "fork three workers");
+        check(coordinator.run(), "every document rendered despite lost workers");
+
+        for (const char *name : {"lost/crash", "lost/hang"})
+        {
+            const DocumentOutcome *outcome = findOutcome(coordinator, name);
+            check(outcome && outcome->success && outcome->attempts == 2, std::string(name) + " requeued once");
+            check(outcome && std::filesystem::exists(outcome->output), std::string(name) + " written");
+        }
+
+        const BatchCoordinator::Stats stats = coordinator.getStats();
+        check(stats.workersLost == 2 && stats.retries == 2, "lost workers counted");
+        check(stats.succeeded == specs.size() && stats.failed == 0, "lost worker outcomes");
+    }
+
+    /**
+     * @brief Fake worker answering the first shard it gets with another shard id
+     */
+    int runMismatchedWorker(int port)
+    {
+        const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            return 1;
+        }
+
+        const std::string hello = "HELO 4\nfake";
+        ::send(fd, hello.data(), hello.size(), 0);
+        std::string received;
+        char buffer[4096];
+        ssize_t count;
+        while (received.find("SHRD") == std::string::npos && (count = ::recv(fd, buffer, sizeof(buffer), 0)) > 0)
+        {
+            received.append(buffer, static_cast<size_t>(count));
+        }
+        const std::string reply = "999\n\n";
+        const std::string done = "DONE " + std::to_string(reply.size()) + "\n" + reply;
+        ::send(fd, done.data(), done.size(), 0);
+
+        // The coordinator closes the connection
+        while (::recv(fd, buffer, sizeof(buffer), 0) > 0)
+        {
+        }
+        ::close(fd);
+        return 0;
+    }
+
+    void checkMismatchedReply(const std::string &root)
+    {
+        check(BatchCoordinator::Options().shardTimeout > 0, "shard timeout limited by default");
+
+        std::vector<DocumentSpec> specs;
+        for (int i = 0; i < 3; ++i)
+        {
+            specs.push_back(makeSpec("mismatch/doc" + std::to_string(i)));
+        }
+
+        BatchCoordinator::Options options;
+        options.shardSize = 1;
+        BatchCoordinator coordinator(specs, options);
+        check(coordinator.listen() > 0, "listen for a mismatched reply");
+        check(coordinator.forkLocalWorkers(1, runMismatchedWorker), "fork the fake worker");
+        // The real worker connects later, so the fake one gets a shard
+        check(coordinator.forkLocalWorkers(1, [&](int port)
+                                           {
+                                               std::this_thread::sleep_for(std::chrono::milliseconds(300));
+                                               return runWorker(port, root, "", nullptr);
+                                           }),
+              "fork a real worker");
+        check(coordinator.run(), "every document rendered despite a mismatched reply");
+
+        const BatchCoordinator::Stats stats = coordinator.getStats();
+        check(stats.workersLost == 1 && stats.retries == 1, "mismatched reply closes and requeues");
+        check(stats.succeeded == specs.size(), "mismatched reply outcomes");
+    }
+
+    void checkManifest(const std::string &root)
+    {
+        std::vector<DocumentSpec> specs;
+        std::string error;
+        writeText(root + "/good.tsv", "name\ttemplate\tbibliography\ttitle\nacct/1\tletter.tex\trefs\tQ4\n");
+        check(readManifest(root + "/good.tsv", specs, &error) && specs.size() == 1 && specs[0].fields["title"] == "Q4",
+              "manifest read (" + error + ")");
+
+        for (const char *name : {"/tmp/absolute", "acct/../../outside", ".."})
+        {
+            writeText(root + "/bad.tsv", std::string("name\ttemplate\nacct/1\tletter.tex\n") + name + "\tletter.tex\n");
+            error.clear();
+            check(!readManifest(root + "/bad.tsv", specs, &error) && error.find(":3:") != std::string::npos,
+                  std::string("manifest name ") + name + " rejected (" + error + ")");
+        }
+        writeText(root + "/bad.tsv", "name\ttemplate\nacct/1\t../letter.tex\n");
+        check(!readManifest(root + "/bad.tsv", specs, &error), "manifest template outside rejected");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <engine>" << std::endl;
+        return 2;
+    }
+
+    const std::string root = makeDirectory();
+    if (root.empty())
+    {
+        std::cerr << "Cannot create a temporary directory" << std::endl;
+        return 2;
+    }
+    writeText(root + "/templates/letter.tex", "Dear {{customer}},\n\nYour statement is attached.\n");
+    writeText(root + "/bib/refs.bib", "@book{knuth,\n  author = {Donald Knuth},\n  title = {The TeXbook},\n"
+                                      "  year = {1984}\n}\n");
+    std::filesystem::create_directories(root + "/markers");
+
+    // The engine runs in the working directory
+    checkCompiledBatch(root, std::filesystem::absolute(argv[1]).string());
+    checkLostWorkers(root);
+    checkMismatchedReply(root);
+    checkManifest(root);
+
+    std::error_code error;
+    std::filesystem::remove_all(root, error);
+
+    if (failures)
+    {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
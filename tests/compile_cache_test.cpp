@@ -0,0 +1,179 @@
+/**
+ * @file compile_cache_test.cpp
+ * @brief Checks CompileCache eviction, lookups of removed files and restarts.
+ *
+ * Usage: compile_cache_test <engine>
+ *
+ * The cache is first used on its own, in a temporary directory: least recently
+ * used PDFs are evicted over the size limit, a PDF deleted behind the cache is a
+ * miss, and a cache opened on an existing directory finds the PDFs and their use
+ * order. Compiler is then run with tests/engine/slow-tex to check that a cached
+ * compile does not run the engine, also after a restart.
+ */
+
+#include "latexcompile.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+using namespace LatexGen;
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const std::string &what)
+    {
+        if (!condition)
+        {
+            ++failures;
+            std::cerr << "FAILED: " << what << std::endl;
+        }
+    }
+
+    std::string makeDirectory()
+    {
+        std::error_code error;
+        std::string pattern = (std::filesystem::temp_directory_path(error) / "compile-cache-test-XXXXXX").string();
+        return mkdtemp(&pattern[0]) ? pattern : std::string();
+    }
+
+    std::string pdfPath(const std::string &directory, uint64_t key)
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string name(16, '0');
+        for (int i = 15; i >= 0; --i, key >>= 4)
+        {
+            name[i] = digits[key & 15];
+        }
+        return directory + "/" + name + ".pdf";
+    }
+
+    void checkEviction(const std::string &directory)
+    {
+        const std::string pdf(100, 'x');
+        CompileCache cache(directory, 250);
+        check(cache.store(1, pdf) && cache.store(2, pdf), "store two PDFs");
+        check(cache.size() == 2 && cache.getStoredBytes() == 200, "two PDFs stored");
+
+        // Key 1 is used again, so key 2 is the least recently used one
+        std::string found;
+        check(cache.lookup(1, found) && found == pdf, "lookup of key 1");
+        check(cache.store(3, pdf), "store a third PDF");
+        check(cache.size() == 2 && cache.getStoredBytes() == 200, "size limit kept");
+        check(!cache.lookup(2, found) && !std::filesystem::exists(pdfPath(directory, 2)), "key 2 evicted");
+        check(cache.lookup(1, found) && cache.lookup(3, found), "keys 1 and 3 kept");
+
+        const CompileCache::Stats stats = cache.getStats();
+        check(stats.evictions == 1 && stats.stores == 3, "eviction counted");
+        check(stats.hits == 3 && stats.misses == 1 && stats.bytesServed == 300, "hits and misses counted");
+    }
+
+    void checkRemovedFile(const std::string &directory)
+    {
+        CompileCache cache(directory);
+        check(cache.store(7, "%PDF-1.4 seven"), "store a PDF");
+
+        // Deleted by another process sharing the directory
+        std::filesystem::remove(pdfPath(directory, 7));
+        std::string found = "previous";
+        check(!cache.lookup(7, found) && found.empty(), "removed PDF is a miss");
+        check(cache.size() == 0 && cache.getStoredBytes() == 0, "removed PDF forgotten");
+        check(cache.store(7, "%PDF-1.4 again") && cache.lookup(7, found) && found == "%PDF-1.4 again",
+              "PDF stored again");
+    }
+
+    void checkRestart(const std::string &directory)
+    {
+        const std::string pdf(100, 'y');
+        {
+            CompileCache cache(directory);
+            check(cache.store(10, pdf) && cache.store(11, pdf) && cache.store(12, pdf), "store three PDFs");
+        }
+
+        // The use order comes from the modification times: key 11 is the oldest
+        const auto now = std::filesystem::file_time_type::clock::now();
+        std::filesystem::last_write_time(pdfPath(directory, 10), now - std::chrono::hours(1));
+        std::filesystem::last_write_time(pdfPath(directory, 11), now - std::chrono::hours(2));
+        std::filesystem::last_write_time(pdfPath(directory, 12), now - std::chrono::minutes(1));
+        std::ofstream(directory + "/notes.txt") << "not a cached PDF";
+
+        CompileCache cache(directory, 300);
+        check(cache.size() == 3 && cache.getStoredBytes() == 300, "PDFs found after a restart");
+        std::string found;
+        check(cache.lookup(12, found) && found == pdf, "lookup after a restart");
+
+        check(cache.store(13, pdf), "store after a restart");
+        check(!std::filesystem::exists(pdfPath(directory, 11)), "oldest PDF evicted after a restart");
+        check(std::filesystem::exists(pdfPath(directory, 10)), "newer PDF kept after a restart");
+        check(std::filesystem::exists(directory + "/notes.txt"), "other files left alone");
+    }
+
+    void checkCompiler(const std::string &directory, const std::string &engine)
+    {
+        CompileOptions options;
+        options.engine = engine;
+        options.bibtex.clear();
+
+        Article article("Cached", "Test");
+        article.addSection(Section("Content"));
+
+        CompileResult first;
+        {
+            Compiler compiler(options);
+            compiler.setCache(std::make_shared<CompileCache>(directory));
+            first = compiler.compile(article);
+            check(first.success && !first.cached, "first compile runs the engine (" + first.log + ")");
+            const CompileResult second = compiler.compile(article);
+            check(second.success && second.cached && second.pdf == first.pdf, "second compile is cached");
+            check(compiler.getCache()->getStats().hits == 1, "cache hit counted");
+        }
+
+        // A new compiler and cache on the same directory, as in a later run
+        Compiler compiler(options);
+        compiler.setCache(std::make_shared<CompileCache>(directory));
+        const CompileResult restarted = compiler.compile(article);
+        check(restarted.success && restarted.cached && restarted.pdf == first.pdf, "compile cached after a restart");
+
+        std::filesystem::remove(pdfPath(directory, restarted.key));
+        const CompileResult removed = compiler.compile(article);
+        check(removed.success && !removed.cached && removed.pdf == first.pdf, "removed PDF is compiled again");
+        check(std::filesystem::exists(pdfPath(directory, removed.key)), "compiled PDF stored again");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <engine>" << std::endl;
+        return 2;
+    }
+
+    const std::string root = makeDirectory();
+    if (root.empty())
+    {
+        std::cerr << "Cannot create a temporary directory" << std::endl;
+        return 2;
+    }
+
+    checkEviction(root + "/eviction");
+    checkRemovedFile(root + "/removed");
+    checkRestart(root + "/restart");
+    // The engine runs in the working directory
+    checkCompiler(root + "/compiler", std::filesystem::absolute(argv[1]).string());
+
+    std::error_code error;
+    std::filesystem::remove_all(root, error);
+
+    if (failures)
+    {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file compile_streaming_benchmark.cpp
+ * @brief Compares the latency of Compiler::compile() and Compiler::compileStreaming().
+ *
+ * Usage: compile_streaming_benchmark <engine> [rounds]
+ *
+ * tests/engine/slow-tex stands in for the engine: 150 ms of startup and 40 ms
+ * per package, reading the source as it arrives. The document is a report with
+ * 200 sections and a body environment that takes 300 ms to build, like content
+ * queried while rendering. Both modes must produce the same output; the average
+ * time of each is printed.
+ */
+
+#include "latexcompile.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+using namespace LatexGen;
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <engine> [rounds]" << std::endl;
+        return 2;
+    }
+    const int rounds = argc > 2 ? std::max(1, std::atoi(argv[2])) : 5;
+
+    CompileOptions options;
+    // The engine runs in the working directory
+    options.engine = std::filesystem::absolute(argv[1]).string();
+    Compiler compiler(options);
+
+    Report report("Quarterly Report", "Benchmark");
+    for (int i = 0; i < 200; ++i)
+    {
+        Section section("Section " + std::to_string(i));
+        for (int k = 0; k < 40; ++k)
+        {
+            section.addContent("Paragraph " + std::to_string(k) + " with some text.\n");
+        }
+        report.addSection(section);
+    }
+    auto queriedContent = []()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        return std::make_shared<Equation>(false);
+    };
+    report.addLazyEnvironment(queriedContent, false);
+
+    double plain = 0;
+    double streamed = 0;
+    double generation = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        const CompileResult first = compiler.compile(report);
+        const CompileResult second = compiler.compileStreaming(report);
+        if (!first.success || !second.success)
+        {
+            std::cerr << "Compile failed:\n" << first.log << second.log << std::endl;
+            return 1;
+        }
+        if (first.pdf != second.pdf)
+        {
+            std::cerr << "Streaming produced a different output" << std::endl;
+            return 1;
+        }
+        plain += first.seconds;
+        streamed += second.seconds;
+        generation += first.generationSeconds;
+    }
+
+    std::cout << "generation " << generation / rounds << " s, compile " << plain / rounds
+              << " s, compileStreaming " << streamed / rounds << " s" << std::endl;
+    return 0;
+}
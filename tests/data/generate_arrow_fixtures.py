@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""Write the Arrow IPC fixtures of arrow_reader_test with pyarrow.
+
+The fixtures are committed; run this script again (pyarrow required) only to
+change them:
+
+    python3 tests/data/generate_arrow_fixtures.py tests/data
+
+types.tsv lists the columns the reader exposes, their type and the expected
+text of every cell (\\N for a missing value); floating point values are
+written with repr() and compared as numbers.
+"""
+
+import datetime
+import decimal
+import os
+import sys
+
+import pyarrow as pa
+import pyarrow.ipc as ipc
+
+
+def build_batches():
+    utc = datetime.timezone.utc
+    epoch = datetime.datetime(1970, 1, 1)
+    rows = [
+        # i8, i32, i64, u8, u64, f32, f64, bool, utf8, large_utf8, date, ts
+        (-128, -2147483648, -9223372036854775808, 0, 0, 1.5, 0.1, True, "alpha", "", datetime.date(1969, 12, 31),
+         datetime.datetime(1969, 12, 31, 23, 59, 59, 500000)),
+        (127, 2147483647, 9223372036854775807, 255, 18446744073709551615, -2.25, -1e300, False, "bêta", "long",
+         datetime.date(2000, 2, 29), datetime.datetime(2000, 2, 29, 12, 0, 0)),
+        (None, 0, None, 7, None, None, 3.0, None, None, None, None, None),
+        (1, -1, 42, 1, 1, 0.0, -0.0, True, "tab\\free", "x" * 300, datetime.date(1900, 1, 1),
+         datetime.datetime(1900, 1, 1, 0, 0, 0, 1)),
+        (0, 5, -5, 200, 12345678901234567890, 3.5, 2.5e-310, False, "日本", "z", datetime.date(2262, 4, 11),
+         datetime.datetime(2262, 4, 11, 23, 47, 16)),
+    ]
+
+    def column(index):
+        return [row[index] for row in rows]
+
+    dates = column(10)
+    stamps = column(11)
+    date64 = [None if d is None else (datetime.datetime(d.year, d.month, d.day) - epoch) // datetime.timedelta(milliseconds=1)
+              for d in dates]
+
+    arrays = {
+        "i8": pa.array(column(0), pa.int8()),
+        "i32": pa.array(column(1), pa.int32()),
+        "i64": pa.array(column(2), pa.int64()),
+        "u8": pa.array(column(3), pa.uint8()),
+        "u64": pa.array(column(4), pa.uint64()),
+        "f32": pa.array(column(5), pa.float32()),
+        "f64": pa.array(column(6), pa.float64()),
+        "flag": pa.array(column(7), pa.bool_()),
+        "name": pa.array(column(8), pa.utf8()),
+        "note": pa.array(column(9), pa.large_utf8()),
+        "day": pa.array(dates, pa.date32()),
+        "day64": pa.array(date64, pa.date64()),
+        "ts_s": pa.array([None if s is None else s.replace(microsecond=0) for s in stamps], pa.timestamp("s")),
+        "ts_ms": pa.array([None if s is None else s.replace(microsecond=s.microsecond // 1000 * 1000) for s in stamps],
+                          pa.timestamp("ms")),
+        "ts_us": pa.array([None if s is None else s.replace(tzinfo=utc) for s in stamps], pa.timestamp("us", tz="UTC")),
+        "ts_ns": pa.array(stamps, pa.timestamp("ns")),
+        "nothing": pa.nulls(len(rows)),
+        # Columns the reader leaves out
+        "list": pa.array([[1, 2], None, [], [3], [4, 5, 6]], pa.list_(pa.int32())),
+        "category": pa.array(["a", "b", "a", None, "c"]).dictionary_encode(),
+        "amount": pa.array([decimal.Decimal("1.25"), None, decimal.Decimal("-3.50"), decimal.Decimal("0"),
+                            decimal.Decimal("99.99")], pa.decimal128(10, 2)),
+    }
+    table = pa.table(arrays)
+    # Two record batches, so values are read from several chunks
+    return table, table.to_batches(max_chunksize=3)
+
+
+def format_cell(value, arrow_type):
+    if value is None:
+        return "\\N"
+    if pa.types.is_floating(arrow_type):
+        return repr(float(value))
+    if pa.types.is_boolean(arrow_type):
+        return "true" if value else "false"
+    if pa.types.is_date(arrow_type):
+        return value.isoformat()
+    if pa.types.is_timestamp(arrow_type):
+        text = value.strftime("%Y-%m-%d %H:%M:%S")
+        return text
+    return str(value)
+
+
+def format_timestamp(array, row):
+    # Exact fraction from the stored integer (datetime only has microseconds)
+    unit = array.type.unit
+    per_second = {"s": 1, "ms": 1000, "us": 1000000, "ns": 1000000000}[unit]
+    digits = {"s": 0, "ms": 3, "us": 6, "ns": 9}[unit]
+    raw = array.cast(pa.int64())[row].as_py()
+    if raw is None:
+        return "\\N"
+    seconds, fraction = divmod(raw, per_second)
+    text = (datetime.datetime(1970, 1, 1) + datetime.timedelta(seconds=seconds)).strftime("%Y-%m-%d %H:%M:%S")
+    if fraction:
+        text += "." + str(fraction).rjust(digits, "0")
+    return text
+
+
+def type_name(arrow_type):
+    if pa.types.is_null(arrow_type):
+        return "null"
+    if pa.types.is_signed_integer(arrow_type):
+        return "int"
+    if pa.types.is_unsigned_integer(arrow_type):
+        return "uint"
+    if pa.types.is_floating(arrow_type):
+        return "float"
+    if pa.types.is_boolean(arrow_type):
+        return "bool"
+    if pa.types.is_string(arrow_type) or pa.types.is_large_string(arrow_type):
+        return "string"
+    if pa.types.is_date(arrow_type):
+        return "date"
+    if pa.types.is_timestamp(arrow_type):
+        return "timestamp"
+    return None
+
+
+def write_expected(table, path):
+    columns = [name for name in table.column_names if type_name(table.schema.field(name).type)]
+    lines = ["\t".join(columns), "\t".join(type_name(table.schema.field(name).type) for name in columns)]
+    for row in range(table.num_rows):
+        cells = []
+        for name in columns:
+            array = table.column(name).combine_chunks()
+            if pa.types.is_timestamp(array.type):
+                cells.append(format_timestamp(array, row))
+            else:
+                cells.append(format_cell(array[row].as_py(), array.type))
+        lines.append("\t".join(cells))
+    with open(path, "w", encoding="utf-8", newline="\n") as out:
+        out.write("\n".join(lines) + "\n")
+
+
+def main():
+    directory = sys.argv[1] if len(sys.argv) > 1 else os.path.dirname(os.path.abspath(__file__))
+    table, batches = build_batches()
+
+    with ipc.new_file(os.path.join(directory, "types.arrow"), table.schema) as writer:
+        for batch in batches:
+            writer.write_batch(batch)
+    with ipc.new_stream(os.path.join(directory, "types.arrows"), table.schema) as writer:
+        for batch in batches:
+            writer.write_batch(batch)
+
+    legacy = ipc.IpcWriteOptions(use_legacy_format=True)
+    with ipc.new_stream(os.path.join(directory, "legacy.arrows"), table.schema, options=legacy) as writer:
+        for batch in batches:
+            writer.write_batch(batch)
+
+    compressed = ipc.IpcWriteOptions(compression="lz4")
+    with ipc.new_file(os.path.join(directory, "compressed.arrow"), table.schema, options=compressed) as writer:
+        for batch in batches:
+            writer.write_batch(batch)
+
+    write_expected(table, os.path.join(directory, "types.tsv"))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,206 @@
+/**
+ * @file workspace_pool_test.cpp
+ * @brief Checks WorkspacePool recycling, input reuse and pruning.
+ *
+ * Usage: workspace_pool_test <engine>
+ *
+ * A pool is first used on its own: a released workspace keeps its inputs and
+ * loses the files written by the job, the next job gets it back and reuses the
+ * unchanged inputs, and prune() deletes the inputs it did not stage. Compiler is
+ * then run with tests/engine/slow-tex on documents with and without a figure, to
+ * check the workspaces it leaves behind.
+ */
+
+#include "latexcompile.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+using namespace LatexGen;
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const std::string &what)
+    {
+        if (!condition)
+        {
+            ++failures;
+            std::cerr << "FAILED: " << what << std::endl;
+        }
+    }
+
+    std::string makeDirectory()
+    {
+        std::error_code error;
+        std::string pattern = (std::filesystem::temp_directory_path(error) / "workspace-pool-test-XXXXXX").string();
+        return mkdtemp(&pattern[0]) ? pattern : std::string();
+    }
+
+    void writeText(const std::filesystem::path &path, const std::string &text)
+    {
+        std::filesystem::create_directories(path.parent_path());
+        std::ofstream(path, std::ios::binary) << text;
+    }
+
+    std::string readText(const std::filesystem::path &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    bool fileExists(const std::filesystem::path &path)
+    {
+        std::error_code error;
+        return std::filesystem::exists(path, error);
+    }
+
+    void checkRecycling(const std::string &root, const std::string &inputs)
+    {
+        writeText(inputs + "/logo.png", "logo");
+        writeText(inputs + "/figures/plot.png", "plot");
+
+        WorkspacePool pool(root, 1);
+        check(pool.getRoot().compare(0, root.size(), root) == 0, "pool created under its root");
+
+        // First job: two inputs and two files of its own
+        const std::string first = pool.acquire();
+        check(!first.empty(), "acquire a workspace");
+        check(pool.stage(first, inputs + "/logo.png", "logo.png"), "stage an input");
+        check(pool.stage(first, inputs + "/figures/plot.png", "figures/plot.png"), "stage a nested input");
+        check(readText(first + "/figures/plot.png") == "plot", "staged input readable");
+        check(!pool.stage(first, inputs + "/missing.png", "missing.png"), "missing input rejected");
+        writeText(first + "/document.aux", "aux");
+        writeText(first + "/out/document.log", "log");
+        pool.release(first);
+
+        check(fileExists(first + "/logo.png") && fileExists(first + "/figures/plot.png"), "inputs kept on release");
+        check(!fileExists(first + "/document.aux") && !fileExists(first + "/out"), "job files deleted on release");
+
+        // Second job: same workspace, one input unchanged, the other not used
+        const std::string second = pool.acquire();
+        check(second == first, "released workspace recycled");
+        check(pool.stage(second, inputs + "/logo.png", "logo.png"), "stage the input again");
+        pool.prune(second);
+        check(fileExists(second + "/logo.png"), "staged input kept by prune");
+        check(!fileExists(second + "/figures/plot.png"), "unused input deleted by prune");
+        pool.release(second);
+        check(!fileExists(second + "/figures"), "emptied input directory deleted on release");
+
+        // Third job: the input changed since it was staged
+        writeText(inputs + "/logo.png", "new logo");
+        const std::string third = pool.acquire();
+        check(pool.stage(third, inputs + "/logo.png", "logo.png"), "stage a changed input");
+        check(readText(third + "/logo.png") == "new logo", "changed input staged again");
+
+        // Over maxIdle, a released workspace is deleted
+        const std::string fourth = pool.acquire();
+        check(!fourth.empty() && fourth != third, "a busy workspace is not handed out twice");
+        pool.release(third);
+        pool.release(fourth);
+        check(fileExists(third) && !fileExists(fourth), "workspaces over maxIdle deleted");
+
+        const WorkspacePool::Stats stats = pool.getStats();
+        check(stats.acquired == 4 && stats.created == 2 && stats.recycled == 2, "acquisitions counted");
+        check(stats.linkedInputs + stats.copiedInputs == 3, "inputs staged counted");
+        check(stats.reusedInputs == 1 && stats.bytesReused == 4, "reused input counted");
+        check(stats.scratchFiles == 2 && stats.scratchBytes == 6, "job files counted");
+
+        const std::string poolRoot = pool.getRoot();
+        {
+            WorkspacePool temporary(root);
+            check(!temporary.acquire().empty(), "second pool on the same root");
+        }
+        check(fileExists(poolRoot), "other pools left alone");
+    }
+
+    std::vector<std::filesystem::path> listWorkspaces(const WorkspacePool &pool)
+    {
+        std::vector<std::filesystem::path> workspaces;
+        for (const auto &entry : std::filesystem::directory_iterator(pool.getRoot()))
+        {
+            workspaces.push_back(entry.path());
+        }
+        return workspaces;
+    }
+
+    void checkCompiler(const std::string &root, const std::string &inputs, const std::string &engine)
+    {
+        writeText(inputs + "/chart.png", "chart");
+
+        CompileOptions options;
+        options.engine = engine;
+        options.bibtex.clear();
+        options.inputDirectory = inputs;
+        Compiler compiler(options);
+        auto pool = std::make_shared<WorkspacePool>(root);
+        compiler.setWorkspacePool(pool);
+
+        Article withFigure("Figures", "Test");
+        withFigure.addEnvironment(std::make_shared<Figure>("chart.png"));
+        Article withoutFigure("Text", "Test");
+        withoutFigure.addSection(Section("Content"));
+
+        CompileResult result = compiler.compile(withFigure);
+        check(result.success, "compile with a figure (" + result.log + ")");
+        std::vector<std::filesystem::path> workspaces = listWorkspaces(*pool);
+        check(workspaces.size() == 1, "one workspace kept");
+        if (workspaces.size() != 1)
+        {
+            return;
+        }
+        const std::filesystem::path workspace = workspaces[0];
+        check(readText(workspace / "chart.png") == "chart", "figure staged");
+        check(!fileExists(workspace / "document.tex") && !fileExists(workspace / "document.pdf"), "job files deleted");
+
+        result = compiler.compile(withFigure);
+        check(result.success, "compile again with a figure");
+        WorkspacePool::Stats stats = pool->getStats();
+        check(stats.recycled == 1 && stats.reusedInputs == 1, "workspace and figure reused");
+
+        result = compiler.compile(withoutFigure);
+        check(result.success, "compile without a figure");
+        check(listWorkspaces(*pool) == workspaces, "same workspace used");
+        check(!fileExists(workspace / "chart.png"), "figure of the previous job pruned");
+
+        stats = pool->getStats();
+        check(stats.acquired == 3 && stats.created == 1 && stats.recycled == 2, "compiles share one workspace");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <engine>" << std::endl;
+        return 2;
+    }
+
+    const std::string root = makeDirectory();
+    if (root.empty())
+    {
+        std::cerr << "Cannot create a temporary directory" << std::endl;
+        return 2;
+    }
+
+    std::filesystem::create_directories(root + "/pool");
+    checkRecycling(root + "/pool", root + "/inputs");
+    std::filesystem::create_directories(root + "/compiler");
+    // The engine runs in the working directory
+    checkCompiler(root + "/compiler", root + "/compiler-inputs", std::filesystem::absolute(argv[1]).string());
+
+    std::error_code error;
+    std::filesystem::remove_all(root, error);
+
+    if (failures)
+    {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}